@@ -33,8 +33,9 @@ FT_NAMESPACE_BEGIN
 /** default constructor */
 fm_args::fm_args()
 	: program_name("fsmove"),
-      io_args(), exclude_list(NULL), inode_cache_path(NULL),
-      io_kind(FC_IO_AUTODETECT), ui_kind(FC_UI_NONE),
+      io_args(), exclude_list(NULL), inode_cache_path(NULL), inode_cache_compact(false),
+      max_bytes_per_sec(0), max_iops(0), trace_path(NULL), jobs(1),
+      order(FC_ORDER_READDIR), io_kind(FC_IO_AUTODETECT), ui_kind(FC_UI_NONE),
       force_run(false), simulate_run(false)
 { }
 
@@ -26,13 +26,14 @@
 #ifndef FSMOVE_ARGS_HH
 #define FSMOVE_ARGS_HH
 
-#include "types.hh"     // for ft_uint, ft_size
+#include "types.hh"     // for ft_uint, ft_size, ft_uoff, ft_ull
 #include "io/io.hh"     // for FC_ARGS_COUNT
 
 FT_NAMESPACE_BEGIN
 
 enum fm_io_kind { FC_IO_AUTODETECT, FC_IO_POSIX, FC_IO_PREALLOC };
 enum fm_ui_kind { FC_UI_NONE };
+enum fm_order_kind { FC_ORDER_READDIR, FC_ORDER_INODE, FC_ORDER_EXTENT };
 
 class fm_args
 {
@@ -41,6 +42,12 @@ public:
     const char * io_args[FT_IO_NS fm_io::FC_ARGS_COUNT];
     char const * const * exclude_list; // NULL-terminated array of files _not_ to move
     const char * inode_cache_path;
+    bool inode_cache_compact;        // if true and inode_cache_path is NULL, use compact in-memory inode cache
+    ft_uoff max_bytes_per_sec;       // max bytes per second to read or write. if 0, unlimited
+    ft_ull max_iops;                 // max read() and write() per second. if 0, unlimited
+    const char * trace_path;         // record reads and writes into this binary trace. if NULL, do not trace
+    ft_size jobs;                    // number of threads moving files in parallel. default: 1
+    fm_order_kind order;     // order to move the entries of each directory. default: FC_ORDER_READDIR
     fm_io_kind io_kind;      // if FC_IO_AUTODETECT, will autodetect
     fm_ui_kind ui_kind;      // default is FC_UI_NONE
     bool force_run;          // if true, some sanity checks will be WARNINGS instead of ERRORS
@@ -0,0 +1,171 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * cache_rope.hh
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#ifndef FSMOVE_CACHE_ROPE_HH
+#define FSMOVE_CACHE_ROPE_HH
+
+#include "../assert.hh"          // for ff_assert()
+#include "../zstring.hh"         // for zinit(), z(), unz()
+#include "../rope/rope.hh"       // for ft_rope
+#include "../rope/rope_pool.hh"  // for ft_rope_pool
+#include "cache.hh"              // for ft_cache
+
+#ifdef FT_HAVE_FT_UNSORTED_MAP
+# include "../unsorted_map.hh" // for ft_unsorted_map<K,V>
+#else
+# include <map>             // for std::map<K,V>
+#endif
+
+
+FT_NAMESPACE_BEGIN
+
+/**
+ * compact in-memory associative array from keys (type K) to paths (ft_string).
+ * Used to implement inode cache - see cache.hh for details.
+ *
+ * each path is split at its last '/': the directory is interned in a ft_rope_pool,
+ * i.e. shared with all other paths in the same directory (and its parents with their subdirectories),
+ * while the file name is compressed with z() and appended as the rope suffix.
+ * Compressed names start with '\0', which cannot appear in paths: it marks where to unz()
+ */
+template<class K>
+class ft_cache_rope : public ft_cache<K, ft_string>
+{
+private:
+    typedef ft_cache<K, ft_string> super_type;
+
+#ifdef FT_HAVE_FT_UNSORTED_MAP
+    typedef ft_unsorted_map<K,ft_rope> map_type;
+#else
+    typedef std::map<K,ft_rope> map_type;
+#endif
+
+    map_type map;
+    ft_rope_pool pool;
+    ft_string buf;
+
+    /** convert 'path' to a rope, interning its directory in 'pool' */
+    ft_rope encode(const ft_string & path)
+    {
+        ft_size name_start = path.rfind('/') + 1; // 0 if not found
+        ft_rope dir = pool.make(path.c_str(), name_start);
+
+        z(buf, path.substr(name_start));
+        return ft_rope(& dir, buf.data(), buf.size());
+    }
+
+    /** convert 'rope' back to a path */
+    void decode(const ft_rope & rope, ft_string & path)
+    {
+        buf.resize(0);
+        rope.to_string(buf);
+
+        ft_size name_start = buf.find('\0');
+        if (name_start == ft_string::npos) {
+            path = buf;
+            return;
+        }
+        ft_string name;
+        unz(name, buf.substr(name_start));
+        path.assign(buf, 0, name_start);
+        path += name;
+    }
+
+public:
+    /** default constructor */
+    ft_cache_rope() : super_type(), map(), pool(), buf()
+    {
+        zinit();
+    }
+
+    /** destructor */
+    virtual ~ft_cache_rope()
+    { }
+
+    /**
+     * if cached inode found, set payload and return 1.
+     * Otherwise add it to cache and return 0.
+     * On error, return < 0.
+     * if returns 0, erase() must be called on the same inode when done with payload!
+     */
+    virtual int find_or_add(const K key, ft_string & inout_payload)
+    {
+        ff_assert(inout_payload != this->zero_payload);
+
+        ft_rope & value = map[key];
+        if (value == ft_rope()) {
+            value = encode(inout_payload);
+            return 0;
+        }
+        decode(value, inout_payload);
+        return 1;
+    }
+
+    /**
+     * if cached key found, set result_payload, remove cached key and return 1.
+     * Otherwise return 0. On error, return < 0.
+     */
+    virtual int find_and_delete(const K key, ft_string & result_payload)
+    {
+        typename map_type::iterator iter = map.find(key);
+        if (iter == map.end())
+            return 0;
+
+        decode(iter->second, result_payload);
+        map.erase(iter);
+        return 1;
+    }
+
+    /**
+     * if cached inode found, change its payload and return 1.
+     * Otherwise return 0. On error, return < 0.
+     */
+    virtual int find_and_update(const K key, const ft_string & new_payload)
+    {
+        typename map_type::iterator iter = map.find(key);
+        if (iter == map.end())
+            return 0;
+
+        iter->second = encode(new_payload);
+        return 1;
+    }
+
+    virtual void clear()
+    {
+        map.clear();
+        pool = ft_rope_pool();
+    }
+
+private:
+    /** copy constructor. not implemented: ft_rope is not thread-safe, do not share ropes among caches */
+    ft_cache_rope(const ft_cache_rope<K> & other);
+
+    /** assignment operator. not implemented */
+    const ft_cache_rope<K> & operator=(const ft_cache_rope<K> & other);
+};
+
+FT_NAMESPACE_END
+
+#endif /* FSMOVE_CACHE_ROPE_HH */
@@ -27,7 +27,7 @@
 
 #include "disk_stat.hh" // for fm_disk_stat
 #include "../log.hh"    // for ff_log()
-#include "../misc.hh"   // for ff_pretty_size()
+#include "../misc.hh"   // for ff_pretty_size(), ff_min2(), ff_max2()
 
 FT_IO_NAMESPACE_BEGIN
 
@@ -65,13 +65,19 @@ int fm_disk_stat::set_free(ft_uoff free) {
  * free space' error
  */
 bool fm_disk_stat::is_too_low_free_space(ft_uoff free) const {
+    return free <= get_threshold();
+}
+
+/** return the largest amount of free space that is 'critically low' */
+ft_uoff fm_disk_stat::get_threshold() const {
     /**
      * if file system is smaller than 6GB, critically low free space is 96kbytes.
      * if file system is between 6GB and 64TB, critically low free space is total
      * disk space divided 65536 (i.e. 0.0015%). if file system is larger than
      * 64TB, critically low free space is 1Gbyte.
      */
-    return free <= THRESHOLD_MIN || (free <= THRESHOLD_MAX && free <= (this_total >> 16));
+    ft_uoff threshold = ff_min2((ft_uoff)THRESHOLD_MAX, this_total >> 16);
+    return ff_max2((ft_uoff)THRESHOLD_MIN, threshold);
 }
 
 FT_IO_NAMESPACE_END
@@ -104,6 +104,9 @@ class fm_disk_stat {
      */
     bool is_too_low_free_space(ft_uoff free) const;
 
+    /** return the largest amount of free space that is 'critically low' */
+    ft_uoff get_threshold() const;
+
     /** return the used disk space */
     FT_INLINE ft_uoff get_used() const {
         return this_free < this_total ? this_total - this_free : 0;
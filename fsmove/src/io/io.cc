@@ -31,6 +31,7 @@
 #include "io.hh"           // for fm_io
 
 #include "../cache/cache_mem.hh"     // for ft_cache_mem
+#include "../cache/cache_rope.hh"    // for ft_cache_rope
 #include "../cache/cache_symlink.hh" // for ft_cache_symlink_kv
 
 #if defined(FT_HAVE_MATH_H)
@@ -61,7 +62,7 @@ fm_io::fm_io()
     : this_inode_cache(NULL), this_exclude_set(),
       this_source_stat(), this_target_stat(),
       this_source_root(), this_target_root(),
-      this_eta(), this_work_total(0), this_work_report_threshold(0),
+      this_eta(), this_throttle(), this_trace(), this_work_total(0), this_work_report_threshold(0),
       this_work_done(0), this_work_last_reported(0),
       this_work_last_reported_time(0.0),
       this_progress_msg(NULL), this_force_run(false), this_simulate_run(false)
@@ -114,6 +115,8 @@ int fm_io::open(const fm_args & args)
     		inode_cache_path = icp->get_path();
     		this_inode_cache = icp;
     	}
+    	else if (args.inode_cache_compact)
+    		this_inode_cache = new ft_cache_rope<ft_inode>();
     	else
     		this_inode_cache = new ft_cache_mem<ft_inode,ft_string>();
 
@@ -124,6 +127,9 @@ int fm_io::open(const fm_args & args)
         this_source_root = arg1;
         this_target_root = arg2;
         this_eta.clear();
+        this_throttle.limits(args.max_bytes_per_sec, args.max_iops);
+        if (args.trace_path != NULL && (err = this_trace.create(args.trace_path, FC_TRACE_FSMOVE)) != 0)
+            break;
         this_work_total = this_work_report_threshold = this_work_done = this_work_last_reported = 0;
         this_force_run = args.force_run;
         this_simulate_run = args.simulate_run;
@@ -266,7 +272,8 @@ void fm_io::show_progress(ft_log_level log_level)
     double percentage = 0.0, time_left = -1.0;
 
 	percentage = moved_len / (double)work_total;
-	time_left = this_eta.add(percentage);
+	/* when throttled, remaining data cannot be moved faster than the limits allow: read + write */
+	time_left = this_eta.add(percentage, this_throttle.min_seconds(2 * (work_total - moved_len)));
 	percentage *= 100.0;
 
 	const char * simul_msg = "";
@@ -293,6 +300,7 @@ void fm_io::close()
     this_work_done = this_work_last_reported = this_work_total = 0;
     this_progress_msg = NULL;
     this_force_run = this_simulate_run = false;
+    (void) this_trace.close();
 
 	delete this_inode_cache;
 	this_inode_cache = NULL;
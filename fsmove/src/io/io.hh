@@ -30,6 +30,8 @@
 
 #include "../types.hh"       // for ft_string, ft_uoff
 #include "../eta.hh"         // for ft_eta
+#include "../throttle.hh"    // for ft_throttle
+#include "../trace.hh"       // for ft_trace
 #include "../log.hh"         // for ft_log_level, also for ff_log() used by io.cc
 #include "../fwd.hh"         // for fm_args
 #include "../cache/cache.hh" // for ft_cache<K,V>
@@ -55,6 +57,8 @@ private:
     ft_string this_source_root, this_target_root;
 
     ft_eta  this_eta;
+    ft_throttle this_throttle;
+    ft_trace this_trace;
     ft_uoff this_work_total, this_work_report_threshold;
     ft_uoff this_work_done,  this_work_last_reported;
     double this_work_last_reported_time;
@@ -98,6 +102,12 @@ protected:
     /** show human-readable progress indication, bytes still to move, and estimated time left */
     void show_progress(ft_log_level log_level = FC_NOTICE);
 
+    /** return the limiter of bytes and operations per second */
+    FT_INLINE ft_throttle & throttle() { return this_throttle; }
+
+    /** return the I/O trace to record reads and writes into. check trace().is_open() before recording */
+    FT_INLINE ft_trace & trace() { return this_trace; }
+
 public:
     enum {
         FC_SOURCE_ROOT = 0, FC_TARGET_ROOT,
@@ -46,34 +46,41 @@
 #include <string.h> // for strcmp(), memset(), memcpy()
 #endif
 
-#ifdef FT_HAVE_DIRENT_H
-#include <dirent.h> // for opendir(), readdir(), closedir()
-#endif
 #ifdef FT_HAVE_FCNTL_H
-#include <fcntl.h> // for open(), mknod()
+#include <fcntl.h> // for open(), openat(), mknodat(), fallocate(), AT_FDCWD, AT_REMOVEDIR
 #endif
 #ifdef FT_HAVE_SYS_STAT_H
-#include <sys/stat.h> // for   "        "    , lstat(), mkdir(), mkfifo(), umask()
+#include <sys/stat.h> // for   "        "    , fstatat(), mkdirat(), mkfifoat(), fchmodat(), umask()
 #endif
 #ifdef FT_HAVE_SYS_TYPES_H
 #include <sys/types.h> //  "    "        "        "        "        "         "    , lseek(), ftruncate()
 #endif
 #ifdef FT_HAVE_UNISTD_H
-#include <unistd.h> //  "    "        "        "   ,symlink(),lchown(), close(),    "          "     , readlink(), read(), write()
+#include <unistd.h> // for symlinkat(), fchownat(), linkat(), unlinkat(), close(), readlinkat(), read(), write(), copy_file_range(), syncfs()
 #endif
 #ifdef FT_HAVE_SYS_STATVFS_H
 #include <sys/statvfs.h> // for statvfs(), fsblkcnt_t
 #endif
-#ifdef FT_HAVE_SYS_TIME_H
-#include <sys/time.h> // for utimes(), utimensat()
+#ifdef FT_HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h> // for sendfile()
+#endif
+#ifdef FT_HAVE_SYS_IOCTL_H
+#include <sys/ioctl.h> // for ioctl()
+#endif
+#ifdef FT_HAVE_LINUX_FS_H
+#include <linux/fs.h> // for FS_IOC_FIEMAP
 #endif
-#ifdef FT_HAVE_UTIME_H
-#include <utime.h> //  "    "           "
+#ifdef FT_HAVE_LINUX_FIEMAP_H
+#include <linux/fiemap.h> // for struct fiemap and struct fiemap_extent
 #endif
 
+#include <algorithm> // for std::sort()
+
+#include "../args.hh"   // for fm_args
 #include "../assert.hh" // for ff_assert()
 #include "../log.hh"    // for ff_log()
-#include "../misc.hh"   // for ff_min2()
+#include "../misc.hh"   // for ff_min2(), ff_sleep()
+#include "../zero.hh"   // for ff_mem_zero_run()
 
 #include "disk_stat.hh"      // for fm_disk_stat::THRESHOLD_MIN
 #include "io_posix.hh"       // for fm_io_posix
@@ -85,15 +92,64 @@
 #define PATH_MAX 4096
 #endif /* PATH_MAX */
 
+#ifndef O_DIRECTORY
+#define O_DIRECTORY 0
+#endif
+#ifndef O_NOFOLLOW
+#define O_NOFOLLOW 0
+#endif
+
 FT_IO_NAMESPACE_BEGIN
 
+/**
+ * constructor. 'source_parent_fd' and 'target_parent_fd' are the descriptors of the directories
+ * containing 'source_path' and 'target_path', or -1 if not available: then use AT_FDCWD and full paths.
+ * the paths must not be modified or destroyed while this fm_io_posix_at is in use
+ */
+fm_io_posix_at::fm_io_posix_at(int source_parent_fd, const ft_string &source_path,
+                               int target_parent_fd, const ft_string &target_path)
+    : source_dir_fd(AT_FDCWD), target_dir_fd(AT_FDCWD), source_name(source_path.c_str()),
+      target_name(target_path.c_str()) {
+    /* children paths are always built as parent path + '/' + name */
+    if (source_parent_fd >= 0) {
+        source_dir_fd = source_parent_fd;
+        source_name += source_path.rfind('/') + 1;
+    }
+    if (target_parent_fd >= 0) {
+        target_dir_fd = target_parent_fd;
+        target_name += target_path.rfind('/') + 1;
+    }
+}
+
+/**
+ * open the directory 'name' relative to 'dir_fd', only to use its descriptor with the *at() system calls.
+ * return -1 if it fails: callers then fall back on full paths
+ */
+static int ff_posix_open_dir_at(int dir_fd, const char *name) {
+    return ::openat(dir_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+}
+
 /** default constructor */
-fm_io_posix::fm_io_posix() : super_type(), bytes_copied_since_last_check(0) {
+fm_io_posix::fm_io_posix()
+    : super_type(), bytes_copied_since_last_check(0), bytes_freed_since_last_check(0), this_source_fd(-1),
+      this_target_fd(-1), this_same_fs(false), bytes_reserved(0), this_jobs(1),
+      this_order(FC_ORDER_READDIR), this_kernel_copy(FC_COPY_FILE_RANGE) {
+#ifdef FT_HAVE_FM_IO_MOVE_POOL
+    (void) pthread_mutex_init(&this_lock, NULL);
+    (void) pthread_cond_init(&this_inode_cond, NULL);
+#endif
+#ifdef FT_HAVE_FM_IO_URING_BATCH
+    this_uring = NULL;
+#endif
 }
 
 /** destructor. calls close() */
 fm_io_posix::~fm_io_posix() {
     close();
+#ifdef FT_HAVE_FM_IO_MOVE_POOL
+    (void) pthread_cond_destroy(&this_inode_cond);
+    (void) pthread_mutex_destroy(&this_lock);
+#endif
 }
 
 /** return true if this fr_io_posix is currently (and correctly) open */
@@ -107,7 +163,27 @@ int fm_io_posix::open(const fm_args &args) {
     do {
         if ((err = super_type::open(args)) != 0)
             break;
-        bytes_copied_since_last_check = 0;
+        bytes_copied_since_last_check = bytes_freed_since_last_check = bytes_reserved = 0;
+        this_jobs = args.jobs != 0 ? args.jobs : 1;
+        this_order = args.order;
+#ifndef FT_HAVE_FM_IO_MOVE_POOL
+        if (this_jobs > 1) {
+            ff_log(FC_WARN, 0, "this fsmove was compiled without threads, ignoring --jobs=%" FT_ULL,
+                   (ft_ull)this_jobs);
+            this_jobs = 1;
+        }
+#endif
+        open_roots();
+#ifdef FT_HAVE_FM_IO_URING_BATCH
+        /* threads copy files one by one. I/O trace needs each read() and write() separately */
+        if (this_jobs == 1 && !trace().is_open()) {
+            this_uring = new fm_uring_batch(*this);
+            if ((err = this_uring->open()) != 0) {
+                ff_log(FC_DEBUG, err, "io_uring not available, copying small files one by one");
+                close_uring();
+            }
+        }
+#endif
         err = check_free_space();
     } while (0);
     return err;
@@ -115,8 +191,34 @@ int fm_io_posix::open(const fm_args &args) {
 
 /** close this I/O, including file descriptors */
 void fm_io_posix::close() {
+    close_uring();
+    close_roots();
     super_type::close();
-    bytes_copied_since_last_check = 0;
+    bytes_copied_since_last_check = bytes_freed_since_last_check = bytes_reserved = 0;
+    this_jobs = 1;
+    this_order = FC_ORDER_READDIR;
+}
+
+/** open source_root() and target_root() for syncfs(), and check if they are on the same file-system */
+void fm_io_posix::open_roots() {
+    ft_stat source_st, target_st;
+
+    close_roots();
+    this_source_fd = ::open(source_root().c_str(), O_RDONLY);
+    this_target_fd = ::open(target_root().c_str(), O_RDONLY);
+    this_same_fs = this_source_fd >= 0 && this_target_fd >= 0 &&
+                   ::fstat(this_source_fd, &source_st) == 0 && ::fstat(this_target_fd, &target_st) == 0 &&
+                   source_st.st_dev == target_st.st_dev;
+}
+
+/** close the descriptors opened by open_roots() */
+void fm_io_posix::close_roots() {
+    if (this_source_fd >= 0)
+        (void) ::close(this_source_fd);
+    if (this_target_fd >= 0)
+        (void) ::close(this_target_fd);
+    this_source_fd = this_target_fd = -1;
+    this_same_fs = false;
 }
 
 /**
@@ -125,7 +227,14 @@ void fm_io_posix::close() {
  * normal
  */
 bool fm_io_posix::enough_free_space(ft_uoff bytes_to_write, bool first_time) {
-    ft_uoff half_free_space = ff_min2(source_stat().get_free(), target_stat().get_free()) >> 1;
+    /*
+     * removing source files frees space in source, and also in target if they are the same file-system.
+     * every byte written to target is assumed to use space in source too: target may be a loop device
+     * whose loop file is inside source
+     */
+    ft_uoff source_margin = free_space_margin(source_stat(), bytes_freed_since_last_check);
+    ft_uoff target_margin = free_space_margin(target_stat(), this_same_fs ? bytes_freed_since_last_check : 0);
+    ft_uoff half_free_space = ff_min2(source_margin, target_margin) >> 1;
     if (first_time)
         half_free_space >>= 1;
 
@@ -133,13 +242,24 @@ bool fm_io_posix::enough_free_space(ft_uoff bytes_to_write, bool first_time) {
            half_free_space - bytes_to_write > bytes_copied_since_last_check;
 }
 
+/**
+ * return the estimated free space above the 'critically low' threshold of 'disk_stat',
+ * adding 'bytes_freed' to the free space measured by last check_free_space()
+ */
+ft_uoff fm_io_posix::free_space_margin(const fm_disk_stat &disk_stat, ft_uoff bytes_freed) {
+    ft_uoff free = disk_stat.get_free() + bytes_freed, threshold = disk_stat.get_threshold();
+    return free > threshold ? free - threshold : 0;
+}
+
 /**
  * add bytes_just_written to bytes_copied_since_last_check.
  *
- * if bytes_copied_since_last_check >= PERIODIC_CHECK_FREE_SPACE or >= 50% of free space,
- * reset bytes_copied_since_last_check to zero and call check_free_space()
+ * if bytes_copied_since_last_check >= 50% of estimated free space above the 'critically low' threshold,
+ * reset bytes_copied_since_last_check and bytes_freed_since_last_check to zero and call check_free_space().
+ * checks become more frequent as free space approaches the threshold
  */
 int fm_io_posix::periodic_check_free_space(ft_uoff bytes_just_written, ft_uoff bytes_to_write) {
+    lock();
     add_work_done(bytes_just_written);
 
     bytes_copied_since_last_check += bytes_just_written;
@@ -147,9 +267,10 @@ int fm_io_posix::periodic_check_free_space(ft_uoff bytes_just_written, ft_uoff b
     int err = 0;
 
     if (!enough_free_space(bytes_to_write)) {
-        bytes_copied_since_last_check = 0;
+        bytes_copied_since_last_check = bytes_freed_since_last_check = 0;
         err = check_free_space();
     }
+    unlock();
     return err;
 }
 
@@ -165,8 +286,17 @@ int fm_io_posix::check_free_space() {
     return err;
 }
 
-/** call ::sync(). slow, but needed to get accurate disk stats when loop devices are involved */
+/**
+ * flush target file-system, then source file-system with syncfs(), or everything with ::sync()
+ * if syncfs() is not available. slow, but needed to get accurate disk stats when loop devices are involved
+ */
 void fm_io_posix::sync() {
+#ifdef FT_HAVE_SYNCFS
+    /* if target is a loop device whose loop file is inside source, its data reaches source first */
+    if (this_source_fd >= 0 && this_target_fd >= 0 &&
+        ::syncfs(this_target_fd) == 0 && (this_same_fs || ::syncfs(this_source_fd) == 0))
+        return;
+#endif
     ::sync();
 }
 
@@ -237,6 +367,26 @@ FT_INLINE static bool fm_io_posix_is_symlink(const ft_stat &stat) {
     return S_ISLNK(stat.st_mode);
 }
 
+/** stop copying small files in batches: each file goes through copy_file_contents() and remove_file() */
+void fm_io_posix::close_uring() {
+#ifdef FT_HAVE_FM_IO_URING_BATCH
+    delete this_uring;
+    this_uring = NULL;
+#endif
+}
+
+/**
+ * copy the small files queued in this_uring. must be called before closing
+ * the directories containing them. returns 0 if success, else the first error
+ */
+int fm_io_posix::flush_uring() {
+#ifdef FT_HAVE_FM_IO_URING_BATCH
+    if (this_uring != NULL)
+        return this_uring->flush();
+#endif
+    return 0;
+}
+
 /** core of recursive move algorithm, actually moves the whole source tree into target */
 int fm_io_posix::move() {
     if (move_rename(source_root().c_str(), target_root().c_str()) == 0)
@@ -246,17 +396,33 @@ int fm_io_posix::move() {
     umask(0);
 
     int err = init_work();
-    if (err == 0)
-        err = move(source_root(), target_root());
-    if (err == 0)
+    if (err == 0) {
+#ifdef FT_HAVE_FM_IO_MOVE_POOL
+        if (this_jobs > 1) {
+            fm_move_pool pool(*this);
+            err = pool.run(source_root(), target_root(), this_jobs);
+        } else
+#endif
+        {
+            err = move(fm_io_posix_at(-1, source_root(), -1, target_root()), source_root(), target_root());
+            /* source_root() may be a single small file */
+            if (err == 0)
+                err = flush_uring();
+        }
+    }
+    if (err == 0) {
         ff_log(FC_NOTICE, 0, "job completed.");
+        if (throttle().throttled_seconds() > 0.0)
+            ff_log(FC_INFO, 0, "spent %.1f seconds waiting for I/O throttling", throttle().throttled_seconds());
+    }
     return err;
 }
 
 /**
  * move a single file/socket/special-device or a whole directory tree
  */
-int fm_io_posix::move(const ft_string &source_path, const ft_string &target_path) {
+int fm_io_posix::move(const fm_io_posix_at &at, const ft_string &source_path,
+                      const ft_string &target_path) {
     ft_stat stat;
     const std::set<ft_string> &exclude_set = this->exclude_set();
     int err = 0;
@@ -269,18 +435,18 @@ int fm_io_posix::move(const ft_string &source_path, const ft_string &target_path
             break;
         }
 
-        if ((err = this->stat(source_path, stat)) != 0)
+        if ((err = this->stat(at, source_path, stat)) != 0)
             break;
 
         if (fm_io_posix_is_file(stat)) {
-            err = this->move_file(source_path, stat, target_path);
+            err = this->move_file(at, source_path, stat, target_path);
             break;
         } else if (!fm_io_posix_is_dir(stat)) {
-            err = this->move_special(source_path, stat, target_path);
+            err = this->move_special(at, source_path, stat, target_path);
             break;
         }
         ft_io_posix_dir source_dir;
-        if ((err = source_dir.open(source_path)))
+        if ((err = source_dir.open_at(at.source_dir_fd, at.source_name, source_path)))
             break;
 
         /*
@@ -289,65 +455,292 @@ int fm_io_posix::move(const ft_string &source_path, const ft_string &target_path
          *
          * Exception: we allow a 'lost+found' directory to exist inside target_root()
          */
-        if ((err = this->create_dir(target_path)) != 0)
+        if ((err = this->create_dir(at, target_path)) != 0)
             break;
 
         if ((err = this->periodic_check_free_space()) != 0)
             break;
 
+        /*
+         * children are accessed relative to source_dir and target_fd:
+         * the kernel no longer resolves their full paths at each system call
+         */
+        int target_fd = ff_posix_open_dir_at(at.target_dir_fd, at.target_name);
+
         ft_string child_source = source_path, child_target = target_path;
         child_source += '/';
         child_target += '/';
 
         ft_io_posix_dirent *dirent;
+        fm_dir_entries entries;
+        ft_size entry_i = 0;
+        const char *name;
+
+        if (this_order != FC_ORDER_READDIR)
+            err = read_dir_sorted(source_dir, source_path, entries);
 
         /* recurse on directory contents */
-        while ((err = source_dir.next(dirent)) == 0 && dirent != NULL) {
-            /* skip "." and ".." */
-            if (!strcmp(".", dirent->d_name) || !strcmp("..", dirent->d_name))
-                continue;
+        while (err == 0) {
+            if (this_order != FC_ORDER_READDIR) {
+                if (entry_i == entries.size())
+                    break;
+                name = entries[entry_i++].name.c_str();
+            } else {
+                if ((err = source_dir.next(dirent)) != 0 || dirent == NULL)
+                    break;
+                name = dirent->d_name;
+                /* skip "." and ".." */
+                if (!strcmp(".", name) || !strcmp("..", name))
+                    continue;
+            }
 
             child_source.resize(1 +
                                 source_path.size()); // faster than child_source = source_path + '/'
-            child_source += dirent->d_name;
+            child_source += name;
 
             child_target.resize(1 +
                                 target_path.size()); // faster than child_target = target_path + '/'
-            child_target += dirent->d_name;
+            child_target += name;
 
-            if ((err = this->move(child_source, child_target)) != 0)
-                break;
+            fm_io_posix_at child_at(source_dir.fd(), child_source, target_fd, child_target);
+            err = this->move(child_at, child_source, child_target);
         }
+        /* small files queued in this_uring are accessed relative to source_dir and target_fd */
+        if (err == 0)
+            err = flush_uring();
+#ifdef FT_HAVE_FM_IO_URING_BATCH
+        else if (this_uring != NULL)
+            this_uring->discard();
+#endif
+        if (target_fd >= 0)
+            (void)::close(target_fd);
         if (err != 0)
             break;
-        if ((err = this->copy_stat(target_path.c_str(), stat)) != 0)
+        err = this->finish_dir(at, target_path, stat, source_path);
+
+    } while (0);
+    return err;
+}
+
+#ifdef FT_HAVE_FM_IO_MOVE_POOL
+/**
+ * move a single file/socket/device, or create a directory and queue its contents into 'pool'.
+ * called by fm_move_pool from thread 'index'
+ */
+int fm_io_posix::move_task(fm_move_pool &pool, ft_size index, fm_move_task *task) {
+    const ft_string &source_path = task->source_path, &target_path = task->target_path;
+    const fm_io_posix_at at = task_at(task);
+    ft_stat &stat = task->stat;
+    int err = 0;
+
+    ff_log(FC_DEBUG, 0, "`%s'\t-> `%s'", source_path.c_str(), target_path.c_str());
+
+    do {
+        if (exclude_set().count(source_path) != 0) {
+            ff_log(FC_INFO, 0, "skipped `%s', matches exclude list", source_path.c_str());
+            break;
+        }
+
+        if ((err = this->stat(at, source_path, stat)) != 0)
             break;
+
+        if (fm_io_posix_is_file(stat)) {
+            err = this->move_file(at, source_path, stat, target_path);
+            break;
+        } else if (!fm_io_posix_is_dir(stat)) {
+            err = this->move_special(at, source_path, stat, target_path);
+            break;
+        }
+        ft_io_posix_dir source_dir;
+        if ((err = source_dir.open_at(at.source_dir_fd, at.source_name, source_path)))
+            break;
+
+        /* same rules as move(): see comments there */
+        if ((err = this->create_dir(at, target_path)) != 0)
+            break;
+
+        if ((err = this->periodic_check_free_space()) != 0)
+            break;
+
+        /* from now on, fm_move_pool will call finish_dir() after all the children are moved */
+        task->is_dir = true;
+
         /*
-         * we do not delete 'lost+found' directory inside source_root()
+         * children are accessed relative to these descriptors, closed when the task is deleted.
+         * set them before queueing any child: other threads can steal children immediately
          */
-        if ((err = this->remove_dir(source_path)) != 0)
+        task->source_fd = ::dup(source_dir.fd());
+        task->target_fd = ff_posix_open_dir_at(at.target_dir_fd, at.target_name);
+
+        ft_string child_source = source_path, child_target = target_path;
+        child_source += '/';
+        child_target += '/';
+
+        if (this_order != FC_ORDER_READDIR) {
+            fm_dir_entries entries;
+            if ((err = read_dir_sorted(source_dir, source_path, entries)) != 0)
+                break;
+            /*
+             * queue directory contents in reverse order:
+             * this thread takes back the last queued one first, other threads steal the first ones
+             */
+            for (ft_size i = entries.size(); i-- != 0; ) {
+                child_source.resize(1 + source_path.size());
+                child_source += entries[i].name;
+
+                child_target.resize(1 + target_path.size());
+                child_target += entries[i].name;
+
+                pool.push(index, task, child_source, child_target);
+            }
             break;
+        }
+
+        ft_io_posix_dirent *dirent;
 
+        /* queue directory contents. other threads can steal them while we are still listing */
+        while ((err = source_dir.next(dirent)) == 0 && dirent != NULL) {
+            /* skip "." and ".." */
+            if (!strcmp(".", dirent->d_name) || !strcmp("..", dirent->d_name))
+                continue;
+
+            child_source.resize(1 + source_path.size());
+            child_source += dirent->d_name;
+
+            child_target.resize(1 + target_path.size());
+            child_target += dirent->d_name;
+
+            pool.push(index, task, child_source, child_target);
+        }
     } while (0);
     return err;
 }
 
+/** call finish_dir() on directory 'task'. called by fm_move_pool after all its children are moved */
+int fm_io_posix::finish_task(const fm_move_task *task) {
+    return finish_dir(task_at(task), task->target_path, task->stat, task->source_path);
+}
+
+/** return the location of 'task' relative to the descriptors of its parent directories */
+fm_io_posix_at fm_io_posix::task_at(const fm_move_task *task) {
+    const fm_move_task *parent = task->parent;
+    return fm_io_posix_at(parent != NULL ? parent->source_fd : -1, task->source_path,
+                          parent != NULL ? parent->target_fd : -1, task->target_path);
+}
+#endif /* FT_HAVE_FM_IO_MOVE_POOL */
+
 /**
- * fill 'stat' with information about the file/directory/special-device 'path'
+ * read all the entries of 'dir' except "." and "..", and sort them in this_order.
+ * 'path' is only used for error messages
  */
-int fm_io_posix::stat(const ft_string &path, ft_stat &stat) {
-    const char *str = path.c_str();
+int fm_io_posix::read_dir_sorted(ft_io_posix_dir &dir, const ft_string &path, fm_dir_entries &entries) {
+    ft_io_posix_dirent *dirent;
+    fm_dir_entry entry;
+    int err;
+
+    entries.clear();
+    while ((err = dir.next(dirent)) == 0 && dirent != NULL) {
+        /* skip "." and ".." */
+        if (!strcmp(".", dirent->d_name) || !strcmp("..", dirent->d_name))
+            continue;
+
+        entry.name = dirent->d_name;
+        entry.key = dirent->d_ino;
+        entry.has_extent = false;
+#ifdef DT_REG
+        /*
+         * only open regular files: opening devices can have side effects.
+         * without d_type (DT_UNKNOWN) we would need an additional fstatat(), so just use the inode number
+         */
+        if (this_order == FC_ORDER_EXTENT && dirent->d_type == DT_REG) {
+            if ((err = first_extent(dir.fd(), dirent->d_name, entry.key)) == 0)
+                entry.has_extent = true;
+            else {
+                entry.key = dirent->d_ino;
+                /* threads read this_order without locks: they keep trying FIEMAP instead */
+                if (err == EOPNOTSUPP && this_jobs == 1) {
+                    ff_log(FC_INFO, 0, "file-system containing `%s' does not support FIEMAP, "
+                           "moving files in inode order", path.c_str());
+                    this_order = FC_ORDER_INODE;
+                }
+                err = 0;
+            }
+        }
+#endif
+        entries.push_back(entry);
+    }
+    if (err == 0)
+        std::sort(entries.begin(), entries.end());
+    return err;
+}
+
+/**
+ * store in 'key' the position on disk of the first extent of regular file 'name' inside directory 'dir_fd'.
+ * returns ENODATA (unreported) if the file has no extents, EOPNOTSUPP (unreported)
+ * if the file-system does not support FIEMAP, else 0 for success or error (unreported)
+ */
+int fm_io_posix::first_extent(int dir_fd, const char *name, ft_uoff &key) {
+#ifdef FS_IOC_FIEMAP
+    enum { K_SIZEOF_FIEMAP = sizeof(struct fiemap) + sizeof(struct fiemap_extent) };
+    ft_u64 buf[(K_SIZEOF_FIEMAP + sizeof(ft_u64) - 1) / sizeof(ft_u64)];
+    struct fiemap *k_map = (struct fiemap *)buf;
+    int fd = ::openat(dir_fd, name, O_RDONLY | O_NOFOLLOW | O_NONBLOCK);
+    if (fd < 0)
+        return errno;
+
+    int err = 0;
+    memset(buf, 0, sizeof(buf));
+    k_map->fm_length = ~(ft_u64)0;
+    k_map->fm_extent_count = 1;
+    if (ioctl(fd, FS_IOC_FIEMAP, k_map) != 0)
+        err = (errno == ENOTTY || errno == EINVAL) ? EOPNOTSUPP : errno;
+    else if (k_map->fm_mapped_extents == 0 ||
+             (k_map->fm_extents[0].fe_flags & (FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_ENCODED)) != 0)
+        /* empty, only holes, or not yet allocated on disk */
+        err = ENODATA;
+    else
+        key = k_map->fm_extents[0].fe_physical;
+    (void)::close(fd);
+    return err;
+#else
+    (void)dir_fd;
+    (void)name;
+    (void)key;
+    return EOPNOTSUPP;
+#endif
+}
+
+/**
+ * copy the permission bits, owner/group and timestamps to the target directory 'target_path'
+ * and remove the source directory 'source_path'. called after all their contents are moved
+ */
+int fm_io_posix::finish_dir(const fm_io_posix_at &at, const ft_string &target_path,
+                            const ft_stat &stat, const ft_string &source_path) {
+    int err = this->copy_stat(at, target_path.c_str(), stat);
+    /*
+     * we do not delete 'lost+found' directory inside source_root()
+     */
+    if (err == 0)
+        err = this->remove_dir(at, source_path);
+    return err;
+}
+
+/**
+ * fill 'stat' with information about the source file/directory/special-device 'at',
+ * whose full path is 'path'
+ */
+int fm_io_posix::stat(const fm_io_posix_at &at, const ft_string &path, ft_stat &stat) {
     int err = 0;
-    if (lstat(str, &stat) != 0)
-        err = ff_log(FC_ERROR, errno, "failed to lstat() `%s'", str);
+    if (fstatat(at.source_dir_fd, at.source_name, &stat, AT_SYMLINK_NOFOLLOW) != 0)
+        err = ff_log(FC_ERROR, errno, "failed to lstat() `%s'", path.c_str());
     return err;
 }
 
 /**
  * move the special-device 'source_path' to 'target_path'.
  */
-int fm_io_posix::move_special(const ft_string &source_path, const ft_stat &stat,
-                              const ft_string &target_path) {
+int fm_io_posix::move_special(const fm_io_posix_at &at, const ft_string &source_path,
+                              const ft_stat &stat, const ft_string &target_path) {
     const char *source = source_path.c_str(), *target = target_path.c_str();
     int err = 0;
     ff_log(FC_TRACE, 0, "move_special() `%s'\t-> `%s'", source, target);
@@ -357,7 +750,7 @@ int fm_io_posix::move_special(const ft_string &source_path, const ft_stat &stat,
 
     do {
         /* check inode_cache for hard links and recreate them */
-        err = this->hard_link(stat, target_path);
+        err = this->hard_link(stat, at, target_path);
         if (err == 0) {
             /** hard link succeeded, no need to create the special-device */
             err = this->periodic_check_free_space();
@@ -372,7 +765,8 @@ int fm_io_posix::move_special(const ft_string &source_path, const ft_stat &stat,
 
         /* found a special device */
         if (S_ISCHR(stat.st_mode) || S_ISBLK(stat.st_mode) || S_ISSOCK(stat.st_mode)) {
-            if (mknod(target, (stat.st_mode | 0600) & ~0077, stat.st_rdev) != 0) {
+            if (mknodat(at.target_dir_fd, at.target_name, (stat.st_mode | 0600) & ~0077,
+                        stat.st_rdev) != 0) {
                 if (!S_ISSOCK(stat.st_mode)) {
                     err = ff_log(FC_ERROR, errno, "failed to create target special device `%s'",
                                  target);
@@ -381,19 +775,19 @@ int fm_io_posix::move_special(const ft_string &source_path, const ft_stat &stat,
                 ff_log(FC_WARN, errno, "failed to create target UNIX socket `%s'", target);
             }
         } else if (S_ISFIFO(stat.st_mode)) {
-            if (mkfifo(target, 0600) != 0) {
+            if (mkfifoat(at.target_dir_fd, at.target_name, 0600) != 0) {
                 err = ff_log(FC_ERROR, errno, "failed to create target named pipe `%s'", target);
                 break;
             }
         } else if (fm_io_posix_is_symlink(stat)) {
             char link_to[PATH_MAX + 1];
-            ssize_t link_len = readlink(source, link_to, PATH_MAX);
+            ssize_t link_len = readlinkat(at.source_dir_fd, at.source_name, link_to, PATH_MAX);
             if (link_len == -1) {
                 err = ff_log(FC_ERROR, errno, "failed to read source symbolic link `%s'", source);
                 break;
             }
             link_to[link_len] = '\0';
-            if (symlink(link_to, target) != 0) {
+            if (symlinkat(link_to, at.target_dir_fd, at.target_name) != 0) {
                 err = ff_log(FC_ERROR, errno, "failed to create target symbolic link `%s'\t-> `%s'",
                              target, link_to);
                 break;
@@ -406,7 +800,7 @@ int fm_io_posix::move_special(const ft_string &source_path, const ft_stat &stat,
             break;
         }
 
-        if ((err = this->copy_stat(target, stat)) != 0)
+        if ((err = this->copy_stat(at, target, stat)) != 0)
             break;
 
         if ((err = this->periodic_check_free_space()) != 0)
@@ -414,8 +808,10 @@ int fm_io_posix::move_special(const ft_string &source_path, const ft_stat &stat,
 
     } while (0);
 
+    release_inode(stat);
+
     if (err == 0)
-        err = remove_special(source);
+        err = remove_special(at, source);
 
     return err;
 }
@@ -423,9 +819,9 @@ int fm_io_posix::move_special(const ft_string &source_path, const ft_stat &stat,
 /**
  * remove the special file 'source_path'
  */
-int fm_io_posix::remove_special(const char *source_path) {
+int fm_io_posix::remove_special(const fm_io_posix_at &at, const char *source_path) {
     int err = 0;
-    if (::remove(source_path) != 0)
+    if (unlinkat(at.source_dir_fd, at.source_name, 0) != 0)
         err = ff_log(FC_ERROR, errno, "failed to remove source special device `%s'", source_path);
     return err;
 }
@@ -433,18 +829,27 @@ int fm_io_posix::remove_special(const char *source_path) {
 /**
  * remove the regular file 'source_path'
  */
-int fm_io_posix::remove_file(const char *source_path) {
+int fm_io_posix::remove_file(const fm_io_posix_at &at, const char *source_path) {
+    ft_stat stat;
+    /* removing the last link of a file frees its blocks */
+    bool last_link = fstatat(at.source_dir_fd, at.source_name, &stat, AT_SYMLINK_NOFOLLOW) == 0 &&
+                     stat.st_nlink == 1;
     int err = 0;
-    if (::remove(source_path) != 0)
+    if (unlinkat(at.source_dir_fd, at.source_name, 0) != 0)
         err = ff_log(FC_ERROR, errno, "failed to remove source file `%s'", source_path);
+    else if (last_link) {
+        lock();
+        bytes_freed_since_last_check += (ft_uoff)stat.st_blocks * 512;
+        unlock();
+    }
     return err;
 }
 
 /**
  * move the regular file 'source_path' to 'target_path'.
  */
-int fm_io_posix::move_file(const ft_string &source_path, const ft_stat &stat,
-                           const ft_string &target_path) {
+int fm_io_posix::move_file(const fm_io_posix_at &at, const ft_string &source_path,
+                           const ft_stat &stat, const ft_string &target_path) {
     const char *source = source_path.c_str(), *target = target_path.c_str();
     int err = 0;
     ff_log(FC_TRACE, 0, "move_file()    `%s'\t-> `%s'", source, target);
@@ -453,7 +858,7 @@ int fm_io_posix::move_file(const ft_string &source_path, const ft_stat &stat,
         return err;
 
     /* check inode_cache for hard links and recreate them */
-    err = this->hard_link(stat, target_path);
+    err = this->hard_link(stat, at, target_path);
     if (err == 0) {
         /** hard link succeeded, no need to copy the file contents */
         err = this->periodic_check_free_space();
@@ -464,11 +869,18 @@ int fm_io_posix::move_file(const ft_string &source_path, const ft_stat &stat,
     }
 
     /* no luck with inode_cache, proceed as usual */
-    err = copy_file_contents(source_path, stat, target_path);
+#ifdef FT_HAVE_FM_IO_URING_BATCH
+    /* copy small files in batches: they are removed from source by fm_uring_batch::flush() */
+    if (this_uring != NULL && fm_uring_batch::is_small(stat) &&
+        (err = this_uring->push(at, source_path, stat, target_path)) != EAGAIN)
+        return err;
+#endif
+    err = copy_file_contents(at, source_path, stat, target_path);
+    release_inode(stat);
 
 move_file_remove_source:
     if (err == 0)
-        err = remove_file(source);
+        err = remove_file(at, source);
     return err;
 }
 
@@ -476,13 +888,13 @@ move_file_remove_source:
  * copy the contents of regular file 'source_path' to 'target_path'
  * including permissions and xattrs.
  */
-int fm_io_posix::copy_file_contents(const ft_string &source_path, const ft_stat &stat,
-                                    const ft_string &target_path) {
+int fm_io_posix::copy_file_contents(const fm_io_posix_at &at, const ft_string &source_path,
+                                    const ft_stat &stat, const ft_string &target_path) {
     const char *source = source_path.c_str(), *target = target_path.c_str();
     int err = 0;
 
     fm_io_posix_xattr handle;
-    int in_fd = handle.openfile(source_path);
+    int in_fd = handle.openfile_at(at.source_dir_fd, at.source_name, source_path);
     if (in_fd < 0) {
         err = ff_log(FC_ERROR, errno, "failed to open source file `%s'", source);
     }
@@ -490,7 +902,7 @@ int fm_io_posix::copy_file_contents(const ft_string &source_path, const ft_stat
 #ifndef O_EXCL
 #define O_EXCL 0
 #endif
-    int out_fd = ::open(target, O_CREAT | O_WRONLY | O_TRUNC | O_EXCL, 0600);
+    int out_fd = ::openat(at.target_dir_fd, at.target_name, O_CREAT | O_WRONLY | O_TRUNC | O_EXCL, 0600);
     if (out_fd < 0) {
         err = ff_log(FC_ERROR, errno, "failed to create target file `%s'", target);
     }
@@ -503,7 +915,7 @@ int fm_io_posix::copy_file_contents(const ft_string &source_path, const ft_stat
             err = this->copy_stream(in_fd, out_fd, stat, source, target);
     }
     if (err == 0) {
-        err = this->copy_stat(target, stat);
+        err = this->copy_stat(at, target, stat);
     }
     if (err == 0) {
         (void)handle.copy_xattr_after(target_path, out_fd);
@@ -541,10 +953,12 @@ int fm_io_posix::move_rename(const char *source, const char *target) {
  *
  * returns EAGAIN if inode *was* not in inode_cache
  */
-int fm_io_posix::hard_link(const ft_stat &stat, const ft_string &target_path) {
+int fm_io_posix::hard_link(const ft_stat &stat, const fm_io_posix_at &at,
+                           const ft_string &target_path) {
     ft_string cached_link = target_path;
     int err;
 
+    lock();
     if (stat.st_nlink > 1) {
         /*
          * source path has 2 or more links.
@@ -564,6 +978,17 @@ int fm_io_posix::hard_link(const ft_stat &stat, const ft_string &target_path) {
          */
         err = inode_cache_find_and_delete(stat.st_ino, cached_link);
     }
+#ifdef FT_HAVE_FM_IO_MOVE_POOL
+    if (this_jobs > 1) {
+        if (err == 0 && stat.st_nlink > 1)
+            /* we added the inode: other threads must wait until we create its first link */
+            this_inodes_pending.insert(stat.st_ino);
+        else if (err == 1)
+            while (this_inodes_pending.count(stat.st_ino) != 0)
+                (void) pthread_cond_wait(&this_inode_cond, &this_lock);
+    }
+#endif
+    unlock();
 
     if (err == 0) {
         // fake error to tell caller that inode was not in cache
@@ -571,7 +996,7 @@ int fm_io_posix::hard_link(const ft_stat &stat, const ft_string &target_path) {
     } else if (err == 1) {
         // inode found in cache
         const char *link_to = cached_link.c_str(), *link_from = target_path.c_str();
-        if (::link(link_to, link_from) != 0)
+        if (linkat(AT_FDCWD, link_to, at.target_dir_fd, at.target_name, 0) != 0)
             err = ff_log(FC_ERROR, errno, "failed to create target hard link `%s'\t-> `%s'",
                          link_from, link_to);
         else
@@ -580,6 +1005,23 @@ int fm_io_posix::hard_link(const ft_stat &stat, const ft_string &target_path) {
     return err;
 }
 
+/**
+ * called after the first link of 'stat' was created in target:
+ * wake up the threads waiting in hard_link() to create more links to it
+ */
+void fm_io_posix::release_inode(const ft_stat &stat) {
+#ifdef FT_HAVE_FM_IO_MOVE_POOL
+    if (this_jobs > 1 && stat.st_nlink > 1) {
+        lock();
+        if (this_inodes_pending.erase(stat.st_ino) != 0)
+            (void) pthread_cond_broadcast(&this_inode_cond);
+        unlock();
+    }
+#else
+    (void) stat;
+#endif
+}
+
 enum {
     FT_LOG_BUFSIZE = 16, //< log2(FT_BUFSIZE)
 
@@ -589,14 +1031,41 @@ enum {
 
     FT_BUFSIZE_m1 = FT_BUFSIZE - 1,
 
+    // bytes copied by each copy_file_range() or sendfile() in copy_stream_kernel(), currently 1M
+    FT_KERNEL_COPYSIZE = FT_BUFSIZE << 4,
+
+    // buffer used by copy_stream_punch(), currently 1M
+    FT_PUNCH_BUFSIZE = FT_BUFSIZE << 4,
+
+    // maximum bytes copied by copy_stream_punch() before punching them from source, currently 64M
+    FT_PUNCH_CHUNK_MAX = FT_BUFSIZE << 10,
+
     FT_BUFSIZE_SANITY_CHECK =
         sizeof(char[FT_BUFSIZE * 3 / 2 >= fm_disk_stat::THRESHOLD_MIN ? 1 : -1])
 };
 
+/**
+ * return the position where backward copy of a sparse file should continue from 'offset_high':
+ * the end of the last data segment before 'offset_high', rounded up to FT_BUFSIZE.
+ * the holes after it are simply truncated away.
+ * also drops from 'segments' the data segments starting at or after 'offset_high'
+ */
+static ft_off ff_skip_holes_backward(std::vector<std::pair<ft_off, ft_off> > &segments,
+                                     ft_off offset_high) {
+    while (!segments.empty() && segments.back().first >= offset_high)
+        segments.pop_back();
+
+    ft_off data_end = 0;
+    if (!segments.empty())
+        data_end = (segments.back().second + FT_BUFSIZE_m1) & ~(ft_off)FT_BUFSIZE_m1;
+    return ff_min2(data_end, offset_high);
+}
+
 /**
  * forward or backward copy file/stream contents from in_fd to out_fd.
  *
- * if disk space is low, we copy backward and progressively truncate in_fd to conserve space:
+ * if disk space is low, we copy forward and punch holes in in_fd to conserve space.
+ * if the file-system cannot punch holes, we copy backward and progressively truncate in_fd:
  * results in heavy fragmentation on target file, but at least we can continue
  */
 int fm_io_posix::copy_stream(int in_fd, int out_fd, const ft_stat &stat, const char *source,
@@ -607,12 +1076,42 @@ int fm_io_posix::copy_stream(int in_fd, int out_fd, const ft_stat &stat, const c
     if ((err = periodic_check_free_space(0, file_size)) != 0)
         return err;
 
-    if (enough_free_space(file_size)) {
-        /* enough free space, use normal forward copy */
-        return copy_stream_forward(in_fd, out_fd, source, target);
+    /*
+     * files being copied forward by other threads will need their free space too:
+     * reserve it, so that all files copied forward at the same time fit.
+     */
+    lock();
+    bool forward = enough_free_space(bytes_reserved + file_size);
+    if (forward && this_jobs > 1)
+        bytes_reserved += file_size;
+    unlock();
+
+    if (forward) {
+        /*
+         * enough free space, use normal forward copy.
+         * files without holes can be copied inside the kernel: there are no holes to recreate,
+         * and zeroed blocks already use as much space in source as they will in target
+         */
+        if ((ft_uoff)stat.st_blocks * 512 >= (ft_uoff)file_size)
+            err = copy_stream_kernel(in_fd, out_fd, file_size, source, target);
+        else
+            /* sparse file: skip its holes without reading them */
+            err = copy_stream_sparse(in_fd, out_fd, source, target);
+        if (err == EAGAIN)
+            err = copy_stream_forward(in_fd, out_fd, source, target);
+        if (this_jobs > 1) {
+            lock();
+            bytes_reserved -= file_size;
+            unlock();
+        }
+        return err;
     }
 
-    /* not enough free space, use backward copy + progressively truncate source file */
+    /* not enough free space, use forward copy + punch holes in source file */
+    if ((err = copy_stream_punch(in_fd, out_fd, stat, source, target)) != EAGAIN)
+        return err;
+
+    /* cannot punch holes, use backward copy + progressively truncate source file */
     double pretty_size = 0.0;
     const char *pretty_label = ff_pretty_size((ft_uoff)file_size, &pretty_size);
     ff_log(FC_INFO, 0,
@@ -624,7 +1123,18 @@ int fm_io_posix::copy_stream(int in_fd, int out_fd, const ft_stat &stat, const c
 
     ft_off offset_high = file_size, offset_low;
 
-    if ((err = fd_truncate(out_fd, offset_high, target)) != 0)
+    /* sparse file: list its data segments, to skip its holes without reading them */
+    fm_data_segments segments;
+    bool sparse = (ft_uoff)stat.st_blocks * 512 < (ft_uoff)file_size;
+    if (sparse && (err = data_segments(in_fd, source, segments)) != 0) {
+        if (err != EAGAIN)
+            return err;
+        sparse = false;
+    }
+    if (sparse)
+        offset_high = ff_skip_holes_backward(segments, offset_high);
+
+    if ((err = fd_truncate(out_fd, file_size, target)) != 0)
         return err;
 
     // slow, but on Linux not doing it is worse:
@@ -635,7 +1145,6 @@ int fm_io_posix::copy_stream(int in_fd, int out_fd, const ft_stat &stat, const c
     char buf[FT_BUFSIZE];
 
     ft_size expected, got;
-    ft_size hole_len, nonhole_len, tosend_offset, tosend_left;
     while (offset_high > 0) {
         /** truncate in_fd, discarding any data that we already copied */
         if ((err = fd_truncate(in_fd, offset_high, source)) != 0)
@@ -658,32 +1167,11 @@ int fm_io_posix::copy_stream(int in_fd, int out_fd, const ft_stat &stat, const c
             break;
         }
 
-        tosend_offset = 0;
-        for (tosend_left = got; tosend_left != 0;) {
-            /* detect hole */
-            if ((hole_len = hole_length(buf + tosend_offset, tosend_left)) != 0) {
-                /* re-create hole in target file */
-                if (::lseek(out_fd, (ft_off)hole_len, SEEK_CUR) == (ft_off)-1) {
-                    err = ff_log(FC_ERROR, errno,
-                                 "error seeking %" FT_ULL " bytes forward in file `%s'",
-                                 (ft_ull)hole_len, target);
-                    break;
-                }
-                tosend_offset += hole_len;
-                tosend_left -= hole_len;
-            }
-
-            if ((nonhole_len = nonhole_length(buf + tosend_offset, tosend_left)) != 0) {
-                // copy the non-hole data
-                if ((err = this->full_write(out_fd, buf + tosend_offset, nonhole_len, target)) != 0)
-                    break;
-                tosend_offset += nonhole_len;
-                tosend_left -= nonhole_len;
-            }
-        }
-        if (err != 0)
+        if ((err = write_skip_holes(out_fd, buf, got, target)) != 0)
             break;
         offset_high = offset_low;
+        if (sparse)
+            offset_high = ff_skip_holes_backward(segments, offset_high);
     }
     if (err != 0 && offset_high != 0 && offset_high != file_size) {
         ff_log(FC_ERROR, 0, "DANGER! due to previous error, copying `%s' -> `%s' was aborted",
@@ -701,44 +1189,185 @@ int fm_io_posix::copy_stream(int in_fd, int out_fd, const ft_stat &stat, const c
     return err;
 }
 
+/**
+ * forward copy file contents from in_fd to out_fd in chunks as large as free space allows,
+ * and punch holes in in_fd after each chunk is copied, to conserve space.
+ * returns EAGAIN (unreported) if the file-system cannot punch holes in in_fd,
+ * else 0 for success or error
+ */
+int fm_io_posix::copy_stream_punch(int in_fd, int out_fd, const ft_stat &stat, const char *source,
+                                   const char *target) {
+#if defined(FT_HAVE_FALLOCATE) && defined(FALLOC_FL_PUNCH_HOLE) && defined(FALLOC_FL_KEEP_SIZE)
+    const int punch_mode = FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE;
+    ft_off file_size = stat.st_size;
+    int err = 0;
+
+    /* check that in_fd supports punching holes: past end-of-file, nothing is discarded */
+    if (::fallocate(in_fd, punch_mode, file_size, APPROX_BLOCK_SIZE) != 0) {
+        if (errno == EOPNOTSUPP || errno == ENOSYS)
+            return EAGAIN;
+        return ff_log(FC_ERROR, errno, "error punching holes in file `%s'", source);
+    }
+
+    double pretty_size = 0.0;
+    const char *pretty_label = ff_pretty_size((ft_uoff)file_size, &pretty_size);
+    ff_log(FC_INFO, 0,
+           "using forward copy and punch holes for file `%s': less than %.2f %sbytes free space left",
+           target, pretty_size, pretty_label);
+
+    /* sparse file: list its data segments, to skip its holes without reading them */
+    fm_data_segments segments;
+    if ((ft_uoff)stat.st_blocks * 512 >= (ft_uoff)file_size ||
+        (err = data_segments(in_fd, source, segments)) == EAGAIN) {
+        segments.clear();
+        segments.push_back(std::make_pair((ft_off)0, file_size));
+        err = 0;
+    }
+    if (err != 0)
+        return err;
+
+    // slow, but on Linux not doing it is worse:
+    // you can get inaccurate disk usage statistics
+    // and (if loop device becomes full) silent I/O errors!
+    sync();
+
+    std::vector<char> buf(FT_PUNCH_BUFSIZE);
+    /* everything before 'punched' was copied to out_fd, then punched from in_fd */
+    ft_off offset, chunk, chunk_end, punched = 0;
+    ft_size expected, got;
+
+    fm_data_segments::const_iterator iter = segments.begin(), end = segments.end();
+    for (; err == 0 && iter != end; ++iter) {
+        for (offset = iter->first; offset < iter->second; offset = chunk_end) {
+            /* chunks are aligned to their size, except at segments boundaries */
+            chunk = punch_chunk_size();
+            chunk_end = ff_min2((offset & ~(chunk - 1)) + chunk, iter->second);
+
+            if ((err = fd_seek2(in_fd, out_fd, offset, source, target)) != 0)
+                break;
+
+            for (ft_off pos = offset; pos < chunk_end; pos += (ft_off)got) {
+                got = expected = (ft_size)ff_min2(chunk_end - pos, (ft_off)FT_PUNCH_BUFSIZE);
+                if ((err = this->full_read(in_fd, &buf[0], got, source)) != 0 || got != expected) {
+                    if (err == 0) {
+                        ff_log(FC_ERROR, 0,
+                               "error reading from `%s': expected %" FT_ULL " bytes, got %" FT_ULL " bytes",
+                               source, (ft_ull)expected, (ft_ull)got);
+                        err = -EIO;
+                    }
+                    break;
+                }
+                if ((err = write_skip_holes(out_fd, &buf[0], got, target)) != 0)
+                    break;
+            }
+            if (err != 0)
+                break;
+
+            /* copied data must reach the disk before the source data is discarded */
+            sync();
+            if (::fallocate(in_fd, punch_mode, offset, chunk_end - offset) != 0) {
+                err = ff_log(FC_ERROR, errno,
+                             "error punching hole at %" FT_ULL " bytes, length %" FT_ULL " bytes in file `%s'",
+                             (ft_ull)offset, (ft_ull)(chunk_end - offset), source);
+                break;
+            }
+            lock();
+            bytes_freed_since_last_check += (ft_uoff)(chunk_end - offset);
+            unlock();
+            punched = chunk_end;
+        }
+    }
+    /* file may end with a hole: set target length from source length */
+    if (err == 0)
+        err = fd_truncate(out_fd, file_size, target);
+
+    if (err != 0 && punched != 0) {
+        ff_log(FC_ERROR, 0, "DANGER! due to previous error, copying `%s' -> `%s' was aborted",
+               source, target);
+        ff_log(FC_ERROR, 0, "        and BOTH copies of this file are now incomplete.");
+        ff_log(FC_ERROR, 0, "        To recover this file, execute the following command");
+        ff_log(FC_ERROR, 0, "        AFTER freeing enough space in the source device:");
+
+        punched = (punched + FT_BUFSIZE_m1) >> FT_LOG_BUFSIZE;
+        ff_log(FC_ERROR, 0,
+               "          /bin/dd bs=%" FT_ULL " count=%" FT_ULL " conv=notrunc if=\"%s\" of=\"%s\"",
+               (ft_ull)FT_BUFSIZE, (ft_ull)punched, target, source);
+    }
+    return err;
+#else
+    (void) in_fd;
+    (void) out_fd;
+    (void) stat;
+    (void) source;
+    (void) target;
+    return EAGAIN;
+#endif
+}
+
+/**
+ * return how many bytes copy_stream_punch() should copy before punching them from source:
+ * the largest power of two between FT_BUFSIZE and FT_PUNCH_CHUNK_MAX that fits free space
+ */
+ft_off fm_io_posix::punch_chunk_size() {
+    ft_off chunk = FT_PUNCH_CHUNK_MAX;
+    lock();
+    while (chunk > FT_BUFSIZE && !enough_free_space(bytes_reserved + (ft_uoff)chunk))
+        chunk >>= 1;
+    unlock();
+    return chunk;
+}
+
+/**
+ * write 'len' bytes from 'buf' to out_fd at its current position,
+ * skipping zeroed blocks to re-create holes in target file.
+ * a final fragment shorter than APPROX_BLOCK_SIZE is always written
+ */
+int fm_io_posix::write_skip_holes(int out_fd, const char *buf, ft_size len, const char *target) {
+    ft_size run_len;
+    bool is_hole;
+    int err = 0;
+    for (; len != 0; buf += run_len, len -= run_len) {
+        /* detect hole */
+        run_len = ff_mem_zero_run(buf, len, APPROX_BLOCK_SIZE, is_hole);
+        if (is_hole) {
+            /* re-create hole in target file */
+            if (::lseek(out_fd, (ft_off)run_len, SEEK_CUR) == (ft_off)-1) {
+                err = ff_log(FC_ERROR, errno,
+                             "error seeking %" FT_ULL " bytes forward in file `%s'",
+                             (ft_ull)run_len, target);
+                break;
+            }
+        } else {
+            // copy the non-hole data
+            if ((err = this->full_write(out_fd, buf, run_len, target)) != 0)
+                break;
+        }
+    }
+    return err;
+}
+
 /**
  * forward copy file/stream contents from in_fd to out_fd.
+ * copies 'length' bytes, or until end-of-file if length is negative
  */
 int fm_io_posix::copy_stream_forward(int in_fd, int out_fd, const char *source,
-                                     const char *target) {
+                                     const char *target, ft_off length) {
     char buf[FT_BUFSIZE];
 
     ft_size present = 0, present_aligned, got;
-    ft_size hole_len, nonhole_len, tosend_offset, tosend_left;
     int err = 0;
     for (;;) {
         got = FT_BUFSIZE - present;
-        if ((err = this->full_read(in_fd, buf + present, got, source)) != 0 || got == 0)
+        if (length >= 0 && (ft_off)got > length)
+            got = (ft_size)length;
+        if (got == 0 || (err = this->full_read(in_fd, buf + present, got, source)) != 0 || got == 0)
             break;
+        if (length >= 0)
+            length -= (ft_off)got;
 
-        tosend_left = present_aligned = (present += got) / APPROX_BLOCK_SIZE * APPROX_BLOCK_SIZE;
-
-        for (tosend_offset = 0; tosend_left != 0;) {
-            /* detect hole */
-            if ((hole_len = hole_length(buf + tosend_offset, tosend_left)) != 0) {
-                /* re-create hole in target file */
-                if (::lseek(out_fd, (ft_off)hole_len, SEEK_CUR) == (ft_off)-1) {
-                    err = ff_log(FC_ERROR, errno, "error seeking in file `%s'", target);
-                    break;
-                }
-                tosend_offset += hole_len;
-                tosend_left -= hole_len;
-            }
+        present_aligned = (present += got) / APPROX_BLOCK_SIZE * APPROX_BLOCK_SIZE;
 
-            if ((nonhole_len = nonhole_length(buf + tosend_offset, tosend_left)) != 0) {
-                // copy the non-hole data
-                if ((err = this->full_write(out_fd, buf + tosend_offset, nonhole_len, target)) != 0)
-                    break;
-                tosend_offset += nonhole_len;
-                tosend_left -= nonhole_len;
-            }
-        }
-        if (err != 0)
+        if ((err = write_skip_holes(out_fd, buf, present_aligned, target)) != 0)
             break;
 
         if (present_aligned != 0 && present > present_aligned)
@@ -771,6 +1400,162 @@ int fm_io_posix::copy_stream_forward(int in_fd, int out_fd, const char *source,
     return err;
 }
 
+/**
+ * forward copy file contents from in_fd to out_fd, only reading and writing its data segments
+ * and recreating the holes between them.
+ * returns EAGAIN (unreported) if the file-system cannot list data segments,
+ * else 0 for success or error
+ */
+int fm_io_posix::copy_stream_sparse(int in_fd, int out_fd, const char *source,
+                                    const char *target) {
+    fm_data_segments segments;
+    int err = data_segments(in_fd, source, segments);
+    if (err != 0)
+        return err;
+
+    fm_data_segments::const_iterator iter = segments.begin(), end = segments.end();
+    for (; err == 0 && iter != end; ++iter) {
+        if ((err = fd_seek2(in_fd, out_fd, iter->first, source, target)) == 0)
+            err = copy_stream_forward(in_fd, out_fd, source, target, iter->second - iter->first);
+    }
+    if (err == 0) {
+        /* file may end with a hole: set target length from source length */
+        ft_off file_size = ::lseek(in_fd, 0, SEEK_END);
+        if (file_size == (ft_off)-1)
+            err = ff_log(FC_ERROR, errno, "error seeking to end of file `%s'", source);
+        else
+            err = fd_truncate(out_fd, file_size, target);
+    }
+    return err;
+}
+
+/**
+ * list the data segments of file 'fd' with lseek(SEEK_DATA) and lseek(SEEK_HOLE).
+ * returns EAGAIN (unreported) if the file-system cannot list data segments,
+ * else 0 for success or error
+ */
+int fm_io_posix::data_segments(int fd, const char *path, fm_data_segments &segments) {
+    segments.clear();
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    ft_off data, hole = 0;
+    for (;;) {
+        if ((data = ::lseek(fd, hole, SEEK_DATA)) == (ft_off)-1) {
+            if (errno == ENXIO)
+                /* no data after 'hole' */
+                break;
+            if (hole == 0 && (errno == EINVAL || errno == EOPNOTSUPP))
+                return EAGAIN;
+            return ff_log(FC_ERROR, errno, "error seeking to data after position %" FT_ULL " of file `%s'",
+                          (ft_ull)hole, path);
+        }
+        if ((hole = ::lseek(fd, data, SEEK_HOLE)) == (ft_off)-1)
+            return ff_log(FC_ERROR, errno, "error seeking to hole after position %" FT_ULL " of file `%s'",
+                          (ft_ull)data, path);
+        if (hole <= data)
+            /* file was truncated meanwhile */
+            break;
+        segments.push_back(std::make_pair(data, hole));
+    }
+    return 0;
+#else
+    (void) fd;
+    (void) path;
+    return EAGAIN;
+#endif
+}
+
+/**
+ * forward copy file contents from in_fd to out_fd inside the kernel,
+ * with copy_file_range() or sendfile(). file_size is only a hint.
+ * zeroed blocks are copied, not turned into holes: only use it for files without holes.
+ * returns EAGAIN (unreported) if the kernel cannot copy these files and nothing was copied,
+ * else 0 for success or error
+ */
+int fm_io_posix::copy_stream_kernel(int in_fd, int out_fd, ft_off file_size, const char *source,
+                                    const char *target) {
+    const bool tracing = trace().is_open();
+    ft_off offset = 0;
+    ft_size len;
+    double start = 0.0;
+    ssize_t got;
+    int err = 0;
+
+    lock();
+    fm_kernel_copy method = this_kernel_copy;
+    unlock();
+
+    while (method != FC_READ_WRITE) {
+        /* copy until end-of-file, even if file grew since stat() */
+        len = FT_KERNEL_COPYSIZE;
+        if (file_size > offset)
+            len = (ft_size)ff_min2(file_size - offset, (ft_off)FT_KERNEL_COPYSIZE);
+
+        if (tracing)
+            start = trace().now();
+
+        got = -1;
+        errno = ENOSYS;
+#ifdef FT_HAVE_COPY_FILE_RANGE
+        if (method == FC_COPY_FILE_RANGE) {
+            loff_t in_offset = offset, out_offset = offset;
+            got = ::copy_file_range(in_fd, &in_offset, out_fd, &out_offset, len, 0);
+        }
+#endif
+#ifdef FT_HAVE_SENDFILE
+        if (method == FC_SENDFILE) {
+            /* sendfile() writes at the current position of out_fd, which is 'offset' */
+            off_t in_offset = offset;
+            got = ::sendfile(out_fd, in_fd, &in_offset, len);
+        }
+#endif
+        if (got == -1 && errno == EINTR)
+            continue;
+
+        if (got == 0)
+            /*
+             * end-of-file. if nothing was copied, file is empty
+             * or some file-system wrongly reports 0 bytes: let caller retry in user space
+             */
+            break;
+
+        if (got == -1) {
+            if (offset != 0 || (errno != ENOSYS && errno != EXDEV && errno != EINVAL && errno != EOPNOTSUPP)) {
+                err = ff_log(FC_ERROR, errno, "error copying from `%s' to `%s'", source, target);
+                break;
+            }
+            /* nothing copied yet, and the kernel cannot copy these files: try next method */
+            const char *label = method == FC_COPY_FILE_RANGE ? "copy_file_range()" : "sendfile()";
+            method = method == FC_COPY_FILE_RANGE ? FC_SENDFILE : FC_READ_WRITE;
+            lock();
+            if (this_kernel_copy < method) {
+                this_kernel_copy = method;
+                ff_log(FC_DEBUG, errno, "%s failed, falling back", label);
+            }
+            unlock();
+            continue;
+        }
+
+        if (tracing) {
+            trace_io(FC_TRACE_READ, in_fd, offset, (ft_size)got, start);
+            trace_io(FC_TRACE_WRITE, out_fd, offset, (ft_size)got, start);
+        }
+        /*
+         * one read and one write. charged after the copy, with the bytes actually copied:
+         * the final call detecting end-of-file copies nothing, and costs nothing
+         */
+        throttle_io((ft_uoff)got);
+        throttle_io((ft_uoff)got);
+        offset += (ft_off)got;
+
+        if ((err = this->periodic_check_free_space((ft_uoff)got)) != 0)
+            break;
+    }
+    if (err == 0 && offset == 0)
+        /* nothing copied: let copy_stream_forward() handle it, including empty files */
+        err = EAGAIN;
+    return err;
+}
+
 /**
  * truncate file pointed by descriptor to specified length
  */
@@ -804,41 +1589,17 @@ int fm_io_posix::fd_seek(int fd, ft_off offset, const char *path) {
 }
 
 /**
- * scan memory for blocksize-length and blocksize-aligned sections full of zeroes
- * return length of zeroed area at the beginning of scanned memory.
- * returned length is rounded down to block_size
- */
-size_t fm_io_posix::hole_length(const char *mem, ft_size mem_len) {
-    size_t len = 0;
-    /* blocks smaller than APPROX_BLOCK_SIZE are always considered non-hole */
-    mem_len = (mem_len / APPROX_BLOCK_SIZE) * APPROX_BLOCK_SIZE;
-    for (; len < mem_len; len++)
-        if (mem[len] != '\0')
-            break;
-    return (len / APPROX_BLOCK_SIZE) * APPROX_BLOCK_SIZE;
-}
-
-/**
- * scan memory for blocksize-length and blocksize-aligned sections NOT full of zeroes
- * return length of NON-zeroed area at the beginning of scanned memory.
- * returned length is rounded UP to block_size if it fits mem_len
+ * charge a read() or write() of 'length' bytes to the I/O throttle, and wait as needed.
+ * never waits while holding this_lock
  */
-size_t fm_io_posix::nonhole_length(const char *mem, ft_size mem_len) {
-    size_t hole_len, offset = 0;
-
-    while (mem_len >= APPROX_BLOCK_SIZE &&
-           (hole_len = hole_length(mem + offset, APPROX_BLOCK_SIZE)) == 0) {
-        offset += APPROX_BLOCK_SIZE;
-        mem_len -= APPROX_BLOCK_SIZE;
-    }
-    /*
-     * blocks smaller than APPROX_BLOCK_SIZE,
-     * or final fragments smaller than APPROX_BLOCK_SIZE,
-     * are always considered non-hole
-     */
-    if (mem_len < APPROX_BLOCK_SIZE)
-        offset += mem_len;
-    return offset;
+void fm_io_posix::throttle_io(ft_uoff length) {
+    if (!throttle().enabled())
+        return;
+    lock();
+    double wait = throttle().charge(length);
+    unlock();
+    if (wait > 0.0)
+        (void) ff_sleep(wait);
 }
 
 /**
@@ -848,16 +1609,27 @@ size_t fm_io_posix::nonhole_length(const char *mem, ft_size mem_len) {
  */
 int fm_io_posix::full_read(int in_fd, char *data, ft_size &len, const char *source_path) {
     ft_size got, left = len;
+    const bool tracing = trace().is_open();
+    ft_off offset = 0;
+    double start = 0.0;
     int err = 0;
     while (left) {
-        while ((got = ::read(in_fd, data, len)) == (ft_size)-1 && errno == EINTR)
+        if (tracing) {
+            offset = ::lseek(in_fd, 0, SEEK_CUR);
+            start = trace().now();
+        }
+        while ((got = ::read(in_fd, data, left)) == (ft_size)-1 && errno == EINTR)
             ;
+        if (tracing && got != (ft_size)-1)
+            trace_io(FC_TRACE_READ, in_fd, offset, got, start);
         if (got == 0 || got == (ft_size)-1) {
             if (got != 0)
                 err = ff_log(FC_ERROR, errno, "error reading from `%s'", source_path);
             // else got == 0: end-of-file
             break;
         }
+        /* charge only the bytes actually read */
+        throttle_io(got);
         left -= got;
         data += got;
     }
@@ -871,14 +1643,25 @@ int fm_io_posix::full_read(int in_fd, char *data, ft_size &len, const char *sour
  */
 int fm_io_posix::full_write(int out_fd, const char *data, ft_size len, const char *target_path) {
     ft_size chunk;
+    const bool tracing = trace().is_open();
+    ft_off offset = 0;
+    double start = 0.0;
     int err = 0;
     while (len) {
+        if (tracing) {
+            offset = ::lseek(out_fd, 0, SEEK_CUR);
+            start = trace().now();
+        }
         while ((chunk = ::write(out_fd, data, len)) == (ft_size)-1 && errno == EINTR)
             ;
+        if (tracing && chunk != (ft_size)-1)
+            trace_io(FC_TRACE_WRITE, out_fd, offset, chunk, start);
         if (chunk == 0 || chunk == (ft_size)-1) {
             err = ff_log(FC_ERROR, errno, "error writing to `%s'", target_path);
             break;
         }
+        /* charge only the bytes actually written */
+        throttle_io(chunk);
         data += chunk;
         len -= chunk;
 
@@ -889,9 +1672,25 @@ int fm_io_posix::full_write(int out_fd, const char *data, ft_size len, const cha
 }
 
 /**
- * copy the permission bits, owner/group and timestamps from 'stat' to 'target'
+ * record into I/O trace a read() or write() of 'len' bytes on 'fd', started at time 'start'.
+ * 'offset' is the file position before the system call
+ */
+void fm_io_posix::trace_io(ft_trace_op_type type, int fd, ft_off offset, ft_size len, double start) {
+    double end = trace().now();
+    ft_stat st;
+    /* files are identified by inode number: source and target inodes are told apart by 'type' */
+    if (offset == (ft_off)-1 || ::fstat(fd, &st) != 0)
+        return;
+    lock();
+    trace().record(type, 0, (ft_uoff)st.st_ino, (ft_uoff)offset, (ft_uoff)len, start, end);
+    unlock();
+}
+
+/**
+ * copy the permission bits, owner/group and timestamps from 'stat' to the target 'at',
+ * whose full path is 'target'
  */
-int fm_io_posix::copy_stat(const char *target, const ft_stat &stat) {
+int fm_io_posix::copy_stat(const fm_io_posix_at &at, const char *target, const ft_stat &stat) {
     int err = 0;
     if (simulate_run())
         return err;
@@ -901,11 +1700,11 @@ int fm_io_posix::copy_stat(const char *target, const ft_stat &stat) {
                                                     : "special device";
 
     /* copy timestamps */
-#if defined(FT_HAVE_UTIMENSAT) && defined(AT_FDCWD) && defined(AT_SYMLINK_NOFOLLOW)
     do {
         struct timespec time_buf[2];
         time_buf[0].tv_sec = stat.st_atime;
         time_buf[1].tv_sec = stat.st_mtime;
+        time_buf[0].tv_nsec = time_buf[1].tv_nsec = 0;
 #if defined(FT_HAVE_STRUCT_STAT_ST_ATIM_TV_NSEC)
         time_buf[0].tv_nsec = stat.st_atim.tv_nsec;
 #elif defined(FT_HAVE_STRUCT_STAT_ST_ATIMENSEC)
@@ -917,24 +1716,10 @@ int fm_io_posix::copy_stat(const char *target, const ft_stat &stat) {
 #elif defined(FT_HAVE_STRUCT_STAT_ST_MTIMENSEC)
         time_buf[1].tv_nsec = stat.st_mtimensec;
 #endif
-        if (utimensat(AT_FDCWD, target, time_buf, AT_SYMLINK_NOFOLLOW) != 0)
+        if (utimensat(at.target_dir_fd, at.target_name, time_buf, AT_SYMLINK_NOFOLLOW) != 0)
             ff_log(FC_WARN, errno, "cannot change timestamps on %s `%s'", label, target);
 
     } while (0);
-#elif defined(FT_HAVE_UTIMES)
-    /* utimes() does not work on symbolic links */
-    if (!fm_io_posix_is_symlink(stat)) {
-        struct timeval time_buf[2];
-        time_buf[0].tv_sec = stat.st_atime;
-        time_buf[1].tv_sec = stat.st_mtime;
-        time_buf[0].tv_usec = time_buf[1].tv_usec = 0;
-
-        if (utimes(target, time_buf) != 0)
-            ff_log(FC_WARN, errno, "cannot change timestamps on %s `%s'", label, target);
-    }
-#else
-#warning utimensat() and utimes() are both missing. fsmove will not be able to set timestamps of copied files/directories
-#endif
 
     do {
         bool is_error = !force_run();
@@ -942,13 +1727,8 @@ int fm_io_posix::copy_stat(const char *target, const ft_stat &stat) {
         const char *fail_label = is_error ? "failed to" : "cannot";
 
         /* copy owner and group. this resets any SUID bits */
-
-#if defined(FT_HAVE_LCHOWN)
-        if (lchown(target, stat.st_uid, stat.st_gid) != 0)
-#else
-        if (!is_symlink && chown(target, stat.st_uid, stat.st_gid) != 0)
-#endif
-        {
+        if (fchownat(at.target_dir_fd, at.target_name, stat.st_uid, stat.st_gid,
+                     AT_SYMLINK_NOFOLLOW) != 0) {
             err = ff_log(is_error ? FC_ERROR : FC_WARN, errno,
                          "%s set owner=%" FT_ULL " and group=%" FT_ULL " on %s `%s'", fail_label,
                          (ft_ull)stat.st_uid, (ft_ull)stat.st_gid, label, target);
@@ -961,7 +1741,7 @@ int fm_io_posix::copy_stat(const char *target, const ft_stat &stat) {
          * 1. chmod() on a symbolic link has no sense, don't to it
          * 2. chmod() must be performed AFTER lchown(), because lchown() resets any SUID bits
          */
-        if (!is_symlink && chmod(target, stat.st_mode) != 0) {
+        if (!is_symlink && fchmodat(at.target_dir_fd, at.target_name, stat.st_mode, 0) != 0) {
             err = ff_log(is_error ? FC_ERROR : FC_WARN, errno,
                          "%s change mode to 0%" FT_OLL " on %s `%s'", fail_label,
                          (ft_ull)stat.st_mode, label, target);
@@ -990,8 +1770,8 @@ bool fm_io_posix::is_target_lost_found(const ft_string &path) const {
     return path == target_root() + "/lost+found";
 }
 
-/** create a target directory, copying its mode and other meta-data from 'stat' */
-int fm_io_posix::create_dir(const ft_string &path) {
+/** create the target directory 'at', whose full path is 'path' */
+int fm_io_posix::create_dir(const fm_io_posix_at &at, const ft_string &path) {
     const char *dir = path.c_str();
     int err = 0;
     ff_log(FC_TRACE, 0, "create_dir()   `%s'", dir);
@@ -999,7 +1779,7 @@ int fm_io_posix::create_dir(const ft_string &path) {
     do {
         if (simulate_run())
             break;
-        if (::mkdir(dir, 0700) == 0)
+        if (mkdirat(at.target_dir_fd, at.target_name, 0700) == 0)
             break;
 
         /* if creating target root, ignore EEXIST error: target root is allowed to exist already */
@@ -1023,7 +1803,7 @@ int fm_io_posix::create_dir(const ft_string &path) {
  * remove a source directory.
  * exception: we do not delete 'lost+found' directory inside source_root()
  */
-int fm_io_posix::remove_dir(const ft_string &path) {
+int fm_io_posix::remove_dir(const fm_io_posix_at &at, const ft_string &path) {
     const char *dir = path.c_str();
     int err = 0;
     ff_log(FC_TRACE, 0, "remove_dir()   `%s'", dir);
@@ -1031,7 +1811,7 @@ int fm_io_posix::remove_dir(const ft_string &path) {
         if (simulate_run() || is_source_lost_found(path))
             break;
 
-        if (::remove(dir) != 0) {
+        if (unlinkat(at.source_dir_fd, at.source_name, AT_REMOVEDIR) != 0) {
             /* ignore error if we are removing source root: it is allowed to be in use */
             if (path != source_root()) {
                 /* if force_run(), failure to remove a source directory is just a warning */
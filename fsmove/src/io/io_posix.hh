@@ -27,10 +27,36 @@
 #define FSMOVE_IO_IO_POSIX_HH
 
 #include "../types.hh" // for ft_string */
+#include "../args.hh"  // for fm_order_kind */
 #include "io.hh"       // for fm_io */
+#include "move_pool.hh" // for fm_move_pool, fm_move_task, FT_HAVE_FM_IO_MOVE_POOL
+#include "uring_batch.hh" // for fm_uring_batch, FT_HAVE_FM_IO_URING_BATCH
+
+#include <set>         // for std::set
+#include <utility>     // for std::pair
+#include <vector>      // for std::vector
 
 FT_IO_NAMESPACE_BEGIN
 
+class ft_io_posix_dir;
+
+/**
+ * location of a source and a target file/directory/special-device,
+ * relative to the descriptors of the directories containing them. passed to the *at() system calls
+ */
+struct fm_io_posix_at {
+    int source_dir_fd, target_dir_fd;
+    const char *source_name, *target_name;
+
+    /**
+     * constructor. 'source_parent_fd' and 'target_parent_fd' are the descriptors of the directories
+     * containing 'source_path' and 'target_path', or -1 if not available: then use AT_FDCWD and full paths.
+     * the paths must not be modified or destroyed while this fm_io_posix_at is in use
+     */
+    fm_io_posix_at(int source_parent_fd, const ft_string &source_path, int target_parent_fd,
+                   const ft_string &target_path);
+};
+
 /**
  * class performing I/O on POSIX systems
  */
@@ -38,8 +64,76 @@ class fm_io_posix : public fm_io {
   private:
     typedef fm_io super_type;
 
+    /** data segments of a sparse file: pairs (start, end) of byte offsets, in increasing order */
+    typedef std::vector<std::pair<ft_off, ft_off> > fm_data_segments;
+
+    /**
+     * an entry of a source directory, and the key to sort it: see read_dir_sorted().
+     * entries without a known extent come first, sorted by inode number,
+     * then entries sorted by the position on disk of their first extent
+     */
+    struct fm_dir_entry {
+        ft_string name;
+        ft_uoff key;
+        bool has_extent;
+
+        FT_INLINE bool operator<(const fm_dir_entry &other) const {
+            return has_extent != other.has_extent ? !has_extent : key < other.key;
+        }
+    };
+    typedef std::vector<fm_dir_entry> fm_dir_entries;
+
+    /** bytes written to target since last check_free_space() */
     ft_uoff bytes_copied_since_last_check;
 
+    /** bytes freed in source by removing files since last check_free_space() */
+    ft_uoff bytes_freed_since_last_check;
+
+    /** descriptors of source_root() and target_root(), used by syncfs(). -1 if not open */
+    int this_source_fd, this_target_fd;
+
+    /** true if source_root() and target_root() are on the same file-system */
+    bool this_same_fs;
+
+    /** sum of the sizes of files being copied forward by other threads. 0 unless this_jobs > 1 */
+    ft_uoff bytes_reserved;
+
+    /** number of threads moving files in parallel. 1 means recursive, single-threaded move */
+    ft_size this_jobs;
+
+    /** order to move the entries of each directory. if this_jobs == 1, downgraded to FC_ORDER_INODE if FIEMAP is not supported */
+    fm_order_kind this_order;
+
+    /** how copy_stream_kernel() copies data. downgraded the first time the kernel refuses a method */
+    enum fm_kernel_copy { FC_COPY_FILE_RANGE, FC_SENDFILE, FC_READ_WRITE };
+    fm_kernel_copy this_kernel_copy;
+
+#ifdef FT_HAVE_FM_IO_MOVE_POOL
+    friend class fm_move_pool;
+
+    /**
+     * if this_jobs > 1, protects the state shared among threads:
+     * free space accounting, work done, throttle, trace and inode_cache
+     */
+    pthread_mutex_t this_lock;
+
+    /** signalled when an inode is removed from this_inodes_pending */
+    pthread_cond_t this_inode_cond;
+
+    /**
+     * inodes added to inode_cache whose first link is still being created by some thread:
+     * hard links to them must wait until it exists. protected by this_lock
+     */
+    std::set<ft_inode> this_inodes_pending;
+#endif
+
+#ifdef FT_HAVE_FM_IO_URING_BATCH
+    friend class fm_uring_batch;
+
+    /** copies small files in batches. NULL if not available, or if this_jobs > 1 */
+    fm_uring_batch *this_uring;
+#endif
+
     enum {
         /**
          * APPROX_BLOCK_SIZE is an approximated block size, only used for tuning creation of holes.
@@ -60,12 +154,24 @@ class fm_io_posix : public fm_io {
      */
     bool enough_free_space(ft_uoff bytes_to_write = 0, bool first_check = false);
 
+    /**
+     * return the estimated free space above the 'critically low' threshold of 'disk_stat',
+     * adding 'bytes_freed' to the free space measured by last check_free_space()
+     */
+    static ft_uoff free_space_margin(const fm_disk_stat &disk_stat, ft_uoff bytes_freed);
+
     /**
      * call sync(), then call disk_stat() twice: one time on source_root() and another on
      * target_root(). return error if statvfs() fails or if free disk space becomes critically low
      */
     int check_free_space();
 
+    /** open source_root() and target_root() for syncfs(), and check if they are on the same file-system */
+    void open_roots();
+
+    /** close the descriptors opened by open_roots() */
+    void close_roots();
+
     /**
      * fill 'disk_stat' with information about the file-system containing 'path'.
      * return error if statvfs() fails or if free disk space becomes critically low
@@ -79,14 +185,83 @@ class fm_io_posix : public fm_io {
     void try_to_make_free_space(const char *path);
 
     /**
-     * fill 'stat' with information about the file/directory/special-device 'path'
+     * fill 'stat' with information about the source file/directory/special-device 'at',
+     * whose full path is 'path'
      */
-    int stat(const ft_string &path, ft_stat &stat);
+    int stat(const fm_io_posix_at &at, const ft_string &path, ft_stat &stat);
 
     /**
      * move a single file/socket/device or a whole directory tree
      */
-    int move(const ft_string &source_path, const ft_string &target_path);
+    int move(const fm_io_posix_at &at, const ft_string &source_path, const ft_string &target_path);
+
+    /**
+     * read all the entries of 'dir' except "." and "..", and sort them in this_order.
+     * 'path' is only used for error messages
+     */
+    int read_dir_sorted(ft_io_posix_dir &dir, const ft_string &path, fm_dir_entries &entries);
+
+    /**
+     * store in 'key' the position on disk of the first extent of regular file 'name' inside directory 'dir_fd'.
+     * returns ENODATA (unreported) if the file has no extents, EOPNOTSUPP (unreported)
+     * if the file-system does not support FIEMAP, else 0 for success or error (unreported)
+     */
+    static int first_extent(int dir_fd, const char *name, ft_uoff &key);
+
+    /**
+     * copy the permission bits, owner/group and timestamps to the target directory 'target_path'
+     * and remove the source directory 'source_path'. called after all their contents are moved
+     */
+    int finish_dir(const fm_io_posix_at &at, const ft_string &target_path, const ft_stat &stat,
+                   const ft_string &source_path);
+
+    /** if this_jobs > 1, lock this_lock */
+    FT_INLINE void lock() {
+#ifdef FT_HAVE_FM_IO_MOVE_POOL
+        if (this_jobs > 1)
+            (void) pthread_mutex_lock(&this_lock);
+#endif
+    }
+
+    /** if this_jobs > 1, unlock this_lock */
+    FT_INLINE void unlock() {
+#ifdef FT_HAVE_FM_IO_MOVE_POOL
+        if (this_jobs > 1)
+            (void) pthread_mutex_unlock(&this_lock);
+#endif
+    }
+
+    /**
+     * charge a read() or write() of 'length' bytes to the I/O throttle, and wait as needed.
+     * never waits while holding this_lock
+     */
+    void throttle_io(ft_uoff length);
+
+#ifdef FT_HAVE_FM_IO_MOVE_POOL
+    /**
+     * move a single file/socket/device, or create a directory and queue its contents into 'pool'.
+     * called by fm_move_pool from thread 'index'
+     */
+    int move_task(fm_move_pool &pool, ft_size index, fm_move_task *task);
+
+    /** call finish_dir() on directory 'task'. called by fm_move_pool after all its children are moved */
+    int finish_task(const fm_move_task *task);
+
+    /** return the location of 'task' relative to the descriptors of its parent directories */
+    static fm_io_posix_at task_at(const fm_move_task *task);
+#endif
+
+    /**
+     * copy the small files queued in this_uring. must be called before closing
+     * the directories containing them. returns 0 if success, else the first error
+     */
+    int flush_uring();
+
+    /**
+     * called after the first link of 'stat' was created in target:
+     * wake up the threads waiting in hard_link() to create more links to it
+     */
+    void release_inode(const ft_stat &stat);
 
     /**
      * try to rename a file, directory or special-device from 'source_path' to 'target_path'.
@@ -96,63 +271,93 @@ class fm_io_posix : public fm_io {
     /**
      * move the single regular file 'source_path' to 'target_path'.
      */
-    int move_file(const ft_string &source_path, const ft_stat &source_stat,
-                  const ft_string &target_path);
+    int move_file(const fm_io_posix_at &at, const ft_string &source_path,
+                  const ft_stat &source_stat, const ft_string &target_path);
 
     /**
      * move the single special-device 'source_path' to 'target_path'.
      */
-    int move_special(const ft_string &source_path, const ft_stat &source_stat,
-                     const ft_string &target_path);
-
-    /**
-     * move the single directory 'source_path' to 'target_path'.
-     */
-    int move_dir(const ft_string &source_path, const ft_stat &source_stat,
-                 const ft_string &target_path);
+    int move_special(const fm_io_posix_at &at, const ft_string &source_path,
+                     const ft_stat &source_stat, const ft_string &target_path);
 
     /**
      * forward or backward copy file/stream contents from in_fd to out_fd.
      *
-     * if disk space is low, we copy backward and progressively truncate in_fd to conserve space:
+     * if disk space is low, we copy forward and punch holes in in_fd to conserve space.
+     * if the file-system cannot punch holes, we copy backward and progressively truncate in_fd:
      * results in heavy fragmentation on target file, but at least we can continue
      */
     int copy_stream(int in_fd, int out_fd, const ft_stat &stat, const char *source,
                     const char *target);
 
+    /**
+     * forward copy file contents from in_fd to out_fd in chunks as large as free space allows,
+     * and punch holes in in_fd after each chunk is copied, to conserve space.
+     * returns EAGAIN (unreported) if the file-system cannot punch holes in in_fd,
+     * else 0 for success or error
+     */
+    int copy_stream_punch(int in_fd, int out_fd, const ft_stat &stat, const char *source,
+                          const char *target);
+
+    /**
+     * return how many bytes copy_stream_punch() should copy before punching them from source:
+     * the largest power of two between FT_BUFSIZE and FT_PUNCH_CHUNK_MAX that fits free space
+     */
+    ft_off punch_chunk_size();
+
+    /**
+     * write 'len' bytes from 'buf' to out_fd at its current position,
+     * skipping zeroed blocks to re-create holes in target file.
+     * a final fragment shorter than APPROX_BLOCK_SIZE is always written
+     */
+    int write_skip_holes(int out_fd, const char *buf, ft_size len, const char *target);
+
     /**
      * forward copy file/stream contents from in_fd to out_fd.
+     * copies 'length' bytes, or until end-of-file if length is negative
      */
-    int copy_stream_forward(int in_fd, int out_fd, const char *source, const char *target);
+    int copy_stream_forward(int in_fd, int out_fd, const char *source, const char *target,
+                            ft_off length = -1);
 
     /**
-     * truncate file pointed by descriptor to specified length
+     * forward copy file contents from in_fd to out_fd, only reading and writing its data segments
+     * and recreating the holes between them.
+     * returns EAGAIN (unreported) if the file-system cannot list data segments,
+     * else 0 for success or error
      */
-    int fd_truncate(int fd, ft_off length, const char *path);
+    int copy_stream_sparse(int in_fd, int out_fd, const char *source, const char *target);
 
     /**
-     * seek to specified position of file descriptor
+     * list the data segments of file 'fd' with lseek(SEEK_DATA) and lseek(SEEK_HOLE).
+     * returns EAGAIN (unreported) if the file-system cannot list data segments,
+     * else 0 for success or error
      */
-    int fd_seek(int fd, ft_off offset, const char *path);
+    int data_segments(int fd, const char *path, fm_data_segments &segments);
 
     /**
-     * seek to specified position of *both* file descriptors fd1 and fd2
+     * forward copy file contents from in_fd to out_fd inside the kernel,
+     * with copy_file_range() or sendfile(). file_size is only a hint.
+     * zeroed blocks are copied, not turned into holes: only use it for files without holes.
+     * returns EAGAIN (unreported) if the kernel cannot copy these files and nothing was copied,
+     * else 0 for success or error
      */
-    int fd_seek2(int fd1, int fd2, ft_off offset, const char *path1, const char *path2);
+    int copy_stream_kernel(int in_fd, int out_fd, ft_off file_size, const char *source,
+                           const char *target);
 
     /**
-     * scan memory for blocksize-length and blocksize-aligned sections full of zeroes
-     * return length of zeroed area at the beginning of scanned memory.
-     * returned length is rounded down to block_size
+     * truncate file pointed by descriptor to specified length
      */
-    static size_t hole_length(const char *mem, ft_size mem_len);
+    int fd_truncate(int fd, ft_off length, const char *path);
 
     /**
-     * scan memory for blocksize-length and blocksize-aligned sections NOT full of zeroes
-     * return length of NON-zeroed area at the beginning of scanned memory.
-     * returned length is rounded UP to block_size
+     * seek to specified position of file descriptor
      */
-    static size_t nonhole_length(const char *mem, ft_size mem_len);
+    int fd_seek(int fd, ft_off offset, const char *path);
+
+    /**
+     * seek to specified position of *both* file descriptors fd1 and fd2
+     */
+    int fd_seek2(int fd1, int fd2, ft_off offset, const char *path1, const char *path2);
 
     /**
      * read bytes from in_fd, retrying in case of short reads or interrupted system calls.
@@ -167,16 +372,23 @@ class fm_io_posix : public fm_io {
      */
     int full_write(int out_fd, const char *data, ft_size len, const char *target_path);
 
+    /**
+     * record into I/O trace a read() or write() of 'len' bytes on 'fd', started at time 'start'.
+     * 'offset' is the file position before the system call
+     */
+    void trace_io(ft_trace_op_type type, int fd, ft_off offset, ft_size len, double start);
+
     /**
      * check inode_cache for hard links and recreate them.
      * must be called if and only if stat.st_nlink > 1.
+     * if this_jobs > 1, waits until the first link of the inode is created by another thread.
      *
-     * returns EAGAIN if inode was not in inode_cache
+     * returns EAGAIN if inode was not in inode_cache: caller must then call release_inode()
      */
-    int hard_link(const ft_stat &stat, const ft_string &target_path);
+    int hard_link(const ft_stat &stat, const fm_io_posix_at &at, const ft_string &target_path);
 
-    /** create a target directory */
-    int create_dir(const ft_string &path);
+    /** create the target directory 'at', whose full path is 'path' */
+    int create_dir(const fm_io_posix_at &at, const ft_string &path);
 
     /**
      * return true if path is the source directory lost+found.
@@ -191,44 +403,51 @@ class fm_io_posix : public fm_io {
     bool is_target_lost_found(const ft_string &path) const;
 
   protected:
-    /** call ::sync(). slow, but needed to get accurate disk stats when loop devices are involved */
+    /** stop copying small files in batches: each file goes through copy_file_contents() and remove_file() */
+    void close_uring();
+
+    /**
+     * flush target file-system, then source file-system with syncfs(), or everything with ::sync()
+     * if syncfs() is not available. slow, but needed to get accurate disk stats when loop devices are involved
+     */
     virtual void sync();
 
     /**
      * add bytes_just_written to bytes_copied_since_last_check.
      *
-     * if enough_free_space() returns false,
-     * also call check_free_space() and reset bytes_copied_since_last_check to zero
+     * if enough_free_space() returns false, also call check_free_space()
+     * and reset bytes_copied_since_last_check and bytes_freed_since_last_check to zero
      */
     int periodic_check_free_space(ft_uoff bytes_just_written = APPROX_INODE_COST,
                                   ft_uoff bytes_to_write = 0);
 
     /**
-     * copy the permission bits, owner/group and timestamps from 'stat' to 'target'
+     * copy the permission bits, owner/group and timestamps from 'stat' to the target 'at',
+     * whose full path is 'target'
      */
-    int copy_stat(const char *target, const ft_stat &stat);
+    int copy_stat(const fm_io_posix_at &at, const char *target, const ft_stat &stat);
 
     /**
      * copy the contents of single regular file 'source_path' to 'target_path'.
      */
-    virtual int copy_file_contents(const ft_string &source_path, const ft_stat &source_stat,
-                                   const ft_string &target_path);
+    virtual int copy_file_contents(const fm_io_posix_at &at, const ft_string &source_path,
+                                   const ft_stat &source_stat, const ft_string &target_path);
 
     /**
      * remove a regular file inside source directory
      */
-    virtual int remove_file(const char *source_path);
+    virtual int remove_file(const fm_io_posix_at &at, const char *source_path);
 
     /**
      * remove a special file inside source directory
      */
-    virtual int remove_special(const char *source_path);
+    virtual int remove_special(const fm_io_posix_at &at, const char *source_path);
 
     /**
      * remove a source directory, which must be empty
      * exception: will not remove '/lost+found' directory inside source_root()
      */
-    virtual int remove_dir(const ft_string &path);
+    virtual int remove_dir(const fm_io_posix_at &at, const ft_string &path);
 
   public:
     /** constructor */
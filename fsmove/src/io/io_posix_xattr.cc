@@ -29,7 +29,7 @@
 #include "../log.hh" // for ff_log()
 
 #ifdef FT_HAVE_FCNTL_H
-#include <fcntl.h> // for open()
+#include <fcntl.h> // for openat(), AT_FDCWD
 #endif
 #ifdef FT_HAVE_ERRNO_H
 #include <errno.h> // for errno
@@ -63,14 +63,19 @@ fm_io_posix_xattr::~fm_io_posix_xattr() {
 
 /** open file read/write, get its extended attributes, remove 'immutable' attribute */
 int fm_io_posix_xattr::openfile(const ft_string &path) {
-    return open(path, false);
+    return open(AT_FDCWD, path.c_str(), path, false);
+}
+
+/** same as openfile(), but open file 'name' relative to directory descriptor 'dir_fd' */
+int fm_io_posix_xattr::openfile_at(int dir_fd, const char *name, const ft_string &path) {
+    return open(dir_fd, name, path, false);
 }
 
 int fm_io_posix_xattr::opendir(const ft_string &path) {
-    return open(path, true);
+    return open(AT_FDCWD, path.c_str(), path, true);
 }
 
-int fm_io_posix_xattr::open(const ft_string &path, bool isdir) {
+int fm_io_posix_xattr::open(int dir_fd, const char *name, const ft_string &path, bool isdir) {
     const char *cpath = path.c_str();
     int err = close();
     if (err != 0) {
@@ -85,9 +90,9 @@ int fm_io_posix_xattr::open(const ft_string &path, bool isdir) {
     int err_open_rdwr = 0;
     bool readonly = false;
     if (isdir) {
-        err = ::open(cpath, O_RDONLY | O_DIRECTORY);
-    } else if ((err = err_open_rdwr = ::open(cpath, O_RDWR)) < 0) {
-        err = ::open(cpath, O_RDONLY);
+        err = ::openat(dir_fd, name, O_RDONLY | O_DIRECTORY);
+    } else if ((err = err_open_rdwr = ::openat(dir_fd, name, O_RDWR)) < 0) {
+        err = ::openat(dir_fd, name, O_RDONLY);
         readonly = true;
     }
     if (err < 0) {
@@ -116,14 +121,14 @@ int fm_io_posix_xattr::open(const ft_string &path, bool isdir) {
         if (readonly) {
             // retry opening read/write after removing immutable and append flags
             (void)close();
-            if ((err = ::open(cpath, O_RDWR)) < 0) {
+            if ((err = ::openat(dir_fd, name, O_RDWR)) < 0) {
                 return err;
             }
             this_fd = err;
         }
     }
 #else
-    err = ::open(cpath, isdir ? O_RDONLY | O_DIRECTORY : O_RDWR);
+    err = ::openat(dir_fd, name, isdir ? O_RDONLY | O_DIRECTORY : O_RDWR);
     if (err >= 0) {
         this_fd = err;
     }
@@ -140,6 +145,30 @@ int fm_io_posix_xattr::close() {
     return err;
 }
 
+// get flags and projid of file descriptor 'fd', opened by the caller: close() will not close it
+int fm_io_posix_xattr::read_xattr(int fd, const ft_string &path) {
+    this_projid = this_flags = 0;
+#ifdef FS_IOC_FSGETXATTR
+    struct fsxattr xattr = {};
+    if (ioctl(fd, FS_IOC_FSGETXATTR, &xattr) < 0) {
+        return ff_log(FC_WARN, errno, "failed to ioctl(FS_IOC_FSGETXATTR) `%s'", path.c_str());
+    }
+    this_flags = xattr.fsx_xflags;
+    this_projid = xattr.fsx_projid;
+#else
+    (void)fd;
+    (void)path;
+#endif
+    return 0;
+}
+
+// return true if the file is neither immutable nor append-only,
+// and copy_xattr_after() has nothing to copy
+bool fm_io_posix_xattr::is_plain() const {
+    const ft_u64 aftermask = FS_XFLAG_IMMUTABLE | FS_XFLAG_APPEND | FS_XFLAG_SYNC | FS_XFLAG_DAX;
+    return (this_flags & aftermask) == 0 && this_projid == 0;
+}
+
 // copy current flags and projid to specified file descriptor,
 // assuming it *will* be modified afterwards
 int fm_io_posix_xattr::copy_xattr_before(const ft_string &path, int fd) const {
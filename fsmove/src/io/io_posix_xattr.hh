@@ -39,9 +39,18 @@ class fm_io_posix_xattr {
     ~fm_io_posix_xattr(); // calls close()
 
     int openfile(const ft_string &path); // return file descriptor, or < 0
+    // open file 'name' relative to directory descriptor 'dir_fd'. 'path' is its full path, used for messages
+    int openfile_at(int dir_fd, const char *name, const ft_string &path); // return file descriptor, or < 0
     int opendir(const ft_string &path);  // return file descriptor, or < 0
     int close();
 
+    // get flags and projid of file descriptor 'fd', opened by the caller: close() will not close it
+    int read_xattr(int fd, const ft_string &path);
+
+    // return true if the file is neither immutable nor append-only,
+    // and copy_xattr_after() has nothing to copy
+    bool is_plain() const;
+
     // copy current flags and projid to specified file descriptor,
     // assuming it *will* be modified afterwards
     int copy_xattr_before(const ft_string &path, int fd) const;
@@ -51,7 +60,7 @@ class fm_io_posix_xattr {
     int copy_xattr_after(const ft_string &path, int fd) const;
 
   private:
-    int open(const ft_string &path, bool isdir);
+    int open(int dir_fd, const char *name, const ft_string &path, bool isdir);
 
     int copy_xattr_to(const ft_string &path, int fd, ft_u64 clearmask, ft_u64 copymask) const;
 
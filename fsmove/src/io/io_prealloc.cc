@@ -33,7 +33,7 @@
 #endif
 
 #ifdef FT_HAVE_FCNTL_H
-#include <fcntl.h>         // for open(), fallocate()
+#include <fcntl.h>         // for openat(), fallocate()
 #endif
 #ifdef FT_HAVE_SYS_STAT_H
 # include <sys/stat.h>     // for   "
@@ -67,8 +67,11 @@ fm_io_prealloc::~fm_io_prealloc()
 int fm_io_prealloc::open(const fm_args & args)
 {
 	int err = super_type::open(args);
-	if (err == 0)
+	if (err == 0) {
+		/* small files must be preallocated by copy_file_contents() too */
+		close_uring();
 		progress_msg(" still to preallocate");
+	}
 	return err;
 }
 
@@ -83,7 +86,7 @@ void fm_io_prealloc::sync()
  * Since we are preallocating, we can (and will) avoid any modification
  * to the source file system. Thus this method does nothing.
  */
-int fm_io_prealloc::remove_file(const char * FT_ARG_UNUSED(source_path))
+int fm_io_prealloc::remove_file(const fm_io_posix_at & FT_ARG_UNUSED(at), const char * FT_ARG_UNUSED(source_path))
 {
     return 0;
 }
@@ -93,7 +96,7 @@ int fm_io_prealloc::remove_file(const char * FT_ARG_UNUSED(source_path))
  * Since we are preallocating, we can (and will) avoid any modification
  * to the source file system. Thus this method does nothing.
  */
-int fm_io_prealloc::remove_special(const char * FT_ARG_UNUSED(source_path))
+int fm_io_prealloc::remove_special(const fm_io_posix_at & FT_ARG_UNUSED(at), const char * FT_ARG_UNUSED(source_path))
 {
     return 0;
 }
@@ -104,7 +107,7 @@ int fm_io_prealloc::remove_special(const char * FT_ARG_UNUSED(source_path))
  * Since we are preallocating, we can (and will) avoid any modification
  * to the source file system. Thus this method does nothing.
  */
-int fm_io_prealloc::remove_dir(const ft_string & path)
+int fm_io_prealloc::remove_dir(const fm_io_posix_at & FT_ARG_UNUSED(at), const ft_string & path)
 {
     ff_log(FC_TRACE, 0, "remove_dir()   `%s'", path.c_str());
     return 0;
@@ -114,7 +117,7 @@ int fm_io_prealloc::remove_dir(const ft_string & path)
  * copy the contents of regular file 'source_path' to 'target_path'.
  * Since we are preallocating, we just preallocate enough blocks inside 'target_path'
  */
-int fm_io_prealloc::copy_file_contents(const ft_string & FT_ARG_UNUSED(source_path), const ft_stat & source_stat, const ft_string & target_path)
+int fm_io_prealloc::copy_file_contents(const fm_io_posix_at & at, const ft_string & FT_ARG_UNUSED(source_path), const ft_stat & source_stat, const ft_string & target_path)
 {
     const char * target = target_path.c_str();
     int err = 0;
@@ -122,7 +125,7 @@ int fm_io_prealloc::copy_file_contents(const ft_string & FT_ARG_UNUSED(source_pa
 #ifndef O_EXCL
 # define O_EXCL 0
 #endif
-    int out_fd = ::open(target, O_CREAT|O_WRONLY|O_TRUNC|O_EXCL, 0600);
+    int out_fd = ::openat(at.target_dir_fd, at.target_name, O_CREAT|O_WRONLY|O_TRUNC|O_EXCL, 0600);
     if (out_fd < 0)
         err = ff_log(FC_ERROR, errno, "failed to create target file `%s'", target);
 
@@ -144,7 +147,7 @@ int fm_io_prealloc::copy_file_contents(const ft_string & FT_ARG_UNUSED(source_pa
         (void) ::close(out_fd);
 
     if (err == 0)
-        err = this->copy_stat(target, source_stat);
+        err = this->copy_stat(at, target, source_stat);
 
     return err;
 }
@@ -54,21 +54,21 @@ protected:
      * copy the contents of single regular file 'source_path' to 'target_path'.
      * Since we are preallocating, we just preallocate enough blocks inside 'target_path'
      */
-    virtual int copy_file_contents(const ft_string & source_path, const ft_stat & source_stat, const ft_string & target_path);
+    virtual int copy_file_contents(const fm_io_posix_at & at, const ft_string & source_path, const ft_stat & source_stat, const ft_string & target_path);
 
     /**
      * remove a regular file inside source directory
      * Since we are preallocating, we can (and will) avoid any modification
      * to the source file system. Thus this method does nothing.
      */
-    virtual int remove_file(const char * source_path);
+    virtual int remove_file(const fm_io_posix_at & at, const char * source_path);
 
     /**
      * remove a special file inside source directory
      * Since we are preallocating, we can (and will) avoid any modification
      * to the source file system. Thus this method does nothing.
      */
-    virtual int remove_special(const char * source_path);
+    virtual int remove_special(const fm_io_posix_at & at, const char * source_path);
 
     /**
      * remove a source directory, which must be empty
@@ -76,7 +76,7 @@ protected:
      * Since we are preallocating, we can (and will) avoid any modification
      * to the source file system. Thus this method does nothing.
      */
-    virtual int remove_dir(const ft_string & path);
+    virtual int remove_dir(const fm_io_posix_at & at, const ft_string & path);
 
 public:
     /** default constructor. */
@@ -0,0 +1,253 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * io/move_pool.cc
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#include "../first.hh"
+
+#ifdef FT_HAVE_UNISTD_H
+# include <unistd.h>      // for close()
+#endif
+
+#include "../log.hh"      // for ff_log()
+#include "io_posix.hh"    // for fm_io_posix
+#include "move_pool.hh"   // for fm_move_pool, fm_move_task, FT_HAVE_FM_IO_MOVE_POOL
+
+#ifdef FT_HAVE_FM_IO_MOVE_POOL
+
+FT_IO_NAMESPACE_BEGIN
+
+/** constructor */
+fm_move_task::fm_move_task(const ft_string & source, const ft_string & target, fm_move_task * up)
+    : source_path(source), target_path(target), stat(), parent(up), pending(1),
+      source_fd(-1), target_fd(-1), is_dir(false)
+{ }
+
+/** destructor. closes source_fd and target_fd */
+fm_move_task::~fm_move_task()
+{
+    if (source_fd >= 0)
+        (void) close(source_fd);
+    if (target_fd >= 0)
+        (void) close(target_fd);
+}
+
+
+/** constructor */
+fm_move_pool::fm_move_pool(fm_io_posix & io)
+    : this_io(io), this_workers(), this_queued(0), this_sleepers(0), this_err(0), this_done(false)
+{
+    (void) pthread_mutex_init(& this_idle_lock, NULL);
+    (void) pthread_cond_init(& this_idle_cond, NULL);
+}
+
+/** destructor */
+fm_move_pool::~fm_move_pool()
+{
+    (void) pthread_cond_destroy(& this_idle_cond);
+    (void) pthread_mutex_destroy(& this_idle_lock);
+}
+
+/**
+ * move source_path to target_path using 'jobs' threads, including the calling thread.
+ * return 0 if success, else the first error
+ */
+int fm_move_pool::run(const ft_string & source_path, const ft_string & target_path, ft_size jobs)
+{
+    ft_size i, started = 1;
+
+    this_queued = this_sleepers = 0;
+    this_err = 0;
+    this_done = false;
+
+    this_workers.resize(jobs);
+    for (i = 0; i < jobs; i++) {
+        fm_worker * worker = this_workers[i] = new fm_worker();
+        worker->pool = this;
+        worker->index = i;
+        (void) pthread_mutex_init(& worker->lock, NULL);
+    }
+
+    this_workers[0]->queue.push_back(new fm_move_task(source_path, target_path, NULL));
+    this_queued = 1;
+
+    /* thread 0 is the calling thread */
+    for (; started < jobs; started++) {
+        int err = pthread_create(& this_workers[started]->thread, NULL, thread_main, this_workers[started]);
+        if (err != 0) {
+            ff_log(FC_WARN, err, "failed to start thread %" FT_ULL "/%" FT_ULL ", continuing with fewer threads",
+                   (ft_ull) started + 1, (ft_ull) jobs);
+            break;
+        }
+    }
+    ff_log(FC_DEBUG, 0, "moving with %" FT_ULL " threads", (ft_ull) started);
+
+    work(0);
+
+    for (i = 1; i < started; i++)
+        (void) pthread_join(this_workers[i]->thread, NULL);
+
+    for (i = 0; i < jobs; i++) {
+        fm_worker * worker = this_workers[i];
+        (void) pthread_mutex_destroy(& worker->lock);
+        delete worker;
+    }
+    this_workers.clear();
+
+    return this_err;
+}
+
+/** start routine of threads created by pthread_create() */
+void * fm_move_pool::thread_main(void * arg)
+{
+    fm_worker * worker = (fm_worker *) arg;
+    worker->pool->work(worker->index);
+    return NULL;
+}
+
+/** main loop of each thread: run tasks until the pool is done */
+void fm_move_pool::work(ft_size index)
+{
+    fm_move_task * task;
+    while ((task = take(index)) != NULL) {
+        /* after an error, drain the queues without running the tasks */
+        if (__atomic_load_n(& this_err, __ATOMIC_RELAXED) == 0) {
+            int err = this_io.move_task(* this, index, task);
+            if (err != 0)
+                fail(err);
+        }
+        release(task);
+    }
+}
+
+/**
+ * queue a child task of 'parent' into the queue of thread 'index'.
+ * must be called only by thread 'index', while running 'parent'
+ */
+void fm_move_pool::push(ft_size index, fm_move_task * parent, const ft_string & source_path, const ft_string & target_path)
+{
+    fm_move_task * task = new fm_move_task(source_path, target_path, parent);
+    fm_worker * worker = this_workers[index];
+
+    __atomic_add_fetch(& parent->pending, 1, __ATOMIC_RELAXED);
+
+    (void) pthread_mutex_lock(& worker->lock);
+    worker->queue.push_back(task);
+    (void) pthread_mutex_unlock(& worker->lock);
+
+    /*
+     * pairs with take(): either the sleeper sees this_queued != 0,
+     * or we see this_sleepers != 0 and wake it up
+     */
+    __atomic_add_fetch(& this_queued, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(& this_sleepers, __ATOMIC_SEQ_CST) != 0) {
+        (void) pthread_mutex_lock(& this_idle_lock);
+        (void) pthread_cond_signal(& this_idle_cond);
+        (void) pthread_mutex_unlock(& this_idle_lock);
+    }
+}
+
+/** return a task from the back of own queue, or stolen from the front of another queue */
+fm_move_task * fm_move_pool::pop(ft_size index)
+{
+    fm_move_task * task = NULL;
+    ft_size i, n = this_workers.size();
+
+    for (i = 0; task == NULL && i < n; i++) {
+        fm_worker * worker = this_workers[(index + i) % n];
+        (void) pthread_mutex_lock(& worker->lock);
+        if (!worker->queue.empty()) {
+            if (i == 0) {
+                task = worker->queue.back();
+                worker->queue.pop_back();
+            } else {
+                task = worker->queue.front();
+                worker->queue.pop_front();
+            }
+        }
+        (void) pthread_mutex_unlock(& worker->lock);
+    }
+    if (task != NULL)
+        __atomic_sub_fetch(& this_queued, 1, __ATOMIC_SEQ_CST);
+    return task;
+}
+
+/** wait until some task can be popped and return it, or return NULL if the pool is done */
+fm_move_task * fm_move_pool::take(ft_size index)
+{
+    fm_move_task * task;
+    bool done;
+    while ((task = pop(index)) == NULL) {
+        (void) pthread_mutex_lock(& this_idle_lock);
+        __atomic_add_fetch(& this_sleepers, 1, __ATOMIC_SEQ_CST);
+        while (!this_done && __atomic_load_n(& this_queued, __ATOMIC_SEQ_CST) == 0)
+            (void) pthread_cond_wait(& this_idle_cond, & this_idle_lock);
+        __atomic_sub_fetch(& this_sleepers, 1, __ATOMIC_SEQ_CST);
+        done = this_done;
+        (void) pthread_mutex_unlock(& this_idle_lock);
+        if (done)
+            break;
+    }
+    return task;
+}
+
+/**
+ * drop one reason 'task' is pending. if it was the last one, finish the task,
+ * then drop one reason its parent is pending, and so on
+ */
+void fm_move_pool::release(fm_move_task * task)
+{
+    while (task != NULL && __atomic_sub_fetch(& task->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        fm_move_task * parent = task->parent;
+
+        if (task->is_dir && __atomic_load_n(& this_err, __ATOMIC_RELAXED) == 0) {
+            int err = this_io.finish_task(task);
+            if (err != 0)
+                fail(err);
+        }
+        delete task;
+        if (parent == NULL)
+            set_done();
+        task = parent;
+    }
+}
+
+/** record the first error and stop running new tasks */
+void fm_move_pool::fail(int err)
+{
+    int expected = 0;
+    (void) __atomic_compare_exchange_n(& this_err, & expected, err, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+/** wake up all idle threads: the pool is done */
+void fm_move_pool::set_done()
+{
+    (void) pthread_mutex_lock(& this_idle_lock);
+    this_done = true;
+    (void) pthread_cond_broadcast(& this_idle_cond);
+    (void) pthread_mutex_unlock(& this_idle_lock);
+}
+
+FT_IO_NAMESPACE_END
+
+#endif /* FT_HAVE_FM_IO_MOVE_POOL */
@@ -0,0 +1,167 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * io/move_pool.hh
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#ifndef FSMOVE_IO_MOVE_POOL_HH
+#define FSMOVE_IO_MOVE_POOL_HH
+
+#include "../types.hh"    // for ft_string, ft_stat, ft_size
+
+// fm_move_pool requires threads and atomic builtins
+#if defined(FT_HAVE_PTHREAD_H) && defined(FT_HAVE_PTHREAD_CREATE) && defined(FT_HAVE_ATOMIC_BUILTINS)
+# define FT_HAVE_FM_IO_MOVE_POOL
+# include <pthread.h>     // for pthread_t, pthread_mutex_t, pthread_cond_t
+
+# include <deque>         // for std::deque
+# include <vector>        // for std::vector
+
+FT_IO_NAMESPACE_BEGIN
+
+class fm_io_posix;
+
+/**
+ * a file, special device or directory to move, queued inside fm_move_pool
+ */
+class fm_move_task
+{
+public:
+    ft_string source_path, target_path;
+
+    /** lstat() of source_path. used by directories after all their children are moved */
+    ft_stat stat;
+
+    /** task of the directory containing this one, or NULL for the root of the move */
+    fm_move_task * parent;
+
+    /**
+     * number of reasons this task is not finished yet: one while it is queued or running,
+     * plus one for each child task not finished yet. accessed atomically
+     */
+    ft_size pending;
+
+    /**
+     * if this task is a directory, descriptors of source_path and target_path
+     * used to access its children with the *at() system calls, or -1 if not open
+     */
+    int source_fd, target_fd;
+
+    /** true if this task is a directory that was created: it must be finished by fm_io_posix::finish_dir() */
+    bool is_dir;
+
+    /** constructor */
+    fm_move_task(const ft_string & source_path, const ft_string & target_path, fm_move_task * parent);
+
+    /** destructor. closes source_fd and target_fd */
+    ~fm_move_task();
+};
+
+/**
+ * pool of threads moving a directory tree in parallel.
+ *
+ * each thread owns a queue of tasks: it pushes and pops tasks at its back (depth-first),
+ * and when it runs out of tasks it steals from the front of other threads' queues.
+ * a directory is finished (see fm_io_posix::finish_dir()) only after all its children are finished.
+ */
+class fm_move_pool
+{
+private:
+    /** per-thread state: queue of tasks, protected by 'lock' */
+    struct fm_worker
+    {
+        fm_move_pool * pool;
+        ft_size index;
+        pthread_t thread;
+        pthread_mutex_t lock;
+        std::deque<fm_move_task *> queue;
+    };
+
+    fm_io_posix & this_io;
+    std::vector<fm_worker *> this_workers;
+
+    /* idle threads sleep on this_idle_cond until new tasks are queued or the pool is done */
+    pthread_mutex_t this_idle_lock;
+    pthread_cond_t this_idle_cond;
+
+    /* accessed atomically */
+    ft_size this_queued, this_sleepers;
+    int this_err;
+
+    /* protected by this_idle_lock */
+    bool this_done;
+
+    /** cannot call copy constructor */
+    fm_move_pool(const fm_move_pool &);
+
+    /** cannot call assignment operator */
+    const fm_move_pool & operator=(const fm_move_pool &);
+
+    /** start routine of threads created by pthread_create() */
+    static void * thread_main(void * arg);
+
+    /** main loop of each thread: run tasks until the pool is done */
+    void work(ft_size index);
+
+    /** return a task from the back of own queue, or stolen from the front of another queue */
+    fm_move_task * pop(ft_size index);
+
+    /** wait until some task can be popped and return it, or return NULL if the pool is done */
+    fm_move_task * take(ft_size index);
+
+    /**
+     * drop one reason 'task' is pending. if it was the last one, finish the task,
+     * then drop one reason its parent is pending, and so on
+     */
+    void release(fm_move_task * task);
+
+    /** record the first error and stop running new tasks */
+    void fail(int err);
+
+    /** wake up all idle threads: the pool is done */
+    void set_done();
+
+public:
+    /** constructor */
+    fm_move_pool(fm_io_posix & io);
+
+    /** destructor */
+    ~fm_move_pool();
+
+    /**
+     * move source_path to target_path using 'jobs' threads, including the calling thread.
+     * return 0 if success, else the first error
+     */
+    int run(const ft_string & source_path, const ft_string & target_path, ft_size jobs);
+
+    /**
+     * queue a child task of 'parent' into the queue of thread 'index'.
+     * must be called only by thread 'index', while running 'parent'
+     */
+    void push(ft_size index, fm_move_task * parent, const ft_string & source_path, const ft_string & target_path);
+};
+
+FT_IO_NAMESPACE_END
+
+#endif /* FT_HAVE_PTHREAD_H && FT_HAVE_PTHREAD_CREATE && FT_HAVE_ATOMIC_BUILTINS */
+
+#endif /* FSMOVE_IO_MOVE_POOL_HH */
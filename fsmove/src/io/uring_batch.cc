@@ -0,0 +1,547 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * io/uring_batch.cc
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#include "../first.hh"
+
+#if defined(FT_HAVE_CERRNO)
+#include <cerrno> // for errno and error codes
+#elif defined(FT_HAVE_ERRNO_H)
+#include <errno.h>
+#endif
+#if defined(FT_HAVE_CSTRING)
+#include <cstring> // for memset()
+#elif defined(FT_HAVE_STRING_H)
+#include <string.h> // for memset()
+#endif
+
+#ifdef FT_HAVE_FCNTL_H
+#include <fcntl.h> // for openat(), O_RDONLY, O_CREAT
+#endif
+#ifdef FT_HAVE_SYS_MMAN_H
+#include <sys/mman.h> // for mmap(), munmap()
+#endif
+#ifdef FT_HAVE_SYS_STAT_H
+#include <sys/stat.h> // for S_ISREG()
+#endif
+#ifdef FT_HAVE_UNISTD_H
+#include <unistd.h> // for close(), unlinkat(), syscall()
+#endif
+
+#include "../assert.hh"      // for ff_assert()
+#include "../log.hh"         // for ff_log()
+#include "../misc.hh"        // for ff_max2()
+#include "io_posix.hh"       // for fm_io_posix, fm_io_posix_at
+#include "io_posix_xattr.hh" // for fm_io_posix_xattr
+#include "uring_batch.hh"    // for fm_uring_batch, FT_HAVE_FM_IO_URING_BATCH
+
+#ifdef FT_HAVE_FM_IO_URING_BATCH
+
+#include <sys/syscall.h> // for __NR_io_uring_setup, __NR_io_uring_enter, __NR_io_uring_register
+
+#ifndef O_EXCL
+#define O_EXCL 0
+#endif
+#ifndef O_NOFOLLOW
+#define O_NOFOLLOW 0
+#endif
+
+FT_IO_NAMESPACE_BEGIN
+
+/** constructor */
+fm_uring_batch::fm_uring_batch(fm_io_posix &io)
+    : this_io(io), this_ring_fd(-1), this_sq_mem(MAP_FAILED), this_cq_mem(MAP_FAILED),
+      this_sq_mem_len(0), this_cq_mem_len(0), this_sqes_len(0), this_sq_head(NULL),
+      this_sq_tail(NULL), this_sq_array(NULL), this_sq_mask(0), this_sq_entries(0),
+      this_cq_head(NULL), this_cq_tail(NULL), this_cq_mask(0), this_sqes(NULL), this_cqes(NULL),
+      this_sq_local_tail(0), this_queued(0), this_files(), this_buf(), this_res(), this_bytes(0) {
+}
+
+/** destructor. calls close() */
+fm_uring_batch::~fm_uring_batch() {
+    close();
+}
+
+/**
+ * create the io_uring. returns 0 if success,
+ * else error (not reported) if the kernel does not support it or forbids it
+ */
+int fm_uring_batch::open() {
+    struct io_uring_params params;
+    int err = 0;
+
+    memset(&params, 0, sizeof(params));
+    if ((this_ring_fd = (int)syscall(__NR_io_uring_setup, (unsigned)FT_URING_ENTRIES, &params)) < 0)
+        return errno;
+
+    do {
+        this_sq_mem_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        this_cq_mem_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        this_sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+
+        /* since Linux 5.4, submission and completion queues share a single mmap() */
+        bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap)
+            this_sq_mem_len = this_cq_mem_len = ff_max2(this_sq_mem_len, this_cq_mem_len);
+
+        this_sq_mem = mmap(NULL, this_sq_mem_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           this_ring_fd, IORING_OFF_SQ_RING);
+        if (this_sq_mem == MAP_FAILED) {
+            err = errno;
+            break;
+        }
+        if (!single_mmap) {
+            this_cq_mem = mmap(NULL, this_cq_mem_len, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, this_ring_fd, IORING_OFF_CQ_RING);
+            if (this_cq_mem == MAP_FAILED) {
+                err = errno;
+                break;
+            }
+        }
+        void *sqes = mmap(NULL, this_sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          this_ring_fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            err = errno;
+            break;
+        }
+        this_sqes = (struct io_uring_sqe *)sqes;
+
+        char *sq = (char *)this_sq_mem, *cq = single_mmap ? sq : (char *)this_cq_mem;
+        this_sq_head = (unsigned *)(sq + params.sq_off.head);
+        this_sq_tail = (unsigned *)(sq + params.sq_off.tail);
+        this_sq_mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+        this_sq_array = (unsigned *)(sq + params.sq_off.array);
+        this_sq_entries = params.sq_entries;
+        this_cq_head = (unsigned *)(cq + params.cq_off.head);
+        this_cq_tail = (unsigned *)(cq + params.cq_off.tail);
+        this_cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+        this_cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+        this_sq_local_tail = *this_sq_tail;
+        this_queued = 0;
+
+        /* openat, read, write and close need Linux >= 5.6 */
+        if (!probe()) {
+            err = EOPNOTSUPP;
+            break;
+        }
+        this_files.reserve(FT_URING_FILES);
+        this_buf.resize(FT_URING_FILES * (FT_URING_FILE_MAX + 1));
+        this_res.resize(2 * FT_URING_FILES);
+        this_bytes = 0;
+    } while (0);
+
+    if (err != 0)
+        close();
+    return err;
+}
+
+/** return true if the kernel supports all the operations used by this class */
+bool fm_uring_batch::probe() {
+    static const unsigned char opcode[] = {
+        IORING_OP_OPENAT,
+        IORING_OP_READ,
+        IORING_OP_WRITE,
+        IORING_OP_CLOSE,
+    };
+    enum { FT_PROBE_OPS = 256 };
+    std::vector<char> buf(sizeof(struct io_uring_probe) +
+                          FT_PROBE_OPS * sizeof(struct io_uring_probe_op));
+    struct io_uring_probe *probe = (struct io_uring_probe *)&buf[0];
+
+    if (syscall(__NR_io_uring_register, this_ring_fd, IORING_REGISTER_PROBE, probe,
+                (unsigned)FT_PROBE_OPS) < 0)
+        return false;
+
+    for (ft_size i = 0; i < sizeof(opcode) / sizeof(opcode[0]); i++) {
+        if (opcode[i] > probe->last_op ||
+            (probe->ops[opcode[i]].flags & IO_URING_OP_SUPPORTED) == 0)
+            return false;
+    }
+    return true;
+}
+
+/** discard queued files without copying them, and destroy the io_uring */
+void fm_uring_batch::close() {
+    discard();
+    if (this_sqes != NULL)
+        (void)munmap(this_sqes, this_sqes_len);
+    if (this_cq_mem != MAP_FAILED)
+        (void)munmap(this_cq_mem, this_cq_mem_len);
+    if (this_sq_mem != MAP_FAILED)
+        (void)munmap(this_sq_mem, this_sq_mem_len);
+    if (this_ring_fd >= 0)
+        (void)::close(this_ring_fd);
+    this_ring_fd = -1;
+    this_sq_mem = this_cq_mem = MAP_FAILED;
+    this_sqes = NULL;
+    this_buf.clear();
+    this_res.clear();
+}
+
+/** discard queued files without copying them: they are left in source */
+void fm_uring_batch::discard() {
+    /* between flush() calls, queued files have no open descriptors */
+    this_files.clear();
+    this_bytes = 0;
+}
+
+/** return true if 'stat' is a small regular file without holes and with a single link */
+bool fm_uring_batch::is_small(const ft_stat &stat) {
+    /*
+     * files with holes need them recreated, and files with several links need inode_cache:
+     * leave both to fm_io_posix
+     */
+    return S_ISREG(stat.st_mode) && stat.st_nlink == 1 &&
+           (ft_uoff)stat.st_size <= FT_URING_FILE_MAX &&
+           (ft_uoff)stat.st_blocks * 512 >= (ft_uoff)stat.st_size;
+}
+
+/**
+ * queue the small file 'source_path' to be copied to 'target_path' and removed.
+ * its directories must stay open until flush(). if the batch is full, call flush() first.
+ * returns EAGAIN (unreported) if there is not enough free space to batch the file,
+ * else 0 for success or error
+ */
+int fm_uring_batch::push(const fm_io_posix_at &at, const ft_string &source_path,
+                         const ft_stat &stat, const ft_string &target_path) {
+    int err;
+    if (this_files.size() >= FT_URING_FILES && (err = flush()) != 0)
+        return err;
+
+    /* queued files are copied forward: they must all fit in free space */
+    if (!this_io.enough_free_space(this_bytes + (ft_uoff)stat.st_size))
+        return EAGAIN;
+
+    this_files.push_back(fm_small_file());
+    fm_small_file &file = this_files.back();
+    file.source_path = source_path;
+    file.target_path = target_path;
+    file.stat = stat;
+    file.source_dir_fd = at.source_dir_fd;
+    file.target_dir_fd = at.target_dir_fd;
+    file.in_fd = file.out_fd = -1;
+    file.length = 0;
+    file.err = 0;
+    this_bytes += (ft_uoff)stat.st_size;
+    return 0;
+}
+
+/** return the location of file 'i' relative to the descriptors of its directories */
+fm_io_posix_at fm_uring_batch::at(ft_size i) const {
+    /* AT_FDCWD is negative: then fm_io_posix_at uses full paths, as push() received them */
+    const fm_small_file &file = this_files[i];
+    return fm_io_posix_at(file.source_dir_fd, file.source_path, file.target_dir_fd,
+                          file.target_path);
+}
+
+/**
+ * queue a submission with 'opcode' on 'fd'. its result will be stored in this_res[user_data].
+ * the ring is large enough for each step of flush(): never fails
+ */
+struct io_uring_sqe *fm_uring_batch::prepare(unsigned char opcode, int fd, ft_size user_data) {
+    ff_assert(this_queued < this_sq_entries && user_data < this_res.size());
+
+    unsigned index = this_sq_local_tail & this_sq_mask;
+    struct io_uring_sqe *sqe = &this_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->user_data = user_data;
+    this_sq_array[index] = index;
+    this_sq_local_tail++;
+    this_queued++;
+    this_res[user_data] = -ECANCELED;
+    return sqe;
+}
+
+/** submit queued submissions and wait for all their results. returns 0 or error */
+int fm_uring_batch::complete() {
+    unsigned submitted = 0, reaped = 0, queued = this_queued;
+
+    this_queued = 0;
+    __atomic_store_n(this_sq_tail, this_sq_local_tail, __ATOMIC_RELEASE);
+
+    while (reaped < queued) {
+        /* submit what is left, and wait for all the results at once */
+        int got = (int)syscall(__NR_io_uring_enter, this_ring_fd, queued - submitted,
+                               queued - reaped, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (got < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                continue;
+            return ff_log(FC_ERROR, errno, "io_uring_enter() failed");
+        }
+        submitted += (unsigned)got;
+
+        unsigned head = *this_cq_head, tail = __atomic_load_n(this_cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++, reaped++) {
+            const struct io_uring_cqe *cqe = &this_cqes[head & this_cq_mask];
+            if (cqe->user_data < this_res.size())
+                this_res[cqe->user_data] = cqe->res;
+        }
+        __atomic_store_n(this_cq_head, head, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+/**
+ * open source files and create target files.
+ * io_uring always creates files in a kernel worker thread, which costs more than it saves:
+ * create them with openat() instead
+ */
+int fm_uring_batch::flush_open() {
+    ft_size i, n = this_files.size();
+    for (i = 0; i < n; i++) {
+        fm_small_file &file = this_files[i];
+        const fm_io_posix_at file_at = at(i);
+        struct io_uring_sqe *sqe = prepare(IORING_OP_OPENAT, file_at.source_dir_fd, 2 * i);
+        sqe->addr = (unsigned long)file_at.source_name;
+        sqe->open_flags = O_RDONLY | O_NOFOLLOW;
+
+        file.out_fd = ::openat(file_at.target_dir_fd, file_at.target_name,
+                               O_CREAT | O_WRONLY | O_TRUNC | O_EXCL, 0600);
+        if (file.out_fd < 0)
+            file.err = ff_log(FC_ERROR, errno, "failed to create target file `%s'",
+                              file.target_path.c_str());
+    }
+    int err = complete();
+    if (err != 0)
+        return err;
+
+    for (i = 0; i < n; i++) {
+        fm_small_file &file = this_files[i];
+        int res = this_res[2 * i];
+        if (res >= 0)
+            file.in_fd = res;
+        else if (file.err == 0)
+            file.err =
+                ff_log(FC_ERROR, -res, "failed to open source file `%s'", file.source_path.c_str());
+    }
+    return err;
+}
+
+/** read source files */
+int fm_uring_batch::flush_read() {
+    ft_size i, n = this_files.size();
+    for (i = 0; i < n; i++) {
+        const fm_small_file &file = this_files[i];
+        if (file.err != 0)
+            continue;
+        /* read one byte more than FT_URING_FILE_MAX, to detect files that grew since stat() */
+        struct io_uring_sqe *sqe = prepare(IORING_OP_READ, file.in_fd, 2 * i);
+        sqe->addr = (unsigned long)&this_buf[i * (FT_URING_FILE_MAX + 1)];
+        sqe->len = FT_URING_FILE_MAX + 1;
+        sqe->off = 0;
+    }
+    int err = complete();
+    if (err != 0)
+        return err;
+
+    for (i = 0; i < n; i++) {
+        fm_small_file &file = this_files[i];
+        int res = this_res[2 * i];
+        if (file.err != 0)
+            continue;
+        /* charge what was actually read: the file may have changed since stat() */
+        if (res > 0)
+            this_io.throttle_io((ft_uoff)res);
+        if (res < 0)
+            file.err = ff_log(FC_ERROR, -res, "error reading from `%s'", file.source_path.c_str());
+        else if ((ft_size)res > FT_URING_FILE_MAX)
+            /* file grew too much: copy it one by one */
+            file.err = EAGAIN;
+        else
+            file.length = (ft_size)res;
+    }
+    return err;
+}
+
+/** write target files and close source files */
+int fm_uring_batch::flush_write() {
+    ft_size i, n = this_files.size();
+    for (i = 0; i < n; i++) {
+        fm_small_file &file = this_files[i];
+        if (file.err == 0 && file.length != 0) {
+            struct io_uring_sqe *sqe = prepare(IORING_OP_WRITE, file.out_fd, 2 * i);
+            sqe->addr = (unsigned long)&this_buf[i * (FT_URING_FILE_MAX + 1)];
+            sqe->len = (unsigned)file.length;
+            sqe->off = 0;
+        }
+        /* fallback() closes the files it copies again */
+        if (file.in_fd >= 0 && file.err != EAGAIN) {
+            prepare(IORING_OP_CLOSE, file.in_fd, 2 * i + 1);
+            file.in_fd = -1;
+        }
+    }
+    int err = complete();
+    if (err != 0)
+        return err;
+
+    ft_uoff written = 0;
+    for (i = 0; i < n; i++) {
+        fm_small_file &file = this_files[i];
+        int res = this_res[2 * i];
+        if (file.err != 0 || file.length == 0)
+            continue;
+        if (res > 0)
+            this_io.throttle_io((ft_uoff)res);
+        if (res < 0 || (ft_size)res != file.length)
+            /* a short write on a regular file means the disk is full */
+            file.err = ff_log(FC_ERROR, res < 0 ? -res : ENOSPC, "error writing to `%s'",
+                              file.target_path.c_str());
+        else
+            written += file.length;
+    }
+    /* same accounting as fm_io_posix::copy_file_contents(): inodes, then data */
+    return this_io.periodic_check_free_space(n * fm_io_posix::APPROX_INODE_COST + written);
+}
+
+/**
+ * close target files and remove source files.
+ * as for flush_open(), io_uring would remove files in a kernel worker thread:
+ * use unlinkat() instead
+ */
+int fm_uring_batch::flush_close() {
+    ft_size i, n = this_files.size();
+    for (i = 0; i < n; i++) {
+        fm_small_file &file = this_files[i];
+        if (file.out_fd >= 0 && file.err != EAGAIN) {
+            prepare(IORING_OP_CLOSE, file.out_fd, 2 * i);
+            file.out_fd = -1;
+        }
+    }
+    int err = complete();
+    if (err != 0)
+        return err;
+
+    ft_uoff freed = 0;
+    for (i = 0; i < n; i++) {
+        fm_small_file &file = this_files[i];
+        if (file.err != 0)
+            continue;
+        const fm_io_posix_at file_at = at(i);
+        if (unlinkat(file_at.source_dir_fd, file_at.source_name, 0) != 0)
+            file.err = ff_log(FC_ERROR, errno, "failed to remove source file `%s'",
+                              file.source_path.c_str());
+        else
+            /* batched files have a single link: removing it frees their blocks */
+            freed += (ft_uoff)file.stat.st_blocks * 512;
+    }
+    this_io.lock();
+    this_io.bytes_freed_since_last_check += freed;
+    this_io.unlock();
+    return err;
+}
+
+/**
+ * close the descriptors of file 'i' that are still open and remove its target,
+ * then copy it one by one
+ */
+int fm_uring_batch::fallback(ft_size i) {
+    fm_small_file &file = this_files[i];
+    const fm_io_posix_at file_at = at(i);
+    const char *target = file.target_path.c_str();
+    int err = 0;
+
+    if (file.in_fd >= 0)
+        (void)::close(file.in_fd);
+    if (file.out_fd >= 0)
+        (void)::close(file.out_fd);
+    file.in_fd = file.out_fd = -1;
+
+    /* copy_file_contents() creates target file again */
+    if (unlinkat(file_at.target_dir_fd, file_at.target_name, 0) != 0)
+        return ff_log(FC_ERROR, errno, "failed to remove target file `%s'", target);
+
+    err = this_io.copy_file_contents(file_at, file.source_path, file.stat, file.target_path);
+    if (err == 0)
+        err = this_io.remove_file(file_at, file.source_path.c_str());
+    return err;
+}
+
+/**
+ * copy all queued files, copy their metadata and remove them from source.
+ * returns 0 if success, else the first error
+ */
+int fm_uring_batch::flush() {
+    ft_size i, n = this_files.size();
+    int err = 0;
+
+    if (n == 0)
+        return err;
+
+    ff_log(FC_TRACE, 0, "flush()        %" FT_ULL " small files", (ft_ull)n);
+
+    do {
+        if ((err = flush_open()) != 0)
+            break;
+
+        /* io_uring cannot get or set xattrs flags: use ioctl() as copy_file_contents() does */
+        for (i = 0; i < n; i++) {
+            fm_small_file &file = this_files[i];
+            if (file.err != 0)
+                continue;
+            fm_io_posix_xattr xattr;
+            xattr.read_xattr(file.in_fd, file.source_path);
+            if (!xattr.is_plain())
+                /* immutable, append-only or with project id: copy it one by one */
+                file.err = EAGAIN;
+            else
+                (void)xattr.copy_xattr_before(file.target_path, file.out_fd);
+        }
+        if ((err = flush_read()) != 0 || (err = flush_write()) != 0)
+            break;
+
+        /* io_uring cannot change owner, mode or timestamps either */
+        for (i = 0; i < n; i++) {
+            fm_small_file &file = this_files[i];
+            if (file.err == 0)
+                file.err = this_io.copy_stat(at(i), file.target_path.c_str(), file.stat);
+        }
+        if ((err = flush_close()) != 0)
+            break;
+
+        for (i = 0; i < n; i++) {
+            fm_small_file &file = this_files[i];
+            if (file.err == EAGAIN)
+                file.err = fallback(i);
+            if (err == 0)
+                err = file.err;
+        }
+    } while (0);
+
+    /* after an error, close what is still open */
+    for (i = 0; i < n; i++) {
+        fm_small_file &file = this_files[i];
+        if (file.in_fd >= 0)
+            (void)::close(file.in_fd);
+        if (file.out_fd >= 0)
+            (void)::close(file.out_fd);
+    }
+    discard();
+    return err;
+}
+
+FT_IO_NAMESPACE_END
+
+#endif /* FT_HAVE_FM_IO_URING_BATCH */
@@ -0,0 +1,180 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * io/uring_batch.hh
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#ifndef FSMOVE_IO_URING_BATCH_HH
+#define FSMOVE_IO_URING_BATCH_HH
+
+#include "../types.hh" // for ft_string, ft_stat, ft_size
+
+// fm_uring_batch requires io_uring and atomic builtins
+#if defined(FT_HAVE_IO_URING) && defined(FT_HAVE_ATOMIC_BUILTINS) && defined(FT_HAVE_SYS_MMAN_H)
+#define FT_HAVE_FM_IO_URING_BATCH
+#include <linux/io_uring.h> // for struct io_uring_sqe, struct io_uring_cqe
+
+#include <vector> // for std::vector
+
+FT_IO_NAMESPACE_BEGIN
+
+class fm_io_posix;
+struct fm_io_posix_at;
+
+/**
+ * copies small regular files in batches through io_uring: the open(), read(), write() and close()
+ * of many files are submitted together and cost a single system call per step,
+ * and the kernel can overlap their I/O.
+ *
+ * only fm_io_posix moving files sequentially uses it. calls that io_uring cannot perform
+ * (xattr ioctl(), chown(), chmod() and utimensat()) or would perform in a worker thread
+ * (creating and removing files) are still issued one by one
+ */
+class fm_uring_batch {
+  public:
+    enum {
+        /** files copied by each batch */
+        FT_URING_FILES = 64,
+        /** only files up to this size are batched, currently 64k */
+        FT_URING_FILE_MAX = (ft_size)1 << 16,
+        /** submission queue entries: each step submits at most two per file */
+        FT_URING_ENTRIES = 2 * FT_URING_FILES,
+    };
+
+  private:
+    /** a small regular file queued in the batch */
+    struct fm_small_file {
+        ft_string source_path, target_path;
+        ft_stat stat;
+        /** descriptors of directories containing source_path and target_path, or AT_FDCWD */
+        int source_dir_fd, target_dir_fd;
+        int in_fd, out_fd;
+        /** bytes read from in_fd */
+        ft_size length;
+        /** 0 while the copy proceeds normally, else the error that stopped it */
+        int err;
+    };
+
+    fm_io_posix &this_io;
+
+    /* io_uring file descriptor and shared memory */
+    int this_ring_fd;
+    void *this_sq_mem, *this_cq_mem;
+    ft_size this_sq_mem_len, this_cq_mem_len, this_sqes_len;
+    unsigned *this_sq_head, *this_sq_tail, *this_sq_array, this_sq_mask, this_sq_entries;
+    unsigned *this_cq_head, *this_cq_tail, this_cq_mask;
+    struct io_uring_sqe *this_sqes;
+    struct io_uring_cqe *this_cqes;
+    /** tail of submission queue, not yet published to the kernel */
+    unsigned this_sq_local_tail;
+    /** submissions queued by prepare() since last complete() */
+    unsigned this_queued;
+
+    std::vector<fm_small_file> this_files;
+    /** file contents: FT_URING_FILE_MAX + 1 bytes for each file, to detect files that grew */
+    std::vector<char> this_buf;
+    /** result of each submission, indexed by its user_data */
+    std::vector<int> this_res;
+    /** sum of the sizes of queued files */
+    ft_uoff this_bytes;
+
+    /** cannot call copy constructor */
+    fm_uring_batch(const fm_uring_batch &);
+
+    /** cannot call assignment operator */
+    const fm_uring_batch &operator=(const fm_uring_batch &);
+
+    /** return true if the kernel supports all the operations used by this class */
+    bool probe();
+
+    /**
+     * queue a submission with 'opcode' on 'fd'. its result will be stored in this_res[user_data].
+     * the ring is large enough for each step of flush(): never fails
+     */
+    struct io_uring_sqe *prepare(unsigned char opcode, int fd, ft_size user_data);
+
+    /** submit queued submissions and wait for all their results. returns 0 or error */
+    int complete();
+
+    /** return the location of file 'i' relative to the descriptors of its directories */
+    fm_io_posix_at at(ft_size i) const;
+
+    /**
+     * close the descriptors of file 'i' that are still open and remove its target,
+     * then copy it one by one
+     */
+    int fallback(ft_size i);
+
+    /** submit the steps of flush() */
+    int flush_open();
+    int flush_read();
+    int flush_write();
+    int flush_close();
+
+  public:
+    /** constructor */
+    fm_uring_batch(fm_io_posix &io);
+
+    /** destructor. calls close() */
+    ~fm_uring_batch();
+
+    /**
+     * create the io_uring. returns 0 if success,
+     * else error (not reported) if the kernel does not support it or forbids it
+     */
+    int open();
+
+    /** discard queued files without copying them, and destroy the io_uring */
+    void close();
+
+    /** discard queued files without copying them: they are left in source */
+    void discard();
+
+    /** return true if 'stat' is a small regular file without holes and with a single link */
+    static bool is_small(const ft_stat &stat);
+
+    /** return true if no files are queued */
+    FT_INLINE bool empty() const {
+        return this_files.empty();
+    }
+
+    /**
+     * queue the small file 'source_path' to be copied to 'target_path' and removed.
+     * its directories must stay open until flush(). if the batch is full, call flush() first.
+     * returns EAGAIN (unreported) if there is not enough free space to batch the file,
+     * else 0 for success or error
+     */
+    int push(const fm_io_posix_at &at, const ft_string &source_path, const ft_stat &stat,
+             const ft_string &target_path);
+
+    /**
+     * copy all queued files, copy their metadata and remove them from source.
+     * returns 0 if success, else the first error
+     */
+    int flush();
+};
+
+FT_IO_NAMESPACE_END
+
+#endif /* FT_HAVE_IO_URING && FT_HAVE_ATOMIC_BUILTINS && FT_HAVE_SYS_MMAN_H */
+
+#endif /* FSMOVE_IO_URING_BATCH_HH */
@@ -26,6 +26,7 @@
 #include "first.hh"
 
 #include "move.hh"
+#include "misc.hh"           // for ff_str2un(), ff_str2un_scaled()
 #include "io/io.hh"          // for fm_io
 #include "io/io_posix.hh"    // for fm_io_posix
 #include "io/io_prealloc.hh" // for fm_io_prealloc
@@ -174,16 +175,34 @@ int fm_move::usage(const char * program_name)
      "      --io=prealloc     use POSIX I/O and preallocate files (do NOT move them)\n"
 #endif
      "      --inode-cache-mem use in-memory inode cache (default)\n"
+     "      --inode-cache-compact\n"
+     "                        use compact in-memory inode cache: slower,\n"
+     "                          but uses less RAM with many hard links\n"
      "      --inode-cache=DIR create and use directory DIR for inode cache\n"
+     "      --jobs=NUM        move up to NUM files at the same time (default: 1).\n"
+     "                          Helps with many small files on fast devices\n"
+     "      --log-async[=SIZE[k|M|G]]\n"
+     "                        write verbose messages from a background thread,\n"
+     "                          buffering up to SIZE bytes (default: 1M).\n"
+     "                          Messages that do not fit are dropped and counted\n"
      "      --log-color=MODE  set messages color. MODE is one of:"
      "                          auto (default), none, ansi\n"
      "      --log-format=FMT  set messages format. FMT is one of:\n"
      "                          msg (default), level_msg, time_level_msg,\n"
      "                          time_level_function_msg\n"
+     "      --max-bytes-per-sec=SIZE[k|M|G|T|P|E|Z|Y]\n"
+     "                        read and write at most SIZE bytes per second\n"
+     "      --max-iops=NUM    issue at most NUM reads and writes per second\n"
      "  -n, --no-action, --simulate-run\n"
      "                        do not actually move any file or directory\n"
+     "      --order=MODE      move the contents of each directory in MODE order.\n"
+     "                          MODE is one of: readdir (default), inode,\n"
+     "                          extent (position on disk of first data block).\n"
+     "                          inode and extent reduce seeks on rotating disks\n"
      "  -q, --quiet           be quiet\n"
      "  -qq                   be very quiet, only print warnings or errors\n"
+     "      --trace=FILE      record every read and write into the binary I/O trace\n"
+     "                          FILE. Replay it with fsreplay\n"
      "  -v, --verbose         be verbose, print what is being done\n"
      "  -vv                   be very verbose, print a lot of detailed output\n"
      "  -vvv                  be incredibly verbose (warning: prints LOTS of output)\n"
@@ -233,6 +252,7 @@ int fm_move::init(int argc, char const* const* argv)
     ft_log_fmt format = FC_FMT_MSG;
     ft_log_level level = FC_INFO, new_level;
     ft_log_color color = FC_COL_AUTO;
+    ft_size log_async_size = 0;
     bool format_set = false;
 
     do {
@@ -285,6 +305,16 @@ int fm_move::init(int argc, char const* const* argv)
                         break;
                     }
                 }
+                /* --log-async, --log-async=SIZE[k|M|G] */
+                else if (!strcmp(arg, "--log-async")) {
+                    log_async_size = FC_LOG_ASYNC_BUFFER_SIZE;
+                }
+                else if (!strncmp(arg, "--log-async=", 12)) {
+                    if ((err = ff_str2un_scaled(arg + 12, & log_async_size)) != 0 || log_async_size == 0) {
+                        err = invalid_cmdline(program_name, err, "invalid asynchronous log buffer size '%s'", arg + 12);
+                        break;
+                    }
+                }
                 else if (!strncmp(arg, "--log-color=", 12)) {
                     /* --color=(auto|none|ansi) */
                         arg += 12;
@@ -344,12 +374,57 @@ int fm_move::init(int argc, char const* const* argv)
                 }
                 else if (!strcmp(arg, "--inode-cache-mem")) {
                     args.inode_cache_path = NULL;
+                    args.inode_cache_compact = false;
+                }
+                else if (!strcmp(arg, "--inode-cache-compact")) {
+                    args.inode_cache_path = NULL;
+                    args.inode_cache_compact = true;
                 }
                 else if (!strncmp(arg, "--inode-cache=", 14)) {
                     // do not allow empty dir name
                     if (arg[14] != '\0')
                         args.inode_cache_path = arg + 14;
                 }
+                /* --max-bytes-per-sec=SIZE[k|M|G|T|P|E|Z|Y] */
+                else if (!strncmp(arg, "--max-bytes-per-sec=", 20)) {
+                    if ((err = ff_str2un_scaled(arg + 20, & args.max_bytes_per_sec)) != 0) {
+                        err = invalid_cmdline(program_name, err, "invalid max bytes per second '%s'", arg + 20);
+                        break;
+                    }
+                }
+                /* --jobs=NUM */
+                else if (!strncmp(arg, "--jobs=", 7)) {
+                    if ((err = ff_str2un(arg + 7, & args.jobs)) != 0 || args.jobs == 0) {
+                        err = invalid_cmdline(program_name, err, "invalid number of jobs '%s'", arg + 7);
+                        break;
+                    }
+                }
+                /* --order=MODE */
+                else if (!strncmp(arg, "--order=", 8)) {
+                    arg += 8;
+                    if (!strcmp(arg, "readdir"))
+                        args.order = FC_ORDER_READDIR;
+                    else if (!strcmp(arg, "inode"))
+                        args.order = FC_ORDER_INODE;
+                    else if (!strcmp(arg, "extent"))
+                        args.order = FC_ORDER_EXTENT;
+                    else {
+                        err = invalid_cmdline(program_name, 0, "invalid order '%s'", arg);
+                        break;
+                    }
+                }
+                /* --max-iops=NUM */
+                else if (!strncmp(arg, "--max-iops=", 11)) {
+                    if ((err = ff_str2un(arg + 11, & args.max_iops)) != 0) {
+                        err = invalid_cmdline(program_name, err, "invalid max I/O operations per second '%s'", arg + 11);
+                        break;
+                    }
+                }
+                /* --trace=FILE */
+                else if (!strncmp(arg, "--trace=", 8)) {
+                    if (arg[8] != '\0')
+                        args.trace_path = arg + 8;
+                }
                 else if (!strcmp(arg, "--help")) {
                     return usage(args.program_name);
                 }
@@ -414,6 +489,12 @@ int fm_move::init(int argc, char const* const* argv)
         // no dot alter appenders min_level
         ft_log_appender::reconfigure_all(format, FC_LEVEL_NOT_SET, color);
 
+        if (log_async_size != 0) {
+            int async_err = ft_log_appender::set_async_all(log_async_size);
+            if (async_err != 0)
+                ff_log(FC_WARN, async_err, "failed to enable asynchronous log, continuing with synchronous log");
+        }
+
         err = init(args);
     }
 
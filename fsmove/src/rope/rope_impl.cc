@@ -92,7 +92,9 @@ ft_rope_impl * ft_rope_impl::make(ft_rope_impl * prefix, const char * suffix, ft
 	ft_rope_impl * ths = reinterpret_cast<ft_rope_impl *>(bytes);
 	new (ths) ft_rope_impl(); // placement new
 	char * dst = ths->suffix() + prefix_len;
-	if ((ths->suffix_len = suffix_length) != 0)
+	// the copied prefix becomes part of the suffix
+	ths->suffix_len = prefix_len + suffix_length;
+	if (suffix_length != 0)
 		memcpy(dst, suffix, suffix_length);
 	do {
 		if ((prefix_len = prefix->suffix_len) != 0)
@@ -54,6 +54,7 @@
 #include "../log.hh"
 #include "../io/io_posix_dir.hh"
 #include "../cache/cache_mem.hh"
+#include "../cache/cache_rope.hh"
 #include "../zstring.hh"
 
 #include "rope_test.hh"
@@ -150,7 +151,7 @@ static ft_uoff recursive_readdir_zstring(ft_unsorted_map<ft_inode, ft_string> &
 	return count;
 }
 
-static ft_uoff recursive_readdir_cachemem(ft_cache_mem<ft_inode, ft_string> & cache,
+static ft_uoff recursive_readdir_cachemem(ft_cache<ft_inode, ft_string> & cache,
 					  const ft_string & path)
 {
 	ft_uoff count = 0;
@@ -221,6 +222,12 @@ int rope_test(int argc, char ** argv)
 		fputs("recursive_readdir_cachemem() completed. check RAM usage and press ENTER\n", stdout);
 		fflush(stdout);
 		fgetc(stdin);
+	} else if (argc > 1 && !strcmp(argv[1], "compact")) {
+		ft_cache_rope<ft_inode> cache;
+		recursive_readdir_cachemem(cache, path);
+		fputs("recursive_readdir_cachemem() on compact cache completed. check RAM usage and press ENTER\n", stdout);
+		fflush(stdout);
+		fgetc(stdin);
 	} else if (argc > 1 && !strcmp(argv[1], "zstring")) {
 		ft_map<ft_inode, ft_string> cache;
 		recursive_readdir_zstring(cache, path);
@@ -0,0 +1 @@
+../../fsremap/src/throttle.cc
\ No newline at end of file
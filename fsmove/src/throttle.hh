@@ -0,0 +1 @@
+../../fsremap/src/throttle.hh
\ No newline at end of file
@@ -0,0 +1 @@
+../../fsremap/src/trace.hh
\ No newline at end of file
@@ -0,0 +1 @@
+../../fsremap/src/zero.hh
\ No newline at end of file
@@ -34,9 +34,9 @@ FT_NAMESPACE_BEGIN
 fr_args::fr_args()
     : program_name("fsremap"), root_dir(NULL),
       io_args(), mount_points(), loop_dev(NULL),
-      ui_arg(NULL), cmd_losetup(NULL), cmd_umount(NULL),
-      storage_size(), job_id(FC_JOB_ID_AUTODETECT), job_clear(FC_CLEAR_AUTODETECT),
-      io_kind(FC_IO_AUTODETECT), ui_kind(FC_UI_NONE),
+      ui_arg(NULL), cmd_losetup(NULL), cmd_umount(NULL), plan_path(NULL), estimate_profile(NULL), emulate_profile(NULL), stats_path(NULL), control_path(NULL), trace_path(NULL),
+      storage_size(), max_bytes_per_sec(0), max_iops(0), job_id(FC_JOB_ID_AUTODETECT), job_clear(FC_CLEAR_AUTODETECT),
+      io_kind(FC_IO_AUTODETECT), ui_kind(FC_UI_NONE), plan_mode(FC_PLAN_NONE),
       force_run(false), simulate_run(false), ask_questions(false)
 {
     ft_size i, n;
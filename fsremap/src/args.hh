@@ -34,9 +34,10 @@ enum fr_storage_size     { FC_MEM_BUFFER_SIZE, FC_SECONDARY_STORAGE_SIZE, FC_PRI
 
 enum fr_clear_free_space { FC_CLEAR_AUTODETECT, FC_CLEAR_ALL, FC_CLEAR_MINIMAL, FC_CLEAR_NONE, };
 enum fr_job_id_kind      { FC_JOB_ID_AUTODETECT = 0 };
-enum fr_io_kind          { FC_IO_AUTODETECT, FC_IO_TEST, FC_IO_SELF_TEST, FC_IO_POSIX, FC_IO_PREALLOC };
+enum fr_io_kind          { FC_IO_AUTODETECT, FC_IO_TEST, FC_IO_EMULATE, FC_IO_SELF_TEST, FC_IO_SELF_VERIFY, FC_IO_POSIX, FC_IO_PREALLOC };
 enum fr_mount_points     { FC_MOUNT_POINT_DEVICE = 0, FC_MOUNT_POINT_LOOP_FILE, FC_MOUNT_POINTS_N };
 enum fr_ui_kind          { FC_UI_NONE, FC_UI_TTY };
+enum fr_plan_mode        { FC_PLAN_NONE, FC_PLAN_WRITE, FC_PLAN_RUN, FC_PLAN_SHOW, FC_PLAN_ESTIMATE };
 
 class fr_args
 {
@@ -49,11 +50,20 @@ public:
     const char * ui_arg;
     const char * cmd_losetup;        // 'losetup' command. currently only needed by fr_io_prealloc
     const char * cmd_umount;
+    const char * plan_path;          // execution plan to write, execute or show, depending on plan_mode
+    const char * estimate_profile;   // DEVICE profile for --estimate: "measure" or "THROUGHPUT,LATENCY_MS". if NULL, use default
+    const char * emulate_profile;    // DEVICE profile for --io=emulate: "hdd", "ssd", "nvme" or "THROUGHPUT,SEEK_MS[,QUEUE_DEPTH[,FLUSH_MS]]". if NULL, use "hdd"
+    const char * stats_path;         // write per-phase metrics to this JSON file. if NULL, do not collect metrics
+    const char * control_path;       // listen on this Unix socket for runtime commands. if NULL, do not listen
+    const char * trace_path;         // record I/O operations into this binary trace. if NULL, do not trace
     ft_size storage_size[FC_STORAGE_SIZE_N]; // if 0, will autodetect
+    ft_uoff max_bytes_per_sec;       // max DEVICE bytes per second to read or write. if 0, unlimited
+    ft_ull max_iops;                 // max DEVICE read() and write() per second. if 0, unlimited
     ft_uint job_id;                  // if FC_JOB_ID_AUTODETECT, will autodetect
     fr_clear_free_space job_clear;
     fr_io_kind io_kind;              // if FC_IO_AUTODETECT, will autodetect
     fr_ui_kind ui_kind;
+    fr_plan_mode plan_mode;
     bool force_run;                  // if true, some sanity checks will be WARNINGS instead of ERRORS
     bool simulate_run;               // if true, remapping algorithm runs WITHOUT reading or writing device blocks
     bool ask_questions;              // if true, remapping algorithm will ask confirmation and read answer from stdin before actually starting
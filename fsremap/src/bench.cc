@@ -0,0 +1,548 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * bench.cc
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#include "first.hh"
+
+#if defined(FT_HAVE_ERRNO_H)
+# include <errno.h>        // for errno, EINVAL
+#elif defined(FT_HAVE_CERRNO)
+# include <cerrno>         // for errno, EINVAL
+#endif
+#if defined(FT_HAVE_STDIO_H)
+# include <stdio.h>        // for FILE, fopen(), fprintf(), fclose()
+#elif defined(FT_HAVE_CSTDIO)
+# include <cstdio>         // for FILE, fopen(), fprintf(), fclose()
+#endif
+#if defined(FT_HAVE_STRING_H)
+# include <string.h>       // for strcmp(), strncmp(), strchr()
+#elif defined(FT_HAVE_CSTRING)
+# include <cstring>        // for strcmp(), strncmp(), strchr()
+#endif
+
+#include <vector>          // for std::vector<T>
+
+#include "log.hh"          // for ff_log(), ft_log
+#include "misc.hh"         // for ff_now(), ff_str2ull_scaled(), ff_str2un()
+#include "job.hh"          // for fr_job
+#include "map.hh"          // for fr_map<T>
+#include "pool.hh"         // for fr_pool<T>
+#include "vector.hh"       // for fr_vector<T>
+#include "work.hh"         // for fr_work<T>
+#include "zero.hh"         // for ff_mem_is_zero_impl(), ff_mem_zero_run()
+#include "io/io_null.hh"   // for ft_io_null
+#include "io/io_self_test.hh" // for fr_io_self_test::invent_layout()
+#include "io/persist.hh"   // for fr_persist
+
+FT_NAMESPACE_BEGIN
+
+enum {
+    /* synthetic extents use 4k blocks */
+    FC_BENCH_BLOCK_SIZE_LOG2 = 12,
+    /* maximum length of synthetic extents, in blocks */
+    FC_BENCH_MAX_EXTENT_BLOCKS = 16,
+    /*
+     * with FC_BENCH_MAX_EXTENT_BLOCKS = 16, each LOOP-FILE extent covers on average
+     * ~9.5 blocks (including physical holes): a DEVICE of 10 * N blocks gives ~N LOOP-FILE extents
+     */
+    FC_BENCH_BLOCKS_PER_EXTENT = 10,
+
+    /* zero scanning: buffer size, as used by fsmove, and number of times it is scanned per run */
+    FC_BENCH_ZERO_BUFSIZE = 65536,
+    FC_BENCH_ZERO_PASSES = 16384,
+    /* zero runs: block size, as used by fsmove */
+    FC_BENCH_ZERO_BLOCK_SIZE = 4096,
+};
+
+/** I/O returning the synthetic extents it is given. used to run fr_work<T>::run_analyze() */
+class fr_bench_io : public FT_IO_NS ft_io_null
+{
+private:
+    typedef FT_IO_NS ft_io_null super_type;
+
+    const fr_vector<ft_uoff> * this_loop_file_extents, * this_free_space_extents;
+
+protected:
+    /** copy the synthetic extents */
+    virtual int read_extents(fr_vector<ft_uoff> & loop_file_extents,
+                             fr_vector<ft_uoff> & free_space_extents,
+                             fr_vector<ft_uoff> & FT_ARG_UNUSED(to_zero_extents),
+                             ft_uoff & ret_block_size_bitmask)
+    {
+        loop_file_extents = * this_loop_file_extents;
+        free_space_extents = * this_free_space_extents;
+        ret_block_size_bitmask |= (ft_uoff) 1 << FC_BENCH_BLOCK_SIZE_LOG2;
+        return 0;
+    }
+
+public:
+    /** constructor */
+    fr_bench_io(FT_IO_NS fr_persist & persist)
+    : super_type(persist), this_loop_file_extents(NULL), this_free_space_extents(NULL)
+    { }
+
+    /** return true if synthetic extents were set */
+    virtual bool is_open() const { return dev_length() != 0; }
+
+    /** set synthetic extents. vectors are NOT copied, and must remain valid until this I/O is closed */
+    void layout(ft_uoff dev_len, const fr_vector<ft_uoff> & loop_file_extents, const fr_vector<ft_uoff> & free_space_extents)
+    {
+        dev_length(dev_len);
+        loop_file_length(dev_len);
+        dev_path("<bench-device>");
+        this_loop_file_extents = & loop_file_extents;
+        this_free_space_extents = & free_space_extents;
+    }
+};
+
+
+/** a single benchmark result */
+struct fr_bench_result
+{
+    const char * type, * operation;
+    ft_ull extents, loop_file_extents, free_space_extents, bytes;
+    double seconds;
+};
+
+/** scan 'mem_len' bytes starting at 'mem' using 'is_zero', return some value depending on the scan */
+typedef ft_size (* fr_bench_scan_func)(ft_mem_is_zero_func is_zero, const char * mem, ft_size mem_len);
+
+/**
+ * microbenchmark of the data structures and planning code used by fsremap:
+ * fr_vector<T>, fr_map<T>, fr_pool<T> and fr_work<T>::analyze(),
+ * for T = ft_uint and T = ft_uoff, on synthetic extents invented by fr_io_self_test::invent_layout().
+ * also measures the throughput of ff_mem_is_zero() and ff_mem_zero_run(), used by fsmove to detect holes.
+ *
+ * each operation is repeated on fresh copies of its input, and the fastest run is reported.
+ */
+class fr_bench
+{
+private:
+    std::vector<fr_bench_result> this_results;
+    std::vector<ft_ull> this_sizes;
+    ft_ull this_repeat;
+    const char * this_output;
+    bool this_uint, this_uoff, this_zero;
+
+    /* current synthetic extents */
+    fr_vector<ft_uoff> this_loop_file_extents, this_free_space_extents;
+    ft_uoff this_dev_len;
+    ft_ull this_extents;
+
+    /** add a result, and log it */
+    void add(const char * type, const char * operation, double seconds);
+
+    /** invent ~'extents' LOOP-FILE extents and some FREE-SPACE extents */
+    void invent(ft_ull extents);
+
+    /** convert a vector of byte extents into block extents */
+    template<typename T>
+    static void to_blocks(const fr_vector<ft_uoff> & bytes, fr_vector<T> & blocks);
+
+    /** run all benchmarks for T */
+    template<typename T>
+    int run_type(const char * type);
+
+    /** time FC_BENCH_ZERO_PASSES calls to scan(is_zero, mem, mem_len), this_repeat times, and add the fastest run */
+    void time_zero(const char * type, const char * operation, fr_bench_scan_func scan,
+                   ft_mem_is_zero_func is_zero, const char * mem, ft_size mem_len);
+
+    /** run all benchmarks of ff_mem_is_zero() and ff_mem_zero_run() */
+    void run_zero();
+
+    /** write results as JSON to this_output, or to stdout if NULL */
+    int write() const;
+
+    /** parse a comma-separated list of sizes */
+    int parse_sizes(const char * arg);
+
+public:
+    /** constructor */
+    fr_bench();
+
+    /** parse command line and run benchmarks */
+    int main(int argc, char ** argv);
+};
+
+/** constructor */
+fr_bench::fr_bench()
+    : this_results(), this_sizes(), this_repeat(3), this_output(NULL), this_uint(true), this_uoff(true), this_zero(true),
+      this_loop_file_extents(), this_free_space_extents(), this_dev_len(0), this_extents(0)
+{ }
+
+/** add a result, and log it */
+void fr_bench::add(const char * type, const char * operation, double seconds)
+{
+    fr_bench_result result = {
+        type, operation, this_extents, this_loop_file_extents.size(), this_free_space_extents.size(), 0, seconds
+    };
+    this_results.push_back(result);
+    ff_log(FC_INFO, 0, "%-7s %10" FT_ULL " extents: %-26s %10.6f seconds", type, this_extents, operation, seconds);
+}
+
+/** invent ~'extents' LOOP-FILE extents and some FREE-SPACE extents */
+void fr_bench::invent(ft_ull extents)
+{
+    ft_uoff block_size_bitmask = 0;
+    this_extents = extents;
+    this_dev_len = ((ft_uoff) extents * FC_BENCH_BLOCKS_PER_EXTENT) << FC_BENCH_BLOCK_SIZE_LOG2;
+    this_loop_file_extents.clear();
+    this_free_space_extents.clear();
+    FT_IO_NS fr_io_self_test::invent_layout(this_dev_len, FC_BENCH_BLOCK_SIZE_LOG2,
+                                            this_loop_file_extents, this_free_space_extents,
+                                            block_size_bitmask, FC_BENCH_MAX_EXTENT_BLOCKS);
+}
+
+/** convert a vector of byte extents into block extents */
+template<typename T>
+void fr_bench::to_blocks(const fr_vector<ft_uoff> & bytes, fr_vector<T> & blocks)
+{
+    fr_vector<ft_uoff>::const_iterator iter = bytes.begin(), end = bytes.end();
+    blocks.clear();
+    blocks.reserve(bytes.size());
+    for (; iter != end; ++iter)
+        blocks.append((T) (iter->first.physical >> FC_BENCH_BLOCK_SIZE_LOG2),
+                      (T) (iter->second.logical >> FC_BENCH_BLOCK_SIZE_LOG2),
+                      (T) (iter->second.length >> FC_BENCH_BLOCK_SIZE_LOG2), iter->second.user_data);
+}
+
+/*
+ * time 'statement' this_repeat times, each after executing 'setup', and add the fastest run.
+ * expects 'err', 'type', 'start', 'stop' and 'best' in scope
+ */
+#define FR_BENCH(operation, setup, statement) \
+    do { \
+        best = -1.0; \
+        for (ft_ull i_ = 0; err == 0 && i_ < this_repeat; i_++) { \
+            setup; \
+            (void) ff_now(start); \
+            statement; \
+            (void) ff_now(stop); \
+            if (best < 0.0 || best > stop - start) \
+                best = stop - start; \
+        } \
+        if (err == 0) \
+            add(type, operation, best); \
+    } while (0)
+
+/** run all benchmarks for T */
+template<typename T>
+int fr_bench::run_type(const char * type)
+{
+    const ft_uoff shift = FC_BENCH_BLOCK_SIZE_LOG2;
+    const ft_uoff dev_len = this_dev_len;
+    double start = 0.0, stop = 0.0, best = 0.0;
+    int err = 0;
+
+    if ((ft_uoff) (T) (dev_len >> shift) != (dev_len >> shift))
+        return ff_log(FC_ERROR, EOVERFLOW, "%" FT_ULL " extents are too many for %s", this_extents, type);
+
+    /* inputs, prepared as analyze() does */
+    fr_vector<ft_uoff> loop_by_logical = this_loop_file_extents, loop_by_physical = this_loop_file_extents;
+    fr_vector<ft_uoff> free_by_physical = this_free_space_extents, union_by_physical = this_loop_file_extents;
+    loop_by_physical.sort_by_physical();
+    free_by_physical.sort_by_physical();
+    union_by_physical.append_all(this_free_space_extents);
+    union_by_physical.sort_by_physical();
+
+    fr_vector<T> blocks_by_logical, blocks_by_physical, blocks;
+    to_blocks<T>(loop_by_logical, blocks_by_logical);
+    to_blocks<T>(loop_by_physical, blocks_by_physical);
+
+    fr_map<T> loop_map, loop_holes_map, dev_map, renumbered_map, map, allocated_map;
+    loop_map.append0_shift(loop_by_physical, shift);
+    loop_holes_map.complement0_logical_shift(loop_by_logical, shift, dev_len);
+    dev_map.complement0_physical_shift(union_by_physical, shift, dev_len);
+
+    /* fr_vector<T> */
+    FR_BENCH("sort_by_physical", blocks = blocks_by_logical, blocks.sort_by_physical());
+    FR_BENCH("sort_by_logical", blocks = blocks_by_physical, blocks.sort_by_logical());
+    FR_BENCH("sort_by_reverse_length", blocks = blocks_by_physical, blocks.sort_by_reverse_length());
+
+    /* fr_map<T> */
+    FR_BENCH("append0_shift", map.clear(), map.append0_shift(loop_by_physical, shift));
+    FR_BENCH("complement0_logical_shift", map.clear(), map.complement0_logical_shift(loop_by_logical, shift, dev_len));
+    FR_BENCH("complement0_physical_shift", map.clear(), map.complement0_physical_shift(union_by_physical, shift, dev_len));
+    FR_BENCH("merge_shift", map = loop_map, map.merge_shift(free_by_physical, shift, FC_PHYSICAL1));
+    FR_BENCH("intersect_all_all", renumbered_map.clear(), renumbered_map.intersect_all_all(dev_map, loop_holes_map, FC_BOTH));
+    FR_BENCH("remove_all", map = dev_map, map.remove_all(renumbered_map));
+
+    /* fr_pool<T>: best-fit allocation of DEVICE extents into LOOP-HOLES, as analyze() does */
+    loop_holes_map.remove_all(renumbered_map);
+    dev_map.remove_all(renumbered_map);
+    {
+        fr_map<T> holes_map;
+        FR_BENCH("pool_allocate_all",
+                 (holes_map = loop_holes_map, map = dev_map, allocated_map.clear()),
+                 fr_pool<T>(holes_map).allocate_all(map, allocated_map));
+    }
+
+    /* full analyze() */
+    {
+        FT_NS fr_job job;
+        FT_IO_NS fr_persist persist(job);
+        fr_bench_io io(persist);
+        fr_vector<ft_uoff> loop_file_extents, free_space_extents, to_zero_extents;
+
+        io.layout(dev_len, this_loop_file_extents, this_free_space_extents);
+        /* fr_bench_io::read_extents() hides the public fr_io::read_extents() */
+        FT_IO_NS fr_io & base_io = io;
+        io.job_clear(FC_CLEAR_ALL);
+
+        /* silence the messages logged by analyze() */
+        ft_log & root_logger = ft_log::get_root_logger();
+        const ft_log_level level = root_logger.get_level();
+        FR_BENCH("analyze",
+                 (loop_file_extents.clear(), free_space_extents.clear(), to_zero_extents.clear(),
+                  err = base_io.read_extents(loop_file_extents, free_space_extents, to_zero_extents)),
+                 if (err == 0) {
+                     root_logger.set_level(FC_WARN);
+                     err = fr_work<T>().run_analyze(loop_file_extents, free_space_extents, to_zero_extents, io);
+                     root_logger.set_level(level);
+                 });
+    }
+    return err;
+}
+
+/** ff_mem_is_zero() implementation used before vectorization: compare one byte at time */
+static bool fr_bench_mem_is_zero_bytewise(const char * mem, ft_size mem_len)
+{
+    for (ft_size i = 0; i < mem_len; i++)
+        if (mem[i] != '\0')
+            return false;
+    return true;
+}
+
+/** return 1 if memory is all zero, else 0 */
+static ft_size fr_bench_scan_is_zero(ft_mem_is_zero_func is_zero, const char * mem, ft_size mem_len)
+{
+    return is_zero(mem, mem_len) ? 1 : 0;
+}
+
+/**
+ * split memory into runs of zero and non-zero blocks as fsmove did before ff_mem_zero_run():
+ * a bytewise scan for zero blocks, followed by a scan for non-zero blocks. return the number of runs
+ */
+static ft_size fr_bench_scan_runs_bytewise(ft_mem_is_zero_func FT_ARG_UNUSED(is_zero), const char * mem, ft_size mem_len)
+{
+    const ft_size block_size = FC_BENCH_ZERO_BLOCK_SIZE;
+    ft_size runs = 0, len, aligned_len;
+    while (mem_len != 0) {
+        /* hole_length() */
+        aligned_len = mem_len / block_size * block_size;
+        for (len = 0; len < aligned_len && mem[len] == '\0'; len++)
+            ;
+        len = len / block_size * block_size;
+        mem += len, mem_len -= len, runs += len != 0;
+
+        /* nonhole_length() */
+        for (len = 0; mem_len - len >= block_size && !fr_bench_mem_is_zero_bytewise(mem + len, block_size); len += block_size)
+            ;
+        if (mem_len - len < block_size)
+            len = mem_len;
+        mem += len, mem_len -= len, runs += len != 0;
+    }
+    return runs;
+}
+
+/** split memory into runs of zero and non-zero blocks with ff_mem_zero_run(). return the number of runs */
+static ft_size fr_bench_scan_runs(ft_mem_is_zero_func FT_ARG_UNUSED(is_zero), const char * mem, ft_size mem_len)
+{
+    ft_size runs = 0, len;
+    bool is_hole;
+    for (; mem_len != 0; mem += len, mem_len -= len, runs++)
+        len = ff_mem_zero_run(mem, mem_len, FC_BENCH_ZERO_BLOCK_SIZE, is_hole);
+    return runs;
+}
+
+/** time FC_BENCH_ZERO_PASSES calls to scan(is_zero, mem, mem_len), this_repeat times, and add the fastest run */
+void fr_bench::time_zero(const char * type, const char * operation, fr_bench_scan_func scan,
+                         ft_mem_is_zero_func is_zero, const char * mem, ft_size mem_len)
+{
+    const ft_ull bytes = (ft_ull) mem_len * FC_BENCH_ZERO_PASSES;
+    double start = 0.0, stop = 0.0, best = -1.0;
+    ft_size check = 0;
+
+    for (ft_ull i = 0; i < this_repeat; i++) {
+        (void) ff_now(start);
+        for (ft_size pass = 0; pass < FC_BENCH_ZERO_PASSES; pass++)
+            check += scan(is_zero, mem, mem_len);
+        (void) ff_now(stop);
+        if (best < 0.0 || best > stop - start)
+            best = stop - start;
+    }
+    fr_bench_result result = { type, operation, 0, 0, 0, bytes, best };
+    this_results.push_back(result);
+    ff_log(FC_INFO, 0, "%-12s %-10s %10.6f seconds, %7.2f GB/s (check %" FT_ULL ")", type, operation, best,
+           best > 0.0 ? bytes / best * 1e-9 : 0.0, (ft_ull) check);
+}
+
+/** run all benchmarks of ff_mem_is_zero() and ff_mem_zero_run() */
+void fr_bench::run_zero()
+{
+    std::vector<char> zeroes(FC_BENCH_ZERO_BUFSIZE), mixed(FC_BENCH_ZERO_BUFSIZE);
+
+    /*
+     * mixed buffer: alternating runs of zero blocks and non-zero blocks.
+     * non-zero blocks contain a single non-zero byte at their end, i.e. the worst case for both scans
+     */
+    for (ft_size block = 0, n = FC_BENCH_ZERO_BUFSIZE / FC_BENCH_ZERO_BLOCK_SIZE; block < n; block++)
+        if ((block % 6) >= 3 - (block / 6) % 3)
+            mixed[(block + 1) * FC_BENCH_ZERO_BLOCK_SIZE - 1] = 1;
+
+    time_zero("mem_is_zero", "bytewise", fr_bench_scan_is_zero, fr_bench_mem_is_zero_bytewise, & zeroes[0], zeroes.size());
+    for (int impl = FC_ZERO_GENERIC; impl < FC_ZERO_IMPL_COUNT; impl++) {
+        ft_mem_is_zero_func func = ff_mem_is_zero_impl((ft_zero_impl) impl);
+        if (func != NULL)
+            time_zero("mem_is_zero", ff_mem_is_zero_impl_name((ft_zero_impl) impl),
+                      fr_bench_scan_is_zero, func, & zeroes[0], zeroes.size());
+    }
+    time_zero("mem_is_zero", "dispatch", fr_bench_scan_is_zero, ff_mem_is_zero, & zeroes[0], zeroes.size());
+
+    time_zero("mem_zero_run", "bytewise", fr_bench_scan_runs_bytewise, NULL, & mixed[0], mixed.size());
+    time_zero("mem_zero_run", "dispatch", fr_bench_scan_runs, NULL, & mixed[0], mixed.size());
+}
+
+/** write results as JSON to this_output, or to stdout if NULL */
+int fr_bench::write() const
+{
+    FILE * f = this_output != NULL ? fopen(this_output, "w") : stdout;
+    if (f == NULL)
+        return ff_log(FC_ERROR, errno, "failed to create output file '%s'", this_output);
+
+    fprintf(f, "{\n  \"block_size\": %" FT_ULL ",\n  \"repeat\": %" FT_ULL ",\n  \"results\": [",
+            (ft_ull) 1 << FC_BENCH_BLOCK_SIZE_LOG2, this_repeat);
+    for (ft_size i = 0, n = this_results.size(); i < n; i++) {
+        const fr_bench_result & r = this_results[i];
+        fprintf(f, "%s\n    { \"type\": \"%s\", \"extents\": %" FT_ULL ", \"loop_file_extents\": %" FT_ULL
+                ", \"free_space_extents\": %" FT_ULL ", \"bytes\": %" FT_ULL ", \"operation\": \"%s\", \"seconds\": %.9f }",
+                i != 0 ? "," : "", r.type, r.extents, r.loop_file_extents, r.free_space_extents, r.bytes,
+                r.operation, r.seconds);
+    }
+    fprintf(f, "\n  ]\n}\n");
+
+    int err = 0;
+    if (ferror(f))
+        err = ff_log(FC_ERROR, EIO, "I/O error writing to output file '%s'", this_output != NULL ? this_output : "<stdout>");
+    if (this_output != NULL && fclose(f) != 0 && err == 0)
+        err = ff_log(FC_ERROR, errno, "I/O error closing output file '%s'", this_output);
+    return err;
+}
+
+/** parse a comma-separated list of sizes */
+int fr_bench::parse_sizes(const char * arg)
+{
+    ft_string str;
+    ft_ull n;
+    int err = 0;
+    this_sizes.clear();
+    while (err == 0 && arg != NULL) {
+        const char * comma = strchr(arg, ',');
+        str.assign(arg, comma != NULL ? comma - arg : strlen(arg));
+        if ((err = ff_str2ull_scaled(str.c_str(), & n)) != 0 || n == 0)
+            return ff_log(FC_ERROR, err ? err : EINVAL, "invalid number of extents '%s'", str.c_str());
+        this_sizes.push_back(n);
+        arg = comma != NULL ? comma + 1 : NULL;
+    }
+    return err;
+}
+
+static int bench_help(const char * program_name)
+{
+    ff_log(FC_NOTICE, 0, "Usage: %s [OPTION]...", program_name);
+    ff_log(FC_NOTICE, 0, "Time fsremap data structures and planning code on synthetic extents,");
+    ff_log(FC_NOTICE, 0, "and the zero-block scanner used to detect holes,");
+    ff_log(FC_NOTICE, 0, "and write the results as JSON.\n");
+    return ff_log(FC_NOTICE, 0,
+     "Options:\n"
+     "  --extents=N[,N...]  number of LOOP-FILE extents to invent, with optional\n"
+     "                        [k|M|G] suffix (default: 10000,100000,1000000)\n"
+     "  --output=FILE       write results to FILE instead of standard output\n"
+     "  --repeat=N          repeat each operation N times, report the fastest (default: 3)\n"
+     "  --type=TYPE         benchmark only TYPE, one of: ft_uint, ft_uoff, zero\n"
+     "                        (default: all)\n"
+     "  -v, --verbose       also log each result as it is measured\n"
+     "  --help              display this help and exit");
+}
+
+/** parse command line and run benchmarks */
+int fr_bench::main(int argc, char ** argv)
+{
+    const char * program_name = argv[0];
+    ft_log_level level = FC_NOTICE;
+    int err = 0;
+
+    this_sizes.push_back(10000);
+    this_sizes.push_back(100000);
+    this_sizes.push_back(1000000);
+
+    while (err == 0 && --argc) {
+        const char * arg = * ++argv;
+        if (!strcmp(arg, "--help"))
+            return bench_help(program_name);
+        else if (!strcmp(arg, "-v") || !strcmp(arg, "--verbose"))
+            level = FC_INFO;
+        else if (!strncmp(arg, "--extents=", 10))
+            err = parse_sizes(arg + 10);
+        else if (!strncmp(arg, "--output=", 9))
+            this_output = arg + 9;
+        else if (!strncmp(arg, "--repeat=", 9)) {
+            if ((err = ff_str2un(arg + 9, & this_repeat)) != 0 || this_repeat == 0)
+                err = ff_log(FC_ERROR, err ? err : EINVAL, "invalid repeat count '%s'", arg + 9);
+        } else if (!strcmp(arg, "--type=ft_uint"))
+            this_uoff = this_zero = false, this_uint = true;
+        else if (!strcmp(arg, "--type=ft_uoff"))
+            this_uint = this_zero = false, this_uoff = true;
+        else if (!strcmp(arg, "--type=zero"))
+            this_uint = this_uoff = false, this_zero = true;
+        else {
+            ff_log(FC_ERROR, 0, "%s: invalid option '%s'", program_name, arg);
+            ff_log(FC_NOTICE, 0, "Try `%s --help' for more information.", program_name);
+            return 1;
+        }
+    }
+    ft_log::get_root_logger().set_level(level);
+
+    if (this_zero)
+        run_zero();
+
+    for (ft_size i = 0, n = this_sizes.size(); err == 0 && (this_uint || this_uoff) && i < n; i++) {
+        invent(this_sizes[i]);
+        if (this_uint)
+            err = run_type<ft_uint>("ft_uint");
+        if (err == 0 && this_uoff)
+            err = run_type<ft_uoff>("ft_uoff");
+    }
+    if (err == 0)
+        err = write();
+    return err != 0 ? 1 : 0;
+}
+
+FT_NAMESPACE_END
+
+
+int main(int argc, char ** argv) {
+    FT_NS fr_bench bench;
+    return bench.main(argc, argv);
+}
@@ -25,115 +25,160 @@
 
 #include "first.hh"
 
-#if defined(FT_HAVE_ERRNO_H)
-# include <errno.h>      // for errno, EDOM
-#elif defined(FT_HAVE_CERRNO)
-# include <cerrno>       // for errno, EDOM
-#endif
-#if defined(FT_HAVE_TIME_H)
-# include <time.h>     // for time_t, time()
-#elif defined(FT_HAVE_CTIME)
-# include <ctime>      // for time_t, time()
-#endif
-
-#include "eta.hh"        // for ft_eta
-#include "misc.hh"       // for ft_now
+#include "eta.hh"        // for ft_eta, ft_eta_throughput
+#include "misc.hh"       // for ff_now()
 
 
 FT_NAMESPACE_BEGIN
 
-
-static int ff_least_squares(ft_size N, const double xi[], const double yi[], double & ret_m, double & ret_q);
+enum { FC_ETA_MIN_N = 3 };
 
 /** default constructor */
 ft_eta::ft_eta(ft_size max_n)
-    : this_x(), this_y()
 {
     clear(max_n);
 }
 
 void ft_eta::clear(ft_size max_n)
 {
-	this_x.clear();
-	this_y.clear();
-
-    this_max_n = max_n;
+    this_n = this_next = 0;
+    this_max_n = max_n < (ft_size) MAX_N ? max_n : (ft_size) MAX_N;
 }
 
 
 /**
- * add percentage and {current timestamp} to the sliding E.T.A. extrapolation.
+ * add percentage and {current timestamp} to the sliding window E.T.A. extrapolation.
  * return number of seconds to E.T.A., or < 0 if not enough data available yet.
  */
-double ft_eta::add(double y)
+double ft_eta::add(double y, double min_time_left)
 {
-	enum { FC_ETA_MIN_N = 3 };
-
-    double x = 0.0;
-    if (this_max_n == 0 || ff_now(x) != 0)
-        return -1.0; /* also in case of error in gettimeofday */
-
-    /* slide window */
-    ft_size n = this_x.size();
-    if (n < this_max_n)
-    	n++;
-    else {
-    	this_x.erase(this_x.begin());
-    	this_y.erase(this_y.begin());
+    double x = 0.0, x_left = -1.0;
+    if (this_max_n != 0 && ff_now(x) == 0) {
+        /* slide window: overwrite the oldest sample */
+        this_x[this_next] = x;
+        this_y[this_next] = y;
+        if (++this_next == this_max_n)
+            this_next = 0;
+        if (this_n < this_max_n)
+            this_n++;
+
+        if (this_n >= FC_ETA_MIN_N || this_n == this_max_n) {
+            /* average progress speed between oldest and newest sample */
+            ft_size oldest = this_n < this_max_n ? 0 : this_next;
+            double dx = x - this_x[oldest], dy = y - this_y[oldest];
+            if (dx > 0.0 && dy > 0.0)
+                x_left = (1.0 - y) * dx / dy;
+        }
     }
-    this_x.push_back(x);
-    this_y.push_back(y);
-
-    if (n < this_max_n && n < FC_ETA_MIN_N)
-        return -1.0; /* not enough data available yet */
-
-    /*
-     * use the simple linear regression (least squares)
-     * formula to find the line best-fitting all points
-     */
-    double m_all = 0.0, q_all, m_last = 0.0, q_last, m;
-    int err = ff_least_squares(n, & this_x[0], & this_y[0], m_all, q_all);
-    if (err != 0 || m_all <= 0.0)
-        return -1.0; /* ill-conditioned data */
-
-    /* repeat to find the line best-fitting last FC_ETA_MIN_N points */
-    err = ff_least_squares(FC_ETA_MIN_N, & this_x[0], & this_y[0], m_last, q_last);
-    if (err == 0 && m_last > 0.0)
-        /* make a brutal average between the two computed m */
-        m = 0.5 * (m_all + m_last);
-    else
-        m = m_all;
-
-    /* but then cheat and change q to force the best-fitting line to pass from last point */
-    double x_left = (1.0 - y) / m;
-    if (x_left < 0.0)
-        return -1.0; /* E.T.A. is in the past! */
-
+    if (min_time_left > 0.0 && x_left < min_time_left)
+        x_left = min_time_left;
     return x_left;
 }
 
-static int ff_least_squares(ft_size N, const double x[], const double y[], double & ret_m, double & ret_q)
+
+
+/** default constructor */
+ft_eta_throughput::ft_eta_throughput(ft_size channels, ft_size max_n)
+{
+    clear(channels, max_n);
+}
+
+void ft_eta_throughput::clear(ft_size channels, ft_size max_n)
+{
+    this_channels = channels < (ft_size) MAX_CHANNELS ? channels : (ft_size) MAX_CHANNELS;
+    this_n = this_next = 0;
+    this_max_n = max_n < (ft_size) MAX_N ? max_n : (ft_size) MAX_N;
+}
+
+/**
+ * add {current timestamp} and cumulative done[i] and busy[i] seconds of each channel
+ * to the sliding window
+ */
+void ft_eta_throughput::add(const double done[], const double busy[])
+{
+    double now = 0.0;
+    if (this_max_n == 0 || ff_now(now) != 0)
+        return;
+
+    /* slide window: overwrite the oldest sample */
+    ft_eta_sample & sample = this_samples[this_next];
+    sample.time = now;
+    for (ft_size i = 0; i < this_channels; i++) {
+        sample.done[i] = done[i];
+        sample.busy[i] = busy[i];
+    }
+    if (this_n == 0)
+        this_first = sample;
+    if (++this_next == this_max_n)
+        this_next = 0;
+    if (this_n < this_max_n)
+        this_n++;
+}
+
+/**
+ * return seconds needed to perform one unit of work on 'channel',
+ * as measured between samples 'from' and 'to', or < 0 if not measurable
+ */
+double ft_eta_throughput::seconds_per_unit(const ft_eta_sample & from, const ft_eta_sample & to, ft_size channel) const
+{
+    const double wall = to.time - from.time;
+    double done = 0.0, busy = 0.0;
+    for (ft_size i = 0; i < this_channels; i++) {
+        done += to.done[i] - from.done[i];
+        busy += to.busy[i] - from.busy[i];
+    }
+    if (wall <= 0.0 || done <= 0.0)
+        return -1.0;
+
+    const double channel_done = to.done[channel] - from.done[channel];
+    const double channel_busy = to.busy[channel] - from.busy[channel];
+    if (channel_done <= 0.0)
+        return -1.0;
+    if (busy <= 0.0 || channel_busy <= 0.0)
+        /* busy time not measurable: assume all channels are equally fast */
+        return wall / done;
+
+    return (channel_busy / channel_done) * (wall / busy);
+}
+
+/**
+ * return number of seconds needed to perform left[i] more work on each channel,
+ * or < 0 if not enough data available yet.
+ */
+double ft_eta_throughput::time_left(const double left[], double min_time_left) const
 {
-    double X = 0, X2 = 0; /* X  = sum(x[i]), X2 = sum(x[i]^2) */
-    double Y = 0, Y2 = 0; /* Y  = sum(y[i]), Y2 = sum(y[i]^2) */
-    double XY = 0;        /* XY = sum(x[i]*y[i]) */
-    double x0 = x[0], y0 = y[0], x_, y_;
-
-    for (ft_size i = 0; i < N; i++) {
-        x_ = x[i] - x0;
-        y_ = y[i] - y0;
-        X  += x_; X2 += x_ * x_;
-        Y  += y_; Y2 += y_ * y_;
-        XY += x_ * y_;
+    double x_left = -1.0;
+    if (this_n >= 2) {
+        const ft_eta_sample & oldest = this_samples[this_n < this_max_n ? 0 : this_next];
+        const ft_eta_sample & newest = this_samples[(this_next != 0 ? this_next : this_max_n) - 1];
+        double average = -1.0, spu;
+
+        x_left = 0.0;
+        for (ft_size i = 0; x_left >= 0.0 && i < this_channels; i++) {
+            if (left[i] <= 0.0)
+                continue;
+            /*
+             * prefer the throughput measured in the sliding window. if this channel did no work there,
+             * fall back on its throughput since first sample, then on the average of all channels
+             */
+            if ((spu = seconds_per_unit(oldest, newest, i)) < 0.0
+                && (spu = seconds_per_unit(this_first, newest, i)) < 0.0)
+            {
+                if (average < 0.0) {
+                    double done = 0.0;
+                    for (ft_size j = 0; j < this_channels; j++)
+                        done += newest.done[j] - this_first.done[j];
+                    if (done > 0.0)
+                        average = (newest.time - this_first.time) / done;
+                }
+                spu = average;
+            }
+            x_left = spu >= 0.0 ? x_left + left[i] * spu : -1.0;
+        }
     }
-    double v = X2 - X*X/N;
-    if (v == 0.0)
-        return -EDOM;
-    double c = XY - X*Y/N;
-    ret_m = c / v;
-    /* adjust back for x0, y0 */
-    ret_q = (Y - ret_m*X) / N + (y0 - ret_m*x0);
-    return 0;
+    if (min_time_left > 0.0 && x_left < min_time_left)
+        x_left = min_time_left;
+    return x_left;
 }
 
 FT_NAMESPACE_END
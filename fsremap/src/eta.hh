@@ -28,34 +28,88 @@
 
 #include "types.hh"         // for ft_size
 
-#include <vector>           // for std::vector<T>
-
 FT_NAMESPACE_BEGIN
 
-/** estimates time-of-arrival from a sliding window extrapolation of last 3 progress percentages */
+/**
+ * estimates time-of-arrival from the progress percentage observed over a sliding window
+ * of the last samples. cost is O(1) per sample
+ */
 class ft_eta
 {
+public:
+    enum { DEFAULT_MAX_N = 12, MAX_N = 16 };
+
 private:
-    std::vector<double> this_x;
-    std::vector<double> this_y;
-    ft_size this_max_n;
+    double this_x[MAX_N], this_y[MAX_N];
+    ft_size this_n, this_next, this_max_n;
 
 public:
-    enum { DEFAULT_MAX_N = 12 };
-
     ft_eta(ft_size max_n = DEFAULT_MAX_N);
 
     /**
      * add percentage and {current timestamp} to the sliding window E.T.A. extrapolation.
      * return number of seconds to E.T.A., or < 0 if not enough data available yet.
+     *
+     * if 'min_time_left' > 0, it is a lower bound known in advance (for example imposed by I/O throttling):
+     * the returned E.T.A. is never smaller, and it is returned also if not enough data is available yet.
      */
-    double add(double percentage);
+    double add(double percentage, double min_time_left = 0.0);
 
     /* reset this E.T.A. to empty */
     void clear(ft_size max_n = DEFAULT_MAX_N);
 };
 
 
+/**
+ * estimates time-of-arrival of work split in several channels (for example copy directions),
+ * from the throughput of each channel measured over a sliding window of the last samples.
+ *
+ * each sample contains, for each channel, the cumulative amount of work done
+ * and the cumulative seconds spent doing it. the wall-clock time not spent in any channel
+ * (planning, flushing...) is distributed among channels proportionally to their busy time.
+ * cost is O(channels) per sample
+ */
+class ft_eta_throughput
+{
+public:
+    enum { DEFAULT_MAX_N = ft_eta::DEFAULT_MAX_N, MAX_N = ft_eta::MAX_N, MAX_CHANNELS = 4 };
+
+private:
+    struct ft_eta_sample {
+        double time, done[MAX_CHANNELS], busy[MAX_CHANNELS];
+    };
+    ft_eta_sample this_samples[MAX_N], this_first;
+    ft_size this_channels, this_n, this_next, this_max_n;
+
+    /**
+     * return seconds needed to perform one unit of work on 'channel',
+     * as measured between samples 'from' and 'to', or < 0 if not measurable
+     */
+    double seconds_per_unit(const ft_eta_sample & from, const ft_eta_sample & to, ft_size channel) const;
+
+public:
+    ft_eta_throughput(ft_size channels = 1, ft_size max_n = DEFAULT_MAX_N);
+
+    /**
+     * add {current timestamp} and cumulative done[i] and busy[i] seconds of each channel
+     * to the sliding window
+     */
+    void add(const double done[], const double busy[]);
+
+    /**
+     * return number of seconds needed to perform left[i] more work on each channel,
+     * or < 0 if not enough data available yet.
+     *
+     * if 'min_time_left' > 0, it is a lower bound known in advance (for example imposed by I/O throttling):
+     * the returned E.T.A. is never smaller, and it is returned also if not enough data is available yet.
+     */
+    double time_left(const double left[], double min_time_left = 0.0) const;
+
+    /* reset this E.T.A. to empty */
+    void clear(ft_size channels = 1, ft_size max_n = DEFAULT_MAX_N);
+};
+
+
 FT_NAMESPACE_END
 
 #endif /* FSTRANSFORM_ETA_HH */
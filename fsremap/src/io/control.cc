@@ -0,0 +1,356 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * io/control.cc
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#include "../first.hh"
+
+#if defined(FT_HAVE_ERRNO_H)
+# include <errno.h>      // for errno, EISCONN, ENAMETOOLONG, ENOSYS, EADDRINUSE, EAGAIN
+#elif defined(FT_HAVE_CERRNO)
+# include <cerrno>       // for errno, EISCONN, ENAMETOOLONG, ENOSYS, EADDRINUSE, EAGAIN
+#endif
+#if defined(FT_HAVE_STRING_H)
+# include <string.h>     // for memset(), strlen(), strcmp(), strncpy()
+#elif defined(FT_HAVE_CSTRING)
+# include <cstring>      // for memset(), strlen(), strcmp(), strncpy()
+#endif
+#if defined(FT_HAVE_STDIO_H)
+# include <stdio.h>      // for snprintf(), sscanf()
+#elif defined(FT_HAVE_CSTDIO)
+# include <cstdio>       // for snprintf(), sscanf()
+#endif
+
+#ifdef FT_HAVE_UNISTD_H
+# include <unistd.h>     // for close(), unlink()
+#endif
+#ifdef FT_HAVE_FCNTL_H
+# include <fcntl.h>      // for fcntl(), F_GETFL, F_SETFL, O_NONBLOCK
+#endif
+#ifdef FT_HAVE_SYS_SOCKET_H
+# include <sys/socket.h> // for socket(), bind(), listen(), accept(), connect(), recv(), send()
+#endif
+#ifdef FT_HAVE_SYS_UN_H
+# include <sys/un.h>     // for struct sockaddr_un
+#endif
+
+#include "../log.hh"     // for ff_log()
+#include "../misc.hh"    // for ff_now(), ff_str2un_scaled()
+#include "io.hh"         // for fr_io
+#include "control.hh"    // for fr_control
+
+#if defined(FT_HAVE_SYS_SOCKET_H) && defined(FT_HAVE_SYS_UN_H) && defined(FT_HAVE_SOCKET) && defined(AF_UNIX)
+# define FT_HAVE_CONTROL_SOCKET
+#endif
+
+FT_IO_NAMESPACE_BEGIN
+
+enum {
+    /* max length of a command line */
+    FC_CONTROL_REQUEST_MAX = 256,
+    /* drop clients that do not send a complete command line within this time, in seconds */
+    FC_CONTROL_CLIENT_TIMEOUT = 10,
+};
+
+static const char FC_CONTROL_HELP[] =
+    "status                 show progress and current tunables\n"
+    "set mem-buffer SIZE    max RAM buffer used by each device to device batch (0 = whole buffer)\n"
+    "set max-rate SIZE      max device bytes per second (0 = unlimited)\n"
+    "set max-iops NUM       max device read() and write() per second (0 = unlimited)\n"
+    "set prefetch SIZE      device bytes to read ahead while copying (0 = disabled)\n"
+    "help                   show this help\n";
+
+
+/** constructor */
+fr_control::fr_control()
+    : this_path(), this_request(), this_io(NULL), this_client_time(0.0),
+      this_percentage(0.0), this_time_left(-1.0), this_bytes_left(0), this_fd(-1), this_client_fd(-1)
+{ }
+
+/** destructor. calls close() */
+fr_control::~fr_control()
+{
+    close();
+}
+
+#ifdef FT_HAVE_CONTROL_SOCKET
+
+/** set O_NONBLOCK on fd. return 0 or errno */
+static int ff_control_nonblock(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0)
+        return errno;
+    return 0;
+}
+
+/** bind listening socket to this_path. if a stale socket exists, remove it and retry */
+int fr_control::bind_socket(int fd)
+{
+    const char * path = this_path.c_str();
+    struct sockaddr_un addr;
+    memset(& addr, '\0', sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    if (bind(fd, (const struct sockaddr *) & addr, sizeof(addr)) == 0)
+        return 0;
+    int err = errno;
+    if (err != EADDRINUSE)
+        return err;
+
+    /* somebody is listening? then do not steal the socket */
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0)
+        return err;
+    bool in_use = connect(probe, (const struct sockaddr *) & addr, sizeof(addr)) == 0;
+    (void) ::close(probe);
+    if (in_use || unlink(path) != 0)
+        return err;
+
+    if (bind(fd, (const struct sockaddr *) & addr, sizeof(addr)) != 0)
+        return errno;
+    return 0;
+}
+
+/** create control socket 'path' to inspect and tune 'io' */
+int fr_control::open(const char * path, fr_io & io)
+{
+    if (is_open()) {
+        ff_log(FC_ERROR, 0, "unexpected call to fr_control::open(), control socket '%s' is already open", this_path.c_str());
+        return -EISCONN;
+    }
+    if (strlen(path) >= sizeof(((struct sockaddr_un *) 0)->sun_path))
+        return ff_log(FC_ERROR, ENAMETOOLONG, "control socket path '%s' is too long", path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return ff_log(FC_ERROR, errno, "failed to create control socket '%s'", path);
+
+    this_path = path;
+    int err = bind_socket(fd);
+    if (err == 0 && listen(fd, 4) != 0)
+        err = errno;
+    if (err == 0)
+        err = ff_control_nonblock(fd);
+    if (err != 0) {
+        (void) ::close(fd);
+        this_path.clear();
+        return ff_log(FC_ERROR, err, "failed to listen on control socket '%s'", path);
+    }
+    this_fd = fd;
+    this_io = & io;
+    ff_log(FC_INFO, 0, "listening on control socket '%s'", path);
+    return 0;
+}
+
+/** close current client connection */
+void fr_control::close_client()
+{
+    if (this_client_fd >= 0) {
+        (void) ::close(this_client_fd);
+        this_client_fd = -1;
+    }
+    this_request.clear();
+}
+
+/** accept and serve pending requests, without blocking */
+void fr_control::poll()
+{
+    if (this_fd < 0)
+        return;
+
+    double now = 0.0;
+    (void) ff_now(now);
+
+    for (;;) {
+        if (this_client_fd < 0) {
+            int fd = accept(this_fd, NULL, NULL);
+            if (fd < 0)
+                return; /* usually EAGAIN: no pending connections */
+            if (ff_control_nonblock(fd) != 0) {
+                (void) ::close(fd);
+                continue;
+            }
+            this_client_fd = fd;
+            this_client_time = now;
+        }
+
+        char buf[FC_CONTROL_REQUEST_MAX];
+        ssize_t got = recv(this_client_fd, buf, sizeof(buf), 0);
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            if (now < this_client_time + FC_CONTROL_CLIENT_TIMEOUT)
+                return; /* wait for the rest of the command at next poll() */
+            close_client();
+            continue;
+        }
+        if (got > 0)
+            this_request.append(buf, (ft_size) got);
+
+        ft_size eol = this_request.find('\n');
+        if (eol == ft_string::npos) {
+            if (got > 0 && this_request.size() < FC_CONTROL_REQUEST_MAX)
+                continue;
+            /* EOF, error or line too long: execute what we got, if anything */
+            eol = got == 0 ? this_request.size() : 0;
+            if (eol == 0) {
+                close_client();
+                continue;
+            }
+        }
+        this_request.resize(eol);
+        if (!this_request.empty() && this_request[eol - 1] == '\r')
+            this_request.resize(eol - 1);
+
+        ft_string reply;
+        execute(this_request.c_str(), reply);
+
+        int flags = 0;
+#ifdef MSG_NOSIGNAL
+        flags = MSG_NOSIGNAL;
+#endif
+        /* replies are small: they fit in socket buffer, and if not, the client loses the tail */
+        (void) send(this_client_fd, reply.c_str(), reply.size(), flags);
+        close_client();
+    }
+}
+
+/** close and remove control socket */
+void fr_control::close()
+{
+    close_client();
+    if (this_fd >= 0) {
+        (void) ::close(this_fd);
+        (void) unlink(this_path.c_str());
+        this_fd = -1;
+    }
+    this_path.clear();
+    this_io = NULL;
+}
+
+#else /* !FT_HAVE_CONTROL_SOCKET */
+
+int fr_control::bind_socket(int fd)
+{
+    (void) fd;
+    return ENOSYS;
+}
+
+int fr_control::open(const char * path, fr_io & io)
+{
+    (void) io;
+    return ff_log(FC_ERROR, ENOSYS, "cannot create control socket '%s': Unix-domain sockets not supported on this platform", path);
+}
+
+void fr_control::close_client()
+{ }
+
+void fr_control::poll()
+{ }
+
+void fr_control::close()
+{ }
+
+#endif /* FT_HAVE_CONTROL_SOCKET */
+
+
+/** remember progress, as computed by fr_work<T>::show_progress() */
+void fr_control::progress(double percentage, ft_uoff bytes_left, double time_left)
+{
+    this_percentage = percentage;
+    this_bytes_left = bytes_left;
+    this_time_left = time_left;
+}
+
+/** execute a command line and append reply to 'reply' */
+void fr_control::execute(const char * command, ft_string & reply)
+{
+    char line[2 * FC_CONTROL_REQUEST_MAX], name[FC_CONTROL_REQUEST_MAX], value[FC_CONTROL_REQUEST_MAX];
+
+    if (!strcmp(command, "status")) {
+        const fr_io & io = * this_io;
+        snprintf(line, sizeof(line),
+                 "progress %.2f\n"
+                 "bytes-left %" FT_ULL "\n"
+                 "time-left %.0f\n"
+                 "simulated %s\n"
+                 "mem-buffer %" FT_ULL "\n"
+                 "mem-buffer-allocated %" FT_ULL "\n"
+                 "max-rate %" FT_ULL "\n"
+                 "max-iops %" FT_ULL "\n"
+                 "throttled-seconds %.1f\n"
+                 "prefetch %" FT_ULL "\n"
+                 "OK\n",
+                 this_percentage, (ft_ull) this_bytes_left, this_time_left,
+                 io.simulate_run() ? "yes" : "no",
+                 (ft_ull) io.mem_buffer_limit(), (ft_ull) io.job_storage_size(FC_MEM_BUFFER_SIZE),
+                 (ft_ull) io.throttle().bytes_per_sec(), (ft_ull) io.throttle().ops_per_sec(),
+                 io.throttle().throttled_seconds(), (ft_ull) io.prefetch_window());
+        reply += line;
+    } else if (!strcmp(command, "help")) {
+        reply += FC_CONTROL_HELP;
+        reply += "OK\n";
+    } else if (sscanf(command, "set %255s %255s", name, value) == 2) {
+        execute_set(name, value, reply);
+    } else
+        reply += "ERROR unknown command, try 'help'\n";
+}
+
+/** execute "set NAME VALUE" and append reply to 'reply' */
+void fr_control::execute_set(const char * name, const char * value, ft_string & reply)
+{
+    fr_io & io = * this_io;
+    ft_ull n = 0;
+    if (ff_str2un_scaled(value, & n) != 0) {
+        reply += "ERROR invalid size, expecting NUMBER[k|M|G|T]\n";
+        return;
+    }
+    if (!strcmp(name, "mem-buffer")) {
+        /* cannot exceed the buffer allocated by create_storage(), and must hold at least one block */
+        const ft_ull allocated = (ft_ull) io.job_storage_size(FC_MEM_BUFFER_SIZE);
+        const ft_ull block_size = (ft_ull) 1 << io.effective_block_size_log2();
+        if (n != 0) {
+            n &= ~(block_size - 1);
+            if (n < block_size)
+                n = block_size;
+            if (allocated != 0 && n >= allocated)
+                n = 0;
+        }
+        io.mem_buffer_limit((ft_size) n);
+    } else if (!strcmp(name, "max-rate"))
+        io.throttle().limits((ft_uoff) n, io.throttle().ops_per_sec());
+    else if (!strcmp(name, "max-iops"))
+        io.throttle().limits(io.throttle().bytes_per_sec(), n);
+    else if (!strcmp(name, "prefetch"))
+        io.prefetch_window((ft_uoff) n);
+    else {
+        reply += "ERROR unknown tunable, expecting one of: mem-buffer max-rate max-iops prefetch\n";
+        return;
+    }
+    ff_log(FC_NOTICE, 0, "control socket: set %s to %" FT_ULL "%s", name, n,
+           n == 0 ? (!strcmp(name, "prefetch") ? " (disabled)" : " (no limit)") : "");
+    reply += "OK\n";
+}
+
+
+FT_IO_NAMESPACE_END
@@ -0,0 +1,104 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * io/control.hh
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#ifndef FSREMAP_IO_CONTROL_HH
+#define FSREMAP_IO_CONTROL_HH
+
+#include "../types.hh"   // for ft_uoff, ft_size, ft_string
+
+FT_IO_NAMESPACE_BEGIN
+
+class fr_io;
+
+/**
+ * Unix-domain control socket, to inspect and tune a running job.
+ *
+ * clients connect, send a single command line and receive a reply terminated by "OK" or "ERROR ...".
+ * commands are:
+ *   status                    show progress and current tunables
+ *   set mem-buffer SIZE       max RAM buffer used by each DEVICE to DEVICE batch (0 = whole buffer)
+ *   set max-rate SIZE         max DEVICE bytes per second (0 = unlimited)
+ *   set max-iops NUM          max DEVICE read() and write() per second (0 = unlimited)
+ *   set prefetch SIZE         DEVICE bytes to read ahead while copying (0 = disabled)
+ *   help                      list commands
+ *
+ * the socket is non-blocking and only polled by the remapping thread (see poll()),
+ * so tunables change between two I/O batches and no locking is needed.
+ */
+class fr_control
+{
+private:
+    ft_string this_path, this_request;
+    fr_io * this_io;
+    double this_client_time;
+    double this_percentage, this_time_left;
+    ft_uoff this_bytes_left;
+    int this_fd, this_client_fd;
+
+    /** cannot call copy constructor */
+    fr_control(const fr_control &);
+
+    /** cannot call assignment operator */
+    const fr_control & operator=(const fr_control &);
+
+    /** bind listening socket to this_path. if a stale socket exists, remove it and retry */
+    int bind_socket(int fd);
+
+    /** execute a command line and append reply to 'reply' */
+    void execute(const char * command, ft_string & reply);
+
+    /** execute "set NAME VALUE" and append reply to 'reply' */
+    void execute_set(const char * name, const char * value, ft_string & reply);
+
+    /** close current client connection */
+    void close_client();
+
+public:
+    /** constructor */
+    fr_control();
+
+    /** destructor. calls close() */
+    ~fr_control();
+
+    /** return true if control socket is open */
+    FT_INLINE bool is_open() const { return this_fd >= 0; }
+
+    /** create control socket 'path' to inspect and tune 'io' */
+    int open(const char * path, fr_io & io);
+
+    /** remember progress, as computed by fr_work<T>::show_progress() */
+    void progress(double percentage, ft_uoff bytes_left, double time_left);
+
+    /** accept and serve pending requests, without blocking */
+    void poll();
+
+    /** close and remove control socket */
+    void close();
+};
+
+
+FT_IO_NAMESPACE_END
+
+#endif /* FSREMAP_IO_CONTROL_HH */
@@ -30,8 +30,18 @@
 #elif defined(FT_HAVE_CERRNO)
 # include <cerrno>       // for errno, ENOMEM, EINVAL, EFBIG
 #endif
+#if defined(FT_HAVE_STRING_H)
+# include <string.h>     // for memcmp()
+#elif defined(FT_HAVE_CSTRING)
+# include <cstring>      // for memcmp()
+#endif
+
+#ifdef FT_HAVE_SYS_MMAN_H
+# include <sys/mman.h>   // for mmap(), munmap(), madvise()
+#endif
 
 #include "../types.hh"       // for ft_off
+#include "util_posix.hh"     // for ff_posix_size()
 #include "../extent.hh"      // for fr_extent<T>
 #include "../vector.hh"      // for fr_vector<T>
 #include "extent_file.hh"    // for ff_read_extents_file()
@@ -86,6 +96,107 @@ int ff_load_extents_file(FILE * f, fr_vector<ft_uoff> & ret_list, ft_uoff & ret_
 }
 
 
+/** skip the rest of current line, including final '\n'. return NULL if no '\n' is found */
+static const char * ff_skip_line(const char * p, const char * end)
+{
+    while (p < end && *p != '\n')
+        p++;
+    return p < end ? p + 1 : NULL;
+}
+
+/** skip blanks, then parse a decimal unsigned number. return pointer after it, or NULL if error */
+static const char * ff_scan_ull(const char * p, const char * end, ft_ull & ret_n)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+        p++;
+    if (p == end || *p < '0' || *p > '9')
+        return NULL;
+
+    ft_ull n = 0, digit;
+    do {
+        digit = (ft_ull)(*p - '0');
+        if (n > ((ft_ull)-1 - digit) / 10)
+            return NULL; /* overflow */
+        n = n * 10 + digit;
+    } while (++p < end && *p >= '0' && *p <= '9');
+
+    ret_n = n;
+    return p;
+}
+
+/** parse extents from memory. same format as ff_load_extents_file() */
+static int ff_parse_extents(const char * p, const char * end, fr_vector<ft_uoff> & ret_list, ft_uoff & ret_block_size_bitmask)
+{
+    for (ft_size i = 0; i < 6; i++) {
+        if (p == NULL || p == end || *p != '#')
+            return EPROTO;
+        p = ff_skip_line(p, end);
+    }
+
+    static const char count_label[] = "count ";
+    const ft_size count_len = sizeof(count_label) - 1;
+    ft_ull physical, logical, length = 0, user_data;
+
+    if (p == NULL || (ft_size)(end - p) < count_len || memcmp(p, count_label, count_len)
+        || (p = ff_scan_ull(p + count_len, end, length)) == NULL
+        || (p = ff_skip_line(p, end)) == NULL /* skip rest of "count" line */
+        || (p = ff_skip_line(p, end)) == NULL) /* skip "physical\tlogical\tlength\tuser_data" line */
+        return EPROTO;
+
+    ft_uoff block_size_bitmask = ret_block_size_bitmask;
+    ft_size i = ret_list.size(), n = (ft_size) length;
+
+    ret_list.resize(n += i);
+    for (; i < n; i++) {
+        if ((p = ff_scan_ull(p, end, physical)) == NULL
+            || (p = ff_scan_ull(p, end, logical)) == NULL
+            || (p = ff_scan_ull(p, end, length)) == NULL
+            || (p = ff_scan_ull(p, end, user_data)) == NULL)
+            return EPROTO;
+
+        fr_extent<ft_uoff> & extent = ret_list[i];
+
+        block_size_bitmask |=
+            (extent.physical() = (ft_uoff) physical) |
+            (extent.logical()  = (ft_uoff) logical) |
+            (extent.length()   = (ft_uoff) length);
+
+        extent.user_data() = (ft_size) user_data;
+    }
+    ret_block_size_bitmask = block_size_bitmask;
+    return 0;
+}
+
+
+/**
+ * same as ff_load_extents_file(), optimized for very large files:
+ * mmap() the whole file and parse it in place with a hand-written integer scanner,
+ * resizing ret_list only once.
+ * falls back on ff_load_extents_file() if the file cannot be mmapped (for example, it's a pipe)
+ */
+int ff_load_extents_file_mmap(FILE * f, fr_vector<ft_uoff> & ret_list, ft_uoff & ret_block_size_bitmask)
+{
+#if defined(FT_HAVE_MMAP) && defined(FT_HAVE_MUNMAP)
+    int fd = fileno(f);
+    ft_uoff len = 0;
+    if (fd >= 0 && ff_posix_size(fd, & len) == 0 && len != 0 && len == (ft_uoff)(ft_size) len) {
+
+        void * mem = mmap(NULL, (ft_size) len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mem != MAP_FAILED) {
+# ifdef MADV_SEQUENTIAL
+            (void) madvise(mem, (ft_size) len, MADV_SEQUENTIAL);
+# endif
+            const char * begin = (const char *) mem;
+            int err = ff_parse_extents(begin, begin + len, ret_list, ret_block_size_bitmask);
+            (void) munmap(mem, (ft_size) len);
+            return err;
+        }
+    }
+#endif /* FT_HAVE_MMAP && FT_HAVE_MUNMAP */
+    return ff_load_extents_file(f, ret_list, ret_block_size_bitmask);
+}
+
+
 /**
  * writes file blocks allocation map (extents) to specified FILE (stores also user_data)
  * in case of failure returns errno-compatible error code.
@@ -49,6 +49,14 @@ FT_IO_NAMESPACE_BEGIN
  */
 int ff_load_extents_file(FILE * f, fr_vector<ft_uoff> & ret_list, ft_uoff & ret_block_size_bitmask);
 
+/**
+ * same as ff_load_extents_file(), optimized for very large files:
+ * mmap() the whole file and parse it in place with a hand-written integer scanner,
+ * resizing ret_list only once.
+ * falls back on ff_load_extents_file() if the file cannot be mmapped (for example, it's a pipe)
+ */
+int ff_load_extents_file_mmap(FILE * f, fr_vector<ft_uoff> & ret_list, ft_uoff & ret_block_size_bitmask);
+
 /**
  * writes file blocks allocation map (extents) to specified FILE (stores also user_data)
  * in case of failure returns errno-compatible error code.
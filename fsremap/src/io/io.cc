@@ -33,7 +33,7 @@
 
 
 #include "../log.hh"       // for ff_log()
-#include "../misc.hh"      // for ff_can_sum()
+#include "../misc.hh"      // for ff_can_sum(), ff_now()
 #include "../ui/ui.hh"     // for fr_ui
 #include "io.hh"           // for fr_io
 #include "extent_file.hh"  // for ff_write_extents_file()
@@ -57,10 +57,15 @@ char const* const fr_io::extents_filename[FC_IO_EXTENTS_COUNT] = {
 /** constructor */
 fr_io::fr_io(fr_persist & persist)
     : this_primary_storage(), request_vec(), this_dev_length(0), this_loop_file_length(0), this_eff_block_size_log2(0),
-      this_dev_path(NULL), this_cmd_umount(NULL), this_job(persist.job()), this_persist(persist), this_ui(NULL),
+      this_dev_path(NULL), this_cmd_umount(NULL), this_job(persist.job()), this_persist(persist), this_plan(NULL), this_stats(NULL), this_control(NULL), this_trace(NULL), this_ui(NULL),
+      this_mem_buffer_limit(0), this_prefetch_window(0), this_throttle(),
       request_dir(FC_INVALID2INVALID), this_delegate_ui(false)
 {
     this_secondary_storage.clear();
+    for (ft_size i = 0; i < FC_INVALID2INVALID; i++) {
+        this_copied_bytes[i] = 0;
+        this_copy_seconds[i] = 0.0;
+    }
 }
 
 /**
@@ -78,6 +83,7 @@ fr_io::~fr_io()
 int fr_io::open(const fr_args & args)
 {
     this_cmd_umount = args.cmd_umount;
+    this_throttle.limits(args.max_bytes_per_sec, args.max_iops);
     return 0;
 }
 
@@ -241,6 +247,25 @@ int fr_io::check_last_block()
 	return 0;
 }
 
+/**
+ * measure DEVICE sequential throughput (in bytes per second) and average seek latency (in seconds)
+ * by reading - never writing - some DEVICE blocks. used to estimate remapping duration.
+ *
+ * default implementation: return ENOSYS without logging it
+ */
+int fr_io::measure_profile(double & ret_bytes_per_second, double & ret_seek_seconds)
+{
+    (void) ret_bytes_per_second;
+    (void) ret_seek_seconds;
+    return ENOSYS;
+}
+
+
+/** return the ft_trace_flags describing copies in direction 'dir' */
+static ft_u32 ff_trace_flags(fr_dir dir)
+{
+    return dir == FC_STORAGE2DEV ? FC_TRACE_FROM_STORAGE : dir == FC_DEV2STORAGE ? FC_TRACE_TO_STORAGE : 0;
+}
 
 /**
  * perform buffering and coalescing of copy requests.
@@ -259,6 +284,24 @@ int fr_io::copy_bytes(fr_dir dir, ft_uoff from_physical, ft_uoff to_physical, ft
     if ((err = validate("ft_uoff", (ft_uoff)-1, dir, from_physical, to_physical, length)) != 0)
         return err;
 
+    // record the copy in the journal or, while replaying, check it matches the recorded one
+    if ((err = this_persist.copy(dir, from_physical, to_physical, length)) != 0)
+        return err;
+
+    if (this_plan != NULL && (err = this_plan->copy(dir, from_physical, to_physical, length)) != 0)
+        return err;
+
+    if (!is_replaying())
+        this_copied_bytes[dir] += length;
+
+    if (this_stats != NULL && !is_replaying())
+        this_stats->copy(dir, length);
+
+    if (this_trace != NULL && !is_replaying()) {
+        double now = this_trace->now();
+        this_trace->record(FC_TRACE_COPY, ff_trace_flags(dir), from_physical, to_physical, length, now, now);
+    }
+
 	// do NOT actually show anything while replaying persistence
     if (this_ui != 0 && !this_delegate_ui && !is_replaying())
         this_ui->show_io_copy(dir, from_physical, to_physical, length);
@@ -281,8 +324,16 @@ int fr_io::flush_queue()
     if (!request_vec.empty()) {
 
     	// do NOT actually copy anything while replaying persistence
-    	if (!is_replaying())
+    	if (!is_replaying()) {
+    		double start = 0.0, end = 0.0, trace_start = this_trace != NULL ? this_trace->now() : 0.0;
+    		(void) ff_now(start);
     		err = flush_copy_bytes(request_dir, request_vec);
+    		if (ff_now(end) == 0)
+    			this_copy_seconds[request_dir] += end - start;
+    		// queued copies are performed only now: tell it to the trace, device is not synced yet
+    		if (err == 0 && this_trace != NULL)
+    			this_trace->record(FC_TRACE_FLUSH, FC_TRACE_NO_SYNC, 0, 0, 0, trace_start, this_trace->now());
+    	}
 
     	request_vec.clear();
         request_dir = FC_INVALID2INVALID;
@@ -290,6 +341,19 @@ int fr_io::flush_queue()
     return err;
 }
 
+/**
+ * invoked by derived classes before each read() or write() of 'length' bytes on DEVICE:
+ * if throttling is enabled, wait as needed to respect the limits
+ */
+void fr_io::throttle_io(ft_uoff length)
+{
+    if (!this_throttle.enabled())
+        return;
+    double waited = this_throttle.take(length);
+    if (waited > 0.0 && this_stats != NULL)
+        this_stats->throttled(waited);
+}
+
 /**
  * flush any I/O specific buffer
  * return 0 if success, else error
@@ -309,6 +373,10 @@ int fr_io::flush_bytes()
 int fr_io::flush()
 {
     int err = flush_queue();
+    double start = this_trace != NULL ? this_trace->now() : 0.0;
+
+    if (err == 0 && this_plan != NULL)
+        err = this_plan->flush();
 
     // do NOT actually copy anything while replaying persistence
     if (!is_replaying()) {
@@ -316,6 +384,12 @@ int fr_io::flush()
     		err = flush_bytes();
     	if (err == 0 && this_ui != 0 && !this_delegate_ui)
     		this_ui->show_io_flush();
+    	if (err == 0 && this_trace != NULL)
+    		this_trace->record(FC_TRACE_FLUSH, 0, 0, 0, 0, start, this_trace->now());
+    	if (err == 0 && this_stats != NULL)
+    		this_stats->update();
+    	if (err == 0 && this_control != NULL)
+    		this_control->poll();
     }
     return err;
 }
@@ -34,9 +34,14 @@
 #include "../extent.hh"      // for fr_extent<T>
 #include "../vector.hh"      // for fr_vector<T>
 #include "../map.hh"         // for fr_map<T>
+#include "../throttle.hh"    // for ft_throttle
+#include "../trace.hh"       // for ft_trace
 #include "../ui/ui.hh"       // for fr_ui
 
 #include "persist.hh"        // for ft_persist
+#include "plan.hh"           // for fr_plan
+#include "stats.hh"          // for fr_stats
+#include "control.hh"        // for fr_control
 #include "request.hh"        // for ft_request
 
 
@@ -75,7 +80,18 @@ private:
     const char * this_cmd_umount;
     fr_job & this_job;
     fr_persist & this_persist;
+    fr_plan * this_plan;
+    fr_stats * this_stats;
+    fr_control * this_control;
+    ft_trace * this_trace;
     FT_UI_NS fr_ui * this_ui;
+    /* runtime tunables. 0 means no limit, or no prefetch */
+    ft_size this_mem_buffer_limit;
+    ft_uoff this_prefetch_window;
+    ft_throttle this_throttle;
+    /* bytes copied and seconds spent copying them in each direction, excluding replayed copies */
+    ft_ull this_copied_bytes[FC_INVALID2INVALID];
+    double this_copy_seconds[FC_INVALID2INVALID];
     fr_dir request_dir;
     bool this_delegate_ui;
 
@@ -116,6 +132,12 @@ protected:
         return validate(type_name, type_max, dir, extent.physical(), extent.logical(), extent.length());
     }
 
+    /**
+     * invoked by derived classes before each read() or write() of 'length' bytes on DEVICE:
+     * if throttling is enabled, wait as needed to respect the limits
+     */
+    void throttle_io(ft_uoff length);
+
     /** invoked by derived classes to tell whether they will invoke ui methods by themselves (default: false) */
     FT_INLINE void delegate_ui(bool flag_delegate_ui) { this_delegate_ui = flag_delegate_ui; }
 
@@ -264,6 +286,52 @@ public:
     /* return the persistence to use, or NULL if not set */
     FT_INLINE fr_persist & persist() const { return this_persist; }
 
+    /* return the execution plan being recorded, or NULL if not set */
+    FT_INLINE fr_plan * plan() const { return this_plan; }
+
+    /* set the execution plan to record all copies, zeroes and flushes into. specify NULL to unset */
+    FT_INLINE void plan(fr_plan * plan) { this_plan = plan; }
+
+    /* return the statistics to update, or NULL if not set */
+    FT_INLINE fr_stats * stats() const { return this_stats; }
+
+    /* set the statistics to update with copied bytes, flushes and latencies. specify NULL to unset */
+    FT_INLINE void stats(fr_stats * stats) { this_stats = stats; }
+
+    /* return the control socket to poll, or NULL if not set */
+    FT_INLINE fr_control * control() const { return this_control; }
+
+    /* set the control socket to poll for requests at each flush. specify NULL to unset */
+    FT_INLINE void control(fr_control * control) { this_control = control; }
+
+    /* return the I/O trace to record copies, zeroes and flushes into, or NULL if not set */
+    FT_INLINE ft_trace * trace() const { return this_trace; }
+
+    /* set the I/O trace to record copies, zeroes and flushes into. specify NULL to unset */
+    FT_INLINE void trace(ft_trace * trace) { this_trace = trace; }
+
+    /** return max bytes of RAM buffer to use for each DEVICE to DEVICE batch, or 0 to use the whole buffer */
+    FT_INLINE ft_size mem_buffer_limit() const { return this_mem_buffer_limit; }
+
+    /** set max bytes of RAM buffer to use for each DEVICE to DEVICE batch. specify 0 to use the whole buffer */
+    FT_INLINE void mem_buffer_limit(ft_size limit) { this_mem_buffer_limit = limit; }
+
+    /** return bytes copied in direction 'dir' so far, excluding replayed copies */
+    FT_INLINE ft_ull copied_bytes(fr_dir dir) const { return this_copied_bytes[dir]; }
+
+    /** return seconds spent copying in direction 'dir' so far, i.e. inside flush_copy_bytes() */
+    FT_INLINE double copy_seconds(fr_dir dir) const { return this_copy_seconds[dir]; }
+
+    /** return the limiter of DEVICE bytes and operations per second */
+    FT_INLINE ft_throttle & throttle() { return this_throttle; }
+    FT_INLINE const ft_throttle & throttle() const { return this_throttle; }
+
+    /** return how many bytes to read ahead while copying from DEVICE, or 0 if disabled */
+    FT_INLINE ft_uoff prefetch_window() const { return this_prefetch_window; }
+
+    /** set how many bytes to read ahead while copying from DEVICE. specify 0 to disable */
+    FT_INLINE void prefetch_window(ft_uoff window) { this_prefetch_window = window; }
+
     /** return true if replaying persistence */
     FT_INLINE bool is_replaying() const { return this_persist.is_replaying(); }
 
@@ -346,6 +414,14 @@ public:
      */
     virtual int check_last_block();
 
+    /**
+     * measure DEVICE sequential throughput (in bytes per second) and average seek latency (in seconds)
+     * by reading - never writing - some DEVICE blocks. used to estimate remapping duration.
+     *
+     * default implementation: return ENOSYS without logging it
+     */
+    virtual int measure_profile(double & ret_bytes_per_second, double & ret_seek_seconds);
+
     /**
      * perform buffering and coalescing of copy requests.
      * queues a copy of single fragment from DEVICE or FREE-STORAGE, to STORAGE to FREE-DEVICE.
@@ -400,7 +476,18 @@ public:
         if (this_ui != 0 && !this_delegate_ui)
             this_ui->show_io_write(to, offset_bytes, length_bytes);
 
-        return zero_bytes(to, offset_bytes, length_bytes);
+        int err;
+        if (this_plan != NULL && (err = this_plan->zero(to, offset_bytes, length_bytes)) != 0)
+            return err;
+
+        if (this_trace == NULL)
+            return zero_bytes(to, offset_bytes, length_bytes);
+
+        double start = this_trace->now();
+        err = zero_bytes(to, offset_bytes, length_bytes);
+        this_trace->record(FC_TRACE_ZERO, to == FC_TO_STORAGE ? FC_TRACE_TO_STORAGE : 0,
+                           0, offset_bytes, length_bytes, start, this_trace->now());
+        return err;
     }
 
     /**
@@ -0,0 +1,322 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * io/io_emulate.cc
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#include "../first.hh"
+
+#if defined(FT_HAVE_ERRNO_H)
+# include <errno.h>        // for EINVAL
+#elif defined(FT_HAVE_CERRNO)
+# include <cerrno>         // for EINVAL
+#endif
+#if defined(FT_HAVE_STDLIB_H)
+# include <stdlib.h>       // for strtod()
+#elif defined(FT_HAVE_CSTDLIB)
+# include <cstdlib>        // for strtod()
+#endif
+#if defined(FT_HAVE_STRING_H)
+# include <string.h>       // for strcmp(), strchr()
+#elif defined(FT_HAVE_CSTRING)
+# include <cstring>        // for strcmp(), strchr()
+#endif
+
+#include "../log.hh"       // for ff_log()
+#include "../args.hh"      // for fr_args
+#include "../misc.hh"      // for ff_min2(), ff_str2ull_scaled(), ff_pretty_size(), ff_pretty_time()
+#include "stats.hh"        // for fr_stats
+#include "io_emulate.hh"   // for fr_io_emulate
+
+
+FT_IO_NAMESPACE_BEGIN
+
+/** predefined DEVICE profiles */
+static const struct {
+    const char * name;
+    ft_ull bytes_per_second, queue_depth;
+    double seek_ms, flush_ms;
+} fc_io_emulate_profiles[] = {
+    { "hdd",  (ft_ull) 120 << 20,  1, 8.0,  20.0 },
+    { "ssd",  (ft_ull) 500 << 20, 32, 0.1,   2.0 },
+    { "nvme", (ft_ull)   2 << 30, 64, 0.02,  0.5 },
+};
+
+/** constructor */
+fr_io_emulate::fr_io_emulate(fr_persist & persist)
+: super_type(persist), this_bytes_per_second(0.0), this_seek_seconds(0.0), this_flush_seconds(0.0),
+  this_queue_depth(1), this_time(0.0), this_pos((ft_uoff)-1),
+  this_read_bytes(0), this_write_bytes(0), this_seeks(0), this_flushes(0),
+  this_dirty_bytes(0), this_dirty_extents(0), this_buffer_len(0)
+{ }
+
+/** destructor */
+fr_io_emulate::~fr_io_emulate()
+{ }
+
+/** load LOOP-FILE and ZERO-FILE extents list from files, and set DEVICE profile from args.emulate_profile */
+int fr_io_emulate::open(const fr_args & args)
+{
+    int err = profile(args.emulate_profile != NULL ? args.emulate_profile : fc_io_emulate_profiles[0].name);
+    if (err == 0)
+        err = super_type::open(args);
+    if (err == 0) {
+        this_time = 0.0;
+        this_pos = (ft_uoff)-1;
+        this_read_bytes = this_write_bytes = this_seeks = this_flushes = 0;
+        this_dirty_bytes = this_dirty_extents = 0;
+        dev_path("<emulated-device>");
+    }
+    return err;
+}
+
+/** set DEVICE profile from 'profile': 'hdd', 'ssd', 'nvme' or THROUGHPUT[k|M|G],SEEK_MS[,QUEUE_DEPTH[,FLUSH_MS]] */
+int fr_io_emulate::profile(const char * profile)
+{
+    for (ft_size i = 0; i < sizeof(fc_io_emulate_profiles) / sizeof(fc_io_emulate_profiles[0]); i++) {
+        if (!strcmp(profile, fc_io_emulate_profiles[i].name)) {
+            this_bytes_per_second = (double) fc_io_emulate_profiles[i].bytes_per_second;
+            this_queue_depth = fc_io_emulate_profiles[i].queue_depth;
+            this_seek_seconds = fc_io_emulate_profiles[i].seek_ms * 1e-3;
+            this_flush_seconds = fc_io_emulate_profiles[i].flush_ms * 1e-3;
+            return 0;
+        }
+    }
+    const char * comma = strchr(profile, ',');
+    char * end = NULL;
+    ft_ull throughput = 0;
+    double seek_ms = -1.0, queue_depth = 1.0, flush_ms = 0.0;
+
+    if (comma != NULL && ff_str2ull_scaled(ft_string(profile, comma - profile).c_str(), & throughput) == 0) {
+        seek_ms = strtod(comma + 1, & end);
+        if (end != comma + 1 && * end == ',') {
+            const char * next = end + 1;
+            queue_depth = strtod(next, & end);
+            if (end != next && * end == ',') {
+                next = end + 1;
+                flush_ms = strtod(next, & end);
+                if (end == next)
+                    end = NULL;
+            } else if (end == next)
+                end = NULL;
+        } else if (end == comma + 1)
+            end = NULL;
+    }
+    if (throughput == 0 || seek_ms < 0.0 || queue_depth < 1.0 || flush_ms < 0.0 || end == NULL || * end != '\0') {
+        ff_log(FC_ERROR, 0, "invalid device profile '%s', expecting one of 'hdd', 'ssd', 'nvme' or "
+               "THROUGHPUT[k|M|G],SEEK_MS[,QUEUE_DEPTH[,FLUSH_MS]]", profile);
+        return -EINVAL;
+    }
+    this_bytes_per_second = (double) throughput;
+    this_queue_depth = (ft_ull) queue_depth;
+    this_seek_seconds = seek_ms * 1e-3;
+    this_flush_seconds = flush_ms * 1e-3;
+    return 0;
+}
+
+/** remember RAM buffer size, used to split DEVICE to DEVICE copies as fr_io_posix does */
+int fr_io_emulate::create_storage(ft_size secondary_len, ft_size buffer_len)
+{
+    this_buffer_len = buffer_len;
+    return super_type::create_storage(secondary_len, buffer_len);
+}
+
+/** advance virtual clock by the time needed to read or write 'length' bytes at DEVICE 'offset'. return such time */
+double fr_io_emulate::access(ft_uoff offset, ft_uoff length)
+{
+    double elapsed = (double) length / this_bytes_per_second;
+    if (offset != this_pos) {
+        elapsed += this_seek_seconds / (double) this_queue_depth;
+        this_seeks++;
+    }
+    this_pos = offset + length;
+    this_time += elapsed;
+    return elapsed;
+}
+
+/** emulate reading 'length' bytes at DEVICE 'offset' */
+void fr_io_emulate::read_dev(ft_uoff offset, ft_uoff length)
+{
+    double elapsed = access(offset, length);
+    this_read_bytes += (ft_ull) length;
+    if (stats() != NULL)
+        stats()->dev_read(elapsed);
+}
+
+/** emulate writing 'length' bytes at DEVICE 'offset' */
+void fr_io_emulate::write_dev(ft_uoff offset, ft_uoff length)
+{
+    double elapsed = access(offset, length);
+    this_write_bytes += (ft_ull) length;
+    if (stats() != NULL)
+        stats()->dev_write(elapsed);
+}
+
+/** emulate writing 'length' bytes to memory-mapped STORAGE */
+void fr_io_emulate::write_storage(ft_uoff length)
+{
+    this_dirty_bytes += (ft_ull) length;
+    this_dirty_extents++;
+}
+
+/** emulate writing back dirty STORAGE to DEVICE. return the time needed */
+double fr_io_emulate::write_back()
+{
+    if (this_dirty_extents == 0)
+        return 0.0;
+    /* dirty pages are written back sorted, but each dirty extent still costs a seek */
+    double elapsed = (double) this_dirty_bytes / this_bytes_per_second
+        + (double) this_dirty_extents * this_seek_seconds / (double) this_queue_depth;
+    this_seeks += this_dirty_extents;
+    this_write_bytes += this_dirty_bytes;
+    this_dirty_bytes = this_dirty_extents = 0;
+    this_pos = (ft_uoff)-1;
+    this_time += elapsed;
+    return elapsed;
+}
+
+/**
+ * emulate copying a list of fragments from DEVICE or FREE-STORAGE, to STORAGE to FREE-DEVICE.
+ * note: parameters are in bytes!
+ * return 0 if success, else error.
+ */
+int fr_io_emulate::flush_copy_bytes(fr_dir dir, fr_vector<ft_uoff> & request_vec)
+{
+    ft_size i, n = request_vec.size();
+    int err = 0;
+
+    switch (dir) {
+    case FC_DEV2STORAGE:
+        for (i = 0; i < n; i++) {
+            const fr_extent<ft_uoff> & extent = request_vec[i];
+            read_dev(extent.physical(), extent.length());
+            write_storage(extent.length());
+        }
+        break;
+    case FC_STORAGE2DEV:
+        /* STORAGE is memory-mapped, reading it is free */
+        for (i = 0; i < n; i++) {
+            const fr_extent<ft_uoff> & extent = request_vec[i];
+            write_dev(extent.logical(), extent.length());
+        }
+        break;
+    case FC_DEV2DEV: {
+        /* as fr_io_posix: fill RAM buffer reading in physical order, then write it in logical order */
+        request_vec.sort_by_physical();
+
+        ft_uoff buf_size = this_buffer_len != 0 ? (ft_uoff) this_buffer_len : (ft_uoff)-1;
+        if (mem_buffer_limit() != 0)
+            buf_size = ff_min2<ft_uoff>(buf_size, mem_buffer_limit());
+
+        for (i = 0; err == 0 && i < n; ) {
+            ft_size start = i;
+            ft_uoff buf_used = 0, length;
+            for (; i < n && (length = request_vec[i].length()) <= buf_size - buf_used; i++) {
+                read_dev(request_vec[i].physical(), length);
+                buf_used += length;
+            }
+            if (i != start) {
+                request_vec.sort_by_logical(request_vec.begin() + start, request_vec.begin() + i);
+                for (ft_size j = start; j < i; j++)
+                    write_dev(request_vec[j].logical(), request_vec[j].length());
+                err = flush_bytes();
+                continue;
+            }
+            /* a single extent larger than RAM buffer: copy it in pieces */
+            ft_uoff from = request_vec[i].physical(), to = request_vec[i].logical(), chunk;
+            for (length = request_vec[i].length(); err == 0 && length != 0; length -= chunk) {
+                chunk = ff_min2<ft_uoff>(length, buf_size);
+                read_dev(from, chunk);
+                write_dev(to, chunk);
+                from += chunk;
+                to += chunk;
+                err = flush_bytes();
+            }
+            i++;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    return err;
+}
+
+/**
+ * emulate flushing any I/O specific buffer: write back dirty STORAGE and pay the flush cost.
+ * return 0 if success, else error
+ */
+int fr_io_emulate::flush_bytes()
+{
+    double elapsed = write_back() + this_flush_seconds;
+    this_time += this_flush_seconds;
+    this_flushes++;
+    if (stats() != NULL)
+        stats()->flush(elapsed);
+    return 0;
+}
+
+/**
+ * emulate writing zeroes to device (or to storage).
+ * used to remove device-renumbered blocks once remapping is finished
+ */
+int fr_io_emulate::zero_bytes(fr_to to, ft_uoff offset, ft_uoff length)
+{
+    if (to == FC_TO_DEV)
+        write_dev(offset, length);
+    else
+        write_storage(length);
+    return 0;
+}
+
+/** emulate writing zeroes to primary storage */
+int fr_io_emulate::zero_primary_storage()
+{
+    fr_vector<ft_uoff>::const_iterator iter = primary_storage().begin(), end = primary_storage().end();
+    for (; iter != end; ++iter)
+        write_storage(iter->second.length);
+    return 0;
+}
+
+/** write back dirty STORAGE, then log the emulated DEVICE time */
+int fr_io_emulate::close_storage()
+{
+    (void) write_back();
+
+    double pretty_len = 0.0, pretty_time = 0.0;
+    const char * pretty_label = ff_pretty_size((ft_uoff) this_bytes_per_second, & pretty_len);
+    ff_log(FC_INFO, 0, "%semulated device profile: throughput %.2f %sbytes/s, seek latency %.2f ms, queue depth %" FT_ULL ", flush %.2f ms",
+           sim_msg, pretty_len, pretty_label, this_seek_seconds * 1e3, this_queue_depth, this_flush_seconds * 1e3);
+
+    pretty_label = ff_pretty_size((ft_uoff) this_read_bytes, & pretty_len);
+    double pretty_len2 = 0.0;
+    const char * pretty_label2 = ff_pretty_size((ft_uoff) this_write_bytes, & pretty_len2);
+    ff_log(FC_INFO, 0, "%semulated device I/O: %.2f %sbytes read, %.2f %sbytes written, %" FT_ULL " seeks, %" FT_ULL " flushes",
+           sim_msg, pretty_len, pretty_label, pretty_len2, pretty_label2, this_seeks, this_flushes);
+
+    pretty_label = ff_pretty_time(this_time, & pretty_time);
+    ff_log(FC_NOTICE, 0, "%semulated device time: %.1f %s%s", sim_msg, pretty_time, pretty_label, pretty_time != 1.0 ? "s" : "");
+
+    return super_type::close_storage();
+}
+
+FT_IO_NAMESPACE_END
@@ -0,0 +1,130 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * io/io_emulate.hh
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#ifndef FSREMAP_IO_IO_EMULATE_HH
+#define FSREMAP_IO_IO_EMULATE_HH
+
+#include "../types.hh"     // for ft_uoff, ft_ull, ft_size
+
+#include "io_test.hh"      // for fr_io_test
+
+
+FT_IO_NAMESPACE_BEGIN
+
+/**
+ * "emulate" class: loads extents definition from files as fr_io_test does,
+ * then models the time a real DEVICE would spend executing the remapping.
+ *
+ * no I/O is performed: each read, write and flush advances a virtual clock
+ * according to a DEVICE profile (sequential throughput, seek latency, queue depth and flush cost).
+ * the model follows what fr_io_posix does: DEVICE to DEVICE copies go through the RAM buffer,
+ * copies to STORAGE dirty the memory-mapped storage and are written back at the next flush.
+ *
+ * STORAGE is assumed to live on DEVICE, and a seek is paid whenever an access
+ * does not start where the previous one ended. queue depth > 1 overlaps seeks of queued requests,
+ * so each seek costs seek latency / queue depth.
+ */
+class fr_io_emulate: public fr_io_test
+{
+private:
+    typedef fr_io_test super_type;
+
+    /* DEVICE profile */
+    double this_bytes_per_second, this_seek_seconds, this_flush_seconds;
+    ft_ull this_queue_depth;
+
+    /* virtual clock, in seconds */
+    double this_time;
+    /* DEVICE offset following the last access, or (ft_uoff)-1 if unknown */
+    ft_uoff this_pos;
+    ft_ull this_read_bytes, this_write_bytes, this_seeks, this_flushes;
+    /* STORAGE bytes and extents written to memory and not yet written back to DEVICE */
+    ft_ull this_dirty_bytes, this_dirty_extents;
+    ft_size this_buffer_len;
+
+    /** set DEVICE profile from 'profile': 'hdd', 'ssd', 'nvme' or THROUGHPUT[k|M|G],SEEK_MS[,QUEUE_DEPTH[,FLUSH_MS]] */
+    int profile(const char * profile);
+
+    /** advance virtual clock by the time needed to read or write 'length' bytes at DEVICE 'offset'. return such time */
+    double access(ft_uoff offset, ft_uoff length);
+
+    /** emulate reading 'length' bytes at DEVICE 'offset' */
+    void read_dev(ft_uoff offset, ft_uoff length);
+
+    /** emulate writing 'length' bytes at DEVICE 'offset' */
+    void write_dev(ft_uoff offset, ft_uoff length);
+
+    /** emulate writing 'length' bytes to memory-mapped STORAGE */
+    void write_storage(ft_uoff length);
+
+    /** emulate writing back dirty STORAGE to DEVICE. return the time needed */
+    double write_back();
+
+protected:
+    /**
+     * emulate copying a list of fragments from DEVICE or FREE-STORAGE, to STORAGE to FREE-DEVICE.
+     * note: parameters are in bytes!
+     * return 0 if success, else error.
+     */
+    virtual int flush_copy_bytes(fr_dir dir, fr_vector<ft_uoff> & request_vec);
+
+    /**
+     * emulate flushing any I/O specific buffer: write back dirty STORAGE and pay the flush cost.
+     * return 0 if success, else error
+     */
+    virtual int flush_bytes();
+
+    /**
+     * emulate writing zeroes to device (or to storage).
+     * used to remove device-renumbered blocks once remapping is finished
+     */
+    virtual int zero_bytes(fr_to to, ft_uoff offset, ft_uoff length);
+
+public:
+    /** constructor */
+    fr_io_emulate(fr_persist & persist);
+
+    /** destructor */
+    virtual ~fr_io_emulate();
+
+    /** load LOOP-FILE and ZERO-FILE extents list from files, and set DEVICE profile from args.emulate_profile */
+    virtual int open(const fr_args & args);
+
+    /** remember RAM buffer size, used to split DEVICE to DEVICE copies as fr_io_posix does */
+    virtual int create_storage(ft_size secondary_len, ft_size buffer_len);
+
+    /** emulate writing zeroes to primary storage */
+    virtual int zero_primary_storage();
+
+    /** write back dirty STORAGE, then log the emulated DEVICE time */
+    virtual int close_storage();
+
+    /** return the emulated DEVICE time since open(), in seconds */
+    FT_INLINE double emulated_time() const { return this_time; }
+};
+
+FT_IO_NAMESPACE_END
+
+#endif /* FSREMAP_IO_IO_EMULATE_HH */
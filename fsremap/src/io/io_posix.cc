@@ -64,7 +64,8 @@
 
 
 #include "../log.hh"      // for ff_log()
-#include "../misc.hh"     // for ff_max2(), ff_min2()
+#include "../misc.hh"     // for ff_max2(), ff_min2(), ff_now(), ff_random()
+#include "../zero.hh"     // for ff_mem_is_zero(), used if ENABLE_CHECK_IF_MEM_IS_ZERO
 
 #include "../ui/ui.hh"    // for fr_ui
 
@@ -87,7 +88,8 @@ FT_IO_NAMESPACE_BEGIN
 /** default constructor */
 fr_io_posix::fr_io_posix(fr_persist & persist)
 : super_type(persist), storage_mmap(MAP_FAILED), buffer_mmap(MAP_FAILED),
-  storage_mmap_size(0), buffer_mmap_size(0), this_dev_blkdev(0)
+  storage_mmap_size(0), buffer_mmap_size(0), this_dev_blkdev(0),
+  this_prefetch_pos(0), this_prefetch_next(0), this_prefetch_ahead(0)
 {
     /* mark fd[] as invalid: they are not open yet */
     for (ft_size i = 0; i < FC_ALL_FILE_COUNT; i++)
@@ -959,6 +961,68 @@ int fr_io_posix::check_last_block()
     return err;
 }
 
+enum {
+    FC_MEASURE_SEQ_CHUNK = 1024*1024, FC_MEASURE_SEQ_N = 32,
+    FC_MEASURE_SEEK_CHUNK = 4096,     FC_MEASURE_SEEK_N = 32,
+};
+
+/**
+ * measure DEVICE sequential throughput (in bytes per second) and average seek latency (in seconds)
+ * by timing some sequential and some random reads. DEVICE is never written.
+ */
+int fr_io_posix::measure_profile(double & ret_bytes_per_second, double & ret_seek_seconds)
+{
+    const char * label_dev = label[FC_DEVICE];
+    const int fd_dev = fd[FC_DEVICE];
+    const ft_uoff dev_len = dev_length();
+    const ft_uoff seq_len = (ft_uoff) FC_MEASURE_SEQ_CHUNK * FC_MEASURE_SEQ_N;
+
+    if (dev_len < seq_len * 2)
+        return ENOSYS;
+
+    char * buf = (char *) malloc(FC_MEASURE_SEQ_CHUNK);
+    if (buf == NULL)
+        return ff_log(FC_ERROR, ENOMEM, "failed to allocate %" FT_ULL " bytes to measure %s speed",
+                      (ft_ull) FC_MEASURE_SEQ_CHUNK, label_dev);
+
+#ifdef POSIX_FADV_DONTNEED
+    /* best effort: do not measure the page cache */
+    (void) posix_fadvise(fd_dev, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+
+    ft_uoff offset = 0;
+    double start = 0.0, seq_end = 0.0, seek_end = 0.0;
+    int err = ff_now(start);
+
+    /* sequential reads, from a random position */
+    offset = (ft_uoff) ff_random((ft_ull) (dev_len - seq_len)) & ~(ft_uoff) (FC_MEASURE_SEEK_CHUNK - 1);
+    if (err == 0 && (err = ff_posix_lseek(fd_dev, offset)) == 0) {
+        for (ft_size i = 0; err == 0 && i < FC_MEASURE_SEQ_N; i++)
+            err = ff_posix_read(fd_dev, buf, FC_MEASURE_SEQ_CHUNK);
+    }
+    if (err == 0)
+        err = ff_now(seq_end);
+
+    /* small random reads: their duration is dominated by seek latency */
+    for (ft_size i = 0; err == 0 && i < FC_MEASURE_SEEK_N; i++) {
+        offset = (ft_uoff) ff_random((ft_ull) (dev_len - FC_MEASURE_SEEK_CHUNK)) & ~(ft_uoff) (FC_MEASURE_SEEK_CHUNK - 1);
+        if ((err = ff_posix_lseek(fd_dev, offset)) == 0)
+            err = ff_posix_read(fd_dev, buf, FC_MEASURE_SEEK_CHUNK);
+    }
+    if (err == 0)
+        err = ff_now(seek_end);
+
+    free(buf);
+
+    if (err != 0)
+        return ff_log(FC_ERROR, err, "I/O error while measuring %s speed", label_dev);
+
+    if (seq_end > start)
+        ret_bytes_per_second = (double) seq_len / (seq_end - start);
+    ret_seek_seconds = (seek_end - seq_end) / FC_MEASURE_SEEK_N;
+    return err;
+}
+
 /**
  * actually copy a list of fragments from DEVICE to STORAGE, or from STORAGE or DEVICE, or from DEVICE to DEVICE.
  * note: parameters are in bytes!
@@ -970,14 +1034,18 @@ int fr_io_posix::flush_copy_bytes(fr_dir dir, fr_vector<ft_uoff> & request_vec)
 {
     int err = 0;
 
+    this_prefetch_pos = this_prefetch_next = 0;
+    this_prefetch_ahead = 0;
+
 
     switch (dir) {
     case FC_DEV2STORAGE: {
         /* from DEVICE to memory-mapped STORAGE */
         /* sequential disk access: request_vec is supposed to be already sorted by device from_offset, i.e. extent->physical */
-        fr_vector<ft_uoff>::const_iterator iter = request_vec.begin(), end = request_vec.end();
-        for (; err == 0 && iter != end; ++iter)
-            err = flush_copy_bytes(FC_POSIX_DEV2STORAGE, *iter);
+        for (ft_size i = 0, n = request_vec.size(); err == 0 && i < n; i++) {
+            prefetch(request_vec, i);
+            err = flush_copy_bytes(FC_POSIX_DEV2STORAGE, request_vec[i]);
+        }
         break;
     }
     case FC_STORAGE2DEV: {
@@ -994,8 +1062,11 @@ int fr_io_posix::flush_copy_bytes(fr_dir dir, fr_vector<ft_uoff> & request_vec)
 
         request_vec.sort_by_physical(); /* sort by device from_offset, i.e. extent->physical */
 
+        /* the RAM buffer actually used can be reduced at runtime, see fr_control */
+        const ft_size buf_size = mem_buffer_limit() != 0 ? ff_min2(mem_buffer_limit(), buffer_mmap_size) : buffer_mmap_size;
+
         ft_uoff from_offset, to_offset, length;
-        ft_size buf_offset = 0, buf_free = buffer_mmap_size, buf_length;
+        ft_size buf_offset = 0, buf_free = buf_size, buf_length;
 
         ft_size start = 0, i = start, save_i, n = request_vec.size();
 
@@ -1005,6 +1076,7 @@ int fr_io_posix::flush_copy_bytes(fr_dir dir, fr_vector<ft_uoff> & request_vec)
                 fr_extent<ft_uoff> & extent = request_vec[i];
                 if ((length = extent.length()) > (ft_uoff) buf_free)
                     break;
+                prefetch(request_vec, i);
                 if ((err = flush_copy_bytes(FC_POSIX_DEV2RAM, extent.physical(), (ft_uoff)(extent.user_data() = buf_offset), length)) != 0)
                     break;
                 buf_offset += (ft_size) length;
@@ -1028,11 +1100,12 @@ int fr_io_posix::flush_copy_bytes(fr_dir dir, fr_vector<ft_uoff> & request_vec)
                 break;
 
             /* buffered data written to target. now there may be one or more extents NOT fitting into buffer_mmap */
-            buf_offset = 0, buf_free = buffer_mmap_size;
+            buf_offset = 0, buf_free = buf_size;
             for (i = save_i; err == 0 && i != n; ++i) {
                 fr_extent<ft_uoff> & extent = request_vec[i];
                 if ((length = extent.length()) <= buf_free)
                     break;
+                prefetch(request_vec, i);
 
                 from_offset = extent.physical();
                 to_offset = extent.logical();
@@ -1063,6 +1136,40 @@ int fr_io_posix::flush_copy_bytes(fr_dir dir, fr_vector<ft_uoff> & request_vec)
 }
 
 
+/**
+ * called before reading request_vec[i] from DEVICE: if prefetch_window() is set,
+ * ask the kernel to read ahead the extents following it, up to prefetch_window() bytes.
+ * request_vec must be sorted by ->physical
+ */
+void fr_io_posix::prefetch(const fr_vector<ft_uoff> & request_vec, ft_size i)
+{
+#ifdef POSIX_FADV_WILLNEED
+    const ft_uoff window = prefetch_window();
+    if (window == 0 || simulate_run())
+        return;
+
+    /* forget extents already read */
+    for (; this_prefetch_pos < i; this_prefetch_pos++) {
+        if (this_prefetch_pos < this_prefetch_next)
+            this_prefetch_ahead -= request_vec[this_prefetch_pos].length();
+    }
+    if (this_prefetch_next < i) {
+        this_prefetch_next = i;
+        this_prefetch_ahead = 0;
+    }
+    const int fd_dev = fd[FC_DEVICE];
+    for (const ft_size n = request_vec.size(); this_prefetch_next < n && this_prefetch_ahead < window; this_prefetch_next++) {
+        const fr_extent<ft_uoff> & extent = request_vec[this_prefetch_next];
+        /* best effort: ignore errors */
+        (void) posix_fadvise(fd_dev, (off_t) extent.physical(), (off_t) extent.length(), POSIX_FADV_WILLNEED);
+        this_prefetch_ahead += extent.length();
+    }
+#else
+    (void) request_vec;
+    (void) i;
+#endif
+}
+
 int fr_io_posix::flush_copy_bytes(fr_dir_posix dir, const fr_extent<ft_uoff> & request)
 {
     return flush_copy_bytes(dir, request.physical(), request.logical(), request.length());
@@ -1073,11 +1180,7 @@ int fr_io_posix::flush_copy_bytes(fr_dir_posix dir, const fr_extent<ft_uoff> & r
 #ifdef ENABLE_CHECK_IF_MEM_IS_ZERO
 /** returns true if the specified memory range contains ONLY zeroes. */
 static bool fr_io_posix_mem_is_zero(const char * mem_address, ft_size mem_length) {
-    for (ft_size i = 0; i < mem_length; i++) {
-        if (mem_address[i] != 0)
-            return false;
-    }
-    return true;
+    return ff_mem_is_zero(mem_address, mem_length);
 }
 #endif // ENABLE_CHECK_IF_MEM_IS_ZERO
 
@@ -1148,6 +1251,13 @@ int fr_io_posix::flush_copy_bytes(fr_dir_posix dir, ft_uoff from_offset, ft_uoff
 
 #endif // ENABLE_CHECK_IF_MEM_IS_ZERO
 
+            throttle_io(length);
+
+            fr_stats * stats = this->stats();
+            double start = 0.0, end = 0.0;
+            if (stats != NULL)
+                (void) ff_now(start);
+
             if (read_dev) {
                 err = ff_posix_read(fd, mmap_address + mem_offset, mem_length);
                 if (err == 0) {
@@ -1157,6 +1267,12 @@ int fr_io_posix::flush_copy_bytes(fr_dir_posix dir, ft_uoff from_offset, ft_uoff
                 CHECK_IF_MEM_IS_ZERO;
                 err = ff_posix_write(fd, mmap_address + mem_offset, mem_length);
             }
+            if (err == 0 && stats != NULL && ff_now(end) == 0) {
+                if (read_dev)
+                    stats->dev_read(end - start);
+                else
+                    stats->dev_write(end - start);
+            }
             if (err != 0) {
                 err = ff_log(FC_ERROR, err, "I/O error while copying " CURRENT_OP_FMT, CURRENT_OP_ARGS);
                 break;
@@ -1188,10 +1304,17 @@ int fr_io_posix::validate(const char * type_name, ft_uoff type_max, fr_dir_posix
  * flush any I/O specific buffer
  * return 0 if success, else error
  * implementation: call msync() because we use a mmapped() buffer for STORAGE,
- * and call sync() because we write() to DEVICE
+ * and call fdatasync() on DEVICE because we write() to it.
+ * only the files we wrote are synced, instead of the whole system with sync():
+ * fr_persist relies on this to commit each step only after its data reached the disk
  */
 int fr_io_posix::flush_bytes()
 {
+    fr_stats * stats = this->stats();
+    double start = 0.0, end = 0.0;
+    if (stats != NULL)
+        (void) ff_now(start);
+
     int err = 0;
     do {
         if (ui() != NULL)
@@ -1214,14 +1337,19 @@ int fr_io_posix::flush_bytes()
             msync_bytes(secondary_storage());
 #endif
 
+#if defined(FT_HAVE_FDATASYNC)
+        if ((err = fdatasync(fd[FC_DEVICE])) != 0)
+            err = ff_log(FC_ERROR, errno, "I/O error in %s fdatasync()", label[FC_DEVICE]);
+#elif defined(FT_HAVE_FSYNC)
+        if ((err = fsync(fd[FC_DEVICE])) != 0)
+            err = ff_log(FC_ERROR, errno, "I/O error in %s fsync()", label[FC_DEVICE]);
+#else
         (void) sync(); // sync() returns void
-#if 0
-        if (err != 0) {
-            ff_log(FC_WARN, errno, "I/O error in sync()");
-            err = 0;
-        }
 #endif
     } while (0);
+
+    if (err == 0 && stats != NULL && ff_now(end) == 0)
+        stats->flush(end - start);
     return err;
 }
 
@@ -1281,6 +1409,7 @@ int fr_io_posix::zero_bytes(fr_to to, ft_uoff offset, ft_uoff length)
         ft_uoff chunk;
         while (length != 0) {
             chunk = ff_min2<ft_uoff>(length, ZERO_BUF_LEN);
+            throttle_io(chunk);
             if ((err = ff_posix_write(dev_fd, zero_buf, chunk)) != 0) {
                 err = ff_log(FC_ERROR, err, "error in %s write({fd = %d, offset = %" FT_ULL "}, zero_buffer, length = %" FT_ULL ")",
                              label[FC_DEVICE], dev_fd, (ft_ull) offset, (ft_ull) chunk);
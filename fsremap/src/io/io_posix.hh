@@ -69,11 +69,9 @@ private:
     /* device major/minor numbers */
     ft_dev this_dev_blkdev;
 
-    /** open DEVICE */
-    int open_dev(const char * path);
-
-    /** really open DEVICE */
-    int open_dev0(const char * path, int * ret_fd, ft_dev * ret_dev, ft_uoff * ret_len);
+    /* read-ahead state of current flush_copy_bytes(): extents [pos, next) are advised, for a total of 'ahead' bytes */
+    ft_size this_prefetch_pos, this_prefetch_next;
+    ft_uoff this_prefetch_ahead;
 
     /** open LOOP-FILE or ZERO-FILE */
     int open_file(ft_size i, const char * path);
@@ -81,8 +79,24 @@ private:
     /** set device major/minor numbers */
     FT_INLINE void dev_blkdev(ft_dev blkdev) { this_dev_blkdev = blkdev; }
 
+    /**
+     * called before reading request_vec[i] from DEVICE: if prefetch_window() is set,
+     * ask the kernel to read ahead the extents following it, up to prefetch_window() bytes.
+     * request_vec must be sorted by ->physical
+     */
+    void prefetch(const fr_vector<ft_uoff> & request_vec, ft_size i);
+
 protected:
 
+    /** open DEVICE */
+    int open_dev(const char * path);
+
+    /** really open DEVICE */
+    virtual int open_dev0(const char * path, int * ret_fd, ft_dev * ret_dev, ft_uoff * ret_len);
+
+    /** return file descriptor of DEVICE, or -1 if not open */
+    FT_INLINE int dev_fd() const { return fd[FC_DEVICE]; }
+
     /** return true if a single descriptor/stream is open */
     bool is_open0(ft_size which) const;
 
@@ -243,6 +257,12 @@ public:
      */
     int check_last_block();
 
+    /**
+     * measure DEVICE sequential throughput (in bytes per second) and average seek latency (in seconds)
+     * by timing some sequential and some random reads. DEVICE is never written.
+     */
+    virtual int measure_profile(double & ret_bytes_per_second, double & ret_seek_seconds);
+
     /**
      * write zeroes to primary storage.
      * used to remove primary-storage once remapping is finished
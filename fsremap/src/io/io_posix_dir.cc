@@ -30,48 +30,111 @@
 #elif defined(FT_HAVE_ERRNO_H)
 #include <errno.h>
 #endif
+#if defined(FT_HAVE_CSTDLIB)
+#include <cstdlib> // for malloc(), free()
+#elif defined(FT_HAVE_STDLIB_H)
+#include <stdlib.h> // for malloc(), free()
+#endif
 
 #ifdef FT_HAVE_SYS_TYPES_H
-#include <sys/types.h> // for DIR, opendir()
+#include <sys/types.h> // for DIR, fdopendir()
 #endif
 #ifdef FT_HAVE_DIRENT_H
-#include <dirent.h> //  "   "     "      , readdir(), closedir()
+#include <dirent.h> //  "   "     "       , readdir(), closedir(), getdents64()
+#endif
+#ifdef FT_HAVE_FCNTL_H
+#include <fcntl.h> // for openat(), AT_FDCWD
+#endif
+#ifdef FT_HAVE_UNISTD_H
+#include <unistd.h> // for close()
 #endif
 
 #include "../log.hh"       // for ff_log()
 #include "io_posix_dir.hh" // for ft_io_posix_dir
 
+#ifndef O_DIRECTORY
+#define O_DIRECTORY 0
+#endif
+#ifndef O_NOFOLLOW
+#define O_NOFOLLOW 0
+#endif
+
 FT_IO_NAMESPACE_BEGIN
 
 /** default constructor */
-ft_io_posix_dir::ft_io_posix_dir() : this_path(), this_dir(NULL) {
+ft_io_posix_dir::ft_io_posix_dir()
+    : this_path(), this_fd(-1),
+#ifdef FT_HAVE_GETDENTS64
+      this_buf(NULL), this_buf_pos(0), this_buf_len(0)
+#else
+      this_dir(NULL)
+#endif
+{
 }
 
 /** destructor. calls close() */
 ft_io_posix_dir::~ft_io_posix_dir() {
     close();
+#ifdef FT_HAVE_GETDENTS64
+    free(this_buf);
+#endif
 }
 
-/** open a directory */
+/** open a directory. like opendir(), follows symbolic links */
 int ft_io_posix_dir::open(const ft_string &path) {
+    return open_at(AT_FDCWD, path.c_str(), path, 0);
+}
+
+/**
+ * open directory 'name' relative to directory descriptor 'dir_fd', without following symbolic links.
+ * 'path' is the full path of the directory, used for messages
+ */
+int ft_io_posix_dir::open_at(int dir_fd, const char *name, const ft_string &path) {
+    return open_at(dir_fd, name, path, O_NOFOLLOW);
+}
+
+/** open directory 'name' relative to 'dir_fd', adding 'flags' to openat() flags */
+int ft_io_posix_dir::open_at(int dir_fd, const char *name, const ft_string &path, int flags) {
     int err = 0;
-    if (this_dir != NULL)
+    if (this_fd >= 0)
         err = EISCONN;
-    else if ((this_dir = ::opendir(path.c_str())) == NULL)
+    else if ((this_fd = ::openat(dir_fd, name, O_RDONLY | O_DIRECTORY | flags)) < 0)
         err = errno;
+#ifdef FT_HAVE_GETDENTS64
+    else if (this_buf == NULL && (this_buf = (char *)malloc(FT_DIR_BUFSIZE)) == NULL)
+        err = ENOMEM;
+#else
+    else if ((this_dir = ::fdopendir(this_fd)) == NULL)
+        err = errno;
+#endif
     else {
         this_path = path;
+#ifdef FT_HAVE_GETDENTS64
+        this_buf_pos = this_buf_len = 0;
+#endif
         return err;
     }
+    if (err != EISCONN && this_fd >= 0) {
+        (void)::close(this_fd);
+        this_fd = -1;
+    }
     return ff_log(FC_ERROR, err, "failed to open directory `%s'", path.c_str());
 }
 
 /** close the currently open directory */
 int ft_io_posix_dir::close() {
-    if (this_dir != NULL) {
+    if (this_fd >= 0) {
+#ifdef FT_HAVE_GETDENTS64
+        if (::close(this_fd) != 0)
+            return ff_log(FC_ERROR, errno, "failed to close directory `%s'", this_path.c_str());
+        this_buf_pos = this_buf_len = 0;
+#else
+        /* closedir() also closes this_fd */
         if (closedir(this_dir) != 0)
             return ff_log(FC_ERROR, errno, "failed to close directory `%s'", this_path.c_str());
         this_dir = NULL;
+#endif
+        this_fd = -1;
     }
     this_path.clear();
     return 0;
@@ -84,13 +147,32 @@ int ft_io_posix_dir::close() {
  */
 int ft_io_posix_dir::next(ft_io_posix_dirent *&result) {
     int err;
-    if (this_dir == NULL)
+    if (this_fd < 0)
         err = ENOTCONN;
     else {
+#ifdef FT_HAVE_GETDENTS64
+        if (this_buf_pos >= this_buf_len) {
+            /* read as many entries as fit in this_buf with a single system call */
+            ssize_t got;
+            while ((got = ::getdents64(this_fd, this_buf, FT_DIR_BUFSIZE)) < 0 && errno == EINTR)
+                ;
+            if (got < 0)
+                return ff_log(FC_ERROR, errno, "failed to read directory `%s'", this_path.c_str());
+            this_buf_pos = 0;
+            this_buf_len = (ft_size)got;
+        }
+        if (this_buf_pos < this_buf_len) {
+            result = (ft_io_posix_dirent *)(this_buf + this_buf_pos);
+            this_buf_pos += result->d_reclen;
+        } else
+            result = NULL; // getdents64() returns 0 at end-of-dir
+        return 0;
+#else
         errno = 0;
         result = readdir(this_dir);
         if ((err = errno) == 0) // 0 for success or end-of-dir
             return err;
+#endif
     }
     return ff_log(FC_ERROR, err, "failed to read directory `%s'", this_path.c_str());
 }
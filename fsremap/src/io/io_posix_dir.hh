@@ -26,20 +26,34 @@
 #ifndef FSTRANSFORM_IO_IO_POSIX_DIR_HH
 #define FSTRANSFORM_IO_IO_POSIX_DIR_HH
 
-#include "../types.hh" // for ft_string, ft_inode
+#include "../types.hh" // for ft_string, ft_inode, ft_size
 
 #ifdef FT_HAVE_DIRENT_H
-#include <dirent.h> // for DIR, DT_UNKNOWN
+#include <dirent.h> // for DIR, DT_UNKNOWN, getdents64()
 #endif
 
 FT_IO_NAMESPACE_BEGIN
 
+#ifdef FT_HAVE_GETDENTS64
+/* entries are read in bulk with getdents64() */
+typedef struct dirent64 ft_io_posix_dirent;
+#else
 typedef struct dirent ft_io_posix_dirent;
+#endif
 
 class ft_io_posix_dir {
   private:
     ft_string this_path;
+    int this_fd;
+#ifdef FT_HAVE_GETDENTS64
+    enum { FT_DIR_BUFSIZE = 32768 };
+
+    /** entries read by getdents64() and not yet returned by next(): this_buf[this_buf_pos, this_buf_len) */
+    char *this_buf;
+    ft_size this_buf_pos, this_buf_len;
+#else
     DIR *this_dir;
+#endif
 
     /** cannot call copy constructor */
     ft_io_posix_dir(const ft_io_posix_dir &);
@@ -47,6 +61,9 @@ class ft_io_posix_dir {
     /** cannot call assignment operator */
     const ft_io_posix_dir &operator=(const ft_io_posix_dir &);
 
+    /** open directory 'name' relative to 'dir_fd', adding 'flags' to openat() flags */
+    int open_at(int dir_fd, const char *name, const ft_string &path, int flags);
+
   public:
     /** default constructor */
     ft_io_posix_dir();
@@ -54,15 +71,22 @@ class ft_io_posix_dir {
     /** destructor, calls close() */
     ~ft_io_posix_dir();
 
-    /** open a directory */
+    /** open a directory. like opendir(), follows symbolic links */
     int open(const ft_string &path);
 
+    /**
+     * open directory 'name' relative to directory descriptor 'dir_fd', without following symbolic links.
+     * 'path' is the full path of the directory, used for messages
+     */
+    int open_at(int dir_fd, const char *name, const ft_string &path);
+
     FT_INLINE bool is_open() const {
-        return this_dir != NULL;
+        return this_fd >= 0;
     };
 
-    FT_INLINE DIR *dir() {
-        return this_dir;
+    /** return the descriptor of the currently open directory, or -1 if not open */
+    FT_INLINE int fd() const {
+        return this_fd;
     }
     FT_INLINE const ft_string &path() const {
         return this_path;
@@ -120,12 +120,29 @@ int fr_io_self_test::read_extents(fr_vector<ft_uoff> & loop_file_extents,
     if (!is_open())
         return ENOTCONN; // not open!
 
-    ft_uoff dev_len = dev_length(), free_len = ff_random(dev_len >> this_block_size_log2) << this_block_size_log2;
+    invent_layout(dev_length(), this_block_size_log2, loop_file_extents, free_space_extents, ret_block_size_bitmask);
+    return 0;
+}
+
+/**
+ * fill loop_file_extents and free_space_extents with random (but consistent) extents
+ * of a DEVICE 'dev_len' bytes long, using blocks (1 << block_size_log2) bytes long.
+ * the vectors will be ordered by extent ->logical.
+ *
+ * extents are at most 'max_extent_blocks' blocks long: if zero, use a limit proportional to 'dev_len'
+ */
+void fr_io_self_test::invent_layout(ft_uoff dev_len, ft_uoff block_size_log2,
+                                    fr_vector<ft_uoff> & loop_file_extents,
+                                    fr_vector<ft_uoff> & free_space_extents,
+                                    ft_uoff & ret_block_size_bitmask,
+                                    ft_uoff max_extent_blocks)
+{
+    ft_uoff free_len = ff_random(dev_len >> block_size_log2) << block_size_log2;
 
     fr_map<ft_uoff> loop_file_map, free_space_map;
 
-    invent_extents(loop_file_map, dev_len, ret_block_size_bitmask);
-    invent_extents(free_space_map, free_len, ret_block_size_bitmask);
+    invent_extents(loop_file_map, dev_len, block_size_log2, max_extent_blocks, ret_block_size_bitmask);
+    invent_extents(free_space_map, free_len, block_size_log2, max_extent_blocks, ret_block_size_bitmask);
 
     /* remove from FREE-SPACE any extent->physical already present in LOOP-FILE */
     fr_map<ft_uoff> intersect_map;
@@ -137,25 +154,29 @@ int fr_io_self_test::read_extents(fr_vector<ft_uoff> & loop_file_extents,
 
     free_space_extents.insert(free_space_extents.end(), free_space_map.begin(), free_space_map.end());
     free_space_extents.sort_by_logical();
-
-    return 0;
 }
 
-/** fill ret_extents with random (but consistent) extents. extents will stop at 'file_len' bytes */
-void fr_io_self_test::invent_extents(fr_map<ft_uoff> & extent_map, ft_uoff file_len, ft_uoff & ret_block_size_bitmask) const
+/**
+ * fill ret_extents with random (but consistent) extents. extents will stop at 'file_len' bytes.
+ * extents are at most 'max_extent_len' blocks long: if zero, use a limit proportional to 'file_len'
+ */
+void fr_io_self_test::invent_extents(fr_map<ft_uoff> & extent_map, ft_uoff file_len, ft_uoff block_size_log2,
+                                     ft_uoff max_extent_len, ft_uoff & ret_block_size_bitmask)
 {
     fr_vector<ft_uoff> extent_vec;
 
-    file_len >>= this_block_size_log2;
-    ft_uoff pos = 0, hole, len, max_extent_len = ff_max2(file_len >> 16, (ft_uoff)0x100);
+    file_len >>= block_size_log2;
+    ft_uoff pos = 0, hole, len;
+    if (max_extent_len == 0)
+        max_extent_len = ff_max2(file_len >> 16, (ft_uoff)0x100);
     fr_extent<ft_uoff> extent;
     while (pos < file_len) {
         /* make some holes in physical layout */
         hole = ff_random(ff_min2(max_extent_len >> 4, file_len - pos - 1));
         len = 1 + ff_min2((ft_uoff)ff_random(max_extent_len), file_len - pos - hole - 1); // length == 0 is not valid!
-        ret_block_size_bitmask |= extent.physical() = (pos + hole) << this_block_size_log2;
+        ret_block_size_bitmask |= extent.physical() = (pos + hole) << block_size_log2;
         extent.logical() = 0;
-        ret_block_size_bitmask |= extent.length() = len << this_block_size_log2;
+        ret_block_size_bitmask |= extent.length() = len << block_size_log2;
 
         /* on average, one extent in 1024 is FC_EXTENT_ZEROED */
         extent.user_data() = ff_random(1023) == 0 ? FC_EXTENT_ZEROED : FC_DEFAULT_USER_DATA;
@@ -174,16 +195,16 @@ void fr_io_self_test::invent_extents(fr_map<ft_uoff> & extent_map, ft_uoff file_
         /* also make some holes in logical layout */
         if ((pos += ff_random(ff_min2(max_extent_len, file_len - pos) >> 8)) >= file_len)
             break;
-        ret_block_size_bitmask |= extent_i.logical() = pos << this_block_size_log2;
-        pos += extent_i.length() >> this_block_size_log2;
+        ret_block_size_bitmask |= extent_i.logical() = pos << block_size_log2;
+        pos += extent_i.length() >> block_size_log2;
         extent_map.insert(extent_i);
     }
 
     if (i + 1 == n) {
         if ((pos += ff_random(ff_min2(max_extent_len, file_len - pos) >> 8)) < file_len) {
             fr_extent<ft_uoff> & extent_i = extent_vec[i];
-            ret_block_size_bitmask |= extent_i.logical() = pos << this_block_size_log2;
-            pos += extent_i.length() >> this_block_size_log2;
+            ret_block_size_bitmask |= extent_i.logical() = pos << block_size_log2;
+            pos += extent_i.length() >> block_size_log2;
             extent_map.insert(extent_i);
         }
     }
@@ -44,8 +44,12 @@ private:
 
     ft_ull this_block_size_log2;
 
-    /** fill ret_extents with random (but consistent) extents. extents will stop at 'length' bytes */
-    void invent_extents(fr_map<ft_uoff> & ret_extents, ft_uoff length, ft_uoff & ret_block_size_bitmask) const;
+    /**
+     * fill ret_extents with random (but consistent) extents. extents will stop at 'length' bytes.
+     * extents are at most 'max_extent_blocks' blocks long: if zero, use a limit proportional to 'length'
+     */
+    static void invent_extents(fr_map<ft_uoff> & ret_extents, ft_uoff length, ft_uoff block_size_log2,
+                               ft_uoff max_extent_blocks, ft_uoff & ret_block_size_bitmask);
 
 protected:
 
@@ -85,6 +89,20 @@ public:
 
     /** close any resource associated to LOOP-FILE and ZERO-FILE extents */
     virtual void close_extents();
+
+    /**
+     * fill loop_file_extents and free_space_extents with random (but consistent) extents
+     * of a DEVICE 'dev_len' bytes long, using blocks (1 << block_size_log2) bytes long.
+     * the vectors will be ordered by extent ->logical. also used by fr_io_self_verify and fsremap-bench.
+     *
+     * extents are at most 'max_extent_blocks' blocks long: if zero, use a limit proportional to 'dev_len',
+     * which produces at most ~10^5 extents. smaller limits produce proportionally more extents
+     */
+    static void invent_layout(ft_uoff dev_len, ft_uoff block_size_log2,
+                              fr_vector<ft_uoff> & loop_file_extents,
+                              fr_vector<ft_uoff> & free_space_extents,
+                              ft_uoff & ret_block_size_bitmask,
+                              ft_uoff max_extent_blocks = 0);
 };
 
 FT_IO_NAMESPACE_END
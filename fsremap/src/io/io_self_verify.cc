@@ -0,0 +1,420 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * io/io_self_verify.cc
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#include "../first.hh"
+
+#if defined(FT_HAVE_ERRNO_H)
+# include <errno.h>        // for errno, EINVAL, EIO, ENOMEM
+#elif defined(FT_HAVE_CERRNO)
+# include <cerrno>         // for errno, EINVAL, EIO, ENOMEM
+#endif
+#if defined(FT_HAVE_STDLIB_H)
+# include <stdlib.h>       // for malloc(), free()
+#elif defined(FT_HAVE_CSTDLIB)
+# include <cstdlib>        // for malloc(), free()
+#endif
+
+#ifdef FT_HAVE_SYS_TYPES_H
+# include <sys/types.h>    // for open()
+#endif
+#ifdef FT_HAVE_SYS_STAT_H
+# include <sys/stat.h>     //  "    "   , S_ISBLK(), S_ISREG()
+#endif
+#ifdef FT_HAVE_FCNTL_H
+# include <fcntl.h>        //  "    "   , posix_fadvise()
+#endif
+#ifdef FT_HAVE_UNISTD_H
+# include <unistd.h>       // for ftruncate(), fdatasync(), fsync()
+#endif
+
+#include "../log.hh"          // for ff_log()
+#include "../misc.hh"         // for ff_min2(), ff_now(), ff_random(), ff_str2un_scaled(), ff_pretty_size()
+#include "util_posix.hh"      // for ff_posix_stat(), ff_posix_blkdev_size(), ff_posix_lseek(), ff_posix_read(), ff_posix_write()
+#include "io_self_test.hh"    // for fr_io_self_test::invent_layout()
+#include "io_self_verify.hh"  // for fr_io_self_verify
+
+
+FT_IO_NAMESPACE_BEGIN
+
+enum {
+    /* tags are written and verified in chunks of this size */
+    FC_SELF_VERIFY_CHUNK = 1024*1024,
+    /* minimum image length, in blocks */
+    FC_SELF_VERIFY_MIN_BLOCKS = 64,
+    /* log at most this many wrong blocks */
+    FC_SELF_VERIFY_REPORT_MAX = 16,
+};
+
+/** log throughput of a self-verify phase */
+static void ff_self_verify_show(const char * phase, ft_ull bytes, double seconds)
+{
+    double pretty_len = 0.0;
+    const char * pretty_label = ff_pretty_size((ft_uoff) bytes, & pretty_len);
+    ff_log(FC_NOTICE, 0, "self-verify: %s %.2f %sbytes in %.2f seconds, %.2f MB/s", phase,
+           pretty_len, pretty_label, seconds, seconds > 0.0 ? (double) bytes / seconds / 1048576.0 : 0.0);
+}
+
+/** write image contents to disk, then drop it from page cache (best effort) so that next reads come from disk */
+static int ff_self_verify_drop_cache(int fd, const char * label_dev)
+{
+#ifdef FT_HAVE_FDATASYNC
+    if (fdatasync(fd) != 0)
+        return ff_log(FC_ERROR, errno, "I/O error in %s fdatasync()", label_dev);
+#else
+    if (fsync(fd) != 0)
+        return ff_log(FC_ERROR, errno, "I/O error in %s fsync()", label_dev);
+#endif
+#ifdef POSIX_FADV_DONTNEED
+    (void) posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+    return 0;
+}
+
+
+/** constructor */
+fr_io_self_verify::fr_io_self_verify(fr_persist & persist)
+: super_type(persist), this_verify_extents(), this_zero_bytes(0), this_image_length(0),
+  this_block_size_log2(0), this_seed(0), this_remap_start(0.0)
+{
+    for (ft_size i = 0; i < FC_INVALID2INVALID; i++)
+        this_copy_bytes[i] = 0;
+}
+
+/** destructor. calls close() */
+fr_io_self_verify::~fr_io_self_verify()
+{
+    close();
+}
+
+/** open IMAGE from args.io_args[0], optionally setting its length from args.io_args[1] */
+int fr_io_self_verify::open(const fr_args & args)
+{
+    if (is_open()) {
+        // already open!
+        ff_log(FC_ERROR, 0, "unexpected call, I/O is already open");
+        return -EISCONN;
+    }
+    if (is_replaying()) {
+        ff_log(FC_ERROR, 0, "resuming job is meaningless for self-verify I/O");
+        return -EINVAL;
+    }
+    char const* const* path = args.io_args;
+    int err = 0;
+
+    this_image_length = 0;
+    if (path[1] != NULL && (err = ff_str2un_scaled(path[1], & this_image_length)) != 0)
+        return ff_log(FC_ERROR, err, "invalid %s length '%s'", label[FC_DEVICE], path[1]);
+
+    /* skip fr_io_posix::open(): it would also open LOOP-FILE and ZERO-FILE */
+    if ((err = fr_io::open(args)) != 0)
+        return err;
+    do {
+        if ((err = open_dev(path[FC_DEVICE])) != 0)
+            break;
+
+        /*
+         * block_size_log2 is a random number in the range [12,16]
+         * thus block_size is one of 4096, 8192, 16384, 32768, 65536.
+         * smaller blocks are not allowed: STORAGE is mmapped() from the image
+         */
+        this_block_size_log2 = (ft_uoff) ff_random(4) + 12;
+
+        const ft_uoff block_size = (ft_uoff) 1 << this_block_size_log2;
+        const ft_uoff dev_len = dev_length() & ~(block_size - 1);
+        if (dev_len < (ft_uoff) FC_SELF_VERIFY_MIN_BLOCKS * block_size) {
+            ff_log(FC_ERROR, 0, "%s '%s' is too small for self-verify: need at least %" FT_ULL " bytes, "
+                   "specify a larger %s length", label[FC_DEVICE], path[FC_DEVICE],
+                   (ft_ull) FC_SELF_VERIFY_MIN_BLOCKS * block_size, label[FC_DEVICE]);
+            err = -EINVAL;
+            break;
+        }
+        dev_length(dev_len);
+        loop_file_length(dev_len);
+
+        this_seed = ((ft_u64) ff_random(0xFFFFFFFFul) << 32) | (ft_u64) ff_random(0xFFFFFFFFul);
+
+        ff_log(FC_INFO, 0, "self-verify: block size is %" FT_ULL " bytes, image contents will be OVERWRITTEN", (ft_ull) block_size);
+    } while (0);
+
+    if (err != 0)
+        close();
+
+    return err;
+}
+
+/** close this I/O, including file descriptor to IMAGE */
+void fr_io_self_verify::close()
+{
+    this_verify_extents.clear();
+    for (ft_size i = 0; i < FC_INVALID2INVALID; i++)
+        this_copy_bytes[i] = 0;
+    this_zero_bytes = 0;
+    this_block_size_log2 = 0;
+    super_type::close();
+}
+
+/** open IMAGE as DEVICE. IMAGE can be a regular file (extended as sparse if needed) or a block device */
+int fr_io_self_verify::open_dev0(const char * path, int * ret_fd, ft_dev * ret_dev, ft_uoff * ret_len)
+{
+    const char * label_dev = label[FC_DEVICE];
+    ft_stat st_buf;
+    int err = 0, dev_fd;
+    do {
+        dev_fd = ::open(path, O_RDWR | O_CREAT, 0600);
+        if (dev_fd < 0) {
+            err = ff_log(FC_ERROR, errno, "error opening %s '%s'", label_dev, path);
+            break;
+        }
+        if ((err = ff_posix_stat(dev_fd, & st_buf)) != 0) {
+            err = ff_log(FC_ERROR, err, "failed %s fstat('%s')", label_dev, path);
+            break;
+        }
+        if (S_ISBLK(st_buf.st_mode)) {
+            * ret_dev = st_buf.st_rdev;
+            if ((err = ff_posix_blkdev_size(dev_fd, ret_len)) != 0) {
+                err = ff_log(FC_ERROR, err, "error in %s ioctl('%s', BLKGETSIZE64)", label_dev, path);
+                break;
+            }
+            if (this_image_length > * ret_len) {
+                ff_log(FC_ERROR, 0, "requested %s length (%" FT_ULL " bytes) exceeds block device '%s' length (%" FT_ULL " bytes)",
+                       label_dev, (ft_ull) this_image_length, path, (ft_ull) * ret_len);
+                err = -EFBIG;
+            } else if (this_image_length != 0)
+                * ret_len = this_image_length;
+            break;
+        }
+        if (!S_ISREG(st_buf.st_mode)) {
+            ff_log(FC_ERROR, 0, "%s '%s' must be a regular file or a block device", label_dev, path);
+            err = -EINVAL;
+            break;
+        }
+        * ret_dev = st_buf.st_dev;
+        * ret_len = (ft_uoff) st_buf.st_size;
+
+        if (this_image_length != 0 && this_image_length != * ret_len) {
+            /* added space is sparse: it uses no disk space until written */
+            if (ftruncate(dev_fd, (ft_off) this_image_length) != 0) {
+                err = ff_log(FC_ERROR, errno, "failed to set %s '%s' length to %" FT_ULL " bytes",
+                             label_dev, path, (ft_ull) this_image_length);
+                break;
+            }
+            * ret_len = this_image_length;
+        }
+    } while (0);
+
+    * ret_fd = dev_fd;
+
+    return err;
+}
+
+/**
+ * invent LOOP-FILE and FREE-SPACE extents with fr_io_self_test::invent_layout(),
+ * then fill the image with LOOP-FILE tags.
+ * return 0 for success, else error (and vectors contents will be UNDEFINED).
+ */
+int fr_io_self_verify::read_extents(fr_vector<ft_uoff> & loop_file_extents,
+                                    fr_vector<ft_uoff> & free_space_extents,
+                                    fr_vector<ft_uoff> & FT_ARG_UNUSED(to_zero_extents),
+                                    ft_uoff & ret_block_size_bitmask)
+{
+    if (!is_open())
+        return ENOTCONN; // not open!
+
+    fr_io_self_test::invent_layout(dev_length(), this_block_size_log2,
+                                   loop_file_extents, free_space_extents, ret_block_size_bitmask);
+
+    int err = fill(loop_file_extents);
+    if (err == 0)
+        (void) ff_now(this_remap_start);
+    return err;
+}
+
+/** write tags of LOOP-FILE extents into the image. return 0 if success, else error */
+int fr_io_self_verify::fill(const fr_vector<ft_uoff> & loop_file_extents)
+{
+    const char * label_dev = label[FC_DEVICE];
+    const int fd_dev = dev_fd();
+
+    ft_u64 * buf = (ft_u64 *) malloc(FC_SELF_VERIFY_CHUNK);
+    if (buf == NULL)
+        return ff_log(FC_ERROR, ENOMEM, "failed to allocate %" FT_ULL " bytes for self-verify", (ft_ull) FC_SELF_VERIFY_CHUNK);
+
+    this_verify_extents.clear();
+
+    fr_vector<ft_uoff>::const_iterator iter = loop_file_extents.begin(), end = loop_file_extents.end();
+    ft_uoff physical, logical, length, chunk;
+    ft_ull total = 0;
+    double start = 0.0, stop = 0.0;
+    int err = ff_now(start);
+
+    for (; err == 0 && iter != end; ++iter) {
+        /* remapping does not copy unwritten extents, there is nothing to verify in them */
+        if (iter->second.user_data == FC_EXTENT_ZEROED)
+            continue;
+
+        physical = iter->first.physical;
+        logical = iter->second.logical;
+        length = iter->second.length;
+
+        if ((err = ff_posix_lseek(fd_dev, physical)) != 0) {
+            err = ff_log(FC_ERROR, err, "I/O error in %s lseek(fd = %d, offset = %" FT_ULL ", SEEK_SET)",
+                         label_dev, fd_dev, (ft_ull) physical);
+            break;
+        }
+        for (; length != 0; logical += chunk, length -= chunk) {
+            chunk = ff_min2<ft_uoff>(length, FC_SELF_VERIFY_CHUNK);
+            for (ft_size i = 0, n = (ft_size) chunk / sizeof(ft_u64); i < n; i++)
+                buf[i] = tag(logical + i * sizeof(ft_u64));
+
+            if ((err = ff_posix_write(fd_dev, buf, chunk)) != 0) {
+                err = ff_log(FC_ERROR, err, "I/O error in %s write(fd = %d, length = %" FT_ULL ")",
+                             label_dev, fd_dev, (ft_ull) chunk);
+                break;
+            }
+            total += chunk;
+        }
+        this_verify_extents.push_back(* iter);
+    }
+    free(buf);
+
+    /* remapping must read the tags from disk, not from page cache */
+    if (err == 0)
+        err = ff_self_verify_drop_cache(fd_dev, label_dev);
+    if (err == 0 && (err = ff_now(stop)) == 0)
+        ff_self_verify_show("filled image with", total, stop - start);
+    return err;
+}
+
+/** read back LOOP-FILE extents from the image and check their tags. return 0 if success, else error */
+int fr_io_self_verify::verify()
+{
+    const char * label_dev = label[FC_DEVICE];
+    const int fd_dev = dev_fd();
+    const ft_size block_words = ((ft_size) 1 << this_block_size_log2) / sizeof(ft_u64);
+
+    ft_u64 * buf = (ft_u64 *) malloc(FC_SELF_VERIFY_CHUNK);
+    if (buf == NULL)
+        return ff_log(FC_ERROR, ENOMEM, "failed to allocate %" FT_ULL " bytes for self-verify", (ft_ull) FC_SELF_VERIFY_CHUNK);
+
+    fr_vector<ft_uoff>::const_iterator iter = this_verify_extents.begin(), end = this_verify_extents.end();
+    ft_uoff logical, length, chunk;
+    ft_ull total = 0, wrong_blocks = 0;
+    double start = 0.0, stop = 0.0;
+    int err = ff_now(start);
+
+    if (err == 0)
+        err = ff_self_verify_drop_cache(fd_dev, label_dev);
+
+    for (; err == 0 && iter != end; ++iter) {
+        logical = iter->second.logical;
+        length = iter->second.length;
+
+        if ((err = ff_posix_lseek(fd_dev, logical)) != 0) {
+            err = ff_log(FC_ERROR, err, "I/O error in %s lseek(fd = %d, offset = %" FT_ULL ", SEEK_SET)",
+                         label_dev, fd_dev, (ft_ull) logical);
+            break;
+        }
+        for (; length != 0; logical += chunk, length -= chunk) {
+            chunk = ff_min2<ft_uoff>(length, FC_SELF_VERIFY_CHUNK);
+            if ((err = ff_posix_read(fd_dev, buf, chunk)) != 0) {
+                err = ff_log(FC_ERROR, err, "I/O error in %s read(fd = %d, length = %" FT_ULL ")",
+                             label_dev, fd_dev, (ft_ull) chunk);
+                break;
+            }
+            /* chunks start at block boundaries: on mismatch, report it and skip to next block */
+            for (ft_size i = 0, n = (ft_size) chunk / sizeof(ft_u64); i < n; i++) {
+                ft_uoff offset = logical + i * sizeof(ft_u64);
+                if (buf[i] == tag(offset))
+                    continue;
+                if (wrong_blocks++ < FC_SELF_VERIFY_REPORT_MAX)
+                    ff_log(FC_ERROR, 0, "self-verify: wrong data at %s offset %" FT_ULL ": found 0x%016" FT_XLL ", expected 0x%016" FT_XLL,
+                           label_dev, (ft_ull) offset, (ft_ull) buf[i], (ft_ull) tag(offset));
+                i = (i / block_words + 1) * block_words - 1;
+            }
+            total += chunk;
+        }
+    }
+    free(buf);
+
+    if (err == 0 && (err = ff_now(stop)) == 0) {
+        ff_self_verify_show("verified", total, stop - start);
+        if (wrong_blocks != 0) {
+            ff_log(FC_ERROR, 0, "self-verify FAILED: %" FT_ULL " blocks of %" FT_ULL " bytes contain wrong data",
+                   wrong_blocks, (ft_ull) block_words * sizeof(ft_u64));
+            err = -EIO;
+        } else
+            ff_log(FC_NOTICE, 0, "self-verify passed: all %" FT_ULL " blocks of %s are at their final position",
+                   (ft_ull) (total >> this_block_size_log2), label[FC_LOOP_FILE]);
+    }
+    return err;
+}
+
+/** account copied bytes, then call fr_io_posix::flush_copy_bytes() */
+int fr_io_self_verify::flush_copy_bytes(fr_dir dir, fr_vector<ft_uoff> & request_vec)
+{
+    if ((unsigned) dir < (unsigned) FC_INVALID2INVALID) {
+        fr_vector<ft_uoff>::const_iterator iter = request_vec.begin(), end = request_vec.end();
+        for (; iter != end; ++iter)
+            this_copy_bytes[dir] += iter->second.length;
+    }
+    return super_type::flush_copy_bytes(dir, request_vec);
+}
+
+/** account zeroed bytes, then call fr_io_posix::zero_bytes() */
+int fr_io_self_verify::zero_bytes(fr_to to, ft_uoff offset, ft_uoff length)
+{
+    this_zero_bytes += length;
+    return super_type::zero_bytes(to, offset, length);
+}
+
+/** IMAGE is not mounted: do nothing and return success */
+int fr_io_self_verify::umount_dev()
+{
+    return 0;
+}
+
+/** called after a successful remapping: remove SECONDARY-STORAGE, then verify the image */
+int fr_io_self_verify::remove_storage_after_success()
+{
+    int err = super_type::remove_storage_after_success();
+    if (err != 0)
+        return err;
+
+    double now = 0.0;
+    (void) ff_now(now);
+    const double seconds = now - this_remap_start;
+
+    ff_self_verify_show("remapping copied", this_copy_bytes[FC_DEV2DEV]
+                        + this_copy_bytes[FC_DEV2STORAGE] + this_copy_bytes[FC_STORAGE2DEV], seconds);
+    ff_log(FC_INFO, 0, "self-verify: remapping copied %" FT_ULL " bytes %s to %s, %" FT_ULL " bytes %s to %s, "
+           "%" FT_ULL " bytes %s to %s, and zeroed %" FT_ULL " bytes",
+           this_copy_bytes[FC_DEV2DEV], label[FC_DEVICE], label[FC_DEVICE],
+           this_copy_bytes[FC_DEV2STORAGE], label[FC_DEVICE], label[FC_STORAGE],
+           this_copy_bytes[FC_STORAGE2DEV], label[FC_STORAGE], label[FC_DEVICE], this_zero_bytes);
+
+    return verify();
+}
+
+FT_IO_NAMESPACE_END
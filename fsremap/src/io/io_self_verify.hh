@@ -0,0 +1,114 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * io/io_self_verify.hh
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#ifndef FSREMAP_IO_IO_SELF_VERIFY_HH
+#define FSREMAP_IO_IO_SELF_VERIFY_HH
+
+#include "../types.hh"    // for ft_uoff, ft_ull, ft_u64, ft_dev
+
+#include "io_posix.hh"    // for fr_io_posix
+
+
+FT_IO_NAMESPACE_BEGIN
+
+/**
+ * self-verify class: invents random LOOP-FILE and FREE-SPACE extents as fr_io_self_test does,
+ * but performs real I/O with fr_io_posix on an image - a sparse file or a block device.
+ *
+ * before remapping, each LOOP-FILE block in the image is filled with a tag
+ * derived from its LOOP-FILE offset. after remapping, the image must contain
+ * each LOOP-FILE block at its logical offset: all of them are read back and verified.
+ *
+ * the image contents is OVERWRITTEN.
+ */
+class fr_io_self_verify: public fr_io_posix
+{
+private:
+    typedef fr_io_posix super_type;
+
+    /* LOOP-FILE extents that must be found at their ->logical offset after remapping */
+    fr_vector<ft_uoff> this_verify_extents;
+    /* bytes copied by flush_copy_bytes(), for each fr_dir */
+    ft_ull this_copy_bytes[FC_INVALID2INVALID];
+    ft_ull this_zero_bytes;
+    /* image length requested on command line, or 0 to use current image length */
+    ft_uoff this_image_length;
+    ft_uoff this_block_size_log2;
+    /* random seed mixed into tags, so that a stale image never passes verification */
+    ft_u64 this_seed;
+    double this_remap_start;
+
+    /** return the tag stored at LOOP-FILE byte 'offset', which must be a multiple of sizeof(ft_u64) */
+    FT_INLINE ft_u64 tag(ft_uoff offset) const { return (ft_u64) offset ^ this_seed; }
+
+    /** write tags of LOOP-FILE extents into the image. return 0 if success, else error */
+    int fill(const fr_vector<ft_uoff> & loop_file_extents);
+
+    /** read back LOOP-FILE extents from the image and check their tags. return 0 if success, else error */
+    int verify();
+
+protected:
+    /** open IMAGE as DEVICE. IMAGE can be a regular file (extended as sparse if needed) or a block device */
+    virtual int open_dev0(const char * path, int * ret_fd, ft_dev * ret_dev, ft_uoff * ret_len);
+
+    /**
+     * invent LOOP-FILE and FREE-SPACE extents with fr_io_self_test::invent_layout(),
+     * then fill the image with LOOP-FILE tags.
+     * return 0 for success, else error (and vectors contents will be UNDEFINED).
+     */
+    virtual int read_extents(fr_vector<ft_uoff> & loop_file_extents,
+                             fr_vector<ft_uoff> & free_space_extents,
+                             fr_vector<ft_uoff> & to_zero_extents,
+                             ft_uoff & ret_block_size_bitmask);
+
+    /** account copied bytes, then call fr_io_posix::flush_copy_bytes() */
+    virtual int flush_copy_bytes(fr_dir dir, fr_vector<ft_uoff> & request_vec);
+
+    /** account zeroed bytes, then call fr_io_posix::zero_bytes() */
+    virtual int zero_bytes(fr_to to, ft_uoff offset, ft_uoff length);
+
+public:
+    /** constructor */
+    fr_io_self_verify(fr_persist & persist);
+
+    /** destructor. calls close() */
+    virtual ~fr_io_self_verify();
+
+    /** open IMAGE from args.io_args[0], optionally setting its length from args.io_args[1] */
+    virtual int open(const fr_args & args);
+
+    /** close this I/O, including file descriptor to IMAGE */
+    virtual void close();
+
+    /** IMAGE is not mounted: do nothing and return success */
+    virtual int umount_dev();
+
+    /** called after a successful remapping: remove SECONDARY-STORAGE, then verify the image */
+    virtual int remove_storage_after_success();
+};
+
+FT_IO_NAMESPACE_END
+
+#endif /* FSREMAP_IO_IO_SELF_VERIFY_HH */
@@ -34,7 +34,7 @@
 #include "../log.hh"       // for ff_log()
 #include "../args.hh"      // for fr_args
 #include "../misc.hh"      // for ff_str2un_scaled()
-#include "extent_file.hh"  // for ff_read_extents_file()
+#include "extent_file.hh"  // for ff_load_extents_file_mmap()
 #include "io_test.hh"      // for fr_io_test
 
 
@@ -82,7 +82,11 @@ int fr_io_test::open(const fr_args & args)
     }
 
     if (!is_replaying()) {
+        const ft_size io_args_n = sizeof(args.io_args) / sizeof(args.io_args[0]);
 		for (i = FC_DEVICE_LENGTH+1; i < FC_EXTENTS_FILE_COUNT; i++) {
+			/* TO-ZERO-EXTENTS is optional: if missing, no additional extents will be zeroed */
+			if (i == FC_TO_ZERO_EXTENTS && (i >= io_args_n || io_args[i] == NULL))
+				continue;
 			if ((this_f[i] = fopen(io_args[i], "r")) == NULL) {
 				err = ff_log(FC_ERROR, errno, "error opening %s '%s'", extents_label[i], io_args[i]);
 				break;
@@ -132,7 +136,8 @@ void fr_io_test::close_extents()
 /** return true if this I/O has open descriptors/streams to LOOP-FILE and FREE-SPACE */
 bool fr_io_test::is_open_extents() const
 {
-    ft_size i, n = FC_EXTENTS_FILE_COUNT;
+    /* TO-ZERO-EXTENTS is optional */
+    ft_size i, n = FC_TO_ZERO_EXTENTS;
     for (i = FC_DEVICE_LENGTH+1; i < n; i++)
         if (this_f[i] == NULL)
             break;
@@ -172,11 +177,13 @@ int fr_io_test::read_extents(fr_vector<ft_uoff> & loop_file_extents,
             break;
         }
         fr_vector<ft_uoff> * ret_extents[FC_EXTENTS_FILE_COUNT] = {
-        	& loop_file_extents, & free_space_extents, & to_zero_extents,
+        	NULL, & loop_file_extents, & free_space_extents, & to_zero_extents,
         };
         for (ft_size i = FC_LOOP_EXTENTS; i < FC_EXTENTS_FILE_COUNT; i++) {
-			/* ff_load_extents_file() appends to fr_vector<ft_uoff>, does NOT overwrite it */
-			if ((err = ff_load_extents_file(this_f[i], * ret_extents[i], block_size_bitmask)) != 0) {
+			if (this_f[i] == NULL)
+				continue;
+			/* ff_load_extents_file_mmap() appends to fr_vector<ft_uoff>, does NOT overwrite it */
+			if ((err = ff_load_extents_file_mmap(this_f[i], * ret_extents[i], block_size_bitmask)) != 0) {
 				err = ff_log(FC_ERROR, err, "error reading %s extents from save-file", extents_label[i]);
 				break;
 			}
@@ -0,0 +1,407 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * io/journal.cc
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#include "../first.hh"
+
+#if defined(FT_HAVE_ERRNO_H)
+# include <errno.h>      // for errno, ENOENT, EINVAL, EFAULT, EISCONN
+#elif defined(FT_HAVE_CERRNO)
+# include <cerrno>       // for errno, ENOENT, EINVAL, EFAULT, EISCONN
+#endif
+#if defined(FT_HAVE_STRING_H)
+# include <string.h>     // for memcpy(), memcmp(), memset()
+#elif defined(FT_HAVE_CSTRING)
+# include <cstring>      // for memcpy(), memcmp(), memset()
+#endif
+
+#ifdef FT_HAVE_FCNTL_H
+# include <fcntl.h>      // for open(), O_RDWR, O_CREAT, O_TRUNC
+#endif
+
+#include "../log.hh"     // for ff_log()
+#include "../misc.hh"    // for ff_crc32(), ff_min2()
+#include "util_posix.hh" // for ff_posix_read(), ff_posix_write(), ff_posix_lseek(), ff_posix_size()
+#include "journal.hh"    // for fr_journal
+
+FT_IO_NAMESPACE_BEGIN
+
+enum {
+    FC_JOURNAL_VERSION = 1,
+    FC_JOURNAL_RECORD_MAGIC = 0x50455453, /* "STEP" in little endian */
+    FC_JOURNAL_SCAN_CHUNK = 64 * 1024,    /* has_record_after() reads damaged journals in chunks this large */
+};
+
+static const char FC_JOURNAL_MAGIC[16] = "fsremap journal";
+
+/** journal header, at the beginning of journal file */
+struct fr_journal_header
+{
+    char magic[16];
+    ft_u32 version, simulated;
+    ft_u64 reserved;
+};
+
+/** record header. followed by 'copy_count' fr_journal_copy */
+struct fr_journal_record
+{
+    ft_u32 magic, checksum;
+    ft_u64 progress1, progress2;
+    ft_u32 copy_count, reserved;
+};
+
+
+/** flush journal to disk: calls fdatasync() or fsync(). return 0 or errno-compatible error code */
+static int ff_journal_sync(int fd)
+{
+#if defined(FT_HAVE_FDATASYNC)
+    if (fdatasync(fd) != 0)
+        return errno;
+#elif defined(FT_HAVE_FSYNC)
+    if (fsync(fd) != 0)
+        return errno;
+#else
+    (void) fd;
+    (void) sync();
+#endif
+    return 0;
+}
+
+
+/** constructor */
+fr_journal::fr_journal()
+    : this_path(), this_record(), this_replay(), this_replay_pos(0),
+      this_size(0), this_read_offset(0), this_step_offset(0), this_fd(-1)
+{ }
+
+/** destructor. calls close() */
+fr_journal::~fr_journal()
+{
+    (void) close();
+}
+
+
+/**
+ * open journal file. if create is true, create (or truncate) it and write its header,
+ * otherwise check the header of the existing journal.
+ * if create is false and the journal does not exist, return ENOENT without logging it.
+ */
+int fr_journal::open(const ft_string & path, bool simulated, bool create)
+{
+    if (this_fd >= 0) {
+        ff_log(FC_ERROR, 0, "unexpected call to fr_journal::open(), journal '%s' is already open", this_path.c_str());
+        return -EISCONN;
+    }
+    this_path = path;
+    const char * path_cstr = path.c_str();
+
+    if ((this_fd = ::open(path_cstr, create ? O_RDWR|O_CREAT|O_TRUNC : O_RDWR, 0600)) < 0) {
+        if (!create && errno == ENOENT)
+            return ENOENT;
+        return ff_log(FC_ERROR, errno, "failed to open journal '%s'", path_cstr);
+    }
+
+    fr_journal_header header;
+    ft_uoff size = 0;
+    const char * simulated_label = simulated ? "simulated job" : "real job";
+    int err = 0;
+
+    if (create) {
+        memset(& header, '\0', sizeof(header));
+        memcpy(header.magic, FC_JOURNAL_MAGIC, sizeof(header.magic));
+        header.version = FC_JOURNAL_VERSION;
+        header.simulated = simulated;
+
+        if ((err = ff_posix_write(this_fd, & header, sizeof(header))) != 0)
+            err = ff_log(FC_ERROR, err, "I/O error writing to journal '%s'", path_cstr);
+        else if ((err = ff_journal_sync(this_fd)) != 0)
+            err = ff_log(FC_ERROR, err, "I/O error flushing journal '%s'", path_cstr);
+
+        this_size = sizeof(header);
+
+    } else if ((err = ff_posix_size(this_fd, & size)) != 0) {
+        err = ff_log(FC_ERROR, err, "failed to get size of journal '%s'", path_cstr);
+
+    } else if ((this_size = (ft_ull) size) < sizeof(header)
+               || (err = ff_posix_read(this_fd, & header, sizeof(header))) != 0
+               || memcmp(header.magic, FC_JOURNAL_MAGIC, sizeof(header.magic))
+               || header.version != FC_JOURNAL_VERSION)
+    {
+        err = ff_log(FC_ERROR, err, "unsupported or corrupted journal '%s'", path_cstr);
+
+    } else if ((header.simulated != 0) != simulated) {
+        ff_log(FC_ERROR, 0, "tried to resume a %s: you MUST%s specify option '-n'%s",
+               header.simulated ? "simulated job" : "real job", simulated ? " NOT" : "", simulated ? "" : " to simulate again");
+        err = -EINVAL;
+    }
+
+    if (err != 0) {
+        (void) close();
+        return err;
+    }
+    this_read_offset = this_step_offset = sizeof(header);
+    ff_log(FC_DEBUG, 0, "opened %s journal '%s'", simulated_label, path_cstr);
+    return err;
+}
+
+
+/** discard a torn record at the end of journal, left by a crash while writing it */
+int fr_journal::truncate_tail(ft_ull offset)
+{
+    ff_log(FC_WARN, 0, "discarding incomplete record at end of journal '%s', offset %" FT_ULL,
+           this_path.c_str(), offset);
+    if (ftruncate(this_fd, (ft_off) offset) != 0)
+        return ff_log(FC_ERROR, errno, "failed to truncate journal '%s'", this_path.c_str());
+    this_size = this_read_offset = offset;
+    return 0;
+}
+
+
+/** return true if a complete record, with valid checksum, begins after the damaged one at 'offset' */
+bool fr_journal::has_record_after(ft_ull offset)
+{
+    enum { FC_RECORD_ALIGN = sizeof(ft_u64) };
+    const ft_ull start = offset + sizeof(fr_journal_record);
+
+    if (start >= this_size || this_size - start < sizeof(fr_journal_record))
+        return false;
+
+    /*
+     * the tail can be large: scan it in chunks overlapping by sizeof(fr_journal_record),
+     * so that records straddling two chunks are found too
+     */
+    std::vector<char> buf(FC_JOURNAL_SCAN_CHUNK + sizeof(fr_journal_record)), copies;
+    fr_journal_record record;
+
+    for (ft_ull chunk_start = start; chunk_start < this_size; chunk_start += FC_JOURNAL_SCAN_CHUNK) {
+        const ft_size chunk_len = (ft_size) ff_min2<ft_ull>(buf.size(), this_size - chunk_start);
+        if (ff_posix_lseek(this_fd, chunk_start) != 0 || ff_posix_read(this_fd, & buf[0], chunk_len) != 0)
+            /* cannot tell: do not discard anything */
+            return true;
+
+        for (ft_size pos = 0; pos < FC_JOURNAL_SCAN_CHUNK && chunk_len - pos >= sizeof(record); pos += FC_RECORD_ALIGN) {
+            memcpy(& record, & buf[pos], sizeof(record));
+            if (record.magic != FC_JOURNAL_RECORD_MAGIC)
+                continue;
+            const ft_ull copies_start = chunk_start + pos + sizeof(record);
+            const ft_ull copies_len = (ft_ull) record.copy_count * sizeof(fr_journal_copy);
+            if (copies_len > this_size - copies_start)
+                continue;
+
+            ft_u32 checksum = record.checksum;
+            record.checksum = 0;
+            ft_u32 crc = ff_crc32(0, & record, sizeof(record));
+
+            if (copies_len <= chunk_len - pos - sizeof(record)) {
+                if (copies_len != 0)
+                    crc = ff_crc32(crc, & buf[pos + sizeof(record)], (ft_size) copies_len);
+            } else {
+                /* copies run past this chunk: read them separately. 'buf' is unchanged */
+                copies.resize(FC_JOURNAL_SCAN_CHUNK);
+                if (ff_posix_lseek(this_fd, copies_start) != 0)
+                    return true;
+                for (ft_ull left = copies_len, len; left != 0; left -= len) {
+                    len = ff_min2<ft_ull>(left, copies.size());
+                    if (ff_posix_read(this_fd, & copies[0], len) != 0)
+                        return true;
+                    crc = ff_crc32(crc, & copies[0], (ft_size) len);
+                }
+            }
+            if (crc == checksum)
+                return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * read next record. on success, return its progress counters
+ * and remember its copies, to be checked by check_copy().
+ * at end of journal, set ret_eof = true.
+ */
+int fr_journal::read(ft_ull & progress1, ft_ull & progress2, bool & ret_eof)
+{
+    const ft_ull offset = this_read_offset;
+    fr_journal_record record;
+    int err = 0;
+
+    this_replay.clear();
+    this_replay_pos = 0;
+
+    if ((ret_eof = (offset >= this_size)))
+        return err;
+
+    if (this_size - offset < sizeof(record)) {
+        if ((err = truncate_tail(offset)) == 0)
+            ret_eof = true;
+        return err;
+    }
+
+    if ((err = ff_posix_lseek(this_fd, offset)) != 0
+        || (err = ff_posix_read(this_fd, & record, sizeof(record))) != 0)
+        return ff_log(FC_ERROR, err, "I/O error reading from journal '%s'", this_path.c_str());
+
+    const ft_ull copies_len = (ft_ull) record.copy_count * sizeof(fr_journal_copy);
+    const ft_ull end = offset + sizeof(record) + copies_len;
+
+    /*
+     * only the last record can be incomplete: it is written after all the previous ones are synced.
+     * if a complete record follows, this one is not a torn tail but a corrupted journal
+     */
+    if (record.magic != FC_JOURNAL_RECORD_MAGIC || end > this_size) {
+        if (!has_record_after(offset)) {
+            if ((err = truncate_tail(offset)) == 0)
+                ret_eof = true;
+            return err;
+        }
+        ff_log(FC_ERROR, 0, "corrupted journal '%s'! bad %s in record at offset %" FT_ULL,
+               this_path.c_str(), record.magic != FC_JOURNAL_RECORD_MAGIC ? "magic" : "copy count", offset);
+        return -EFAULT;
+    }
+
+    this_replay.resize(record.copy_count);
+    if (copies_len != 0 && (err = ff_posix_read(this_fd, & this_replay[0], copies_len)) != 0)
+        return ff_log(FC_ERROR, err, "I/O error reading from journal '%s'", this_path.c_str());
+
+    ft_u32 checksum = record.checksum;
+    record.checksum = 0;
+    ft_u32 crc = ff_crc32(0, & record, sizeof(record));
+    if (copies_len != 0)
+        crc = ff_crc32(crc, & this_replay[0], copies_len);
+
+    if (crc != checksum) {
+        this_replay.clear();
+        if (end == this_size) {
+            if ((err = truncate_tail(offset)) == 0)
+                ret_eof = true;
+            return err;
+        }
+
+        ff_log(FC_ERROR, 0, "corrupted journal '%s'! bad checksum in record at offset %" FT_ULL,
+               this_path.c_str(), offset);
+        return -EFAULT;
+    }
+    progress1 = record.progress1;
+    progress2 = record.progress2;
+    this_step_offset = offset;
+    this_read_offset = end;
+    return err;
+}
+
+
+/** continue reading from the record starting at 'offset' */
+int fr_journal::seek(ft_ull offset)
+{
+    if (offset < sizeof(fr_journal_header) || offset >= this_size) {
+        ff_log(FC_ERROR, 0, "invalid offset %" FT_ULL " in journal '%s', length is %" FT_ULL,
+               offset, this_path.c_str(), this_size);
+        return -EINVAL;
+    }
+    this_read_offset = offset;
+    return 0;
+}
+
+
+/** add a copy to the pending record */
+void fr_journal::append_copy(fr_dir dir, ft_uoff from, ft_uoff to, ft_uoff length)
+{
+    fr_journal_copy copy = { (ft_u64) from, (ft_u64) to, (ft_u64) length, (ft_u32) dir, 0 };
+
+    if (this_record.empty())
+        this_record.resize(sizeof(fr_journal_record));
+
+    const char * bytes = (const char *) & copy;
+    this_record.insert(this_record.end(), bytes, bytes + sizeof(copy));
+}
+
+
+/** check that a copy performed while replaying matches the one recorded in the journal */
+int fr_journal::check_copy(fr_dir dir, ft_uoff from, ft_uoff to, ft_uoff length)
+{
+    if (this_replay_pos < this_replay.size()) {
+        const fr_journal_copy & copy = this_replay[this_replay_pos++];
+        if (copy.dir == (ft_u32) dir && copy.from == (ft_u64) from
+            && copy.to == (ft_u64) to && copy.length == (ft_u64) length)
+            return 0;
+
+        ff_log(FC_ERROR, 0, "unexpected copy while replaying journal '%s'", this_path.c_str());
+        ff_log(FC_ERROR, 0, "\texpected dir %u from %" FT_ULL " to %" FT_ULL " length %" FT_ULL
+               ", found dir %u from %" FT_ULL " to %" FT_ULL " length %" FT_ULL,
+               (unsigned) copy.dir, (ft_ull) copy.from, (ft_ull) copy.to, (ft_ull) copy.length,
+               (unsigned) dir, (ft_ull) from, (ft_ull) to, (ft_ull) length);
+    } else
+        ff_log(FC_ERROR, 0, "unexpected copy while replaying journal '%s': recorded step contains only %" FT_ULL " copies",
+               this_path.c_str(), (ft_ull) this_replay.size());
+    return -EINVAL;
+}
+
+
+/** write pending record with progress counters and checksum, then fdatasync() journal */
+int fr_journal::commit(ft_ull progress1, ft_ull progress2)
+{
+    if (this_record.empty())
+        this_record.resize(sizeof(fr_journal_record));
+
+    const ft_size record_len = this_record.size();
+    fr_journal_record record;
+    memset(& record, '\0', sizeof(record));
+    record.magic = FC_JOURNAL_RECORD_MAGIC;
+    record.progress1 = (ft_u64) progress1;
+    record.progress2 = (ft_u64) progress2;
+    record.copy_count = (ft_u32) ((record_len - sizeof(record)) / sizeof(fr_journal_copy));
+
+    memcpy(& this_record[0], & record, sizeof(record));
+    record.checksum = ff_crc32(0, & this_record[0], record_len);
+    memcpy(& this_record[0], & record, sizeof(record));
+
+    int err;
+    if ((err = ff_posix_lseek(this_fd, this_size)) != 0
+        || (err = ff_posix_write(this_fd, & this_record[0], record_len)) != 0)
+        return ff_log(FC_ERROR, err, "I/O error writing to journal '%s'", this_path.c_str());
+
+    /* group commit: a single sync for the whole step, no matter how many copies it contains */
+    if ((err = ff_journal_sync(this_fd)) != 0)
+        return ff_log(FC_ERROR, err, "I/O error flushing journal '%s'", this_path.c_str());
+
+    this_step_offset = this_size;
+    this_size += record_len;
+    this_read_offset = this_size;
+    this_record.clear();
+    return err;
+}
+
+
+/** close journal file */
+int fr_journal::close()
+{
+    if (this_fd >= 0) {
+        if (::close(this_fd) != 0)
+            return ff_log(FC_ERROR, errno, "failed to close journal '%s'", this_path.c_str());
+        this_fd = -1;
+    }
+    return 0;
+}
+
+FT_IO_NAMESPACE_END
@@ -0,0 +1,132 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * io/journal.hh
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#ifndef FSREMAP_IO_JOURNAL_HH
+#define FSREMAP_IO_JOURNAL_HH
+
+#include "../types.hh"   // for ft_u32, ft_u64, ft_ull, ft_uoff, ft_string
+#include "../extent.hh"  // for fr_dir
+
+#include <vector>        // for std::vector<T>
+
+FT_IO_NAMESPACE_BEGIN
+
+/** a single copy recorded in the journal. all fields are in bytes */
+struct fr_journal_copy
+{
+    ft_u64 from, to, length;
+    ft_u32 dir, reserved;
+};
+
+/**
+ * binary journal used by fr_persist.
+ *
+ * each record describes one step of the remapping algorithm:
+ * the progress counters, all the copies performed since previous step, and a CRC32 checksum.
+ *
+ * a record is committed with a single write() followed by a single fdatasync() (group commit),
+ * and only after the data it describes has been flushed to disk:
+ * replaying a job thus never trusts a step whose copies may be incomplete.
+ *
+ * records are stored in native byte order: a job must be resumed on the same machine.
+ */
+class fr_journal
+{
+private:
+    ft_string this_path;
+    /** pending record: header followed by copies, committed by commit() */
+    std::vector<char> this_record;
+    /** copies of the record being replayed */
+    std::vector<fr_journal_copy> this_replay;
+    ft_size this_replay_pos;
+    /** file length, offset of next record to read and offset where last record begins */
+    ft_ull this_size, this_read_offset, this_step_offset;
+    int this_fd;
+
+    /** cannot call copy constructor */
+    fr_journal(const fr_journal &);
+
+    /** cannot call assignment operator */
+    const fr_journal & operator=(const fr_journal &);
+
+    /** discard a torn record at the end of journal, left by a crash while writing it */
+    int truncate_tail(ft_ull offset);
+
+    /** return true if a complete record, with valid checksum, begins after the damaged one at 'offset' */
+    bool has_record_after(ft_ull offset);
+
+public:
+    /** constructor */
+    fr_journal();
+
+    /** destructor. calls close() */
+    ~fr_journal();
+
+    /** return true if journal is open */
+    FT_INLINE bool is_open() const { return this_fd >= 0; }
+
+    /**
+     * open journal file. if create is true, create (or truncate) it and write its header,
+     * otherwise check the header of the existing journal.
+     * if create is false and the journal does not exist, return ENOENT without logging it.
+     */
+    int open(const ft_string & path, bool simulated, bool create);
+
+    /**
+     * read next record. on success, return its progress counters
+     * and remember its copies, to be checked by check_copy().
+     * at end of journal, set ret_eof = true.
+     */
+    int read(ft_ull & progress1, ft_ull & progress2, bool & ret_eof);
+
+    /** continue reading from the record starting at 'offset' */
+    int seek(ft_ull offset);
+
+    /** add a copy to the pending record */
+    void append_copy(fr_dir dir, ft_uoff from, ft_uoff to, ft_uoff length);
+
+    /** check that a copy performed while replaying matches the one recorded in the journal */
+    int check_copy(fr_dir dir, ft_uoff from, ft_uoff to, ft_uoff length);
+
+    /** return true if all copies of the record being replayed were checked */
+    FT_INLINE bool is_replay_complete() const { return this_replay_pos == this_replay.size(); }
+
+    /** write pending record with progress counters and checksum, then fdatasync() journal */
+    int commit(ft_ull progress1, ft_ull progress2);
+
+    /** return the offset in journal where the last read or written record begins */
+    FT_INLINE ft_ull step_offset() const { return this_step_offset; }
+
+    /** return journal path */
+    FT_INLINE const ft_string & path() const { return this_path; }
+
+    /** close journal file */
+    int close();
+};
+
+
+FT_IO_NAMESPACE_END
+
+#endif /* FSREMAP_IO_JOURNAL_HH */
@@ -37,6 +37,10 @@
 # include <cstring>      // for strlen(), strcmp()
 #endif
 
+#ifdef FT_HAVE_FCNTL_H
+# include <fcntl.h>      // for open(), O_RDONLY
+#endif
+
 #include "../args.hh"    // for FC_PRIMARY_STORAGE_EXACT_SIZE, FC_SECONDARY_STORAGE_EXACT_SIZE
 #include "../log.hh"     // for ff_log()
 #include "persist.hh"    // for fr_persist
@@ -45,9 +49,9 @@ FT_IO_NAMESPACE_BEGIN
 
 /** constructor */
 fr_persist::fr_persist(fr_job & job)
-    : this_progress1((ft_ull)-1), this_progress2((ft_ull)-1),
-      this_persist_path(), this_persist_file(NULL),
-      this_job(job), this_replaying(false)
+    : this_progress1((ft_ull)-1), this_progress2((ft_ull)-1), this_step_offset(0),
+      this_persist_path(), this_checkpoint_path(), this_persist_file(NULL),
+      this_journal(), this_job(job), this_replaying(false)
 { }
 
 #define FC_PERSIST_FILE_VERSION     "version 0.9.4"
@@ -58,11 +62,18 @@ fr_persist::fr_persist(fr_job & job)
 #define FC_OLD_HEADER_SIMULATED     "simulated job"
 #define FC_OLD_HEADER_REAL          "real job"
 
+#define FC_CHECKPOINT_HEADER_SIMULATED "simulated job checkpoint, " FC_PERSIST_FILE_VERSION
+#define FC_CHECKPOINT_HEADER_REAL      "real job checkpoint, " FC_PERSIST_FILE_VERSION
+
 
-/** create and open persistence file job.job_dir() + "/fsremap.persist" */
+/**
+ * create and open binary journal job.job_dir() + "/fsremap.journal".
+ * if resuming a job that has no journal, open instead text persistence file
+ * job.job_dir() + "/fsremap.persist"
+ */
 int fr_persist::open()
 {
-    if (this_persist_file != NULL) {
+    if (this_persist_file != NULL || this_journal.is_open()) {
         ff_log(FC_ERROR, 0, "unexpected call to open(), persistence is already initialized");
         // return error as already reported
         return -EISCONN;
@@ -71,6 +82,25 @@ int fr_persist::open()
     this_persist_path = this_job.job_dir();
     this_persist_path += "/fsremap.persist";
 
+    this_checkpoint_path = this_job.job_dir();
+    this_checkpoint_path += "/fsremap.checkpoint";
+
+    ft_string journal_path = this_job.job_dir();
+    journal_path += "/fsremap.journal";
+
+    this_replaying = this_job.resuming_job();
+    const bool simulated = this_job.simulate_run();
+
+    int err = this_journal.open(journal_path, simulated, !this_replaying);
+    if (err == 0) {
+        if (this_replaying)
+            err = do_read(this_progress1, this_progress2);
+        return err;
+    }
+    if (err != ENOENT)
+        return err;
+
+    // resuming a job without journal: it was created by an older version, use text persistence file
     const char * persist_path = this_persist_path.c_str();
 
     // fopen(... "a+") = Open for reading and appending. The file is created if it does not exist.
@@ -80,15 +110,13 @@ int fr_persist::open()
     if ((this_persist_file = fopen(persist_path, "a+")) == NULL)
         return ff_log(FC_ERROR, errno, "failed to open persistence file '%s'", persist_path);
 
-    this_replaying = this_job.resuming_job();
-    const bool simulated = this_job.simulate_run();
     const char * header = simulated ? FC_PERSIST_HEADER_SIMULATED : FC_PERSIST_HEADER_REAL;
     const char * other_header = simulated ? FC_PERSIST_HEADER_REAL : FC_PERSIST_HEADER_SIMULATED;
 
     const char * header_old = simulated ? FC_OLD_HEADER_SIMULATED : FC_OLD_HEADER_REAL;
     const char * other_header_old = simulated ? FC_OLD_HEADER_REAL : FC_OLD_HEADER_SIMULATED;
 
-    int err = 0;
+    err = 0;
     if (this_replaying) {
         enum { FT_LINE_LEN = 80 };
         char line[FT_LINE_LEN + 1] = { '\0' };
@@ -205,6 +233,11 @@ int fr_persist::next(ft_ull progress1, ft_ull progress2)
     if (!this_replaying)
         return do_write(progress1, progress2);
 
+    if (this_journal.is_open() && !this_journal.is_replay_complete()) {
+        ff_log(FC_ERROR, 0, "fewer copies than expected while replaying journal '%s'",
+                this_journal.path().c_str());
+        return -EINVAL;
+    }
     if (progress1 != this_progress1 || progress2 != this_progress2) {
         ff_log(FC_ERROR, 0, "unexpected values found while replaying persistence file '%s'",
                 this_persist_path.c_str());
@@ -216,11 +249,62 @@ int fr_persist::next(ft_ull progress1, ft_ull progress2)
 }
 
 
+/**
+ * skip directly to the step starting at 'offset' in persistence file,
+ * check that it contains (progress1, progress2),
+ * then continue replaying from the following step.
+ */
+int fr_persist::seek_step(ft_ull offset, ft_ull progress1, ft_ull progress2)
+{
+    if (!this_replaying)
+        return ff_log(FC_ERROR, 0, "tried to seek persistence file '%s' while not replaying", this_persist_path.c_str());
+
+    ft_ull found1 = (ft_ull)-1, found2 = (ft_ull)-1;
+    int err = 0;
+    if (this_journal.is_open())
+        err = this_journal.seek(offset);
+    else if (fseek(this_persist_file, (long) offset, SEEK_SET) != 0)
+        return ff_log(FC_ERROR, errno, "I/O error seeking persistence file '%s' to offset %" FT_ULL,
+                      this_persist_path.c_str(), offset);
+
+    if (err == 0)
+        err = do_read(found1, found2);
+    if (err == 0 && (!this_replaying || found1 != progress1 || found2 != progress2)) {
+        ff_log(FC_ERROR, 0, "checkpoint does not match persistence file '%s' at offset %" FT_ULL,
+               this_persist_path.c_str(), offset);
+        err = -EINVAL;
+    }
+    if (err == 0)
+        err = do_read(this_progress1, this_progress2);
+    return err;
+}
+
+
+/**
+ * record a copy into the current step or, if replaying,
+ * check it against the copies recorded in the current step
+ */
+int fr_persist::copy(fr_dir dir, ft_uoff from, ft_uoff to, ft_uoff length)
+{
+    if (!this_journal.is_open())
+        return 0;
+    if (this_replaying)
+        return this_journal.check_copy(dir, from, to, length);
+
+    this_journal.append_copy(dir, from, to, length);
+    return 0;
+}
+
+
 /** try to read data from persistence fle */
 int fr_persist::do_read(ft_ull & progress1, ft_ull & progress2)
 {
     int err = 0;
-    if (this_replaying) {
+    if (this_replaying && this_journal.is_open()) {
+        bool eof = false;
+        if ((err = this_journal.read(progress1, progress2, eof)) == 0 && eof)
+            this_replaying = false;
+    } else if (this_replaying) {
         int items = fscanf(this_persist_file, "%" FT_ULL "\t%" FT_ULL "\n", & progress1, & progress2);
         if (items == 2) {
             /* ok */
@@ -238,6 +322,15 @@ int fr_persist::do_read(ft_ull & progress1, ft_ull & progress2)
 /** try to write data into persistence fle */
 int fr_persist::do_write(ft_ull progress1, ft_ull progress2)
 {
+    if (this_journal.is_open())
+        return this_journal.commit(progress1, progress2);
+
+    /* output is always appended: after a flush, ftell() returns where this step will start */
+    long offset = ftell(this_persist_file);
+    if (offset < 0)
+        return ff_log(FC_ERROR, errno, "I/O error querying offset of persistence file '%s'", this_persist_path.c_str());
+    this_step_offset = (ft_ull) offset;
+
     if (fprintf(this_persist_file, "%" FT_ULL "\t%" FT_ULL "\n", progress1, progress2) <= 0)
         return ff_log(FC_ERROR, errno, "I/O error writing to persistence file '%s'", this_persist_path.c_str());
     return do_flush();
@@ -246,11 +339,17 @@ int fr_persist::do_write(ft_ull progress1, ft_ull progress2)
 /** flush this_persist_file to disk: calls fflush() then fdatasync() or fsync() */
 int fr_persist::do_flush()
 {
-    if (fflush(this_persist_file) == 0) {
+    return do_flush(this_persist_file, this_persist_path.c_str());
+}
+
+/** flush a FILE to disk: calls fflush() then fdatasync() or fsync() */
+int fr_persist::do_flush(FILE * file, const char * path)
+{
+    if (fflush(file) == 0) {
 
-        int fd = fileno(this_persist_file);
+        int fd = fileno(file);
         if (fd < 0)
-            return ff_log(FC_ERROR, errno, "fileno('%s') failed: return value = %d", this_persist_path.c_str(), fd);
+            return ff_log(FC_ERROR, errno, "fileno('%s') failed: return value = %d", path, fd);
 
 #if defined(FT_HAVE_FDATASYNC)
         if (fdatasync(fd) == 0)
@@ -261,13 +360,97 @@ int fr_persist::do_flush()
 #endif
             return 0;
     }
-    return ff_log(FC_ERROR, errno, "I/O error flushing persistence file '%s'", this_persist_path.c_str());
+    return ff_log(FC_ERROR, errno, "I/O error flushing file '%s'", path);
+}
+
+/** fsync() job directory, needed to make a rename() inside it durable */
+int fr_persist::do_sync_dir()
+{
+    const char * dir_path = this_job.job_dir().c_str();
+#if defined(FT_HAVE_FSYNC) && defined(O_RDONLY)
+    int fd = ::open(dir_path, O_RDONLY);
+    if (fd < 0)
+        return ff_log(FC_ERROR, errno, "failed to open job directory '%s'", dir_path);
+    int err = 0;
+    if (fsync(fd) != 0)
+        err = ff_log(FC_ERROR, errno, "I/O error syncing job directory '%s'", dir_path);
+    (void) ::close(fd);
+    return err;
+#else
+    (void) dir_path;
+    (void) sync();
+    return 0;
+#endif
+}
+
+
+/** return the header that checkpoint files must start with */
+const char * fr_persist::checkpoint_header() const
+{
+    return this_job.simulate_run() ? FC_CHECKPOINT_HEADER_SIMULATED : FC_CHECKPOINT_HEADER_REAL;
+}
+
+/** create a new, temporary checkpoint file job.job_dir() + "/fsremap.checkpoint.tmp" */
+int fr_persist::checkpoint_create(FILE *& ret_file)
+{
+    ft_string tmp_path = this_checkpoint_path;
+    tmp_path += ".tmp";
+
+    if ((ret_file = fopen(tmp_path.c_str(), "w")) == NULL)
+        return ff_log(FC_ERROR, errno, "failed to create checkpoint file '%s'", tmp_path.c_str());
+
+    if (fprintf(ret_file, "%s\n", checkpoint_header()) < 0) {
+        int err = ff_log(FC_ERROR, errno, "I/O error writing to checkpoint file '%s'", tmp_path.c_str());
+        (void) fclose(ret_file);
+        ret_file = NULL;
+        return err;
+    }
+    return 0;
+}
+
+/**
+ * flush and sync temporary checkpoint file, then atomically rename() it
+ * to job.job_dir() + "/fsremap.checkpoint" and sync job directory.
+ * closes 'file' in any case.
+ */
+int fr_persist::checkpoint_commit(FILE * file)
+{
+    ft_string tmp_path = this_checkpoint_path;
+    tmp_path += ".tmp";
+
+    int err = do_flush(file, tmp_path.c_str());
+    if (fclose(file) != 0 && err == 0)
+        err = ff_log(FC_ERROR, errno, "failed to close checkpoint file '%s'", tmp_path.c_str());
+    if (err != 0)
+        return err;
+
+    /* rename() is atomic: after a crash, we find either the previous or the new checkpoint, never a partial one */
+    if (rename(tmp_path.c_str(), this_checkpoint_path.c_str()) != 0)
+        return ff_log(FC_ERROR, errno, "failed to rename checkpoint file '%s' to '%s'",
+                      tmp_path.c_str(), this_checkpoint_path.c_str());
+
+    return do_sync_dir();
+}
+
+/** open checkpoint file for reading. if it does not exist, return 0 and set ret_file = NULL */
+int fr_persist::checkpoint_open(FILE *& ret_file)
+{
+    const char * path = this_checkpoint_path.c_str();
+    if ((ret_file = fopen(path, "r")) != NULL)
+        return 0;
+    if (errno == ENOENT)
+        return 0;
+    return ff_log(FC_ERROR, errno, "failed to open checkpoint file '%s'", path);
 }
 
 
 /** close persistence file */
 int fr_persist::close()
 {
+    int err = this_journal.close();
+    if (err != 0)
+        return err;
+
     if (this_persist_file != NULL) {
         if (fclose(this_persist_file) != 0) {
             return ff_log(FC_ERROR, errno, "failed to close persistence file '%s'", this_persist_path.c_str());
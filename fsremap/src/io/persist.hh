@@ -27,6 +27,7 @@
 #define FSREMAP_PERSIST_HH
 
 #include "../job.hh"   // for fr_job
+#include "journal.hh"  // for fr_journal
 
 #if defined(FT_HAVE_STDIO_H)
 # include <stdio.h>        // for FILE. also for fopen(), fclose(), fprintf() and fscanf() used in persist.cc
@@ -40,10 +41,14 @@ class fr_persist
 {
 private:
     ft_ull this_progress1, this_progress2;
-    ft_string this_persist_path;
+    ft_ull this_step_offset;
+    ft_string this_persist_path, this_checkpoint_path;
 
+    /** text persistence file, only used to resume jobs created before fr_journal existed */
     FILE * this_persist_file;
 
+    fr_journal this_journal;
+
     fr_job & this_job;
 
     /** true while replaying persistence */
@@ -64,6 +69,12 @@ private:
     /** flush this_persist_file to disk: calls fflush() then fdatasync() or fsync() */
     int do_flush();
 
+    /** flush a FILE to disk: calls fflush() then fdatasync() or fsync() */
+    static int do_flush(FILE * file, const char * path);
+
+    /** fsync() job directory, needed to make a rename() inside it durable */
+    int do_sync_dir();
+
 public:
     /** constructor */
     fr_persist(fr_job & job);
@@ -71,7 +82,11 @@ public:
     /** return job */
     FT_INLINE fr_job & job() { return this_job; }
 
-    /** create and open persistence file job.job_dir() + "/fsremap.persist" */
+    /**
+     * create and open binary journal job.job_dir() + "/fsremap.journal".
+     * if resuming a job that has no journal, open instead text persistence file
+     * job.job_dir() + "/fsremap.persist"
+     */
     int open();
 
     /** return true if replaying persistence file */
@@ -93,6 +108,41 @@ public:
     /** read or write a step in persistence file */
     int next(ft_ull progress1, ft_ull progress2);
 
+    /**
+     * record a copy into the current step or, if replaying,
+     * check it against the copies recorded in the current step
+     */
+    int copy(fr_dir dir, ft_uoff from, ft_uoff to, ft_uoff length);
+
+    /** return the offset in persistence file where the last written step begins */
+    FT_INLINE ft_ull step_offset() const { return this_journal.is_open() ? this_journal.step_offset() : this_step_offset; }
+
+    /**
+     * skip directly to the step starting at 'offset' in persistence file,
+     * check that it contains (progress1, progress2),
+     * then continue replaying from the following step.
+     */
+    int seek_step(ft_ull offset, ft_ull progress1, ft_ull progress2);
+
+    /** return the header that checkpoint files must start with */
+    const char * checkpoint_header() const;
+
+    /** create a new, temporary checkpoint file job.job_dir() + "/fsremap.checkpoint.tmp" */
+    int checkpoint_create(FILE *& ret_file);
+
+    /**
+     * flush and sync temporary checkpoint file, then atomically rename() it
+     * to job.job_dir() + "/fsremap.checkpoint" and sync job directory.
+     * closes 'file' in any case.
+     */
+    int checkpoint_commit(FILE * file);
+
+    /** open checkpoint file for reading. if it does not exist, return 0 and set ret_file = NULL */
+    int checkpoint_open(FILE *& ret_file);
+
+    /** return the checkpoint file path */
+    FT_INLINE const ft_string & checkpoint_path() const { return this_checkpoint_path; }
+
     /** close persistence file */
     int close();
 
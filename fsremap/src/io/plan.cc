@@ -0,0 +1,712 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * io/plan.cc
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#include "../first.hh"
+
+#if defined(FT_HAVE_ERRNO_H)
+# include <errno.h>      // for errno, EINVAL, EFAULT, EISCONN
+#elif defined(FT_HAVE_CERRNO)
+# include <cerrno>       // for errno, EINVAL, EFAULT, EISCONN
+#endif
+#if defined(FT_HAVE_STRING_H)
+# include <string.h>     // for memcpy(), memcmp(), memset()
+#elif defined(FT_HAVE_CSTRING)
+# include <cstring>      // for memcpy(), memcmp(), memset()
+#endif
+#ifdef FT_HAVE_UNISTD_H
+# include <unistd.h>     // for unlink()
+#endif
+
+#include <algorithm>     // for std::stable_sort()
+
+#include "../eta.hh"     // for ft_eta_throughput
+#include "../log.hh"     // for ff_log()
+#include "../misc.hh"    // for ff_crc32(), ff_pretty_size(), ff_show_progress()
+#include "../ui/ui.hh"   // for fr_ui
+#include "io.hh"         // for fr_io
+#include "persist.hh"    // for fr_persist
+#include "plan.hh"       // for fr_plan
+
+FT_IO_NAMESPACE_BEGIN
+
+enum {
+    FC_PLAN_VERSION = 1,
+    /* operations buffered in memory while writing or reading a plan */
+    FC_PLAN_BUFFER_OPS = 4096,
+};
+
+static const char FC_PLAN_MAGIC[16] = "fsremap plan";
+
+/* default cost model used by fr_plan_cost: a typical rotational disk */
+static const double FC_PLAN_COST_SEEK_SECONDS = 0.008;
+static const double FC_PLAN_COST_BYTES_PER_SECOND = 100.0 * 1024 * 1024;
+
+/** plan header, at the beginning of plan file. followed by PRIMARY-STORAGE extents, then by operations */
+struct fr_plan_header
+{
+    char magic[16];
+    ft_u32 version, eff_block_size_log2;
+    ft_u64 dev_length, loop_file_length;
+    ft_u64 sizes[3];
+    ft_u64 primary_extent_count, op_count, extents_checksum;
+};
+
+/** a PRIMARY-STORAGE extent, as stored in plan file */
+struct fr_plan_extent
+{
+    ft_u64 physical, logical, length;
+};
+
+
+/** order copies by destination */
+static bool ff_plan_copy_less(const fr_plan_op & a, const fr_plan_op & b)
+{
+    return a.to < b.to;
+}
+
+/**
+ * optimize a group of copies between two barriers: sort them by destination, then merge contiguous ones.
+ * copies in the same group never overlap, so their order is irrelevant as long as they all share the same direction.
+ */
+static void ff_plan_optimize(std::vector<fr_plan_op> & ops)
+{
+    ft_size i, n = ops.size(), out = 0;
+    if (n == 0)
+        return;
+
+    for (i = 1; i < n && ops[i].dir == ops[0].dir; i++)
+        ;
+    if (i == n)
+        std::stable_sort(ops.begin(), ops.end(), ff_plan_copy_less);
+
+    for (i = 1; i < n; i++) {
+        fr_plan_op & last = ops[out];
+        const fr_plan_op & op = ops[i];
+        if (op.dir == last.dir && last.from + last.length == op.from && last.to + last.length == op.to)
+            last.length += op.length;
+        else
+            ops[++out] = op;
+    }
+    ops.resize(out + 1);
+}
+
+
+/** constructor. uses a typical rotational disk as profile */
+fr_plan_cost::fr_plan_cost()
+    : this_group(), this_bytes_per_second(FC_PLAN_COST_BYTES_PER_SECOND), this_seek_seconds(FC_PLAN_COST_SEEK_SECONDS)
+{
+    clear();
+}
+
+/** forget all accounted operations */
+void fr_plan_cost::clear()
+{
+    this_group.clear();
+    for (ft_size i = 0; i < FC_PLAN_OP_TYPE_N; i++)
+        this_counts[i] = this_bytes[i] = 0;
+    for (ft_size i = 0; i < FC_INVALID2INVALID; i++)
+        this_dir_bytes[i] = 0;
+    for (ft_size pass = 0; pass < 2; pass++) {
+        this_requests[pass] = this_seeks[pass] = 0;
+        this_next_from[pass] = this_next_to[pass] = (ft_ull)-1;
+    }
+}
+
+/** set device throughput (in bytes per second) and average seek latency (in seconds) */
+void fr_plan_cost::profile(double bytes_per_second, double seek_seconds)
+{
+    this_bytes_per_second = bytes_per_second;
+    this_seek_seconds = seek_seconds;
+}
+
+/** account an operation */
+void fr_plan_cost::add(const fr_plan_op & op)
+{
+    const ft_u32 type = op.type < FC_PLAN_OP_TYPE_N ? op.type : 0;
+    this_counts[type]++;
+    this_bytes[type] += op.length;
+    if (type == FC_PLAN_COPY) {
+        if (op.dir < FC_INVALID2INVALID)
+            this_dir_bytes[op.dir] += op.length;
+        this_group.push_back(op);
+    } else
+        add_group();
+}
+
+/** account the pending group of copies, then clear it */
+void fr_plan_cost::add_group()
+{
+    for (ft_size pass = 0; pass < 2; pass++) {
+        if (pass == 1)
+            ff_plan_optimize(this_group);
+
+        std::vector<fr_plan_op>::const_iterator iter = this_group.begin(), end = this_group.end();
+        for (; iter != end; ++iter) {
+            this_requests[pass]++;
+            /* a copy not contiguous with the previous one costs a seek to read and a seek to write */
+            if (iter->from != this_next_from[pass] || iter->to != this_next_to[pass])
+                this_seeks[pass] += 2;
+            this_next_from[pass] = iter->from + iter->length;
+            this_next_to[pass] = iter->to + iter->length;
+        }
+    }
+    this_group.clear();
+}
+
+/** log accounted bytes, barriers, seeks and estimated duration */
+void fr_plan_cost::show(const char * simul_msg)
+{
+    add_group();
+
+    static char const* const dir_label[FC_INVALID2INVALID] = {
+        "device -> device", "storage -> device", "device -> storage",
+    };
+    double pretty_len = 0.0, pretty_time = 0.0;
+    const char * pretty_label;
+
+    if (this_counts[0] != 0)
+        ff_log(FC_WARN, 0, "%sestimate: ignored %" FT_ULL " unknown operations", simul_msg, this_counts[0]);
+
+    for (ft_size dir = 0; dir < FC_INVALID2INVALID; dir++) {
+        pretty_label = ff_pretty_size(this_dir_bytes[dir], & pretty_len);
+        ff_log(FC_NOTICE, 0, "%sestimate: %-17s %.2f %sbytes read, %.2f %sbytes written",
+               simul_msg, dir_label[dir], pretty_len, pretty_label, pretty_len, pretty_label);
+    }
+    pretty_label = ff_pretty_size(this_bytes[FC_PLAN_ZERO], & pretty_len);
+    ff_log(FC_NOTICE, 0, "%sestimate: %-17s %.2f %sbytes written%s", simul_msg, "clear free space", pretty_len, pretty_label,
+           this_counts[FC_PLAN_ZERO_PRIMARY_STORAGE] != 0 ? ", plus primary storage" : "");
+
+    /* persistence steps are one at start of remapping, then three per iteration */
+    const ft_ull steps = this_counts[FC_PLAN_STEP];
+    ff_log(FC_NOTICE, 0, "%sestimate: %" FT_ULL " relocate iterations, %" FT_ULL " flush barriers",
+           simul_msg, steps != 0 ? (steps - 1) / 3 : 0, this_counts[FC_PLAN_FLUSH]);
+
+    /* each byte copied is read once and written once, each byte cleared is written once */
+    const double transfer_time = (2.0 * (double) this_bytes[FC_PLAN_COPY] + (double) this_bytes[FC_PLAN_ZERO]) / this_bytes_per_second;
+    for (ft_size pass = 0; pass < 2; pass++) {
+        ft_ull seeks = this_seeks[pass] + this_counts[FC_PLAN_FLUSH] + this_counts[FC_PLAN_ZERO];
+        pretty_label = ff_pretty_time(transfer_time + (double) seeks * this_seek_seconds, & pretty_time);
+        ff_log(FC_NOTICE, 0, "%sestimate: %s %" FT_ULL " copy requests, %" FT_ULL " seeks, %.1f %s%s",
+               simul_msg, pass == 0 ? "as recorded:" : "optimized:  ", this_requests[pass], seeks,
+               pretty_time, pretty_label, pretty_time != 1.0 ? "s" : "");
+    }
+    pretty_label = ff_pretty_size((ft_uoff) this_bytes_per_second, & pretty_len);
+    ff_log(FC_NOTICE, 0, "%sestimate: assuming device throughput %.2f %sbytes/s, seek latency %.2f ms",
+           simul_msg, pretty_len, pretty_label, this_seek_seconds * 1e3);
+}
+
+
+/** constructor */
+fr_plan::fr_plan()
+    : this_path(), this_ops(), this_primary_storage(),
+      this_dev_length(0), this_loop_file_length(0), this_eff_block_size_log2(0),
+      this_op_count(0), this_extents_checksum(0), this_file(NULL), this_writing(false)
+{
+    this_sizes[0] = this_sizes[1] = this_sizes[2] = 0;
+}
+
+/** destructor. calls close() */
+fr_plan::~fr_plan()
+{
+    close();
+}
+
+
+/** compute the checksum of LOOP-FILE, FREE-SPACE and TO-ZERO extents, used to match a plan against DEVICE */
+ft_ull fr_plan::extents_checksum(const fr_vector<ft_uoff> & loop_file_extents,
+                                 const fr_vector<ft_uoff> & free_space_extents,
+                                 const fr_vector<ft_uoff> & to_zero_extents)
+{
+    const fr_vector<ft_uoff> * vecs[] = { & loop_file_extents, & free_space_extents, & to_zero_extents };
+    ft_u32 crc = 0;
+    for (ft_size i = 0; i < sizeof(vecs)/sizeof(vecs[0]); i++) {
+        const fr_vector<ft_uoff> & vec = * vecs[i];
+        ft_u64 count = vec.size();
+        crc = ff_crc32(crc, & count, sizeof(count));
+
+        fr_vector<ft_uoff>::const_iterator iter = vec.begin(), end = vec.end();
+        for (; iter != end; ++iter) {
+            fr_plan_extent extent = { iter->physical(), iter->logical(), iter->length() };
+            crc = ff_crc32(crc, & extent, sizeof(extent));
+        }
+    }
+    return (ft_ull) crc;
+}
+
+
+/** create plan file and write the DEVICE geometry found by io.read_extents() */
+int fr_plan::create(const char * path, const fr_io & io, ft_ull extents_checksum)
+{
+    if (this_file != NULL || this_writing) {
+        ff_log(FC_ERROR, 0, "unexpected call to fr_plan::create(), plan '%s' is already open", this_path.c_str());
+        return -EISCONN;
+    }
+    if (path != NULL)
+        this_path = path;
+    this_dev_length = io.dev_length();
+    this_loop_file_length = io.loop_file_length();
+    this_eff_block_size_log2 = io.effective_block_size_log2();
+    this_extents_checksum = extents_checksum;
+    this_op_count = 0;
+    this_primary_storage.clear();
+    this_ops.clear();
+    this_cost.clear();
+
+    this_writing = true;
+    if (path == NULL) {
+        this_path = "<estimate>";
+        return 0;
+    }
+    if ((this_file = fopen(path, "wb")) == NULL)
+        return ff_log(FC_ERROR, errno, "failed to create plan '%s'", path);
+
+    /* header is written by commit(). until then, leave an invalid one */
+    fr_plan_header header;
+    memset(& header, '\0', sizeof(header));
+    if (fwrite(& header, sizeof(header), 1, this_file) != 1)
+        return ff_log(FC_ERROR, errno, "I/O error writing to plan '%s'", path);
+
+    ff_log(FC_INFO, 0, "writing execution plan to '%s'", path);
+    return 0;
+}
+
+
+/** open an existing plan file and read its header and storage layout */
+int fr_plan::open(const char * path)
+{
+    if (this_file != NULL) {
+        ff_log(FC_ERROR, 0, "unexpected call to fr_plan::open(), plan '%s' is already open", this_path.c_str());
+        return -EISCONN;
+    }
+    this_path = path;
+    this_writing = false;
+
+    if ((this_file = fopen(path, "rb")) == NULL)
+        return ff_log(FC_ERROR, errno, "failed to open plan '%s'", path);
+
+    fr_plan_header header;
+    if (fread(& header, sizeof(header), 1, this_file) != 1
+        || memcmp(header.magic, FC_PLAN_MAGIC, sizeof(header.magic))
+        || header.version != FC_PLAN_VERSION)
+    {
+        return ff_log(FC_ERROR, ferror(this_file) ? errno : 0, "unsupported, corrupted or incomplete plan '%s'", path);
+    }
+    this_dev_length = header.dev_length;
+    this_loop_file_length = header.loop_file_length;
+    this_eff_block_size_log2 = header.eff_block_size_log2;
+    for (ft_size i = 0; i < 3; i++)
+        this_sizes[i] = header.sizes[i];
+    this_op_count = header.op_count;
+    this_extents_checksum = header.extents_checksum;
+
+    this_primary_storage.clear();
+    fr_plan_extent extent;
+    for (ft_u64 i = 0; i < header.primary_extent_count; i++) {
+        if (fread(& extent, sizeof(extent), 1, this_file) != 1)
+            return ff_log(FC_ERROR, ferror(this_file) ? errno : 0, "truncated plan '%s'", path);
+        this_primary_storage.append(extent.physical, extent.logical, extent.length, FC_DEFAULT_USER_DATA);
+    }
+    ff_log(FC_DEBUG, 0, "opened plan '%s', %" FT_ULL " operations", path, this_op_count);
+    return 0;
+}
+
+
+/** record PRIMARY-STORAGE extents and storage sizes. must be called once, before any operation */
+int fr_plan::storage(const fr_vector<ft_uoff> & primary_storage, ft_size primary_size, ft_size secondary_size, ft_size mem_buffer_size)
+{
+    if (!is_writing() || this_op_count != 0 || !this_ops.empty()) {
+        ff_log(FC_ERROR, 0, "unexpected call to fr_plan::storage(), plan '%s' is not open or not empty", this_path.c_str());
+        return -EINVAL;
+    }
+    this_primary_storage = primary_storage;
+    this_sizes[0] = primary_size;
+    this_sizes[1] = secondary_size;
+    this_sizes[2] = mem_buffer_size;
+
+    fr_vector<ft_uoff>::const_iterator iter = primary_storage.begin(), end = primary_storage.end();
+    for (; this_file != NULL && iter != end; ++iter) {
+        fr_plan_extent extent = { iter->physical(), iter->logical(), iter->length() };
+        if (fwrite(& extent, sizeof(extent), 1, this_file) != 1)
+            return ff_log(FC_ERROR, errno, "I/O error writing to plan '%s'", this_path.c_str());
+    }
+    return 0;
+}
+
+
+/** append an operation to the plan being written */
+int fr_plan::record(fr_plan_op_type type, ft_u32 dir, ft_uoff from, ft_uoff to, ft_uoff length)
+{
+    fr_plan_op op = { (ft_u32) type, dir, (ft_u64) from, (ft_u64) to, (ft_u64) length };
+    this_cost.add(op);
+    if (this_file == NULL)
+        return 0;
+
+    this_ops.push_back(op);
+
+    if (this_ops.size() >= FC_PLAN_BUFFER_OPS)
+        return write_ops();
+    return 0;
+}
+
+
+/** write buffered operations to plan file */
+int fr_plan::write_ops()
+{
+    ft_size n = this_ops.size();
+    if (n != 0 && fwrite(& this_ops[0], sizeof(fr_plan_op), n, this_file) != n)
+        return ff_log(FC_ERROR, errno, "I/O error writing to plan '%s'", this_path.c_str());
+    this_op_count += n;
+    this_ops.clear();
+    return 0;
+}
+
+
+/** write pending operations and complete plan header. return 0 if success, else error */
+int fr_plan::commit()
+{
+    const char * path = this_path.c_str();
+    int err;
+    if (!is_writing()) {
+        ff_log(FC_ERROR, 0, "unexpected call to fr_plan::commit(), plan '%s' is not open for writing", path);
+        return -EINVAL;
+    }
+    if (this_file == NULL) {
+        this_writing = false;
+        return 0;
+    }
+    if ((err = write_ops()) != 0)
+        return err;
+
+    fr_plan_header header;
+    memset(& header, '\0', sizeof(header));
+    memcpy(header.magic, FC_PLAN_MAGIC, sizeof(header.magic));
+    header.version = FC_PLAN_VERSION;
+    header.eff_block_size_log2 = (ft_u32) this_eff_block_size_log2;
+    header.dev_length = this_dev_length;
+    header.loop_file_length = this_loop_file_length;
+    for (ft_size i = 0; i < 3; i++)
+        header.sizes[i] = this_sizes[i];
+    header.primary_extent_count = this_primary_storage.size();
+    header.op_count = this_op_count;
+    header.extents_checksum = this_extents_checksum;
+
+    if (fseek(this_file, 0, SEEK_SET) != 0
+        || fwrite(& header, sizeof(header), 1, this_file) != 1
+        || fflush(this_file) != 0)
+        return ff_log(FC_ERROR, errno, "I/O error writing to plan '%s'", path);
+
+    FILE * f = this_file;
+    this_file = NULL;
+    this_writing = false;
+    if (fclose(f) != 0)
+        return ff_log(FC_ERROR, errno, "I/O error closing plan '%s'", path);
+
+    ff_log(FC_NOTICE, 0, "execution plan '%s' written, %" FT_ULL " operations", path, this_op_count);
+    return 0;
+}
+
+
+/** check that the plan matches the DEVICE geometry and extents found by io.read_extents() */
+int fr_plan::check(const fr_io & io, ft_ull extents_checksum) const
+{
+    const char * path = this_path.c_str();
+    if (this_dev_length != (ft_ull) io.dev_length()
+        || this_loop_file_length != (ft_ull) io.loop_file_length()
+        || this_eff_block_size_log2 != (ft_ull) io.effective_block_size_log2())
+    {
+        ff_log(FC_ERROR, 0, "plan '%s' was computed for a different %s or %s", path, fr_io::label[fr_io::FC_DEVICE], fr_io::label[fr_io::FC_LOOP_FILE]);
+        ff_log(FC_ERROR, 0, "\tplan has %s length %" FT_ULL ", %s length %" FT_ULL ", block size %" FT_ULL
+               ", found %" FT_ULL ", %" FT_ULL ", %" FT_ULL,
+               fr_io::label[fr_io::FC_DEVICE], this_dev_length, fr_io::label[fr_io::FC_LOOP_FILE], this_loop_file_length,
+               (ft_ull) 1 << this_eff_block_size_log2, (ft_ull) io.dev_length(), (ft_ull) io.loop_file_length(),
+               (ft_ull) 1 << io.effective_block_size_log2());
+        return -EINVAL;
+    }
+    if (this_extents_checksum != extents_checksum) {
+        ff_log(FC_ERROR, 0, "plan '%s' does not match current %s extents: was %s modified after computing the plan?",
+               path, fr_io::label[fr_io::FC_LOOP_FILE], fr_io::label[fr_io::FC_DEVICE]);
+        return -EINVAL;
+    }
+    return 0;
+}
+
+
+/** read up to 'n' operations from plan file into 'ops'. return 0 at end of plan */
+ft_size fr_plan::read_ops(fr_plan_op * ops, ft_size n)
+{
+    if (n > this_op_count)
+        n = (ft_size) this_op_count;
+    if (n != 0) {
+        n = fread(ops, sizeof(fr_plan_op), n, this_file);
+        this_op_count -= n;
+    }
+    return n;
+}
+
+
+/**
+ * sum the bytes of all remaining copies in each direction, without consuming them.
+ * return 0 if success, else error
+ */
+int fr_plan::count_copies(double ret_bytes[FC_INVALID2INVALID])
+{
+    const char * path = this_path.c_str();
+    const ft_ull op_count = this_op_count;
+    fpos_t pos;
+    for (ft_size i = 0; i < FC_INVALID2INVALID; i++)
+        ret_bytes[i] = 0.0;
+
+    if (fgetpos(this_file, & pos) != 0)
+        return ff_log(FC_ERROR, errno, "failed to read position in plan '%s'", path);
+
+    std::vector<fr_plan_op> buf(FC_PLAN_BUFFER_OPS);
+    ft_size i, n;
+    while ((n = read_ops(& buf[0], buf.size())) != 0) {
+        for (i = 0; i < n; i++) {
+            const fr_plan_op & op = buf[i];
+            if (op.type == FC_PLAN_COPY && op.dir < FC_INVALID2INVALID)
+                ret_bytes[op.dir] += (double) op.length;
+        }
+    }
+    this_op_count = op_count;
+    if (fsetpos(this_file, & pos) != 0)
+        return ff_log(FC_ERROR, errno, "failed to seek in plan '%s'", path);
+    return 0;
+}
+
+/** sort pending copies by destination, coalesce them and pass them to io.copy_bytes() */
+int fr_plan::execute_copies(fr_io & io)
+{
+    int err = 0;
+    ff_plan_optimize(this_ops);
+
+    std::vector<fr_plan_op>::const_iterator iter = this_ops.begin(), end = this_ops.end();
+    for (; err == 0 && iter != end; ++iter)
+        err = io.copy_bytes((fr_dir) iter->dir, iter->from, iter->to, iter->length);
+    this_ops.clear();
+    return err;
+}
+
+
+/**
+ * execute the plan: create storage, then perform all recorded operations
+ * and persistence steps in order, and finally remove storage.
+ * a job started by executing a plan can only be resumed by executing the same plan.
+ */
+int fr_plan::execute(fr_io & io)
+{
+    const char * path = this_path.c_str();
+    const char * dev_path = io.dev_path();
+    const bool simulated = io.simulate_run();
+    const char * simul_msg = simulated ? "(simulated) " : "";
+    const ft_ull op_count = this_op_count;
+    fr_persist & persist = io.persist();
+    fr_stats * stats = io.stats();
+    int err = 0;
+
+    if (this_file == NULL || this_writing) {
+        ff_log(FC_ERROR, 0, "unexpected call to fr_plan::execute(), plan '%s' is not open for reading", path);
+        return -EINVAL;
+    }
+
+    /* the exact storage sizes are checked against persistence, in case we are resuming an interrupted job */
+    io.job_storage_size(FC_PRIMARY_STORAGE_EXACT_SIZE, (ft_size) this_sizes[0]);
+    io.job_storage_size(FC_SECONDARY_STORAGE_EXACT_SIZE, (ft_size) this_sizes[1]);
+    if (io.job_storage_size(FC_MEM_BUFFER_SIZE) == 0)
+        io.job_storage_size(FC_MEM_BUFFER_SIZE, (ft_size) this_sizes[2]);
+
+    const bool persist_has_sizes_exact = persist.is_replaying();
+    ft_size primary_size = 0, secondary_size = 0;
+    if ((err = persist.get_storage_sizes_exact(primary_size, secondary_size)) != 0)
+        return err;
+    if (!persist_has_sizes_exact && (err = persist.set_storage_sizes_exact((ft_size) this_sizes[0], (ft_size) this_sizes[1])) != 0)
+        return err;
+
+    if (stats != NULL)
+        stats->begin_phase("create_storage");
+
+    io.primary_storage() = this_primary_storage;
+    if ((err = io.create_storage((ft_size) this_sizes[1], io.job_storage_size(FC_MEM_BUFFER_SIZE))) != 0)
+        return err;
+
+    if (io.ui() != NULL && (err = io.ui()->start(& io)) != 0)
+        return err;
+
+    if (!simulated && (err = io.umount_dev()) != 0) {
+        const bool is_replaying = io.is_replaying();
+        ff_log(is_replaying ? FC_WARN : FC_ERROR, 0, "unmount %s '%s' failed", fr_io::label[fr_io::FC_DEVICE], dev_path);
+        ff_log(is_replaying ? FC_WARN : FC_ERROR, 0, "    you could unmount it yourself and continue");
+        if (!is_replaying)
+            return err;
+        ff_log(FC_WARN, 0, "    but this is a job resume, so fsremap will try to continue anyway");
+    }
+    if ((err = io.check_last_block()) != 0)
+        return err;
+
+    ff_log(FC_NOTICE, 0, "%sexecuting plan '%s' (%" FT_ULL " operations). this may take a LONG time ...", simul_msg, path, op_count);
+
+    /* E.T.A. is computed from the bytes still to copy in each direction and their measured throughput */
+    double copy_left[FC_INVALID2INVALID], done[FC_INVALID2INVALID], busy[FC_INVALID2INVALID];
+    ft_eta_throughput eta(FC_INVALID2INVALID);
+    if ((err = count_copies(copy_left)) != 0)
+        return err;
+
+    const ft_uoff eff_block_size_log2 = io.effective_block_size_log2();
+    std::vector<fr_plan_op> buf(FC_PLAN_BUFFER_OPS);
+    ft_ull work_total = 0, last_progress1 = (ft_ull)-1, step_count = 0, iteration = 0;
+    bool next_iteration = false, clearing = false;
+    ft_size i, n;
+    this_ops.clear();
+
+    while (err == 0 && (n = read_ops(& buf[0], buf.size())) != 0) {
+        for (i = 0; err == 0 && i < n; i++) {
+            const fr_plan_op & op = buf[i];
+            /* persistence steps are one at start of remapping, then three per iteration */
+            if (next_iteration && (op.type == FC_PLAN_COPY || op.type == FC_PLAN_STEP)) {
+                next_iteration = false;
+                if (stats != NULL)
+                    stats->begin_phase("relocate", ++iteration);
+            }
+            if (op.type == FC_PLAN_COPY) {
+                this_ops.push_back(op);
+                if (op.dir < FC_INVALID2INVALID)
+                    copy_left[op.dir] -= (double) op.length;
+                continue;
+            }
+            if ((err = execute_copies(io)) != 0)
+                break;
+
+            /* zeroes are only written after remapping, while clearing free space */
+            if (stats != NULL && !clearing && (op.type == FC_PLAN_ZERO || op.type == FC_PLAN_ZERO_PRIMARY_STORAGE)) {
+                clearing = true;
+                stats->begin_phase("clear_free_space");
+            }
+
+            switch (op.type) {
+            case FC_PLAN_ZERO:
+                err = io.zero<ft_uoff>((fr_to) op.dir, op.to >> eff_block_size_log2, op.length >> eff_block_size_log2);
+                break;
+            case FC_PLAN_ZERO_PRIMARY_STORAGE:
+                err = io.zero_primary_storage();
+                break;
+            case FC_PLAN_FLUSH:
+                err = io.flush();
+                break;
+            case FC_PLAN_STEP:
+                next_iteration = ++step_count % 3 == 1;
+                /* show progress about once per iteration of the remapping algorithm, i.e. when DEVICE blocks to relocate change */
+                if ((err = persist.next(op.from, op.to)) == 0 && op.from != last_progress1) {
+                    last_progress1 = op.from;
+                    if (work_total == 0)
+                        work_total = op.from;
+                    double percentage = work_total == 0 ? 0.0
+                        : 100.0 * (1.0 - ((double) op.from + 0.5 * (double) op.to) / (double) work_total);
+
+                    for (ft_size d = 0; d < FC_INVALID2INVALID; d++) {
+                        done[d] = (double) io.copied_bytes((fr_dir) d);
+                        busy[d] = io.copy_seconds((fr_dir) d);
+                    }
+                    eta.add(done, busy);
+                    /* when throttled, remaining I/O cannot complete faster than the limits allow: each copied byte is read and written */
+                    double min_time_left = simulated ? 0.0
+                        : io.throttle().min_seconds((ft_uoff) (2.0 * (copy_left[FC_DEV2DEV] + copy_left[FC_STORAGE2DEV] + copy_left[FC_DEV2STORAGE])));
+
+                    ff_show_progress(FC_NOTICE, io.is_replaying() ? "(replaying) " : simul_msg, percentage,
+                                     (ft_uoff) (op.from + op.to) << eff_block_size_log2, " still to remap",
+                                     eta.time_left(copy_left, min_time_left));
+                }
+                break;
+            default:
+                ff_log(FC_ERROR, 0, "corrupted plan '%s': unknown operation type %u", path, (unsigned) op.type);
+                err = -EFAULT;
+                break;
+            }
+        }
+    }
+    if (err == 0)
+        err = execute_copies(io);
+    if (err == 0 && this_op_count != 0)
+        err = ff_log(FC_ERROR, ferror(this_file) ? errno : 0, "truncated plan '%s'", path);
+    if (err == 0)
+        err = io.flush();
+    if (err == 0 && (err = io.close_storage()) == 0)
+        err = io.remove_storage_after_success();
+
+    if (err == 0)
+        ff_log(FC_NOTICE, 0, "%sjob completed.", simul_msg);
+    return err;
+}
+
+
+/** log plan contents and estimated cost, before and after coalescing */
+int fr_plan::show()
+{
+    const char * path = this_path.c_str();
+    if (this_file == NULL || this_writing) {
+        ff_log(FC_ERROR, 0, "unexpected call to fr_plan::show(), plan '%s' is not open for reading", path);
+        return -EINVAL;
+    }
+    const char * dev_label = fr_io::label[fr_io::FC_DEVICE];
+    double pretty_len = 0.0;
+    const char * pretty_label;
+
+    std::vector<fr_plan_op> buf(FC_PLAN_BUFFER_OPS);
+    ft_size i, n;
+    int err = 0;
+
+    pretty_label = ff_pretty_size(this_dev_length, & pretty_len);
+    ff_log(FC_NOTICE, 0, "plan '%s': %s length %.2f %sbytes, block size %" FT_ULL " bytes, %" FT_ULL " operations",
+           path, dev_label, pretty_len, pretty_label, (ft_ull) 1 << this_eff_block_size_log2, this_op_count);
+    ff_log(FC_NOTICE, 0, "    storage: primary %" FT_ULL " bytes (%" FT_ULL " fragments), secondary %" FT_ULL " bytes, memory buffer %" FT_ULL " bytes",
+           this_sizes[0], (ft_ull) this_primary_storage.size(), this_sizes[1], this_sizes[2]);
+
+    this_cost.clear();
+    while ((n = read_ops(& buf[0], buf.size())) != 0) {
+        for (i = 0; i < n; i++)
+            this_cost.add(buf[i]);
+    }
+    if (this_op_count != 0) {
+        ff_log(FC_ERROR, ferror(this_file) ? errno : 0, "truncated plan '%s'", path);
+        err = -EFAULT;
+    }
+    this_cost.show("");
+    return err;
+}
+
+
+/** close plan file. if writing and commit() was not called, remove the incomplete plan */
+void fr_plan::close()
+{
+    if (this_file != NULL) {
+        (void) fclose(this_file);
+        this_file = NULL;
+        if (this_writing && unlink(this_path.c_str()) != 0)
+            ff_log(FC_WARN, errno, "failed to remove incomplete plan '%s'", this_path.c_str());
+    }
+    this_writing = false;
+    this_ops.clear();
+}
+
+FT_IO_NAMESPACE_END
@@ -0,0 +1,227 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * io/plan.hh
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#ifndef FSREMAP_IO_PLAN_HH
+#define FSREMAP_IO_PLAN_HH
+
+#include "../types.hh"   // for ft_u32, ft_u64, ft_ull, ft_uoff, ft_size, ft_string
+#include "../extent.hh"  // for fr_dir, fr_to
+#include "../vector.hh"  // for fr_vector<T>
+
+#if defined(FT_HAVE_STDIO_H)
+# include <stdio.h>      // for FILE
+#elif defined(FT_HAVE_CSTDIO)
+# include <cstdio>       // for FILE
+#endif
+
+#include <vector>        // for std::vector<T>
+
+FT_IO_NAMESPACE_BEGIN
+
+class fr_io;
+
+enum fr_plan_op_type {
+    FC_PLAN_COPY = 1,             // copy 'length' bytes from 'from' to 'to' in direction 'dir'
+    FC_PLAN_ZERO,                 // write 'length' zeroes at 'to'. 'dir' is a fr_to
+    FC_PLAN_ZERO_PRIMARY_STORAGE, // write zeroes to the whole PRIMARY-STORAGE
+    FC_PLAN_FLUSH,                // barrier: all previous operations must complete before the next ones
+    FC_PLAN_STEP,                 // persistence step. 'from' and 'to' are DEVICE and STORAGE blocks still to relocate
+    FC_PLAN_OP_TYPE_N,
+};
+
+/** a single operation recorded in a plan. all offsets and lengths are in bytes */
+struct fr_plan_op
+{
+    ft_u32 type, dir;
+    ft_u64 from, to, length;
+};
+
+/**
+ * estimate the cost of a sequence of plan operations:
+ * bytes read and written per direction, flush barriers, seeks,
+ * and the resulting duration for a device with the given throughput and seek latency.
+ *
+ * seeks are counted both for copies as recorded and for copies optimized as fr_plan::execute() does.
+ */
+class fr_plan_cost
+{
+private:
+    /** copies since last barrier, not yet accounted */
+    std::vector<fr_plan_op> this_group;
+    ft_ull this_counts[FC_PLAN_OP_TYPE_N], this_bytes[FC_PLAN_OP_TYPE_N];
+    ft_ull this_dir_bytes[FC_INVALID2INVALID];
+    /* index 0: copies as recorded, index 1: copies after optimization */
+    ft_ull this_requests[2], this_seeks[2], this_next_from[2], this_next_to[2];
+    double this_bytes_per_second, this_seek_seconds;
+
+    /** account the pending group of copies, then clear it */
+    void add_group();
+
+public:
+    /** constructor. uses a typical rotational disk as profile */
+    fr_plan_cost();
+
+    /** forget all accounted operations */
+    void clear();
+
+    /** set device throughput (in bytes per second) and average seek latency (in seconds) */
+    void profile(double bytes_per_second, double seek_seconds);
+
+    /** account an operation */
+    void add(const fr_plan_op & op);
+
+    /** log accounted bytes, barriers, seeks and estimated duration */
+    void show(const char * simul_msg);
+};
+
+/**
+ * serialized execution plan.
+ *
+ * the planner (fsremap --plan-write=FILE) runs the remapping algorithm in simulated mode
+ * and records every copy, every zeroing and every flush barrier into a compact binary file,
+ * together with the storage layout they refer to.
+ *
+ * the executor (fsremap --plan-run=FILE) streams the plan against DEVICE with the selected I/O,
+ * without analyzing or rebuilding the in-memory maps. copies between two barriers
+ * never overlap, so the executor coalesces them and sorts them by destination.
+ *
+ * plans are stored in native byte order: they must be executed on the same machine.
+ */
+class fr_plan
+{
+private:
+    ft_string this_path;
+    /** operations not yet written (planner) or current group of copies (executor) */
+    std::vector<fr_plan_op> this_ops;
+    fr_plan_cost this_cost;
+    fr_vector<ft_uoff> this_primary_storage;
+    ft_ull this_dev_length, this_loop_file_length, this_eff_block_size_log2;
+    ft_ull this_sizes[3]; // primary storage, secondary storage, memory buffer
+    ft_ull this_op_count, this_extents_checksum;
+    FILE * this_file;
+    bool this_writing;
+
+    /** cannot call copy constructor */
+    fr_plan(const fr_plan &);
+
+    /** cannot call assignment operator */
+    const fr_plan & operator=(const fr_plan &);
+
+    /** append an operation to the plan being written */
+    int record(fr_plan_op_type type, ft_u32 dir, ft_uoff from, ft_uoff to, ft_uoff length);
+
+    /** write buffered operations to plan file */
+    int write_ops();
+
+    /** read up to 'n' operations from plan file into 'ops'. return 0 at end of plan */
+    ft_size read_ops(fr_plan_op * ops, ft_size n);
+
+    /**
+     * sum the bytes of all remaining copies in each direction, without consuming them.
+     * return 0 if success, else error
+     */
+    int count_copies(double ret_bytes[FC_INVALID2INVALID]);
+
+    /** sort pending copies by destination, coalesce them and pass them to io.copy_bytes() */
+    int execute_copies(fr_io & io);
+
+public:
+    /** constructor */
+    fr_plan();
+
+    /** destructor. calls close() */
+    ~fr_plan();
+
+    /** return plan path */
+    FT_INLINE const ft_string & path() const { return this_path; }
+
+    /** return true if plan is open for writing, or for estimating its cost only */
+    FT_INLINE bool is_writing() const { return this_writing; }
+
+    /** return the cost of operations recorded so far */
+    FT_INLINE fr_plan_cost & cost() { return this_cost; }
+
+    /** compute the checksum of LOOP-FILE, FREE-SPACE and TO-ZERO extents, used to match a plan against DEVICE */
+    static ft_ull extents_checksum(const fr_vector<ft_uoff> & loop_file_extents,
+                                   const fr_vector<ft_uoff> & free_space_extents,
+                                   const fr_vector<ft_uoff> & to_zero_extents);
+
+    /**
+     * create plan file and write the DEVICE geometry found by io.read_extents().
+     * if path is NULL, do not create any file: only estimate the cost of recorded operations
+     */
+    int create(const char * path, const fr_io & io, ft_ull extents_checksum);
+
+    /** open an existing plan file and read its header and storage layout */
+    int open(const char * path);
+
+    /** record PRIMARY-STORAGE extents and storage sizes. must be called once, before any operation */
+    int storage(const fr_vector<ft_uoff> & primary_storage, ft_size primary_size, ft_size secondary_size, ft_size mem_buffer_size);
+
+    /** record a copy. note: parameters are in bytes! */
+    FT_INLINE int copy(fr_dir dir, ft_uoff from, ft_uoff to, ft_uoff length)
+    {
+        return record(FC_PLAN_COPY, (ft_u32) dir, from, to, length);
+    }
+
+    /** record writing zeroes. note: parameters are in bytes! */
+    FT_INLINE int zero(fr_to to, ft_uoff offset, ft_uoff length)
+    {
+        return record(FC_PLAN_ZERO, (ft_u32) to, 0, offset, length);
+    }
+
+    /** record writing zeroes to the whole PRIMARY-STORAGE */
+    FT_INLINE int zero_primary_storage() { return record(FC_PLAN_ZERO_PRIMARY_STORAGE, 0, 0, 0, 0); }
+
+    /** record a flush barrier */
+    FT_INLINE int flush() { return record(FC_PLAN_FLUSH, 0, 0, 0, 0); }
+
+    /** record a persistence step */
+    FT_INLINE int step(ft_ull progress1, ft_ull progress2) { return record(FC_PLAN_STEP, 0, progress1, progress2, 0); }
+
+    /** write pending operations and complete plan header. return 0 if success, else error */
+    int commit();
+
+    /** check that the plan matches the DEVICE geometry and extents found by io.read_extents() */
+    int check(const fr_io & io, ft_ull extents_checksum) const;
+
+    /**
+     * execute the plan: create storage, then perform all recorded operations
+     * and persistence steps in order, and finally remove storage.
+     * a job started by executing a plan can only be resumed by executing the same plan.
+     */
+    int execute(fr_io & io);
+
+    /** log plan contents and estimated cost, before and after coalescing */
+    int show();
+
+    /** close plan file. if writing and commit() was not called, remove the incomplete plan */
+    void close();
+};
+
+
+FT_IO_NAMESPACE_END
+
+#endif /* FSREMAP_IO_PLAN_HH */
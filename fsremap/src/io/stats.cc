@@ -0,0 +1,273 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * io/stats.cc
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#include "../first.hh"
+
+#if defined(FT_HAVE_ERRNO_H)
+# include <errno.h>      // for errno, ECANCELED, EIO
+#elif defined(FT_HAVE_CERRNO)
+# include <cerrno>       // for errno, ECANCELED, EIO
+#endif
+#if defined(FT_HAVE_STRING_H)
+# include <string.h>     // for memset()
+#elif defined(FT_HAVE_CSTRING)
+# include <cstring>      // for memset()
+#endif
+
+#include "../log.hh"     // for ff_log()
+#include "../misc.hh"    // for ff_now()
+#include "stats.hh"      // for fr_stats
+
+FT_IO_NAMESPACE_BEGIN
+
+enum {
+    /* minimum interval between two writes of the document while a phase runs, in seconds */
+    FC_STATS_INTERVAL = 5,
+};
+
+static char const* const FC_STATS_DIR_LABEL[FC_INVALID2INVALID] = {
+    "dev2dev", "storage2dev", "dev2storage",
+};
+
+
+/** account a latency, in seconds */
+void fr_stats_histogram::add(double seconds)
+{
+    if (seconds < 0.0)
+        seconds = 0.0;
+    double usec = seconds * 1e6, limit = 1.0;
+    ft_size i = 0;
+    for (; i < FC_STATS_HISTOGRAM_N - 1 && usec >= limit; i++)
+        limit *= 2.0;
+    buckets[i]++;
+    count++;
+    total += seconds;
+    if (max < seconds)
+        max = seconds;
+}
+
+
+/** constructor */
+fr_stats::fr_stats()
+    : this_path(), this_phases(), this_start(0.0), this_last_write(0.0), this_status("running"), this_warned(false)
+{ }
+
+/** destructor. if still open, calls close() to mark the job as failed */
+fr_stats::~fr_stats()
+{
+    if (is_open())
+        (void) close(-ECANCELED);
+}
+
+
+/** start collecting metrics and write an initial (empty) document to 'path' */
+int fr_stats::open(const char * path)
+{
+    this_path = path;
+    this_phases.clear();
+    this_status = "running";
+    (void) ff_now(this_start);
+
+    /* report errors creating the document here, write() only warns about them */
+    this_warned = true;
+    int err = write();
+    this_warned = false;
+    if (err != 0) {
+        err = ff_log(FC_ERROR, err, "failed to create statistics file '%s'", path);
+        this_path.clear();
+    }
+    return err;
+}
+
+
+/** return the current phase. creates an unnamed one if no phase was started */
+fr_stats_phase & fr_stats::phase()
+{
+    if (this_phases.empty())
+        begin_phase("unknown");
+    return this_phases.back();
+}
+
+
+/** end current phase (if any) and start a new one. iteration is only meaningful for 'relocate' */
+void fr_stats::begin_phase(const char * name, ft_ull iteration)
+{
+    double now = 0.0;
+    (void) ff_now(now);
+
+    if (!this_phases.empty())
+        this_phases.back().end = now;
+
+    fr_stats_phase phase;
+    memset(& phase, '\0', sizeof(phase));
+    phase.name = name;
+    phase.iteration = iteration;
+    phase.start = now;
+    phase.end = -1.0;
+    this_phases.push_back(phase);
+
+    if (is_open())
+        (void) write();
+}
+
+/** account bytes copied in direction 'dir' */
+void fr_stats::copy(fr_dir dir, ft_uoff length)
+{
+    if ((unsigned) dir >= (unsigned) FC_INVALID2INVALID)
+        return;
+    fr_stats_phase & phase = this->phase();
+    phase.bytes_read[dir] += (ft_ull) length;
+    phase.bytes_written[dir] += (ft_ull) length;
+}
+
+/** set extent counts of current phase */
+void fr_stats::extents(ft_ull dev_map_extents, ft_ull storage_map_extents)
+{
+    fr_stats_phase & phase = this->phase();
+    phase.dev_map_extents = dev_map_extents;
+    phase.storage_map_extents = storage_map_extents;
+}
+
+/** rewrite the document if enough time elapsed since last write */
+void fr_stats::update()
+{
+    double now = 0.0;
+    if (is_open() && ff_now(now) == 0 && now >= this_last_write + FC_STATS_INTERVAL)
+        (void) write();
+}
+
+
+/** write a latency histogram as JSON object to 'f' */
+void fr_stats::write_histogram(FILE * f, const fr_stats_histogram & hist)
+{
+    fprintf(f, "{ \"count\": %" FT_ULL ", \"total_seconds\": %.6f, \"max_seconds\": %.6f, \"buckets_usec\": {",
+            hist.count, hist.total, hist.max);
+    const char * sep = "";
+    ft_ull limit = 1;
+    for (ft_size i = 0; i < FC_STATS_HISTOGRAM_N; i++, limit <<= 1) {
+        if (hist.buckets[i] == 0)
+            continue;
+        /* last bucket has no upper limit */
+        if (i == FC_STATS_HISTOGRAM_N - 1)
+            fprintf(f, "%s \"inf\": %" FT_ULL, sep, hist.buckets[i]);
+        else
+            fprintf(f, "%s \"%" FT_ULL "\": %" FT_ULL, sep, limit, hist.buckets[i]);
+        sep = ",";
+    }
+    fputs(" } }", f);
+}
+
+/** write a phase as JSON object to 'f'. 'now' is used as end time of a running phase */
+void fr_stats::write_phase(FILE * f, const fr_stats_phase & phase, double now)
+{
+    double end = phase.end >= 0.0 ? phase.end : now;
+
+    fprintf(f, "    {\n"
+            "      \"name\": \"%s\",\n", phase.name);
+    if (phase.iteration != 0)
+        fprintf(f, "      \"iteration\": %" FT_ULL ",\n", phase.iteration);
+    fprintf(f, "      \"running\": %s,\n"
+            "      \"wall_seconds\": %.6f,\n"
+            "      \"bytes\": {",
+            phase.end >= 0.0 ? "false" : "true", end - phase.start);
+    for (ft_size dir = 0; dir < FC_INVALID2INVALID; dir++)
+        fprintf(f, "%s \"%s\": { \"read\": %" FT_ULL ", \"written\": %" FT_ULL " }",
+                dir == 0 ? "" : ",", FC_STATS_DIR_LABEL[dir], phase.bytes_read[dir], phase.bytes_written[dir]);
+    fprintf(f, " },\n"
+            "      \"throttled_seconds\": %.6f,\n"
+            "      \"flush_bytes\": ", phase.throttled);
+    write_histogram(f, phase.flush_latency);
+    fputs(",\n"
+          "      \"read_latency\": ", f);
+    write_histogram(f, phase.read_latency);
+    fputs(",\n"
+          "      \"write_latency\": ", f);
+    write_histogram(f, phase.write_latency);
+    fprintf(f, ",\n"
+            "      \"extents\": { \"dev_map\": %" FT_ULL ", \"storage_map\": %" FT_ULL " }\n"
+            "    }", phase.dev_map_extents, phase.storage_map_extents);
+}
+
+/** rewrite the document now. return 0 if success, else error */
+int fr_stats::write()
+{
+    const char * path = this_path.c_str();
+    ft_string tmp_path = this_path;
+    tmp_path += ".tmp";
+
+    double now = 0.0;
+    (void) ff_now(now);
+    this_last_write = now;
+
+    FILE * f = fopen(tmp_path.c_str(), "w");
+    int err = 0;
+    if (f == NULL)
+        err = errno;
+    else {
+        fprintf(f, "{\n"
+                "  \"version\": 1,\n"
+                "  \"status\": \"%s\",\n"
+                "  \"wall_seconds\": %.6f,\n"
+                "  \"phases\": [", this_status, now - this_start);
+
+        std::vector<fr_stats_phase>::const_iterator iter = this_phases.begin(), end = this_phases.end();
+        for (const char * sep = "\n"; iter != end; ++iter, sep = ",\n") {
+            fputs(sep, f);
+            write_phase(f, * iter, now);
+        }
+        fputs("\n  ]\n}\n", f);
+
+        if (ferror(f))
+            err = errno ? errno : EIO;
+        if (fclose(f) != 0 && err == 0)
+            err = errno;
+        if (err == 0 && rename(tmp_path.c_str(), path) != 0)
+            err = errno;
+    }
+    if (err != 0) {
+        /* statistics are not critical: warn only once, then keep going */
+        if (!this_warned)
+            err = ff_log(FC_WARN, err, "I/O error writing statistics file '%s'", path);
+        this_warned = true;
+    }
+    return err;
+}
+
+/** end current phase and write the document a last time, with status depending on 'err' */
+int fr_stats::close(int err)
+{
+    if (!is_open())
+        return 0;
+
+    if (!this_phases.empty() && this_phases.back().end < 0.0)
+        (void) ff_now(this_phases.back().end);
+
+    this_status = err == 0 ? "completed" : "failed";
+    err = write();
+    this_path.clear();
+    return err;
+}
+
+FT_IO_NAMESPACE_END
@@ -0,0 +1,147 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * io/stats.hh
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#ifndef FSREMAP_IO_STATS_HH
+#define FSREMAP_IO_STATS_HH
+
+#include "../types.hh"   // for ft_ull, ft_uoff, ft_size, ft_string
+#include "../extent.hh"  // for fr_dir
+
+#if defined(FT_HAVE_STDIO_H)
+# include <stdio.h>      // for FILE
+#elif defined(FT_HAVE_CSTDIO)
+# include <cstdio>       // for FILE
+#endif
+
+#include <vector>        // for std::vector<T>
+
+FT_IO_NAMESPACE_BEGIN
+
+enum {
+    /* latency histograms have one bucket per power of two microseconds */
+    FC_STATS_HISTOGRAM_N = 32,
+};
+
+/** latency histogram. bucket i counts latencies below 2^i microseconds (and not in a previous bucket) */
+struct fr_stats_histogram
+{
+    ft_ull count, buckets[FC_STATS_HISTOGRAM_N];
+    double total, max;
+
+    /** account a latency, in seconds */
+    void add(double seconds);
+};
+
+/** metrics collected during a single phase */
+struct fr_stats_phase
+{
+    const char * name;
+    ft_ull iteration;
+    double start, end;
+    ft_ull bytes_read[FC_INVALID2INVALID], bytes_written[FC_INVALID2INVALID];
+    ft_ull dev_map_extents, storage_map_extents;
+    double throttled;
+    fr_stats_histogram flush_latency, read_latency, write_latency;
+};
+
+/**
+ * per-phase metrics of a remapping job, written as a JSON document to a file.
+ *
+ * the document is rewritten at each phase change, at most every few seconds while a phase runs,
+ * and a last time by close(). each write goes to a temporary file atomically renamed over
+ * the previous document, so readers never see a partial one.
+ */
+class fr_stats
+{
+private:
+    ft_string this_path;
+    std::vector<fr_stats_phase> this_phases;
+    double this_start, this_last_write;
+    const char * this_status;
+    bool this_warned;
+
+    /** cannot call copy constructor */
+    fr_stats(const fr_stats &);
+
+    /** cannot call assignment operator */
+    const fr_stats & operator=(const fr_stats &);
+
+    /** return the current phase. creates an unnamed one if no phase was started */
+    fr_stats_phase & phase();
+
+    /** write a phase as JSON object to 'f'. 'now' is used as end time of a running phase */
+    static void write_phase(FILE * f, const fr_stats_phase & phase, double now);
+
+    /** write a latency histogram as JSON object to 'f' */
+    static void write_histogram(FILE * f, const fr_stats_histogram & hist);
+
+public:
+    /** constructor */
+    fr_stats();
+
+    /** destructor. if still open, calls close() to mark the job as failed */
+    ~fr_stats();
+
+    /** return true if stats file is open */
+    FT_INLINE bool is_open() const { return !this_path.empty(); }
+
+    /** start collecting metrics and write an initial (empty) document to 'path' */
+    int open(const char * path);
+
+    /** end current phase (if any) and start a new one. iteration is only meaningful for 'relocate' */
+    void begin_phase(const char * name, ft_ull iteration = 0);
+
+    /** account bytes copied in direction 'dir' */
+    void copy(fr_dir dir, ft_uoff length);
+
+    /** account a call to fr_io::flush_bytes() that took 'seconds' */
+    FT_INLINE void flush(double seconds) { phase().flush_latency.add(seconds); }
+
+    /** account a DEVICE read() that took 'seconds' */
+    FT_INLINE void dev_read(double seconds) { phase().read_latency.add(seconds); }
+
+    /** account a DEVICE write() that took 'seconds' */
+    FT_INLINE void dev_write(double seconds) { phase().write_latency.add(seconds); }
+
+    /** account 'seconds' spent waiting for the DEVICE I/O limiter */
+    FT_INLINE void throttled(double seconds) { phase().throttled += seconds; }
+
+    /** set extent counts of current phase */
+    void extents(ft_ull dev_map_extents, ft_ull storage_map_extents);
+
+    /** rewrite the document if enough time elapsed since last write */
+    void update();
+
+    /** rewrite the document now. return 0 if success, else error */
+    int write();
+
+    /** end current phase and write the document a last time, with status depending on 'err' */
+    int close(int err);
+};
+
+
+FT_IO_NAMESPACE_END
+
+#endif /* FSREMAP_IO_STATS_HH */
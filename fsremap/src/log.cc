@@ -25,14 +25,19 @@
 #include "first.hh"
 
 #if defined(FT_HAVE_STRING_H)
-# include <string.h>     // for strerror(), strncmp()
+# include <string.h>     // for strerror(), strncmp(), memcpy()
 #elif defined(FT_HAVE_CSTRING)
-# include <cstring>      // for strerror(), strncmp()
+# include <cstring>      // for strerror(), strncmp(), memcpy()
+#endif
+#if defined(FT_HAVE_STDLIB_H)
+# include <stdlib.h>     // for malloc(), free(), atexit()
+#elif defined(FT_HAVE_CSTDLIB)
+# include <cstdlib>      // for malloc(), free(), atexit()
 #endif
 #if defined(FT_HAVE_TIME_H)
-# include <time.h>       // for time(), localtime_r(), localtime(), strftime()
+# include <time.h>       // for time(), localtime_r(), localtime(), strftime(), nanosleep()
 #elif defined(FT_HAVE_CTIME)
-# include <ctime>        // for time(), localtime_r(), localtime(), strftime()
+# include <ctime>        // for time(), localtime_r(), localtime(), strftime(), nanosleep()
 #endif
 
 
@@ -40,6 +45,16 @@
 # include <unistd.h>     /* for isatty() */
 #endif
 
+#if defined(FT_HAVE_PTHREAD_H) && defined(FT_HAVE_PTHREAD_CREATE) && defined(FT_HAVE_PTHREAD_ATFORK) \
+    && defined(FT_HAVE_ATOMIC_BUILTINS) && defined(FT_HAVE_NANOSLEEP)
+# define FT_LOG_ASYNC
+# include <pthread.h>    /* for pthread_create(), pthread_join(), pthread_atfork() */
+#endif
+#if defined(FT_HAVE_PTHREAD_H) && defined(FT_HAVE_PTHREAD_CREATE)
+# define FT_LOG_THREADS
+# include <pthread.h>    /* for pthread_mutex_lock(), pthread_mutex_unlock() */
+#endif
+
 
 #include <utility>       // for std::make_pair()
 
@@ -75,6 +90,9 @@ static char const* const this_log_color_ansi[FC_FATAL+1] =
 
 static char const* const this_log_color_ansi_off_nl = "\033[0m\n";
 
+/* messages up to this length are formatted on the stack, longer ones in malloc()ated memory */
+enum { FC_LOG_LINE_MAX = 4096 };
+
 
 
 const char * ff_log_level_to_string(ft_log_level level)
@@ -93,6 +111,245 @@ static all_loggers_type * fc_log_all_loggers = NULL;
 static ft_log * fc_log_root_logger = NULL;
 static bool fc_log_initialized = false;
 
+#ifdef FT_LOG_THREADS
+/* serializes ff_log() and ff_vlog() from multiple threads, as fsmove --jobs=N does */
+static pthread_mutex_t fc_log_mutex = PTHREAD_MUTEX_INITIALIZER;
+# define ff_log_lock()   (void) pthread_mutex_lock(& fc_log_mutex)
+# define ff_log_unlock() (void) pthread_mutex_unlock(& fc_log_mutex)
+#else
+# define ff_log_lock()   ((void) 0)
+# define ff_log_unlock() ((void) 0)
+#endif
+
+
+
+#ifdef FT_LOG_ASYNC
+
+/* set in child processes created by fork(): they do not have the background threads */
+static bool fc_log_async_forked = false;
+
+/** pthread_atfork() child handler */
+static void ff_log_async_atfork_child()
+{
+    fc_log_async_forked = true;
+}
+
+/** atexit() handler: write pending messages of all asynchronous appenders */
+static void ff_log_async_atexit()
+{
+    ft_log_appender::set_async_all(0);
+}
+
+/**
+ * single-producer, single-consumer lock-free ring buffer of formatted log messages.
+ * the producer is the thread calling ff_log() (callers are serialized by fc_log_mutex),
+ * the consumer is a background thread
+ * that writes the messages to stream.
+ *
+ * messages are stored whole or not at all, so stream never receives partial lines.
+ * 'head' and 'tail' are the total bytes ever stored and consumed:
+ * the message bytes still pending are [tail, head) modulo capacity.
+ */
+class ft_log_ring
+{
+private:
+    FILE * stream;
+    char * data;
+    ft_size capacity;
+    ft_size head;  /* written by producer only */
+    ft_size tail;  /* written by consumer only */
+    ft_size lost;  /* messages dropped because ring buffer was full. written by producer only */
+    ft_size lost_reported; /* accessed by consumer only */
+    bool quit;
+    pthread_t thread;
+
+    /** copy constructor. not implemented */
+    ft_log_ring(const ft_log_ring &);
+    /** assignment operator. not implemented */
+    const ft_log_ring & operator=(const ft_log_ring &);
+
+    /** write pending messages to stream. return true if something was written */
+    bool drain();
+
+    /** main loop of background thread */
+    void run();
+
+    /** pthread_create() entry point */
+    static void * thread_main(void * arg);
+
+    /** sleep for the specified milliseconds */
+    static void sleep_millis(long millis);
+
+public:
+    /** constructor */
+    ft_log_ring(FILE * stream, char * data, ft_size capacity);
+
+    /** destructor. does NOT stop background thread, call stop() for that */
+    ~ft_log_ring();
+
+    /** allocate a ring buffer and start its background thread. return 0 if success, else error */
+    static int create(FILE * stream, ft_size capacity, ft_log_ring ** ret_ring);
+
+    /**
+     * append a formatted message. called by producer.
+     * return false (and count the message as lost) if ring buffer is full
+     */
+    bool push(const char * msg, ft_size len);
+
+    /** wait until background thread wrote all the messages pushed so far. called by producer */
+    void wait();
+
+    /** write pending messages and stop background thread. called by producer */
+    void stop();
+};
+
+/** constructor */
+ft_log_ring::ft_log_ring(FILE * my_stream, char * my_data, ft_size my_capacity)
+    : stream(my_stream), data(my_data), capacity(my_capacity),
+      head(0), tail(0), lost(0), lost_reported(0), quit(false), thread()
+{ }
+
+/** destructor. does NOT stop background thread, call stop() for that */
+ft_log_ring::~ft_log_ring()
+{
+    free(data);
+}
+
+/** allocate a ring buffer and start its background thread. return 0 if success, else error */
+int ft_log_ring::create(FILE * stream, ft_size capacity, ft_log_ring ** ret_ring)
+{
+    static bool handlers_installed = false;
+    if (!handlers_installed) {
+        if (pthread_atfork(NULL, NULL, ff_log_async_atfork_child) != 0 || atexit(ff_log_async_atexit) != 0)
+            return ENOMEM;
+        handlers_installed = true;
+    }
+
+    char * data = (char *) malloc(capacity);
+    if (data == NULL)
+        return ENOMEM;
+
+    ft_log_ring * ring = new ft_log_ring(stream, data, capacity);
+    int err = pthread_create(& ring->thread, NULL, thread_main, ring);
+    if (err != 0) {
+        delete ring;
+        return err;
+    }
+    * ret_ring = ring;
+    return 0;
+}
+
+/**
+ * append a formatted message. called by producer.
+ * return false (and count the message as lost) if ring buffer is full
+ */
+bool ft_log_ring::push(const char * msg, ft_size len)
+{
+    const ft_size my_head = head;
+    const ft_size my_tail = __atomic_load_n(& tail, __ATOMIC_ACQUIRE);
+
+    if (len > capacity - (my_head - my_tail)) {
+        __atomic_store_n(& lost, lost + 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    const ft_size offset = my_head % capacity, first_len = len < capacity - offset ? len : capacity - offset;
+    memcpy(data + offset, msg, first_len);
+    memcpy(data, msg + first_len, len - first_len);
+
+    /* publish the message only after its bytes are in place */
+    __atomic_store_n(& head, my_head + len, __ATOMIC_RELEASE);
+    return true;
+}
+
+/** write pending messages to stream. return true if something was written */
+bool ft_log_ring::drain()
+{
+    const ft_size my_tail = tail;
+    const ft_size my_head = __atomic_load_n(& head, __ATOMIC_ACQUIRE);
+    const ft_size my_lost = __atomic_load_n(& lost, __ATOMIC_RELAXED);
+
+    if (my_head != my_tail) {
+        const ft_size len = my_head - my_tail;
+        const ft_size offset = my_tail % capacity, first_len = len < capacity - offset ? len : capacity - offset;
+        fwrite(data + offset, 1, first_len, stream);
+        fwrite(data, 1, len - first_len, stream);
+
+        /* release the bytes to the producer only after writing them */
+        __atomic_store_n(& tail, my_head, __ATOMIC_RELEASE);
+    }
+    if (my_lost != lost_reported) {
+        fprintf(stream, "WARN: %" FT_ULL " log messages lost, asynchronous log buffer is full\n",
+                (ft_ull) (my_lost - lost_reported));
+        lost_reported = my_lost;
+    }
+    if (my_head == my_tail)
+        return false;
+    fflush(stream);
+    return true;
+}
+
+/** sleep for the specified milliseconds */
+void ft_log_ring::sleep_millis(long millis)
+{
+    struct timespec ts;
+    ts.tv_sec = millis / 1000;
+    ts.tv_nsec = (millis % 1000) * 1000000;
+    (void) nanosleep(& ts, NULL);
+}
+
+/** main loop of background thread */
+void ft_log_ring::run()
+{
+    /* poll the ring buffer, sleeping longer while it stays empty */
+    long millis = 1;
+    while (!__atomic_load_n(& quit, __ATOMIC_ACQUIRE)) {
+        if (drain())
+            millis = 1;
+        else {
+            sleep_millis(millis);
+            if (millis < 32)
+                millis <<= 1;
+        }
+    }
+    drain();
+}
+
+/** pthread_create() entry point */
+void * ft_log_ring::thread_main(void * arg)
+{
+    ((ft_log_ring *) arg)->run();
+    return NULL;
+}
+
+/** wait until background thread wrote all the messages pushed so far. called by producer */
+void ft_log_ring::wait()
+{
+    const ft_size my_head = head;
+    while (__atomic_load_n(& tail, __ATOMIC_ACQUIRE) != my_head)
+        sleep_millis(1);
+}
+
+/** write pending messages and stop background thread. called by producer */
+void ft_log_ring::stop()
+{
+    __atomic_store_n(& quit, true, __ATOMIC_RELEASE);
+    (void) pthread_join(thread, NULL);
+}
+
+#else /* !FT_LOG_ASYNC */
+
+/* asynchronous log is not supported, keep the compiler happy */
+class ft_log_ring
+{
+public:
+    FT_INLINE bool push(const char *, ft_size) { return false; }
+    FT_INLINE void wait() { }
+    FT_INLINE void stop() { }
+};
+
+#endif /* FT_LOG_ASYNC */
+
+
 
 /** list of all appenders */
 ft_log_appenders & ft_log_appender::get_all_appenders()
@@ -110,79 +367,216 @@ ft_log_appender::ft_log_appender(FILE * my_stream, ft_log_fmt my_format,
         ft_log_level my_min_level, ft_log_level my_max_level, ft_log_color my_color)
     :
         stream(my_stream), format(my_format),
-        min_level(my_min_level), max_level(my_max_level), color(my_color)
+        min_level(my_min_level), max_level(my_max_level), color(my_color), ring(NULL)
 {
     get_all_appenders().insert(this);
+    if (async_buffer_size != 0 && min_level < FC_WARN)
+        (void) set_async(async_buffer_size);
 }
 
 /** destructor. */
 ft_log_appender::~ft_log_appender()
 {
+    (void) set_async(0);
     flush();
     get_all_appenders().erase(this);
 }
 
+ft_size ft_log_appender::async_buffer_size = 0;
 
+/**
+ * append printf-style output to buf at position pos.
+ * return the new position, which can exceed buf_len as snprintf() does
+ */
+static ft_size ff_log_vprint(char * buf, ft_size buf_len, ft_size pos, const char * fmt, va_list vargs)
+{
+    int n = vsnprintf(pos < buf_len ? buf + pos : NULL, pos < buf_len ? buf_len - pos : 0, fmt, vargs);
+    return n > 0 ? pos + (ft_size) n : pos;
+}
 
 /**
- * write a log message to stream.
- *
- * print fmt and subsequent printf-style args to log stream.
- * if err != 0, append ": ", strerror(errno) and "\n"
- * else append "\n"
+ * append printf-style output to buf at position pos.
+ * return the new position, which can exceed buf_len as snprintf() does
  */
-void ft_log_appender::append(ft_log_event & event)
+static ft_size ff_log_print(char * buf, ft_size buf_len, ft_size pos, const char * fmt, ...)
 {
-    const ft_log_level level = event.level;
-    if (level < min_level || level > max_level)
-        return;
+    va_list vargs;
+    va_start(vargs, fmt);
+    pos = ff_log_vprint(buf, buf_len, pos, fmt, vargs);
+    va_end(vargs);
+    return pos;
+}
+
+
 
+/**
+ * format a complete log message into buf, including the final newline.
+ * return the message length, which can exceed buf_len as snprintf() does:
+ * in such case the message is truncated
+ */
+ft_size ft_log_appender::format_event(char * buf, ft_size buf_len, ft_log_event & event)
+{
+    const ft_log_level level = event.level;
     const char * color_on = "", * color_off_nl = "\n";
-#if defined(FT_HAVE_ISATTY) && defined(FT_HAVE_FILENO)
-    if (color == FC_COL_AUTO)
-        color = (isatty(fileno(stream)) == 1) ? FC_COL_ANSI : FC_COL_NONE;
-#endif
     if (color == FC_COL_ANSI)
     {
         color_on = this_log_color_ansi[level];
         color_off_nl = this_log_color_ansi_off_nl;
     }
 
-
+    ft_size pos;
     switch (format) {
         case FC_FMT_DATETIME_LEVEL_CALLER_MSG:
-            fprintf(stream, "%s%s %s [%.*s%s.%s(%d)]\t", color_on, event.str_now, this_log_label[level],
-                    event.file_len, event.file, event.file_suffix, event.function, event.line);
+            pos = ff_log_print(buf, buf_len, 0, "%s%s %s [%.*s%s.%s(%d)]\t", color_on, event.str_now, this_log_label[level],
+                               event.file_len, event.file, event.file_suffix, event.function, event.line);
             break;
         case FC_FMT_DATETIME_LEVEL_MSG:
-            fprintf(stream, "%s%s %s ", color_on, event.str_now, this_log_label[level]);
+            pos = ff_log_print(buf, buf_len, 0, "%s%s %s ", color_on, event.str_now, this_log_label[level]);
             break;
         case FC_FMT_LEVEL_MSG:
-            fprintf(stream, "%s%s ", color_on, this_log_label[level]);
+            pos = ff_log_print(buf, buf_len, 0, "%s%s ", color_on, this_log_label[level]);
             break;
         case FC_FMT_MSG:
         default:
             /* always mark warnings, errors and fatal errors as such */
-            fprintf(stream, "%s%s", color_on, this_log_label_always[level]);
+            pos = ff_log_print(buf, buf_len, 0, "%s%s", color_on, this_log_label_always[level]);
             break;
     }
 
     va_list vargs;
     ff_va_copy(vargs, event.vargs);
-    vfprintf(stream, event.fmt, vargs);
+    pos = ff_log_vprint(buf, buf_len, pos, event.fmt, vargs);
     va_end(vargs);
 
     if (event.err != 0) {
         bool is_reported = ff_log_is_reported(event.err);
-        fprintf(stream, is_reported ? " (caused by previous error: %s)%s" : ": %s%s",
-                strerror(is_reported ? -event.err : event.err), color_off_nl);
+        pos = ff_log_print(buf, buf_len, pos, is_reported ? " (caused by previous error: %s)%s" : ": %s%s",
+                           strerror(is_reported ? -event.err : event.err), color_off_nl);
     } else
-        fputs(color_off_nl, stream);
+        pos = ff_log_print(buf, buf_len, pos, "%s", color_off_nl);
+
+    return pos;
+}
+
+/**
+ * write a log message to stream.
+ *
+ * print fmt and subsequent printf-style args to log stream.
+ * if err != 0, append ": ", strerror(errno) and "\n"
+ * else append "\n"
+ */
+void ft_log_appender::append(ft_log_event & event)
+{
+    const ft_log_level level = event.level;
+    if (level < min_level || level > max_level)
+        return;
+
+#if defined(FT_HAVE_ISATTY) && defined(FT_HAVE_FILENO)
+    if (color == FC_COL_AUTO)
+        color = (isatty(fileno(stream)) == 1) ? FC_COL_ANSI : FC_COL_NONE;
+#endif
+
+    char buf[FC_LOG_LINE_MAX], * msg = buf;
+    ft_size len = format_event(buf, sizeof(buf), event);
+    if (len >= sizeof(buf)) {
+        /* message does not fit buf: format it again into a large enough buffer, or truncate it */
+        if ((msg = (char *) malloc(len + 1)) != NULL)
+            (void) format_event(msg, len + 1, event);
+        else
+            msg = buf, len = sizeof(buf) - 1;
+    }
+
+#ifdef FT_LOG_ASYNC
+    if (ring != NULL && !fc_log_async_forked) {
+        if (level < FC_WARN)
+            (void) ring->push(msg, len);
+        else {
+            /* do not overtake pending messages, in this nor in other appenders */
+            wait_all_async();
+            fwrite(msg, 1, len, stream);
+        }
+    } else
+#endif
+    {
+        if (level >= FC_WARN)
+            wait_all_async();
+        fwrite(msg, 1, len, stream);
+    }
+
+    if (msg != buf)
+        free(msg);
+}
+
+/** wait until the background thread of all asynchronous appenders wrote their pending messages */
+void ft_log_appender::wait_all_async()
+{
+#ifdef FT_LOG_ASYNC
+    if (async_buffer_size == 0 || fc_log_async_forked)
+        return;
+
+    ft_log_appenders & all_appenders = get_all_appenders();
+    ft_log_appenders_citerator iter = all_appenders.begin(), end = all_appenders.end();
+    for (; iter != end; ++iter) {
+        if ((*iter)->ring != NULL)
+            (*iter)->ring->wait();
+    }
+#endif
+}
+
+/**
+ * if buffer_size != 0, switch this appender to asynchronous mode.
+ * if buffer_size == 0, write pending messages and switch this appender back to synchronous mode.
+ * return 0 if success, else error
+ */
+int ft_log_appender::set_async(ft_size buffer_size)
+{
+    if (ring != NULL) {
+#ifdef FT_LOG_ASYNC
+        /* in a forked child the background thread does not exist: just forget the ring buffer */
+        if (!fc_log_async_forked) {
+            ring->stop();
+            delete ring;
+        }
+#endif
+        ring = NULL;
+    }
+    if (buffer_size == 0)
+        return 0;
+#ifdef FT_LOG_ASYNC
+    return ft_log_ring::create(stream, buffer_size, & ring);
+#else
+    return ENOSYS;
+#endif
+}
+
+/**
+ * call set_async(buffer_size) on all appenders that accept messages less serious than FC_WARN,
+ * and remember buffer_size for appenders created later.
+ * return 0 if success, else error
+ */
+int ft_log_appender::set_async_all(ft_size buffer_size)
+{
+    ft_log_appenders & all_appenders = get_all_appenders();
+    ft_log_appenders_citerator iter = all_appenders.begin(), end = all_appenders.end();
+    int err = 0;
+
+    async_buffer_size = 0;
+    for (; err == 0 && iter != end; ++iter) {
+        if ((*iter)->min_level < FC_WARN)
+            err = (*iter)->set_async(buffer_size);
+    }
+    if (err == 0)
+        async_buffer_size = buffer_size;
+    else
+        (void) set_async_all(0);
+    return err;
 }
 
 /** flush this appender */
 void ft_log_appender::flush()
 {
+    if (ring != NULL)
+        ring->wait();
     fflush(stream);
 }
 
@@ -412,9 +806,10 @@ bool ff_logl_is_enabled(const char * file, int file_len, ft_log_level level)
     ff_pretty_file(event);
 
     ft_mstring logger_name(event.file, event.file_len);
-    ft_log & logger = ft_log::get_logger(logger_name);
-
-    return logger.is_enabled(level);
+    ff_log_lock();
+    bool enabled = ft_log::get_logger(logger_name).is_enabled(level);
+    ff_log_unlock();
+    return enabled;
 }
 
 
@@ -431,6 +826,7 @@ int ff_logl(const char * file, int file_len, const char * func, int line, ft_log
      * log subsystem is automatically initialized upon first call to
      * ff_log(), ff_vlog(), ff_log_register() or ff_log_set_threshold().
      */
+    ff_log_lock();
     ft_log_event event = {
         ff_strftime(), file, "", func, fmt,
         file_len, line, err,
@@ -445,6 +841,7 @@ int ff_logl(const char * file, int file_len, const char * func, int line, ft_log
     va_start(event.vargs, fmt);
     logger.log(event);
     va_end(event.vargs);
+    ff_log_unlock();
 
     /* note 1.2.1) ff_log() and ff_vlog() always return errors as reported (-EINVAL, -ENOMEM...) */
     return ff_log_is_reported(err) ? err : -err;
@@ -466,6 +863,7 @@ int ff_logv(const char * file, int file_len, const char * func, int line, ft_log
      * log subsystem is automatically initialized upon first call to
      * ff_log(), ff_vlog(), ff_log_register() or ff_log_set_threshold().
      */
+    ff_log_lock();
     ft_log_event event = {
         ff_strftime(), file, "", func, fmt,
         file_len, line, err,
@@ -480,6 +878,7 @@ int ff_logv(const char * file, int file_len, const char * func, int line, ft_log
     ff_va_copy(event.vargs, vargs);
     logger.log(event);
     va_end(event.vargs);
+    ff_log_unlock();
 
     /* note 1.2.1) ff_log() and ff_vlog() always return errors as reported (-EINVAL, -ENOMEM...) */
     return ff_log_is_reported(err) ? err : -err;
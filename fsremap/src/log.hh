@@ -46,6 +46,7 @@
 #include <set>           /* for std::set<T>  */
 #include <map>           /* for std::map<K,V> */
 
+#include "types.hh"      /* ft_size */
 #include "mstring.hh"    /* ft_mstring */
 
 FT_NAMESPACE_BEGIN
@@ -113,6 +114,10 @@ struct ft_log_event
     va_list vargs;
 };
 
+/* default size of the ring buffer used by asynchronous appenders */
+enum { FC_LOG_ASYNC_BUFFER_SIZE = 1024 * 1024 };
+
+class ft_log_ring;
 class ft_log_appender;
 typedef std::set<ft_log_appender *> ft_log_appenders;
 typedef ft_log_appenders::iterator ft_log_appenders_iterator;
@@ -125,6 +130,11 @@ private:
     ft_log_fmt format;
     ft_log_level min_level, max_level;
     ft_log_color color;
+    /* if not NULL, messages less serious than FC_WARN are written asynchronously through this ring buffer */
+    ft_log_ring * ring;
+
+    /* ring buffer size of new appenders, or 0 if they are synchronous */
+    static ft_size async_buffer_size;
 
     /** destructor. */
     ~ft_log_appender();
@@ -132,6 +142,16 @@ private:
     /** list of all appenders */
     static ft_log_appenders & get_all_appenders();
 
+    /**
+     * format a complete log message into buf, including the final newline.
+     * return the message length, which can exceed buf_len as snprintf() does:
+     * in such case the message is truncated
+     */
+    ft_size format_event(char * buf, ft_size buf_len, ft_log_event & event);
+
+    /** wait until the background thread of all asynchronous appenders wrote their pending messages */
+    static void wait_all_async();
+
 public:
     /** constructor. */
     ft_log_appender(FILE * stream, ft_log_fmt format = FC_FMT_MSG,
@@ -157,6 +177,27 @@ public:
 
     /** set format, min level and color of all appenders */
     static void reconfigure_all(ft_log_fmt format_except_fatal = FC_FMT_MSG, ft_log_level stdout_min_level = FC_LEVEL_NOT_SET, ft_log_color color = FC_COL_AUTO);
+
+    /**
+     * if buffer_size != 0, switch this appender to asynchronous mode:
+     * messages less serious than FC_WARN are formatted into a lock-free ring buffer of buffer_size bytes
+     * and written to stream by a background thread. if the ring buffer is full, messages are dropped and counted.
+     * messages of level FC_WARN or more serious are still written synchronously, after the pending ones.
+     *
+     * if buffer_size == 0, write pending messages and switch this appender back to synchronous mode.
+     * return 0 if success, else error
+     */
+    int set_async(ft_size buffer_size);
+
+    /** return true if this appender is asynchronous */
+    FT_INLINE bool is_async() const { return ring != NULL; }
+
+    /**
+     * call set_async(buffer_size) on all appenders that accept messages less serious than FC_WARN,
+     * and remember buffer_size for appenders created later.
+     * return 0 if success, else error
+     */
+    static int set_async_all(ft_size buffer_size);
 };
 
 
@@ -32,9 +32,12 @@
 #endif
 
 #if defined(FT_HAVE_TIME_H)
-# include <time.h>     // for time()
+# include <time.h>     // for time(), nanosleep()
 #elif defined(FT_HAVE_CTIME)
-# include <ctime>      // for time()
+# include <ctime>      // for time(), nanosleep()
+#endif
+#ifdef FT_HAVE_UNISTD_H
+# include <unistd.h>   // for sleep()
 #endif
 
 #ifdef FT_HAVE_SYS_TIME_H
@@ -114,6 +117,29 @@ int ff_str2ull_scaled(const char * str, ft_ull * ret_n)
 }
 
 
+/** compute CRC-32 (IEEE 802.3 polynomial) of specified memory, continuing from 'crc' */
+ft_u32 ff_crc32(ft_u32 crc, const void * mem, ft_size len)
+{
+    static ft_u32 table[256];
+    static bool table_ready = false;
+
+    if (!table_ready) {
+        for (ft_u32 i = 0; i < 256; i++) {
+            ft_u32 c = i;
+            for (ft_size j = 0; j < 8; j++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        table_ready = true;
+    }
+    const unsigned char * p = (const unsigned char *) mem;
+    crc = ~crc;
+    while (len--)
+        crc = table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+
 int ff_now(double & ret_time) {
     int err;
 #ifdef FT_HAVE_GETTIMEOFDAY
@@ -135,6 +161,23 @@ int ff_now(double & ret_time) {
     return err;
 }
 
+/** suspend execution for the specified number of seconds. return 0 or (-)errno */
+int ff_sleep(double seconds) {
+    if (seconds <= 0.0)
+        return 0;
+#ifdef FT_HAVE_NANOSLEEP
+    struct timespec ts;
+    ts.tv_sec = (time_t) seconds;
+    ts.tv_nsec = (long) ((seconds - (double) ts.tv_sec) * 1e9);
+    if (nanosleep(& ts, NULL) != 0)
+        return -errno;
+#else
+    /* round up: sleeping less than requested defeats the callers' purpose */
+    (void) sleep((unsigned) seconds + 1);
+#endif
+    return 0;
+}
+
 
 
 #if defined(FT_HAVE_SRANDOM) && defined(FT_HAVE_RANDOM)
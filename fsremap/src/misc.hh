@@ -132,8 +132,14 @@ FT_INLINE T * ff_if_null(T * p, T * default_p) { return p != NULL ? p : default_
 
 
 
+/** compute CRC-32 (IEEE 802.3 polynomial) of specified memory, continuing from 'crc' */
+ft_u32 ff_crc32(ft_u32 crc, const void * mem, ft_size len);
+
 int ff_now(double & ret_time);
 
+/** suspend execution for the specified number of seconds. return 0 or (-)errno */
+int ff_sleep(double seconds);
+
 /**
  * return human-readable representation of length,
  * with [kilo|mega|giga|tera|peta|exa|zeta|yotta] scale as appropriate
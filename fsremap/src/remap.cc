@@ -32,9 +32,9 @@
 #endif
 
 #if defined(FT_HAVE_STRING_H)
-# include <stdlib.h>       // for atoi()
+# include <stdlib.h>       // for atoi(), strtod()
 #elif defined(FT_HAVE_CSTRING)
-# include <cstdlib>        // for atoi()
+# include <cstdlib>        // for atoi(), strtod()
 #endif
 
 #include "log.hh"             // for ff_log()
@@ -49,7 +49,10 @@
 #ifdef FT_HAVE_IO_PREALLOC
 # include "io/io_prealloc.hh"  // for fr_io_prealloc
 #endif
+#include "io/io_emulate.hh"   // for fr_io_emulate
 #include "io/io_self_test.hh" // for fr_io_self_test
+#include "io/io_self_verify.hh" // for fr_io_self_verify
+#include "io/plan.hh"         // for fr_plan
 #include "io/util_dir.hh"     // for ff_mkdir()
 
 
@@ -71,12 +74,17 @@ static char const* const* LABEL = FT_IO_NS fr_io::LABEL;
 
 /** constructor */
 fr_remap::fr_remap()
-    : this_job(NULL), this_persist(NULL), this_io(NULL), this_ui(NULL), quit_immediately(false)
+    : this_job(NULL), this_persist(NULL), this_io(NULL), this_ui(NULL),
+      this_plan(NULL), this_plan_path(NULL), this_plan_mode(FC_PLAN_NONE), this_stats(NULL), this_control(NULL), this_trace(NULL), quit_immediately(false)
 { }
 
-/** destructor. calls quit_io(), quit_ui() and quit_job_persist() */
+/** destructor. calls quit_trace(), quit_control(), quit_stats(), quit_plan(), quit_io(), quit_ui() and quit_job_persist() */
 fr_remap::~fr_remap()
 {
+    quit_trace();
+    quit_control();
+    quit_stats();
+    quit_plan();
     quit_io();
     quit_ui();
     quit_job_persist();
@@ -135,19 +143,42 @@ int fr_remap::usage(const char * program_name)
      "      --cmd-losetup=CMD 'losetup' command (default: /sbin/losetup)\n"
      "      --color=MODE      set messages color. MODE is one of:\n"
      "                          auto (default), none, ansi\n"
+     "      --control-socket=PATH\n"
+     "                        listen on Unix socket PATH for commands to show\n"
+     "                          progress and tune the running job. Connect and\n"
+     "                          send 'help' for the list of commands\n"
 #ifdef FT_HAVE_IO_PREALLOC
      "      --device-mount-point=DIR\n"
      "                        set device mount point (needed by --io=prealloc)\n"
 #endif
+     "      --estimate[=PROFILE]\n"
+     "                        simulate the remapping without logging each extent,\n"
+     "                          then print I/O volume and predicted duration.\n"
+     "                          PROFILE is 'measure' or THROUGHPUT[k|M|G],LATENCY_MS\n"
+     "                          (default: 100M,8)\n"
+     "      --emulate-profile=PROFILE\n"
+     "                        device profile for --io=emulate. PROFILE is hdd\n"
+     "                          (default), ssd, nvme or\n"
+     "                          THROUGHPUT[k|M|G],SEEK_MS[,QUEUE_DEPTH[,FLUSH_MS]]\n"
      "  -f, --force-run       continue even if some sanity checks fail\n"
      "  -i, --interactive     ask confirmation after analysis, before actual work\n"
      "      --io=posix        use posix I/O (default)\n"
 #ifdef FT_HAVE_IO_PREALLOC
      "      --io=prealloc     use posix I/O with EXPERIMENTAL preallocated files\n"
 #endif
+     "      --io=emulate      like --io=test, and also report how long the remapping\n"
+     "                          would take on a device with --emulate-profile\n"
      "      --io=self-test    perform in-memory self-test with random data\n"
+     "      --io=self-verify  perform self-test with random data on a real image,\n"
+     "                          then verify it. Arguments are: IMAGE [IMAGE-LENGTH]\n"
+     "                          IMAGE is a sparse file or a block device, and its\n"
+     "                          contents will be OVERWRITTEN\n"
      "      --io=test         use test I/O. Arguments are:\n"
      "                          DEVICE-LENGTH LOOP-FILE-EXTENTS FREE-SPACE-EXTENTS\n"
+     "      --log-async[=SIZE[k|M|G]]\n"
+     "                        write verbose messages from a background thread,\n"
+     "                          buffering up to SIZE bytes (default: 1M).\n"
+     "                          Messages that do not fit are dropped and counted\n"
 #ifdef FT_HAVE_IO_PREALLOC
      "      --loop-device=LOOP-DEVICE\n"
      "                        loop device to disconnect (needed by --io=prealloc)\n"
@@ -156,8 +187,17 @@ int fr_remap::usage(const char * program_name)
 #endif
      "  -m, --mem-buffer=RAM_SIZE[k|M|G|T|P|E|Z|Y]\n"
      "                        set RAM buffer size (default: autodetect)\n"
+     "      --max-bytes-per-sec=SIZE[k|M|G|T|P|E|Z|Y]\n"
+     "                        read and write at most SIZE device bytes per second\n"
+     "      --max-iops=NUM    issue at most NUM device reads and writes per second\n"
      "  -n, --no-action, --simulate-run\n"
      "                        do not actually read or write any disk block\n"
+     "      --plan-run=FILE   execute the plan FILE instead of computing the\n"
+     "                          remapping. Options --clear=... and storage sizes\n"
+     "                          are taken from the plan\n"
+     "      --plan-show=FILE  show contents and estimated cost of plan FILE\n"
+     "      --plan-write=FILE simulate the remapping and write every copy,\n"
+     "                          clear and flush into plan FILE. Implies -n\n"
      "      --questions=MODE  set interactive mode. MODE is one of:\n"
      "                          no: never ask questions, abort on errors (default)\n"
      "                          yes: ask questions in case of user-fixable errors\n"
@@ -169,8 +209,12 @@ int fr_remap::usage(const char * program_name)
      "                         as argument, or you will LOSE YOUR DATA!\n"
      "  -s, --secondary-storage=SECONDARY_SIZE[k|M|G|T|P|E|Z|Y]\n"
      "                        set secondary storage file length (default: autodetect)\n"
+     "      --stats-file=PATH write per-phase I/O metrics into PATH as JSON,\n"
+     "                          updated periodically and at exit\n"
      "  -t, --temp-dir=DIR    write storage and log files inside DIR\n"
      "                          (default: /var/tmp/fstransform)\n"
+     "      --trace=FILE      record every device copy, clear and flush into the\n"
+     "                          binary I/O trace FILE. Replay it with fsreplay\n"
      "      --ui-tty=TTY      show full-text progress on tty device TTY\n"
      "  -v, --verbose         be verbose\n"
      "  -vv                   be very verbose\n"
@@ -265,9 +309,11 @@ int fr_remap::init(int argc, char const* const* argv)
     int err;
     fr_io_kind io_kind;
     fr_clear_free_space new_clear;
+    fr_plan_mode plan_mode;
     ft_log_fmt format = FC_FMT_MSG;
     ft_log_level level = FC_INFO, new_level;
     ft_log_color color = FC_COL_AUTO;
+    ft_size log_async_size = 0;
     bool format_set = false;
 
     do {
@@ -322,6 +368,16 @@ int fr_remap::init(int argc, char const* const* argv)
                 else if (!strncmp(arg, "--cmd-umount=", opt_len)) {
                     args.cmd_umount = opt_arg;
                 }
+                /* --estimate, --estimate=PROFILE */
+                else if (!strcmp(arg, "--estimate") || !strncmp(arg, "--estimate=", opt_len)) {
+                    if (args.plan_mode != FC_PLAN_NONE)
+                        err = invalid_cmdline(args, 0,
+                                "options --estimate, --plan-write, --plan-run and --plan-show are mutually exclusive");
+                    else {
+                        args.plan_mode = FC_PLAN_ESTIMATE;
+                        args.estimate_profile = arg[opt_len - 1] == '=' ? opt_arg : NULL;
+                    }
+                }
                 /* -f, --force-run: consider failed sanity checks as WARNINGS (which let execution continue) instead of ERRORS (which stop execution) */
                 else if (!strcmp(arg, "-f") || !strcmp(arg, "--force-run")) {
                     args.force_run = true;
@@ -330,9 +386,11 @@ int fr_remap::init(int argc, char const* const* argv)
                 else if (!strcmp(arg, "-i") || !strcmp(arg, "--interactive")) {
                     args.ask_questions = true;
                 }
-                /* --io=test, --io=self-test, --io=posix, --io=prealloc */
+                /* --io=test, --io=emulate, --io=self-test, --io=self-verify, --io=posix, --io=prealloc */
                 else if ((io_kind = FC_IO_TEST,        !strcmp(arg, "--io=test"))
+                        || (io_kind = FC_IO_EMULATE,   !strcmp(arg, "--io=emulate"))
                         || (io_kind = FC_IO_SELF_TEST, !strcmp(arg, "--io=self-test"))
+                        || (io_kind = FC_IO_SELF_VERIFY, !strcmp(arg, "--io=self-verify"))
                         || (io_kind = FC_IO_POSIX,     !strcmp(arg, "--io=posix"))
 #ifdef FT_HAVE_IO_PREALLOC
                         || (io_kind = FC_IO_PREALLOC,  !strcmp(arg, "--io=prealloc"))
@@ -343,7 +401,11 @@ int fr_remap::init(int argc, char const* const* argv)
                         args.io_kind = io_kind;
                     else
                         err = invalid_cmdline(args, 0,
-                                "options --io=posix, --io=prealloc, --io=test and --io=self-test are mutually exclusive");
+                                "options --io=posix, --io=prealloc, --io=test, --io=emulate, --io=self-test and --io=self-verify are mutually exclusive");
+                }
+                /* --emulate-profile=PROFILE */
+                else if (!strncmp(arg, "--emulate-profile=", opt_len)) {
+                    args.emulate_profile = opt_arg;
                 }
                 else if (!strncmp(arg, "--loop-device=", opt_len)) {
                     args.loop_dev = opt_arg;
@@ -358,6 +420,24 @@ int fr_remap::init(int argc, char const* const* argv)
                     if (is_short_opt)
                         --argc, ++argv;
                 }
+                /* --max-bytes-per-sec=SIZE[k|M|G|T|P|E|Z|Y] */
+                else if (!strncmp(arg, "--max-bytes-per-sec=", opt_len)) {
+                    if ((err = ff_str2un_scaled(opt_arg, & args.max_bytes_per_sec)) != 0) {
+                        err = invalid_cmdline(args, err, "invalid max bytes per second '%s'", opt_arg);
+                        break;
+                    }
+                }
+                /* --max-iops=NUM */
+                else if (!strncmp(arg, "--max-iops=", opt_len)) {
+                    if ((err = ff_str2un(opt_arg, & args.max_iops)) != 0) {
+                        err = invalid_cmdline(args, err, "invalid max I/O operations per second '%s'", opt_arg);
+                        break;
+                    }
+                }
+                /* --control-socket=PATH */
+                else if (!strncmp(arg, "--control-socket=", opt_len)) {
+                    args.control_path = opt_arg;
+                }
                 else if (!strncmp(arg, "--device-mount-point=", opt_len)) {
                     args.mount_points[FC_MOUNT_POINT_DEVICE] = opt_arg;
                 }
@@ -368,6 +448,18 @@ int fr_remap::init(int argc, char const* const* argv)
                 else if (!strcmp(arg, "-n") || !strcmp(arg, "--no-action") || !strcmp(arg, "--simulate-run")) {
                     args.simulate_run = true;
                 }
+                /* --plan-write=FILE, --plan-run=FILE, --plan-show=FILE */
+                else if ((plan_mode = FC_PLAN_WRITE, !strncmp(arg, "--plan-write=", opt_len))
+                        || (plan_mode = FC_PLAN_RUN,  !strncmp(arg, "--plan-run=", opt_len))
+                        || (plan_mode = FC_PLAN_SHOW, !strncmp(arg, "--plan-show=", opt_len)))
+                {
+                    if (args.plan_mode == FC_PLAN_NONE) {
+                        args.plan_mode = plan_mode;
+                        args.plan_path = opt_arg;
+                    } else
+                        err = invalid_cmdline(args, 0,
+                                "options --estimate, --plan-write, --plan-run and --plan-show are mutually exclusive");
+                }
                 /* --questions=[no|yes|extra] */
                 else if (!strncmp(arg, "--questions=", opt_len))
                 {
@@ -396,6 +488,14 @@ int fr_remap::init(int argc, char const* const* argv)
                     if (is_short_opt)
                         --argc, ++argv;
                 }
+                /* --trace=FILE */
+                else if (!strncmp(arg, "--trace=", opt_len)) {
+                    args.trace_path = opt_arg;
+                }
+                /* --stats-file=PATH */
+                else if (!strncmp(arg, "--stats-file=", opt_len)) {
+                    args.stats_path = opt_arg;
+                }
                 /* -t, --temp-dir=DIR */
                 else if ((argc > 1 && !strcmp(arg, "-t")) || !strncmp(arg, "--temp-dir=", opt_len)) {
                     args.root_dir = opt_arg;
@@ -451,6 +551,16 @@ int fr_remap::init(int argc, char const* const* argv)
                                 "options -q, -qq, -v, -vv, -vvv, --quiet, --verbose are mutually exclusive");
                         break;
                     }
+                }
+                /* --log-async, --log-async=SIZE[k|M|G] */
+                else if (!strcmp(arg, "--log-async")) {
+                    log_async_size = FC_LOG_ASYNC_BUFFER_SIZE;
+                }
+                else if (!strncmp(arg, "--log-async=", opt_len)) {
+                    if ((err = ff_str2un_scaled(opt_arg, & log_async_size)) != 0 || log_async_size == 0) {
+                        err = invalid_cmdline(args, err, "invalid asynchronous log buffer size '%s'", opt_arg);
+                        break;
+                    }
                 } else if (!strncmp(arg, "--log-color=", 12)) {
                     /* --color=(auto|none|ansi) */
                     arg += 12;
@@ -496,6 +606,27 @@ int fr_remap::init(int argc, char const* const* argv)
         if (err != 0)
             break;
 
+        if (args.plan_mode == FC_PLAN_SHOW) {
+            if (io_args_n != 0)
+                err = invalid_cmdline(args, 0, "too many arguments");
+            break;
+        }
+        if (args.plan_mode == FC_PLAN_WRITE || args.plan_mode == FC_PLAN_ESTIMATE) {
+            if (args.job_id != FC_JOB_ID_AUTODETECT) {
+                err = invalid_cmdline(args, 0, "options --%s and --resume-job are mutually exclusive",
+                                      args.plan_mode == FC_PLAN_WRITE ? "plan-write" : "estimate");
+                break;
+            }
+            /* the planner only simulates the remapping */
+            args.simulate_run = true;
+        }
+        if (args.plan_mode == FC_PLAN_ESTIMATE) {
+            /* estimate: no UI, and no detailed logging unless explicitly requested */
+            args.ui_kind = FC_UI_NONE;
+            if (level == FC_INFO)
+                level = FC_NOTICE;
+        }
+
         /* if autodetect, clear all free blocks */
         if (args.job_clear == FC_CLEAR_AUTODETECT)
             args.job_clear = FC_CLEAR_ALL;
@@ -522,7 +653,7 @@ int fr_remap::init(int argc, char const* const* argv)
                 } else
                     err = invalid_cmdline(args, 0, "too many arguments");
             }
-        } else if (args.io_kind == FC_IO_TEST) {
+        } else if (args.io_kind == FC_IO_TEST || args.io_kind == FC_IO_EMULATE) {
             if (io_args_n == 0) {
                 err = invalid_cmdline(args, 0, "missing arguments: %s %s %s", LABEL[0], LABEL[1], LABEL[2]);
             } else if (io_args_n == 1) {
@@ -533,6 +664,15 @@ int fr_remap::init(int argc, char const* const* argv)
                 /* ok */
             } else
                 err = invalid_cmdline(args, 0, "too many arguments");
+        } else if (args.io_kind == FC_IO_SELF_VERIFY) {
+            if (args.job_id != FC_JOB_ID_AUTODETECT) {
+                err = invalid_cmdline(args, 0, "option --resume-job is meaningless with --io=self-verify");
+            } else if (io_args_n == 0) {
+                err = invalid_cmdline(args, 0, "missing argument: IMAGE");
+            } else if (io_args_n == 1 || io_args_n == 2) {
+                /* ok */
+            } else
+                err = invalid_cmdline(args, 0, "too many arguments");
         }
     } while (0);
 
@@ -554,7 +694,16 @@ int fr_remap::init(int argc, char const* const* argv)
         // set stdout appender->min_level, since we played tricks with root_logger->level above.
         ft_log_appender::reconfigure_all(format, level, color);
 
-        err = init(args);
+        if (log_async_size != 0) {
+            int async_err = ft_log_appender::set_async_all(log_async_size);
+            if (async_err != 0)
+                ff_log(FC_WARN, async_err, "failed to enable asynchronous log, continuing with synchronous log");
+        }
+
+        if (args.plan_mode == FC_PLAN_SHOW)
+            err = show_plan(args.plan_path);
+        else
+            err = init(args);
     }
 
     return err;
@@ -575,6 +724,14 @@ int fr_remap::init(const fr_args & args)
             break;
         if ((err = init_io(args)) != 0)
             break;
+        if ((err = init_plan(args)) != 0)
+            break;
+        if ((err = init_stats(args)) != 0)
+            break;
+        if ((err = init_control(args)) != 0)
+            break;
+        if ((err = init_trace(args)) != 0)
+            break;
 
     } while (0);
 
@@ -671,6 +828,176 @@ void fr_remap::quit_ui()
 }
 
 
+/** initialize execution plan: open it if it must be executed */
+int fr_remap::init_plan(const fr_args & args)
+{
+    if (this_plan != NULL) {
+        ff_log(FC_ERROR, 0, "unexpected call to init_plan(): execution plan is already initialized");
+        /* mark error as reported */
+        return -EISCONN;
+    }
+    int err = 0;
+    if (args.plan_mode == FC_PLAN_WRITE || args.plan_mode == FC_PLAN_RUN || args.plan_mode == FC_PLAN_ESTIMATE) {
+        this_plan = new FT_IO_NS fr_plan();
+        if ((args.plan_mode == FC_PLAN_RUN && (err = this_plan->open(args.plan_path)) != 0)
+            || (args.plan_mode == FC_PLAN_ESTIMATE && (err = init_estimate_profile(args.estimate_profile)) != 0))
+        {
+            quit_plan();
+            return err;
+        }
+        this_plan_path = args.plan_path;
+        this_plan_mode = args.plan_mode;
+    }
+    return err;
+}
+
+/** initialize statistics: create stats file if requested, and tell I/O to update it */
+int fr_remap::init_stats(const fr_args & args)
+{
+    if (this_stats != NULL) {
+        ff_log(FC_ERROR, 0, "unexpected call to init_stats(): statistics are already initialized");
+        /* mark error as reported */
+        return -EISCONN;
+    }
+    int err = 0;
+    if (args.stats_path != NULL) {
+        this_stats = new FT_IO_NS fr_stats();
+        if ((err = this_stats->open(args.stats_path)) != 0) {
+            quit_stats();
+            return err;
+        }
+        this_io->stats(this_stats);
+    }
+    return err;
+}
+
+/** close statistics and delete them */
+void fr_remap::quit_stats()
+{
+    if (this_io != NULL)
+        this_io->stats(NULL);
+    delete this_stats;
+    this_stats = NULL;
+}
+
+/** initialize control socket if requested, and tell I/O to poll it */
+int fr_remap::init_control(const fr_args & args)
+{
+    if (this_control != NULL) {
+        ff_log(FC_ERROR, 0, "unexpected call to init_control(): control socket is already initialized");
+        /* mark error as reported */
+        return -EISCONN;
+    }
+    int err = 0;
+    if (args.control_path != NULL) {
+        this_control = new FT_IO_NS fr_control();
+        if ((err = this_control->open(args.control_path, * this_io)) != 0) {
+            quit_control();
+            return err;
+        }
+        this_io->control(this_control);
+    }
+    return err;
+}
+
+/** close control socket and delete it */
+void fr_remap::quit_control()
+{
+    if (this_io != NULL)
+        this_io->control(NULL);
+    delete this_control;
+    this_control = NULL;
+}
+
+/** initialize I/O trace if requested, and tell I/O to record into it */
+int fr_remap::init_trace(const fr_args & args)
+{
+    if (this_trace != NULL) {
+        ff_log(FC_ERROR, 0, "unexpected call to init_trace(): I/O trace is already initialized");
+        /* mark error as reported */
+        return -EISCONN;
+    }
+    int err = 0;
+    if (args.trace_path != NULL) {
+        this_trace = new ft_trace();
+        if ((err = this_trace->create(args.trace_path, FC_TRACE_FSREMAP)) != 0) {
+            quit_trace();
+            return err;
+        }
+        this_trace->dev_length(this_io->dev_length());
+        this_io->trace(this_trace);
+    }
+    return err;
+}
+
+/** close I/O trace and delete it */
+void fr_remap::quit_trace()
+{
+    if (this_io != NULL)
+        this_io->trace(NULL);
+    delete this_trace;
+    this_trace = NULL;
+}
+
+/** set DEVICE profile used to estimate the remapping duration */
+int fr_remap::init_estimate_profile(const char * profile)
+{
+    double bytes_per_second = 0.0, seek_seconds = 0.0;
+    int err = 0;
+
+    if (profile == NULL)
+        return err;
+
+    if (!strcmp(profile, "measure")) {
+        const char * dev_path = ff_if_null(this_io->dev_path(), "<unknown>");
+        ff_log(FC_NOTICE, 0, "measuring %s '%s' speed ...", label[FC_DEVICE], dev_path);
+
+        if ((err = this_io->measure_profile(bytes_per_second, seek_seconds)) == ENOSYS) {
+            ff_log(FC_WARN, 0, "cannot measure %s speed with this I/O, using default profile", label[FC_DEVICE]);
+            return 0;
+        } else if (err != 0)
+            return err;
+
+    } else {
+        const char * comma = strchr(profile, ',');
+        char * end = NULL;
+        ft_ull throughput = 0;
+        if (comma != NULL && ff_str2ull_scaled(ft_string(profile, comma - profile).c_str(), & throughput) == 0) {
+            bytes_per_second = (double) throughput;
+            seek_seconds = strtod(comma + 1, & end) * 1e-3;
+        }
+        if (bytes_per_second <= 0.0 || seek_seconds < 0.0 || end == NULL || end == comma + 1 || * end != '\0') {
+            ff_log(FC_ERROR, 0, "invalid device profile '%s', expecting 'measure' or THROUGHPUT[k|M|G],LATENCY_MS", profile);
+            return -EINVAL;
+        }
+    }
+    this_plan->cost().profile(bytes_per_second, seek_seconds);
+    return err;
+}
+
+/** log contents and estimated cost of an execution plan, then quit */
+int fr_remap::show_plan(const char * path)
+{
+    FT_IO_NS fr_plan plan;
+
+    quit_immediately = true;
+
+    int err = plan.open(path);
+    if (err == 0)
+        err = plan.show();
+    return err;
+}
+
+/** close execution plan and delete it */
+void fr_remap::quit_plan()
+{
+    delete this_plan;
+    this_plan = NULL;
+    this_plan_path = NULL;
+    this_plan_mode = FC_PLAN_NONE;
+}
+
+
 /**
  * choose the I/O to use, create and initialize it. if success, stores a pointer to I/O object.
  *
@@ -683,9 +1010,15 @@ int fr_remap::init_io(const fr_args & args)
         case FC_IO_TEST:
             err = init_io_class<FT_IO_NS fr_io_test>(args);
             break;
+        case FC_IO_EMULATE:
+            err = init_io_class<FT_IO_NS fr_io_emulate>(args);
+            break;
         case FC_IO_SELF_TEST:
             err = init_io_class<FT_IO_NS fr_io_self_test>(args);
             break;
+        case FC_IO_SELF_VERIFY:
+            err = init_io_class<FT_IO_NS fr_io_self_verify>(args);
+            break;
         case FC_IO_POSIX:
             err = init_io_class<FT_IO_NS fr_io_posix>(args);
             break;
@@ -695,7 +1028,7 @@ int fr_remap::init_io(const fr_args & args)
             break;
 #endif
         default:
-            ff_log(FC_ERROR, 0, "tried to initialize unknown I/O '%d': not POSIX, not PREALLOC, not TEST, not SELF-TEST", (int) args.io_kind);
+            ff_log(FC_ERROR, 0, "tried to initialize unknown I/O '%d': not POSIX, not PREALLOC, not TEST, not EMULATE, not SELF-TEST, not SELF-VERIFY", (int) args.io_kind);
             err = -ENOSYS;
             break;
     }
@@ -708,8 +1041,9 @@ int fr_remap::init_io(const fr_args & args)
  *
  * args depend on I/O type:
  * POSIX and PREALLOC I/O require two or three arguments in args.io_args: DEVICE, LOOP-FILE and optionally ZERO-FILE;
- * test I/O requires three arguments in args.io_args: DEVICE-LENGTH, LOOP-FILE-EXTENTS and ZERO-FILE-EXTENTS;
+ * test and emulate I/O require three arguments in args.io_args: DEVICE-LENGTH, LOOP-FILE-EXTENTS and ZERO-FILE-EXTENTS;
  * self-test I/O does not require any argument in args.io_args;
+ * self-verify I/O requires one or two arguments in args.io_args: IMAGE and optionally IMAGE-LENGTH;
  * return 0 if success, else error.
  */
 template<class IO_T>
@@ -758,6 +1092,9 @@ void fr_remap::quit_io()
  * calls this_io->read_extents() to fill them, and finally invokes
  * fr_dispatch::main(loop_file_extents, free_space_extents, this_io)
  *
+ * if an execution plan must be written, records it while fr_dispatch::main() runs.
+ * if an execution plan must be executed, calls this_plan->execute() instead of fr_dispatch::main()
+ *
  * return 0 if success, else error.
  */
 int fr_remap::run()
@@ -781,6 +1118,9 @@ int fr_remap::run()
         fr_vector<ft_uoff> to_zero_extents;
 
 
+        if (this_stats != NULL)
+            this_stats->begin_phase("read_extents");
+
         /* ask actual I/O subsystem to read LOOP-FILE and FREE-SPACE extents */
         if ((err = io.read_extents(loop_file_extents, free_space_extents, to_zero_extents)) != 0)
             break;
@@ -791,11 +1131,39 @@ int fr_remap::run()
 
         io.close_extents();
 
+        if (this_plan_mode == FC_PLAN_RUN) {
+            /* the plan must have been computed for exactly these extents */
+            ft_ull checksum = FT_IO_NS fr_plan::extents_checksum(loop_file_extents, free_space_extents, to_zero_extents);
+            if ((err = this_plan->check(io, checksum)) == 0)
+                err = this_plan->execute(io);
+            break;
+        }
+        /* when estimating, record the plan in memory only, to compute its cost */
+        if (this_plan_mode == FC_PLAN_WRITE || this_plan_mode == FC_PLAN_ESTIMATE) {
+            ft_ull checksum = FT_IO_NS fr_plan::extents_checksum(loop_file_extents, free_space_extents, to_zero_extents);
+            if ((err = this_plan->create(this_plan_mode == FC_PLAN_WRITE ? this_plan_path : NULL, io, checksum)) != 0)
+                break;
+            io.plan(this_plan);
+        }
+
         /* invoke fr_dispatch::main() to choose which fr_work<T> to instantiate, and run it */
         err = fr_dispatch::main(loop_file_extents, free_space_extents, to_zero_extents, io);
 
+        if (this_plan_mode == FC_PLAN_WRITE || this_plan_mode == FC_PLAN_ESTIMATE) {
+            io.plan(NULL);
+            if (err == 0)
+                err = this_plan->commit();
+            if (err == 0 && this_plan_mode == FC_PLAN_ESTIMATE)
+                this_plan->cost().show("");
+        }
+
     } while (0);
 
+    if (this_stats != NULL) {
+        int stats_err = this_stats->close(err);
+        if (err == 0)
+            err = stats_err;
+    }
     return err;
 }
 
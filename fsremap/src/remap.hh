@@ -45,6 +45,12 @@ private:
     FT_IO_NS fr_persist * this_persist;
     FT_IO_NS fr_io * this_io;
     FT_UI_NS fr_ui * this_ui;
+    FT_IO_NS fr_plan * this_plan;
+    const char * this_plan_path;
+    fr_plan_mode this_plan_mode;
+    FT_IO_NS fr_stats * this_stats;
+    FT_IO_NS fr_control * this_control;
+    ft_trace * this_trace;
 
     /** true if usage() or version() was called. */
     bool quit_immediately;
@@ -84,6 +90,36 @@ private:
     /** quit UI subsystem */
     void quit_ui();
 
+    /** initialize execution plan: open it if it must be executed */
+    int init_plan(const fr_args & args);
+
+    /** set DEVICE profile used to estimate the remapping duration */
+    int init_estimate_profile(const char * profile);
+
+    /** log contents and estimated cost of an execution plan, then quit */
+    int show_plan(const char * path);
+
+    /** close execution plan and delete it */
+    void quit_plan();
+
+    /** initialize statistics: create stats file if requested, and tell I/O to update it */
+    int init_stats(const fr_args & args);
+
+    /** close statistics and delete them */
+    void quit_stats();
+
+    /** initialize control socket if requested, and tell I/O to poll it */
+    int init_control(const fr_args & args);
+
+    /** close control socket and delete it */
+    void quit_control();
+
+    /** initialize I/O trace if requested, and tell I/O to record into it */
+    int init_trace(const fr_args & args);
+
+    /** close I/O trace and delete it */
+    void quit_trace();
+
     int pre_init_io();
 
     /**
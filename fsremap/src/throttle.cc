@@ -0,0 +1,116 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * throttle.cc
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#include "first.hh"
+
+#include "misc.hh"       // for ff_now(), ff_sleep(), ff_min2(), ff_max2()
+#include "throttle.hh"   // for ft_throttle
+
+
+FT_NAMESPACE_BEGIN
+
+/** default constructor. no limits */
+ft_throttle::ft_throttle()
+    : this_bytes_per_sec(0.0), this_ops_per_sec(0.0),
+      this_bytes(0.0), this_ops(0.0), this_last(0.0), this_throttled(0.0)
+{ }
+
+/** set limits. 0 means unlimited. can be called while running */
+void ft_throttle::limits(ft_uoff bytes_per_sec, ft_ull ops_per_sec)
+{
+    this_bytes_per_sec = (double) bytes_per_sec;
+    this_ops_per_sec = (double) ops_per_sec;
+    /* start with full buckets, but keep any debt */
+    this_bytes = ff_min2(this_bytes, 0.0) + this_bytes_per_sec;
+    this_ops = ff_min2(this_ops, 0.0) + this_ops_per_sec;
+    this_last = 0.0;
+}
+
+/** add tokens accumulated since last refill */
+void ft_throttle::refill(double now)
+{
+    if (this_last != 0.0 && now > this_last) {
+        double elapsed = now - this_last;
+        /* buckets hold at most one second worth of tokens */
+        this_bytes = ff_min2(this_bytes + elapsed * this_bytes_per_sec, this_bytes_per_sec);
+        this_ops = ff_min2(this_ops + elapsed * this_ops_per_sec, this_ops_per_sec);
+    }
+    this_last = now;
+}
+
+/**
+ * account a single I/O operation of 'length' bytes, waiting as needed to respect the limits.
+ * return the seconds spent waiting
+ */
+double ft_throttle::take(ft_uoff length)
+{
+    double wait = charge(length);
+    if (wait > 0.0)
+        (void) ff_sleep(wait);
+    return wait;
+}
+
+/**
+ * account a single I/O operation of 'length' bytes, without waiting.
+ * return the seconds the caller must wait to respect the limits.
+ * lets multi-threaded callers update the buckets under a lock, and wait after releasing it
+ */
+double ft_throttle::charge(ft_uoff length)
+{
+    double now = 0.0;
+    if (!enabled() || ff_now(now) != 0)
+        return 0.0;
+
+    refill(now);
+
+    double wait = 0.0;
+    if (this_bytes_per_sec > 0.0) {
+        this_bytes -= (double) length;
+        if (this_bytes < 0.0)
+            wait = -this_bytes / this_bytes_per_sec;
+    }
+    if (this_ops_per_sec > 0.0) {
+        this_ops -= 1.0;
+        if (this_ops < 0.0)
+            wait = ff_max2(wait, -this_ops / this_ops_per_sec);
+    }
+    /* tokens accumulated while the caller waits repay the debt at next refill() */
+    if (wait > 0.0)
+        this_throttled += wait;
+    return wait;
+}
+
+/** return the minimum time needed to transfer 'length' bytes in 'ops' operations at current limits, in seconds */
+double ft_throttle::min_seconds(ft_uoff length, ft_ull ops) const
+{
+    double seconds = 0.0;
+    if (this_bytes_per_sec > 0.0)
+        seconds = (double) length / this_bytes_per_sec;
+    if (this_ops_per_sec > 0.0)
+        seconds = ff_max2(seconds, (double) ops / this_ops_per_sec);
+    return seconds;
+}
+
+FT_NAMESPACE_END
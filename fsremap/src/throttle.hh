@@ -0,0 +1,93 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * throttle.hh
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#ifndef FSTRANSFORM_THROTTLE_HH
+#define FSTRANSFORM_THROTTLE_HH
+
+#include "types.hh"         // for ft_uoff, ft_ull
+
+FT_NAMESPACE_BEGIN
+
+/**
+ * token-bucket limiter for I/O bandwidth (bytes per second) and I/O operations per second.
+ *
+ * each bucket holds at most one second worth of tokens, so short bursts are allowed
+ * while sustained rates are capped. an operation larger than the bucket puts it in debt,
+ * and the next operations wait until the debt is repaid.
+ */
+class ft_throttle
+{
+private:
+    double this_bytes_per_sec, this_ops_per_sec;
+    /* available tokens. negative if in debt */
+    double this_bytes, this_ops;
+    /* time of last refill, as returned by ff_now() */
+    double this_last;
+    /* total time spent waiting for tokens, in seconds */
+    double this_throttled;
+
+    /** add tokens accumulated since last refill */
+    void refill(double now);
+
+public:
+    /** default constructor. no limits */
+    ft_throttle();
+
+    /** set limits. 0 means unlimited. can be called while running */
+    void limits(ft_uoff bytes_per_sec, ft_ull ops_per_sec);
+
+    /** return max bytes per second, or 0 if unlimited */
+    FT_INLINE ft_uoff bytes_per_sec() const { return (ft_uoff) this_bytes_per_sec; }
+
+    /** return max operations per second, or 0 if unlimited */
+    FT_INLINE ft_ull ops_per_sec() const { return (ft_ull) this_ops_per_sec; }
+
+    /** return true if at least one limit is set */
+    FT_INLINE bool enabled() const { return this_bytes_per_sec > 0.0 || this_ops_per_sec > 0.0; }
+
+    /** return total time spent waiting for tokens, in seconds */
+    FT_INLINE double throttled_seconds() const { return this_throttled; }
+
+    /**
+     * account a single I/O operation of 'length' bytes, waiting as needed to respect the limits.
+     * return the seconds spent waiting
+     */
+    double take(ft_uoff length);
+
+    /**
+     * account a single I/O operation of 'length' bytes, without waiting.
+     * return the seconds the caller must wait to respect the limits.
+     * lets multi-threaded callers update the buckets under a lock, and wait after releasing it
+     */
+    double charge(ft_uoff length);
+
+    /** return the minimum time needed to transfer 'length' bytes in 'ops' operations at current limits, in seconds */
+    double min_seconds(ft_uoff length, ft_ull ops = 0) const;
+};
+
+
+FT_NAMESPACE_END
+
+#endif /* FSTRANSFORM_THROTTLE_HH */
@@ -0,0 +1,216 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * trace.cc
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#include "first.hh"
+
+#if defined(FT_HAVE_ERRNO_H)
+# include <errno.h>      // for errno, EISCONN, EIO
+#elif defined(FT_HAVE_CERRNO)
+# include <cerrno>       // for errno, EISCONN, EIO
+#endif
+#if defined(FT_HAVE_STRING_H)
+# include <string.h>     // for memcmp(), memcpy(), memset()
+#elif defined(FT_HAVE_CSTRING)
+# include <cstring>      // for memcmp(), memcpy(), memset()
+#endif
+
+#include "log.hh"        // for ff_log()
+#include "misc.hh"       // for ff_now()
+#include "trace.hh"      // for ft_trace
+
+
+FT_NAMESPACE_BEGIN
+
+enum {
+    FC_TRACE_VERSION = 1,
+    /* buffer this many records before writing them */
+    FC_TRACE_BUFFER_N = 4096,
+};
+
+static const char FC_TRACE_MAGIC[8] = { 'F', 'S', 'T', 'R', 'A', 'C', 'E', '\0' };
+
+struct ft_trace_header
+{
+    char magic[8];
+    ft_u32 version, program;
+    ft_u64 dev_length;
+};
+
+
+/** constructor */
+ft_trace::ft_trace()
+    : this_path(), this_ops(), this_file(NULL), this_start(0.0), this_dev_length(0), this_program(0), this_writing(false)
+{ }
+
+/** destructor. calls close() */
+ft_trace::~ft_trace()
+{
+    (void) close();
+}
+
+/** create trace file 'path', written by 'program' */
+int ft_trace::create(const char * path, ft_trace_program program)
+{
+    if (this_file != NULL) {
+        ff_log(FC_ERROR, 0, "unexpected call to ft_trace::create(), trace '%s' is already open", this_path.c_str());
+        return -EISCONN;
+    }
+    this_path = path;
+    this_program = program;
+    this_dev_length = 0;
+    this_ops.clear();
+    this_ops.reserve(FC_TRACE_BUFFER_N);
+    (void) ff_now(this_start);
+
+    if ((this_file = fopen(path, "wb")) == NULL)
+        return ff_log(FC_ERROR, errno, "failed to create I/O trace '%s'", path);
+
+    /* header is rewritten by close(), with the final DEVICE length */
+    ft_trace_header header;
+    memset(& header, '\0', sizeof(header));
+    memcpy(header.magic, FC_TRACE_MAGIC, sizeof(header.magic));
+    header.version = FC_TRACE_VERSION;
+    header.program = program;
+    if (fwrite(& header, sizeof(header), 1, this_file) != 1) {
+        int err = ff_log(FC_ERROR, errno, "I/O error writing to I/O trace '%s'", path);
+        (void) fclose(this_file);
+        this_file = NULL;
+        return err;
+    }
+    this_writing = true;
+    ff_log(FC_INFO, 0, "writing I/O trace to '%s'", path);
+    return 0;
+}
+
+/** return current time in seconds since the trace was created, to be passed to record() */
+double ft_trace::now() const
+{
+    double now = 0.0;
+    (void) ff_now(now);
+    return now - this_start;
+}
+
+/** append an operation to the trace */
+void ft_trace::record(ft_trace_op_type type, ft_u32 flags, ft_uoff from, ft_uoff to, ft_uoff length, double start, double end)
+{
+    if (!this_writing)
+        return;
+    ft_trace_op op;
+    op.type = type;
+    op.flags = flags;
+    op.from = from;
+    op.to = to;
+    op.length = length;
+    op.start = start;
+    op.end = end;
+    this_ops.push_back(op);
+    if (this_ops.size() >= FC_TRACE_BUFFER_N)
+        (void) write_ops();
+}
+
+/** write buffered records to trace file. on error, warn and stop tracing */
+int ft_trace::write_ops()
+{
+    ft_size n = this_ops.size();
+    int err = 0;
+    if (n != 0 && fwrite(& this_ops[0], sizeof(ft_trace_op), n, this_file) != n) {
+        err = ff_log(FC_WARN, errno, "I/O error writing to I/O trace '%s', tracing stopped", this_path.c_str());
+        this_writing = false;
+    }
+    this_ops.clear();
+    return err;
+}
+
+/** open an existing trace file for reading */
+int ft_trace::open(const char * path)
+{
+    if (this_file != NULL) {
+        ff_log(FC_ERROR, 0, "unexpected call to ft_trace::open(), trace '%s' is already open", this_path.c_str());
+        return -EISCONN;
+    }
+    this_path = path;
+    this_writing = false;
+
+    if ((this_file = fopen(path, "rb")) == NULL)
+        return ff_log(FC_ERROR, errno, "failed to open I/O trace '%s'", path);
+
+    ft_trace_header header;
+    if (fread(& header, sizeof(header), 1, this_file) != 1
+        || memcmp(header.magic, FC_TRACE_MAGIC, sizeof(header.magic))
+        || header.version != FC_TRACE_VERSION
+        || (header.program != FC_TRACE_FSREMAP && header.program != FC_TRACE_FSMOVE))
+    {
+        int err = ff_log(FC_ERROR, ferror(this_file) ? errno : 0, "unsupported or corrupted I/O trace '%s'", path);
+        (void) close();
+        return err ? err : -EINVAL;
+    }
+    this_program = header.program;
+    this_dev_length = header.dev_length;
+    return 0;
+}
+
+/** read up to 'n' records into 'ops'. return number of records read, 0 at end of trace */
+ft_size ft_trace::read(ft_trace_op * ops, ft_size n)
+{
+    if (this_file == NULL || this_writing)
+        return 0;
+    return fread(ops, sizeof(ft_trace_op), n, this_file);
+}
+
+/** restart reading from the first record */
+int ft_trace::rewind()
+{
+    if (this_file == NULL || this_writing || fseek(this_file, sizeof(ft_trace_header), SEEK_SET) != 0)
+        return ff_log(FC_ERROR, errno, "failed to rewind I/O trace '%s'", this_path.c_str());
+    return 0;
+}
+
+/** close trace file, writing any buffered record */
+int ft_trace::close()
+{
+    if (this_file == NULL)
+        return 0;
+    int err = 0;
+    if (this_writing) {
+        err = write_ops();
+
+        ft_trace_header header;
+        memset(& header, '\0', sizeof(header));
+        memcpy(header.magic, FC_TRACE_MAGIC, sizeof(header.magic));
+        header.version = FC_TRACE_VERSION;
+        header.program = this_program;
+        header.dev_length = this_dev_length;
+        if (err == 0 && (fseek(this_file, 0, SEEK_SET) != 0 || fwrite(& header, sizeof(header), 1, this_file) != 1))
+            err = ff_log(FC_WARN, errno, "I/O error writing to I/O trace '%s'", this_path.c_str());
+    }
+    if (fclose(this_file) != 0 && err == 0 && this_writing)
+        err = ff_log(FC_WARN, errno, "I/O error closing I/O trace '%s'", this_path.c_str());
+    this_file = NULL;
+    this_writing = false;
+    this_ops.clear();
+    return err;
+}
+
+FT_NAMESPACE_END
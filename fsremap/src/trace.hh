@@ -0,0 +1,143 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * trace.hh
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#ifndef FSTRANSFORM_TRACE_HH
+#define FSTRANSFORM_TRACE_HH
+
+#include "types.hh"         // for ft_u32, ft_u64, ft_uoff, ft_size, ft_string
+
+#if defined(FT_HAVE_STDIO_H)
+# include <stdio.h>         // for FILE
+#elif defined(FT_HAVE_CSTDIO)
+# include <cstdio>          // for FILE
+#endif
+
+#include <vector>           // for std::vector<T>
+
+FT_NAMESPACE_BEGIN
+
+enum ft_trace_program { FC_TRACE_FSREMAP = 1, FC_TRACE_FSMOVE = 2 };
+
+enum ft_trace_op_type {
+    FC_TRACE_COPY = 1,  // fsremap: copy 'length' bytes from 'from' to 'to'. 'flags' tell if they are STORAGE offsets
+    FC_TRACE_ZERO,      // fsremap: write 'length' zeroes at 'to'. 'flags' tell if it is a STORAGE offset
+    FC_TRACE_FLUSH,     // fsremap: barrier, all copies queued since previous FLUSH were performed between 'start' and 'end'.
+                        //          'flags' tell if the device was not synced afterwards
+    FC_TRACE_READ,      // fsmove: read 'length' bytes at offset 'to' of source file with inode 'from'
+    FC_TRACE_WRITE,     // fsmove: write 'length' bytes at offset 'to' of target file with inode 'from'
+    FC_TRACE_OP_TYPE_N,
+};
+
+enum ft_trace_flags {
+    FC_TRACE_FROM_STORAGE = 1,
+    FC_TRACE_TO_STORAGE = 2,
+    FC_TRACE_NO_SYNC = 4,
+};
+
+/** a single traced operation. offsets and lengths are in bytes, times in seconds since the trace was created */
+struct ft_trace_op
+{
+    ft_u32 type, flags;
+    ft_u64 from, to, length;
+    double start, end;
+};
+
+/**
+ * binary trace of the I/O operations performed by fsremap or fsmove.
+ *
+ * the file contains a header followed by fixed-size ft_trace_op records, in native byte order.
+ * it records only offsets and lengths, never data, so it can be shared and replayed
+ * against a scratch image (see fsreplay) to compare I/O backends on real-world access patterns.
+ *
+ * tracing is not critical: write errors are reported once, then tracing stops.
+ */
+class ft_trace
+{
+private:
+    ft_string this_path;
+    std::vector<ft_trace_op> this_ops;
+    FILE * this_file;
+    double this_start;
+    ft_u64 this_dev_length;
+    ft_u32 this_program;
+    bool this_writing;
+
+    /** cannot call copy constructor */
+    ft_trace(const ft_trace &);
+
+    /** cannot call assignment operator */
+    const ft_trace & operator=(const ft_trace &);
+
+    /** write buffered records to trace file. on error, warn and stop tracing */
+    int write_ops();
+
+public:
+    /** constructor */
+    ft_trace();
+
+    /** destructor. calls close() */
+    ~ft_trace();
+
+    /** return true if trace is open */
+    FT_INLINE bool is_open() const { return this_file != NULL; }
+
+    /** return trace path */
+    FT_INLINE const ft_string & path() const { return this_path; }
+
+    /** return the program that wrote the trace, as ft_trace_program */
+    FT_INLINE ft_u32 program() const { return this_program; }
+
+    /** return DEVICE length recorded by fsremap, or 0 */
+    FT_INLINE ft_u64 dev_length() const { return this_dev_length; }
+
+    /** create trace file 'path', written by 'program' */
+    int create(const char * path, ft_trace_program program);
+
+    /** set DEVICE length. must be called before the first record() */
+    FT_INLINE void dev_length(ft_u64 length) { this_dev_length = length; }
+
+    /** return current time in seconds since the trace was created, to be passed to record() */
+    double now() const;
+
+    /** append an operation to the trace */
+    void record(ft_trace_op_type type, ft_u32 flags, ft_uoff from, ft_uoff to, ft_uoff length, double start, double end);
+
+    /** open an existing trace file for reading */
+    int open(const char * path);
+
+    /** read up to 'n' records into 'ops'. return number of records read, 0 at end of trace */
+    ft_size read(ft_trace_op * ops, ft_size n);
+
+    /** restart reading from the first record */
+    int rewind();
+
+    /** close trace file, writing any buffered record */
+    int close();
+};
+
+
+FT_NAMESPACE_END
+
+#endif /* FSTRANSFORM_TRACE_HH */
@@ -46,14 +46,29 @@
 #ifdef FT_HAVE_FCNTL_H
 # include <fcntl.h>
 #endif
+#if defined(FT_HAVE_TIME_H)
+# include <time.h>         // for nanosleep()
+#elif defined(FT_HAVE_CTIME)
+# include <ctime>          // for nanosleep()
+#endif
 
 #include "../log.hh"        // for ff_log
+#include "../misc.hh"       // for ff_now()
 #include "../vector.hh"     // for fr_vector<T>
 #include "../io/io.hh"      // for fr_io
 #include "ui_tty.hh"
 
 FT_UI_NAMESPACE_BEGIN
 
+/* cells are written by show_io_*() and read by the background thread, if any */
+#ifdef FT_UI_TTY_THREAD
+# define ff_cell_load(ptr)        __atomic_load_n(ptr, __ATOMIC_RELAXED)
+# define ff_cell_store(ptr, cell) __atomic_store_n(ptr, cell, __ATOMIC_RELAXED)
+#else
+# define ff_cell_load(ptr)        (* (ptr))
+# define ff_cell_store(ptr, cell) (* (ptr) = (cell))
+#endif
+
 fr_ui_tty::fr_tty_window::fr_tty_window()
     : len(0), h0(0), h(0)
 { }
@@ -62,13 +77,31 @@ fr_ui_tty::fr_tty_window::fr_tty_window()
 /** default constructor */
 fr_ui_tty::fr_ui_tty()
     : super_type(), this_dev(), this_storage(),
-      this_w(0), this_h(0), this_file(NULL), need_clr(true)
+      this_w(0), this_h(0), this_file(NULL), this_cells(NULL), this_shown(NULL),
+      this_last_frame(0.0), need_clr(false), need_screen_clr(true)
+#ifdef FT_UI_TTY_THREAD
+    , this_quit(false), this_thread_started(false), this_thread()
+#endif
 { }
 
 
-/** destructor */
+/** destructor. stops background thread and draws a last frame */
 fr_ui_tty::~fr_ui_tty()
-{ }
+{
+#ifdef FT_UI_TTY_THREAD
+    if (this_thread_started) {
+        __atomic_store_n(& this_quit, true, __ATOMIC_RELEASE);
+        (void) pthread_join(this_thread, NULL);
+    }
+#endif
+    if (this_cells != NULL) {
+        draw_frame();
+        fputs("\033[0m", this_file);
+        fflush(this_file);
+    }
+    delete[] this_cells;
+    delete[] this_shown;
+}
 
 
 int fr_ui_tty::init(const char * tty_name)
@@ -127,6 +160,17 @@ int fr_ui_tty::start(FT_IO_NS fr_io * io)
         this_storage.h = 1;
     this_dev.h0 = this_storage.h;
     this_dev.h = this_h - this_storage.h;
+
+    const ft_size n = (ft_size) this_w * this_h;
+    this_cells = new unsigned char[n]();
+    this_shown = new unsigned char[n]();
+
+#ifdef FT_UI_TTY_THREAD
+    int err = pthread_create(& this_thread, NULL, thread_main, this);
+    if (err != 0)
+        return ff_log(FC_ERROR, err, "error starting tty UI thread");
+    this_thread_started = true;
+#endif
     return 0;
 }
 
@@ -150,30 +194,97 @@ void fr_ui_tty::show_io_copy(fr_dir dir, ft_uoff from_physical, ft_uoff to_physi
     show_io_write(ff_to(dir), to_physical, length);
 }
 
+/** mark as read or written the cells of window corresponding to [offset, offset + length) */
 void fr_ui_tty::show_io_op(bool is_write, const fr_tty_window & window, ft_uoff offset, ft_uoff length)
 {
+    ft_size i, n;
     if (need_clr) {
         need_clr = false;
-        fputs("\033[2J", this_file);
+        for (i = 0, n = (ft_size) this_w * this_h; i < n; i++)
+            ff_cell_store(& this_cells[i], (unsigned char) FC_CELL_EMPTY);
     }
     ft_ull pos = (ft_ull)((double)offset * this_w * window.h / window.len);
     ft_ull len = (ft_ull)(((double)length * this_w * window.h + window.len - 1) / window.len);
+    ft_ull window_cells = (ft_ull) this_w * window.h;
 
-    ft_ull y = pos / this_w, x = pos % this_w;
-    fprintf(this_file, "\033[3%cm\033[%" FT_ULL ";%" FT_ULL "H", (int)(is_write ? '1' : '2'), y+1+window.h0, x+1); /* ANSI colors: 1 = red, 2 = green */
+    if (pos >= window_cells)
+        return;
+    if (len > window_cells - pos)
+        len = window_cells - pos;
 
-    while (len >= 40) {
-        len -= 40;
-        fputs("########################################", this_file);
-    }
-    while (len-- != 0)
-        putc('#', this_file);
+    const unsigned char cell = is_write ? FC_CELL_WRITE : FC_CELL_READ;
+    for (i = (ft_size) window.h0 * this_w + (ft_size) pos, n = i + (ft_size) len; i < n; i++)
+        ff_cell_store(& this_cells[i], cell);
 }
 
+/** forget previously read or written cells at next show_io_*() */
 void fr_ui_tty::show_io_flush()
 {
-    fflush(this_file);
     need_clr = true;
+#ifndef FT_UI_TTY_THREAD
+    /* no background thread: draw from here, at most FC_UI_TTY_FRAMES_PER_SEC times per second */
+    double now;
+    if (ff_now(now) == 0 && now - this_last_frame >= 1.0 / FC_UI_TTY_FRAMES_PER_SEC) {
+        this_last_frame = now;
+        draw_frame();
+    }
+#endif
+}
+
+/** draw on tty the cells that changed since previous frame */
+void fr_ui_tty::draw_frame()
+{
+    const ft_size n = (ft_size) this_w * this_h;
+    /* position after the last drawn cell, i.e. where the tty cursor is */
+    ft_size next = n;
+    unsigned char color = FC_CELL_EMPTY;
+    bool drawn = false;
+
+    if (need_screen_clr) {
+        need_screen_clr = false;
+        fputs("\033[2J", this_file);
+    }
+    for (ft_size i = 0; i < n; i++) {
+        const unsigned char cell = ff_cell_load(& this_cells[i]);
+        if (cell == this_shown[i])
+            continue;
+        this_shown[i] = cell;
+
+        ft_size y = i / this_w, x = i % this_w;
+        if (i != next || x == 0)
+            fprintf(this_file, "\033[%" FT_ULL ";%" FT_ULL "H", (ft_ull) y + 1, (ft_ull) x + 1);
+        if (cell != FC_CELL_EMPTY && cell != color) {
+            color = cell;
+            fprintf(this_file, "\033[3%cm", (int)(cell == FC_CELL_WRITE ? '1' : '2')); /* ANSI colors: 1 = red, 2 = green */
+        }
+        putc(cell == FC_CELL_EMPTY ? ' ' : '#', this_file);
+        next = i + 1;
+        drawn = true;
+    }
+    if (drawn)
+        fflush(this_file);
+}
+
+#ifdef FT_UI_TTY_THREAD
+/** main loop of background thread: call draw_frame() periodically until this_quit becomes true */
+void fr_ui_tty::run()
+{
+    struct timespec ts;
+    ts.tv_sec = 0;
+    ts.tv_nsec = 1000000000 / FC_UI_TTY_FRAMES_PER_SEC;
+
+    while (!__atomic_load_n(& this_quit, __ATOMIC_ACQUIRE)) {
+        draw_frame();
+        (void) nanosleep(& ts, NULL);
+    }
+}
+
+/** pthread_create() entry point */
+void * fr_ui_tty::thread_main(void * arg)
+{
+    ((fr_ui_tty *) arg)->run();
+    return NULL;
 }
+#endif /* FT_UI_TTY_THREAD */
 
 FT_UI_NAMESPACE_END
@@ -32,17 +32,35 @@
 # include <cstdio>       // for FILE. also for fdopen() used in ui_tty.cc
 #endif
 
+#if defined(FT_HAVE_PTHREAD_H) && defined(FT_HAVE_PTHREAD_CREATE) && defined(FT_HAVE_ATOMIC_BUILTINS) && defined(FT_HAVE_NANOSLEEP)
+# define FT_UI_TTY_THREAD
+# include <pthread.h>    // for pthread_t. also for pthread_create(), pthread_join() used in ui_tty.cc
+#endif
+
 #include "../fwd.hh"     // for fr_io
 #include "../types.hh"   // for ft_uint, ft_uoff
 #include "ui.hh"         // for fr_ui
 
 FT_UI_NAMESPACE_BEGIN
 
+/**
+ * full-text UI: shows device and storage as two windows on a tty,
+ * drawing recently read blocks in green and recently written blocks in red.
+ *
+ * show_io_*() only update an in-memory map of tty cells. a background thread
+ * (or, if threads are not available, show_io_flush()) draws on the tty
+ * the cells that changed since previous frame, at most FC_UI_TTY_FRAMES_PER_SEC times per second.
+ */
 class fr_ui_tty : public fr_ui
 {
 private:
     typedef fr_ui super_type;
 
+    enum { FC_UI_TTY_FRAMES_PER_SEC = 10 };
+
+    /** contents of a tty cell */
+    enum fr_tty_cell { FC_CELL_EMPTY = 0, FC_CELL_READ = 1, FC_CELL_WRITE = 2 };
+
     struct fr_tty_window {
         ft_uoff len;
         ft_uint h0, h;
@@ -52,7 +70,14 @@ private:
     fr_tty_window this_dev, this_storage;
     ft_uint this_w, this_h; /*< tty width and height */
     FILE * this_file;
-    bool need_clr;
+    /* this_w * this_h cells updated by show_io_*(), and the ones currently drawn on tty */
+    unsigned char * this_cells, * this_shown;
+    double this_last_frame;
+    bool need_clr, need_screen_clr;
+#ifdef FT_UI_TTY_THREAD
+    bool this_quit, this_thread_started;
+    pthread_t this_thread;
+#endif
 
     /** cannot call copy constructor */
     fr_ui_tty(const fr_ui_tty &);
@@ -60,17 +85,30 @@ private:
     /** cannot call assignment operator */
     const fr_ui_tty & operator=(const fr_ui_tty &);
 
+    /** mark as read or written the cells of window corresponding to [offset, offset + length) */
     void show_io_op(bool is_write, const fr_tty_window & window, ft_uoff offset, ft_uoff length);
 
+    /** draw on tty the cells that changed since previous frame */
+    void draw_frame();
+
+#ifdef FT_UI_TTY_THREAD
+    /** main loop of background thread: call draw_frame() periodically until this_quit becomes true */
+    void run();
+
+    /** pthread_create() entry point */
+    static void * thread_main(void * arg);
+#endif
+
 public:
     /** default constructor */
     fr_ui_tty();
 
-    /** destructor */
+    /** destructor. stops background thread and draws a last frame */
     virtual ~fr_ui_tty();
 
     int init(const char * tty_name);
 
+    /** compute windows size, allocate the cells and start background thread */
     virtual int start(FT_IO_NS fr_io * io);
 
     virtual void show_io_read(fr_from from, ft_uoff offset, ft_uoff length);
@@ -79,6 +117,7 @@ public:
 
     virtual void show_io_copy(fr_dir dir, ft_uoff from_physical, ft_uoff to_physical, ft_uoff length);
 
+    /** forget previously read or written cells at next show_io_*() */
     virtual void show_io_flush();
 };
 
@@ -28,7 +28,7 @@
 
 #include "types.hh"     // for ft_uoff
 #include "map_stat.hh"  // for fr_map_stat<T>
-#include "eta.hh"       // for ft_eta
+#include "eta.hh"       // for ft_eta_throughput
 #include "log.hh"       // for ft_log_level
 #include "io/io.hh"     // for fr_io
 
@@ -63,9 +63,12 @@ private:
 
     FT_IO_NS fr_io * io;
 
-    ft_eta eta;
+    ft_eta_throughput eta;
     T work_total;
 
+    /** time of last checkpoint, as returned by ff_now() */
+    double checkpoint_time;
+
     /** cannot call copy constructor */
     fr_work(const fr_work<T> &);
 
@@ -128,6 +131,9 @@ private:
      */
     int clear_free_space();
 
+    /** fill PRIMARY-STORAGE with zeroes, and record it into I/O trace if enabled */
+    int zero_primary_storage();
+
     /** called after relocate() and clear_free_space(). closes storage */
     int close_storage_after_success();
 
@@ -184,9 +190,37 @@ private:
     /** read or write next step from persistence file */
     int update_persistence();
 
+    /**
+     * called by relocate() between iterations.
+     * if not replaying and enough time elapsed since last checkpoint, call save_checkpoint()
+     */
+    int update_checkpoint();
+
+    /**
+     * serialize dev_*, storage_* and toclear_map into job checkpoint file.
+     * the checkpoint refers to the last step written into persistence file.
+     */
+    int save_checkpoint();
+
+    /**
+     * called by relocate() while replaying: load dev_*, storage_* and toclear_map
+     * from job checkpoint file (if present), then skip persistence file to the same step.
+     * avoids replaying the whole job from the beginning.
+     */
+    int load_checkpoint();
+
     /** show progress status and E.T.A. */
     void show_progress(ft_log_level log_level);
 
+    /** add to E.T.A. the bytes copied so far in each direction, and the seconds spent copying them */
+    void add_eta_sample();
+
+    /**
+     * if statistics are enabled, save dev_map and storage_map extent counts into current phase,
+     * then start phase 'name' (if not NULL)
+     */
+    void stats_phase(const char * name, ft_ull iteration = 0);
+
 public:
     /** default constructor */
     fr_work();
@@ -223,6 +257,15 @@ public:
             fr_vector<ft_uoff> & to_zero_extents,
             FT_IO_NS fr_io & io);
 
+    /**
+     * analysis phase only: calls init() and analyze(), without creating storage or performing any I/O.
+     * used by fsremap-bench to time the planning code on synthetic extents.
+     */
+    int run_analyze(fr_vector<ft_uoff> & loop_file_extents,
+                    fr_vector<ft_uoff> & free_space_extents,
+                    fr_vector<ft_uoff> & to_zero_extents,
+                    FT_IO_NS fr_io & io);
+
     /** performs cleanup. called by destructor, you can also call it explicitly after (or instead of) run()  */
     void cleanup();
 };
@@ -30,9 +30,9 @@
 # include <cerrno>        // for errno, EOVERFLOW
 #endif
 #if defined(FT_HAVE_STRING_H)
-# include <string.h>       // for strerror()
+# include <string.h>       // for strerror(), strcmp(), strncmp()
 #elif defined(FT_HAVE_CSTRING)
-# include <cstring>        // for strerror()
+# include <cstring>        // for strerror(), strcmp(), strncmp()
 #endif
 
 #include "assert.hh"      // for ff_assert()
@@ -70,7 +70,7 @@ template<typename T>
 fr_work<T>::fr_work()
     : dev_map(), storage_map(), dev_free(), dev_transpose(),
       storage_free(), storage_transpose(), toclear_map(),
-      io(NULL), eta(), work_total(0)
+      io(NULL), eta(), work_total(0), checkpoint_time(0.0)
 { }
 
 
@@ -154,7 +154,10 @@ int fr_work<T>::run(fr_vector<ft_uoff> & loop_file_extents,
     { }
 
     if (err == 0) {
+        stats_phase(NULL);
         ff_log(FC_NOTICE, 0, "%sjob completed.", io.simulate_run() ? "(simulated) " : "");
+        if (io.throttle().throttled_seconds() > 0.0)
+            ff_log(FC_INFO, 0, "spent %.1f seconds waiting for I/O throttling", io.throttle().throttled_seconds());
 
     } else if (!ff_log_is_reported(err)) {
         /*
@@ -167,6 +170,22 @@ int fr_work<T>::run(fr_vector<ft_uoff> & loop_file_extents,
     return err;
 }
 
+/**
+ * analysis phase only: calls init() and analyze(), without creating storage or performing any I/O.
+ * used by fsremap-bench to time the planning code on synthetic extents.
+ */
+template<typename T>
+int fr_work<T>::run_analyze(fr_vector<ft_uoff> & loop_file_extents,
+                            fr_vector<ft_uoff> & free_space_extents,
+                            fr_vector<ft_uoff> & to_zero_extents,
+                            FT_IO_NS fr_io & io)
+{
+    int err;
+    if ((err = init(io)) == 0)
+        err = analyze(loop_file_extents, free_space_extents, to_zero_extents);
+    return err;
+}
+
 /**
  *  check if LOOP-FILE and DEVICE in-use extents can be represented
  *  by fr_map<T>. takes into account the fact that all extents
@@ -281,6 +300,8 @@ int fr_work<T>::analyze(fr_vector<ft_uoff> & loop_file_extents,
     // cleanup in case dev_map, storage_map or storage_map are not empty, or work_count != 0
     cleanup();
 
+    stats_phase("analyze");
+
     map_type loop_map, loop_holes_map, renumbered_map;
 
     ft_uoff eff_block_size_log2 = io->effective_block_size_log2();
@@ -631,6 +652,8 @@ int fr_work<T>::create_storage()
         _64k_minus_1 = 64*1024 - 1,
     };
 
+    stats_phase("create_storage");
+
     const ft_uoff eff_block_size_log2 = io->effective_block_size_log2();
     const ft_uoff eff_block_size_minus_1 = ((ft_uoff)1 << eff_block_size_log2) - 1;
 
@@ -850,6 +873,14 @@ int fr_work<T>::create_storage()
     /* fill io->primary_storage() with PRIMARY-STORAGE extents actually used */
     fill_io_primary_storage_extents(primary_size);
 
+    /* if recording an execution plan, it must contain the storage layout too */
+    FT_IO_NS fr_plan * plan = io->plan();
+    if (plan != NULL) {
+        int err = plan->storage(io->primary_storage(), primary_size, secondary_size, mem_buffer_size);
+        if (err != 0)
+            return err;
+    }
+
     return io->create_storage(secondary_size, mem_buffer_size);
 }
 
@@ -1020,13 +1051,22 @@ int fr_work<T>::relocate()
         return err;
 
     /* initialize progress report */
-    eta.clear();
-    eta.add(0.0);
+    eta.clear(FC_INVALID2INVALID);
+    add_eta_sample();
 
     err = update_persistence();
 
+    if (err == 0 && io->is_replaying())
+        err = load_checkpoint();
+
+    if (err == 0)
+        (void) ff_now(checkpoint_time);
+
+    ft_ull iteration = 0;
     while (err == 0 && !(dev_map.empty() && storage_map.empty())) {
 
+        stats_phase("relocate", ++iteration);
+
         if (!dev_map.empty() && !storage_free.empty())
             err = fill_storage();
         if (err == 0)
@@ -1044,6 +1084,9 @@ int fr_work<T>::relocate()
             err = move_to_target(FC_FROM_STORAGE);
         if (err == 0)
             err = update_persistence();
+
+        if (err == 0)
+            err = update_checkpoint();
     }
     if (err == 0)
         ff_log(FC_INFO, 0, "%sblocks remapping completed.", simul_msg);
@@ -1051,16 +1094,230 @@ int fr_work<T>::relocate()
     return err;
 }
 
+/**
+ * if statistics are enabled, save dev_map and storage_map extent counts into current phase,
+ * then start phase 'name' (if not NULL)
+ */
+template<typename T>
+void fr_work<T>::stats_phase(const char * name, ft_ull iteration)
+{
+    FT_IO_NS fr_stats * stats = io->stats();
+    if (stats == NULL)
+        return;
+    stats->extents((ft_ull) dev_map.size(), (ft_ull) storage_map.size());
+    if (name != NULL)
+        stats->begin_phase(name, iteration);
+}
+
 /** read or write next step from persistence file */
 template<typename T>
 int fr_work<T>::update_persistence()
 {
     T dev_used = dev_map.used_count(), storage_used = storage_map.used_count();
 
+    FT_IO_NS fr_plan * plan = io->plan();
+    if (plan != NULL) {
+        int err = plan->step((ft_ull) dev_used, (ft_ull) storage_used);
+        if (err != 0)
+            return err;
+    }
     return io->persist().next((ft_ull) dev_used, (ft_ull) storage_used);
 }
 
 
+enum {
+    /* minimum interval between checkpoints, in seconds */
+    FC_CHECKPOINT_INTERVAL = 60,
+};
+
+/**
+ * called by relocate() between iterations.
+ * if not replaying and enough time elapsed since last checkpoint, call save_checkpoint()
+ */
+template<typename T>
+int fr_work<T>::update_checkpoint()
+{
+    double now = 0.0;
+    if (io->is_replaying() || ff_now(now) != 0 || now < checkpoint_time + FC_CHECKPOINT_INTERVAL)
+        return 0;
+
+    int err = save_checkpoint();
+    if (err == 0)
+        checkpoint_time = now;
+    return err;
+}
+
+/** write a map into checkpoint file. return 0 or errno-compatible error code */
+template<typename T>
+static int ff_checkpoint_save_map(FILE * f, const char * name, const fr_map<T> & map)
+{
+    if (fprintf(f, "%s %" FT_ULL "\n", name, (ft_ull) map.size()) <= 0)
+        return errno;
+
+    typename fr_map<T>::const_iterator iter = map.begin(), end = map.end();
+    for (; iter != end; ++iter) {
+        if (fprintf(f, "%" FT_ULL "\t%" FT_ULL "\t%" FT_ULL "\t%" FT_ULL "\n",
+                    (ft_ull) iter->first.physical, (ft_ull) iter->second.logical,
+                    (ft_ull) iter->second.length, (ft_ull) iter->second.user_data) <= 0)
+            return errno;
+    }
+    return 0;
+}
+
+/** read a map from checkpoint file. return 0 or errno-compatible error code */
+template<typename T>
+static int ff_checkpoint_load_map(FILE * f, const char * name, fr_map<T> & map)
+{
+    char found_name[32];
+    ft_ull physical, logical, length, user_data, count = 0;
+
+    if (fscanf(f, "%31s %" FT_ULL "\n", found_name, & count) != 2 || strcmp(name, found_name))
+        return EPROTO;
+
+    map.clear();
+    for (; count != 0; count--) {
+        if (fscanf(f, "%" FT_ULL " %" FT_ULL " %" FT_ULL " %" FT_ULL "\n", &physical, &logical, &length, &user_data) != 4)
+            return EPROTO;
+        /* maps were consistent when saved, no need to check for merges */
+        map.insert0((T) physical, (T) logical, (T) length, (ft_size) user_data);
+    }
+    return 0;
+}
+
+/**
+ * serialize dev_*, storage_* and toclear_map into job checkpoint file.
+ * the checkpoint refers to the last step written into persistence file.
+ *
+ * crash-consistent: checkpoint is written into a temporary file,
+ * synced to disk and only then renamed over the previous checkpoint.
+ */
+template<typename T>
+int fr_work<T>::save_checkpoint()
+{
+    FT_IO_NS fr_persist & persist = io->persist();
+    FILE * f = NULL;
+    int err = persist.checkpoint_create(f);
+    if (err != 0)
+        return err;
+
+    do {
+        if (fprintf(f, "step %" FT_ULL " %" FT_ULL " %" FT_ULL "\n", persist.step_offset(),
+                    (ft_ull) dev_map.used_count(), (ft_ull) storage_map.used_count()) <= 0
+            || fprintf(f, "work %u %" FT_ULL " %" FT_ULL " %" FT_ULL " %" FT_ULL " %" FT_ULL "\n",
+                       (unsigned) sizeof(T), (ft_ull) io->effective_block_size_log2(), (ft_ull) io->dev_length(),
+                       (ft_ull) work_total, (ft_ull) dev_map.total_count(), (ft_ull) storage_map.total_count()) <= 0)
+        {
+            err = errno;
+            break;
+        }
+        if ((err = ff_checkpoint_save_map<T>(f, "dev_map", dev_map)) != 0
+            || (err = ff_checkpoint_save_map<T>(f, "dev_free", dev_free)) != 0
+            || (err = ff_checkpoint_save_map<T>(f, "dev_transpose", dev_transpose)) != 0
+            || (err = ff_checkpoint_save_map<T>(f, "storage_map", storage_map)) != 0
+            || (err = ff_checkpoint_save_map<T>(f, "storage_free", storage_free)) != 0
+            || (err = ff_checkpoint_save_map<T>(f, "storage_transpose", storage_transpose)) != 0
+            || (err = ff_checkpoint_save_map<T>(f, "toclear_map", toclear_map)) != 0)
+            break;
+
+        if (fprintf(f, "end\n") <= 0)
+            err = errno;
+    } while (0);
+
+    if (err != 0) {
+        err = ff_log(FC_ERROR, err, "I/O error writing checkpoint file '%s.tmp'", persist.checkpoint_path().c_str());
+        (void) fclose(f);
+        return err;
+    }
+    if ((err = persist.checkpoint_commit(f)) == 0)
+        ff_log(FC_DEBUG, 0, "saved checkpoint '%s'", persist.checkpoint_path().c_str());
+    return err;
+}
+
+/**
+ * called by relocate() while replaying: load dev_*, storage_* and toclear_map
+ * from job checkpoint file (if present), then skip persistence file to the same step.
+ * avoids replaying the whole job from the beginning.
+ */
+template<typename T>
+int fr_work<T>::load_checkpoint()
+{
+    FT_IO_NS fr_persist & persist = io->persist();
+    const char * path = persist.checkpoint_path().c_str();
+    FILE * f = NULL;
+    int err = persist.checkpoint_open(f);
+    if (err != 0 || f == NULL)
+        return err;
+
+    ft_ull offset = 0, dev_used = 0, storage_used = 0;
+    ft_ull block_size_log2 = 0, dev_length = 0, total = 0, dev_total = 0, storage_total = 0;
+    unsigned sizeof_T = 0;
+
+    enum { FT_LINE_LEN = 80 };
+    char line[FT_LINE_LEN + 1] = { '\0' };
+
+    do {
+        if (fgets(line, FT_LINE_LEN, f) == NULL || strncmp(line, persist.checkpoint_header(), strlen(persist.checkpoint_header()))) {
+            err = EPROTO;
+            break;
+        }
+        if (fscanf(f, "step %" FT_ULL " %" FT_ULL " %" FT_ULL "\n", & offset, & dev_used, & storage_used) != 3
+            || fscanf(f, "work %u %" FT_ULL " %" FT_ULL " %" FT_ULL " %" FT_ULL " %" FT_ULL "\n", & sizeof_T,
+                      & block_size_log2, & dev_length, & total, & dev_total, & storage_total) != 6)
+        {
+            err = EPROTO;
+            break;
+        }
+        if (sizeof_T != sizeof(T) || block_size_log2 != (ft_ull) io->effective_block_size_log2()
+            || dev_length != (ft_ull) io->dev_length() || total != (ft_ull) work_total
+            || storage_total != (ft_ull) storage_map.total_count())
+        {
+            ff_log(FC_ERROR, 0, "checkpoint file '%s' belongs to a different job", path);
+            err = -EINVAL;
+            break;
+        }
+        if ((err = ff_checkpoint_load_map<T>(f, "dev_map", dev_map)) != 0
+            || (err = ff_checkpoint_load_map<T>(f, "dev_free", dev_free)) != 0
+            || (err = ff_checkpoint_load_map<T>(f, "dev_transpose", dev_transpose)) != 0
+            || (err = ff_checkpoint_load_map<T>(f, "storage_map", storage_map)) != 0
+            || (err = ff_checkpoint_load_map<T>(f, "storage_free", storage_free)) != 0
+            || (err = ff_checkpoint_load_map<T>(f, "storage_transpose", storage_transpose)) != 0
+            || (err = ff_checkpoint_load_map<T>(f, "toclear_map", toclear_map)) != 0)
+            break;
+
+        if (fgets(line, FT_LINE_LEN, f) == NULL || strcmp(line, "end\n"))
+            err = EPROTO;
+    } while (0);
+
+    (void) fclose(f);
+
+    if (err == EPROTO)
+        err = ff_log(FC_ERROR, err, "corrupted checkpoint file '%s'", path);
+    if (err == 0) {
+        /* move_to_target() shrinks dev_map.total_count() while DEVICE blocks reach their final destination */
+        dev_map.total_count((T) dev_total);
+        dev_map.used_count((T) dev_used);
+        storage_map.used_count((T) storage_used);
+        err = persist.seek_step(offset, dev_used, storage_used);
+    }
+    if (err == 0)
+        ff_log(FC_INFO, 0, "(replaying) loaded checkpoint '%s', skipped to %" FT_ULL " blocks still to remap",
+               path, dev_used + storage_used);
+    return err;
+}
+
+
+/** add to E.T.A. the bytes copied so far in each direction, and the seconds spent copying them */
+template<typename T>
+void fr_work<T>::add_eta_sample()
+{
+    double done[FC_INVALID2INVALID], busy[FC_INVALID2INVALID];
+    for (ft_size i = 0; i < FC_INVALID2INVALID; i++) {
+        done[i] = (double) io->copied_bytes((fr_dir) i);
+        busy[i] = io->copy_seconds((fr_dir) i);
+    }
+    eta.add(done, busy);
+}
+
 /** show progress status and E.T.A. */
 template<typename T>
 void fr_work<T>::show_progress(ft_log_level log_level)
@@ -1077,16 +1334,36 @@ void fr_work<T>::show_progress(ft_log_level log_level)
     if (work_total != 0) {
         percentage = 1.0 - ((double)dev_used + 0.5 * (double)storage_used) / (double)work_total;
 
-        /* underestimate the progress percentage: algorithm slows down near the end */
-        /* time_left = eta.add(percentage); */
-        double x = percentage;
-        time_left = eta.add(0.5*x + 0.5*x*x);
+        add_eta_sample();
+        /*
+         * DEVICE blocks still to relocate are copied either directly to their target (DEV2DEV)
+         * or through STORAGE (DEV2STORAGE, then STORAGE2DEV): assume the same mix observed so far
+         */
+        const double dev2dev = (double) io->copied_bytes(FC_DEV2DEV), dev2storage = (double) io->copied_bytes(FC_DEV2STORAGE);
+        const double via_storage = dev2dev + dev2storage > 0.0 ? dev2storage / (dev2dev + dev2storage) : 0.5;
+        const double dev_left = (double) ((ft_uoff) dev_used << eff_block_size_log2);
+        const double storage_left = (double) ((ft_uoff) storage_used << eff_block_size_log2);
+        double left[FC_INVALID2INVALID];
+        left[FC_DEV2DEV] = dev_left * (1.0 - via_storage);
+        left[FC_DEV2STORAGE] = dev_left * via_storage;
+        left[FC_STORAGE2DEV] = storage_left + dev_left * via_storage;
+
+        /* when throttled, remaining I/O cannot complete faster than the limits allow: each copied byte is read and written */
+        const double copy_left = left[FC_DEV2DEV] + left[FC_DEV2STORAGE] + left[FC_STORAGE2DEV];
+        double min_time_left = io->simulate_run() ? 0.0 : io->throttle().min_seconds((ft_uoff) (2.0 * copy_left));
+        time_left = eta.time_left(left, min_time_left);
 
         percentage *= 100.0;
     }
 
     ff_show_progress(log_level, simul_msg, percentage, total_len, " still to remap", time_left);
 
+    FT_IO_NS fr_control * control = io->control();
+    if (control != NULL) {
+        control->progress(percentage, total_len, time_left);
+        control->poll();
+    }
+
     const ft_uoff eff_block_size = (ft_uoff)1 << eff_block_size_log2;
 
     dev_map.show(label[FC_DEVICE], "", eff_block_size, FC_DUMP);
@@ -1384,6 +1661,8 @@ int fr_work<T>::clear_free_space()
     int err = 0;
     fr_clear_free_space job_clear = io->job_clear();
 
+    stats_phase("clear_free_space");
+
     do {
         ft_uoff toclear_len = 0;
         if (job_clear == FC_CLEAR_MINIMAL)
@@ -1399,7 +1678,10 @@ int fr_work<T>::clear_free_space()
             case FC_CLEAR_MINIMAL:
                 ff_log(FC_NOTICE, 0, "%sclearing %.2f %sbytes free space from %s to remove temporary data (%s and %s backup)...",
                        sim_msg, pretty_len, pretty_label, label[FC_DEVICE], label[FC_PRIMARY_STORAGE], label[FC_DEVICE]);
-                err = io->zero_primary_storage();
+                if (io->plan() != NULL)
+                    err = io->plan()->zero_primary_storage();
+                if (err == 0)
+                    err = zero_primary_storage();
                 break;
             default:
             case FC_CLEAR_ALL:
@@ -1448,6 +1730,26 @@ int fr_work<T>::clear_free_space()
 }
 
 
+/** fill PRIMARY-STORAGE with zeroes, and record it into I/O trace if enabled */
+template<typename T>
+int fr_work<T>::zero_primary_storage()
+{
+    ft_trace * trace = io->trace();
+    if (trace == NULL)
+        return io->zero_primary_storage();
+
+    /* PRIMARY-STORAGE is the beginning of STORAGE */
+    ft_uoff primary_len = 0;
+    fr_vector<ft_uoff>::const_iterator iter = io->primary_storage().begin(), end = io->primary_storage().end();
+    for (; iter != end; ++iter)
+        primary_len += iter->second.length;
+
+    double start = trace->now();
+    int err = io->zero_primary_storage();
+    trace->record(FC_TRACE_ZERO, FC_TRACE_TO_STORAGE, 0, 0, primary_len, start, trace->now());
+    return err;
+}
+
 /** called after relocate() and clear_free_space(). closes storage */
 template<typename T>
 int fr_work<T>::close_storage_after_success()
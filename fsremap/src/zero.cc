@@ -0,0 +1,184 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * zero.cc
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#include "first.hh"
+
+#if defined(FT_HAVE_STRING_H)
+# include <string.h>       // for memcpy()
+#elif defined(FT_HAVE_CSTRING)
+# include <cstring>        // for memcpy()
+#endif
+
+#if defined(__SSE2__)
+# define FT_ZERO_SSE2
+# include <emmintrin.h>    // for _mm_loadu_si128(), _mm_or_si128(), _mm_cmpeq_epi8(), _mm_movemask_epi8()
+#endif
+#if defined(FT_HAVE_AVX2_DISPATCH)
+# define FT_ZERO_AVX2
+# include <immintrin.h>    // for _mm256_loadu_si256(), _mm256_or_si256(), _mm256_testz_si256()
+#endif
+
+#include "zero.hh"         // for ff_mem_is_zero(), ff_mem_zero_run()
+
+FT_NAMESPACE_BEGIN
+
+/** ff_mem_is_zero() implementation for any CPU: OR machine words together, 4 at time */
+static bool ff_mem_is_zero_generic(const char * mem, ft_size mem_len)
+{
+    enum { word_size = sizeof(unsigned long) };
+    unsigned long w0, w1, w2, w3;
+
+    /* memcpy() avoids unaligned accesses and strict-aliasing issues, and compiles to plain loads */
+    for (; mem_len >= 4 * word_size; mem += 4 * word_size, mem_len -= 4 * word_size) {
+        memcpy(& w0, mem, word_size);
+        memcpy(& w1, mem + word_size, word_size);
+        memcpy(& w2, mem + 2 * word_size, word_size);
+        memcpy(& w3, mem + 3 * word_size, word_size);
+        if ((w0 | w1 | w2 | w3) != 0)
+            return false;
+    }
+    for (; mem_len >= word_size; mem += word_size, mem_len -= word_size) {
+        memcpy(& w0, mem, word_size);
+        if (w0 != 0)
+            return false;
+    }
+    for (; mem_len != 0; mem++, mem_len--) {
+        if (* mem != '\0')
+            return false;
+    }
+    return true;
+}
+
+#ifdef FT_ZERO_SSE2
+/** ff_mem_is_zero() implementation for x86 with SSE2: OR 64 bytes together, then compare with zero */
+static bool ff_mem_is_zero_sse2(const char * mem, ft_size mem_len)
+{
+    const __m128i zero = _mm_setzero_si128();
+    for (; mem_len >= 64; mem += 64, mem_len -= 64) {
+        __m128i v = _mm_or_si128(
+            _mm_or_si128(_mm_loadu_si128((const __m128i *) mem),
+                         _mm_loadu_si128((const __m128i *) (mem + 16))),
+            _mm_or_si128(_mm_loadu_si128((const __m128i *) (mem + 32)),
+                         _mm_loadu_si128((const __m128i *) (mem + 48))));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) != 0xFFFF)
+            return false;
+    }
+    return ff_mem_is_zero_generic(mem, mem_len);
+}
+#endif /* FT_ZERO_SSE2 */
+
+#ifdef FT_ZERO_AVX2
+/** ff_mem_is_zero() implementation for x86 with AVX2: OR 128 bytes together, then test for zero */
+__attribute__((target("avx2")))
+static bool ff_mem_is_zero_avx2(const char * mem, ft_size mem_len)
+{
+    for (; mem_len >= 128; mem += 128, mem_len -= 128) {
+        __m256i v = _mm256_or_si256(
+            _mm256_or_si256(_mm256_loadu_si256((const __m256i *) mem),
+                            _mm256_loadu_si256((const __m256i *) (mem + 32))),
+            _mm256_or_si256(_mm256_loadu_si256((const __m256i *) (mem + 64)),
+                            _mm256_loadu_si256((const __m256i *) (mem + 96))));
+        if (!_mm256_testz_si256(v, v))
+            return false;
+    }
+    return ff_mem_is_zero_generic(mem, mem_len);
+}
+#endif /* FT_ZERO_AVX2 */
+
+
+/** return implementation 'impl' of ff_mem_is_zero(), or NULL if not supported by this CPU or compiler */
+ft_mem_is_zero_func ff_mem_is_zero_impl(ft_zero_impl impl)
+{
+    switch (impl) {
+        case FC_ZERO_GENERIC:
+            return ff_mem_is_zero_generic;
+#ifdef FT_ZERO_SSE2
+        case FC_ZERO_SSE2:
+            return ff_mem_is_zero_sse2;
+#endif
+#ifdef FT_ZERO_AVX2
+        case FC_ZERO_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") ? ff_mem_is_zero_avx2 : NULL;
+#endif
+        default:
+            return NULL;
+    }
+}
+
+/** return the name of implementation 'impl' of ff_mem_is_zero() */
+const char * ff_mem_is_zero_impl_name(ft_zero_impl impl)
+{
+    static const char * const label[FC_ZERO_IMPL_COUNT] = { "generic", "sse2", "avx2" };
+    return impl >= FC_ZERO_GENERIC && impl < FC_ZERO_IMPL_COUNT ? label[impl] : "unknown";
+}
+
+/** return the fastest implementation of ff_mem_is_zero() supported by this CPU */
+static ft_mem_is_zero_func ff_mem_is_zero_select()
+{
+    ft_mem_is_zero_func func = NULL;
+    for (int impl = FC_ZERO_IMPL_COUNT - 1; func == NULL && impl >= FC_ZERO_GENERIC; impl--)
+        func = ff_mem_is_zero_impl((ft_zero_impl) impl);
+    return func;
+}
+
+/* selected once, before main() and before any thread is started */
+static const ft_mem_is_zero_func fc_mem_is_zero = ff_mem_is_zero_select();
+
+/** return true if the 'mem_len' bytes starting at 'mem' are all zero. uses the fastest implementation for this CPU */
+bool ff_mem_is_zero(const char * mem, ft_size mem_len)
+{
+    return fc_mem_is_zero(mem, mem_len);
+}
+
+/**
+ * scan memory in blocks of 'block_size' bytes, and return the length of the initial run
+ * of blocks that are all zero (then set ret_is_zero = true) or NOT all zero (then set ret_is_zero = false).
+ * a final fragment shorter than block_size is always considered NOT zero.
+ * each block is scanned only once
+ */
+ft_size ff_mem_zero_run(const char * mem, ft_size mem_len, ft_size block_size, bool & ret_is_zero)
+{
+    ft_size len = 0;
+    bool is_zero = mem_len >= block_size && fc_mem_is_zero(mem, block_size);
+
+    if (is_zero) {
+        do {
+            len += block_size;
+        } while (mem_len - len >= block_size && fc_mem_is_zero(mem + len, block_size));
+    } else {
+        /* the first block was already scanned, and it is NOT zero */
+        len = block_size;
+        while (mem_len > len && mem_len - len >= block_size && !fc_mem_is_zero(mem + len, block_size))
+            len += block_size;
+        /* a final fragment shorter than block_size is NOT zero */
+        if (mem_len <= len || mem_len - len < block_size)
+            len = mem_len;
+    }
+    ret_is_zero = is_zero;
+    return len;
+}
+
+FT_NAMESPACE_END
@@ -0,0 +1,62 @@
+/*
+ * fstransform - transform a file-system to another file-system type,
+ *               preserving its contents and without the need for a backup
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * zero.hh
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#ifndef FSTRANSFORM_ZERO_HH
+#define FSTRANSFORM_ZERO_HH
+
+#include "types.hh"         // for ft_size
+
+FT_NAMESPACE_BEGIN
+
+/** implementations of ff_mem_is_zero() */
+enum ft_zero_impl {
+    FC_ZERO_GENERIC = 0, // machine words, any CPU
+    FC_ZERO_SSE2,        // 16 bytes at time, x86 with SSE2
+    FC_ZERO_AVX2,        // 32 bytes at time, x86 with AVX2, selected at runtime
+    FC_ZERO_IMPL_COUNT,  // must be equal to count of preceding enum constants
+};
+
+typedef bool (* ft_mem_is_zero_func)(const char * mem, ft_size mem_len);
+
+/** return true if the 'mem_len' bytes starting at 'mem' are all zero. uses the fastest implementation for this CPU */
+bool ff_mem_is_zero(const char * mem, ft_size mem_len);
+
+/**
+ * scan memory in blocks of 'block_size' bytes, and return the length of the initial run
+ * of blocks that are all zero (then set ret_is_zero = true) or NOT all zero (then set ret_is_zero = false).
+ * a final fragment shorter than block_size is always considered NOT zero.
+ * each block is scanned only once
+ */
+ft_size ff_mem_zero_run(const char * mem, ft_size mem_len, ft_size block_size, bool & ret_is_zero);
+
+/** return implementation 'impl' of ff_mem_is_zero(), or NULL if not supported by this CPU or compiler */
+ft_mem_is_zero_func ff_mem_is_zero_impl(ft_zero_impl impl);
+
+/** return the name of implementation 'impl' of ff_mem_is_zero() */
+const char * ff_mem_is_zero_impl_name(ft_zero_impl impl);
+
+FT_NAMESPACE_END
+
+#endif /* FSTRANSFORM_ZERO_HH */
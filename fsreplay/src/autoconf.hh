@@ -0,0 +1 @@
+../../fsremap/src/autoconf.hh
\ No newline at end of file
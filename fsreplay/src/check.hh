@@ -0,0 +1 @@
+../../fsremap/src/check.hh
\ No newline at end of file
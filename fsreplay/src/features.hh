@@ -0,0 +1 @@
+../../fsremap/src/features.hh
\ No newline at end of file
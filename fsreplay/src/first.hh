@@ -0,0 +1 @@
+../../fsremap/src/first.hh
\ No newline at end of file
@@ -0,0 +1 @@
+../../fsremap/src/ft_config.hh
\ No newline at end of file
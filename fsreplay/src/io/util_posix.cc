@@ -0,0 +1 @@
+../../../fsremap/src/io/util_posix.cc
\ No newline at end of file
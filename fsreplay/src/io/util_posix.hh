@@ -0,0 +1 @@
+../../../fsremap/src/io/util_posix.hh
\ No newline at end of file
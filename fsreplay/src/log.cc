@@ -0,0 +1 @@
+../../fsremap/src/log.cc
\ No newline at end of file
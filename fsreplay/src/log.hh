@@ -0,0 +1 @@
+../../fsremap/src/log.hh
\ No newline at end of file
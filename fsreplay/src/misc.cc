@@ -0,0 +1 @@
+../../fsremap/src/misc.cc
\ No newline at end of file
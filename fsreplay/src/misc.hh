@@ -0,0 +1 @@
+../../fsremap/src/misc.hh
\ No newline at end of file
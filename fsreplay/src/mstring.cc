@@ -0,0 +1 @@
+../../fsremap/src/mstring.cc
\ No newline at end of file
@@ -0,0 +1 @@
+../../fsremap/src/mstring.hh
\ No newline at end of file
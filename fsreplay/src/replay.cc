@@ -0,0 +1,536 @@
+/*
+ * fsreplay - replay fsremap and fsmove I/O traces
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * replay.cc
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#include "first.hh"
+
+#if defined(FT_HAVE_ERRNO_H)
+# include <errno.h>        // for errno, ENOSYS, ENOSPC
+#elif defined(FT_HAVE_CERRNO)
+# include <cerrno>         // for errno, ENOSYS, ENOSPC
+#endif
+#if defined(FT_HAVE_STDLIB_H)
+# include <stdlib.h>       // for malloc(), free()
+#elif defined(FT_HAVE_CSTDLIB)
+# include <cstdlib>        // for malloc(), free()
+#endif
+#if defined(FT_HAVE_STRING_H)
+# include <string.h>       // for memset(), strcmp(), strncmp()
+#elif defined(FT_HAVE_CSTRING)
+# include <cstring>        // for memset(), strcmp(), strncmp()
+#endif
+
+#ifdef FT_HAVE_FCNTL_H
+# include <fcntl.h>        // for open(), O_RDWR, O_CREAT, O_DIRECT, O_DSYNC
+#endif
+#ifdef FT_HAVE_SYS_STAT_H
+# include <sys/stat.h>     // for fstat(), S_ISBLK(), S_ISREG()
+#endif
+#ifdef FT_HAVE_UNISTD_H
+# include <unistd.h>       // for close(), ftruncate(), fdatasync()
+#endif
+
+#include <algorithm>       // for std::sort()
+#include <map>             // for std::map<K,V>
+#include <utility>         // for std::pair<T1,T2>
+#include <vector>          // for std::vector<T>
+
+#include "log.hh"          // for ff_log()
+#include "misc.hh"         // for ff_now(), ff_sleep(), ff_min2(), ff_max2(), ff_pretty_size(), ff_pretty_time()
+#include "trace.hh"        // for ft_trace
+#include "io/util_posix.hh" // for ff_posix_lseek(), ff_posix_read(), ff_posix_write(), ff_posix_blkdev_size()
+#include "replay.hh"       // for replay_main()
+
+FT_NAMESPACE_BEGIN
+
+enum ft_replay_backend { FC_REPLAY_BUFFERED, FC_REPLAY_DIRECT, FC_REPLAY_DSYNC };
+
+enum ft_replay_kind { FC_REPLAY_READ, FC_REPLAY_WRITE, FC_REPLAY_FLUSH, FC_REPLAY_KIND_N };
+
+enum {
+    /* copies are replayed in chunks of this size */
+    FC_REPLAY_CHUNK = 1 << 20,
+    /* alignment of buffers, offsets and lengths for --backend=direct */
+    FC_REPLAY_ALIGN = 4096,
+    /* size of each buffer: with --backend=direct, an unaligned chunk is rounded out by up to FC_REPLAY_ALIGN */
+    FC_REPLAY_BUFSIZE = FC_REPLAY_CHUNK + FC_REPLAY_ALIGN,
+    /* fsmove traces: alignment of each file inside the image */
+    FC_REPLAY_FILE_ALIGN = 1 << 20,
+    /* number of trace records read at once */
+    FC_REPLAY_OPS_N = 4096,
+};
+
+static char const* const fc_replay_backend_label[] = { "buffered", "direct", "dsync" };
+static char const* const fc_replay_kind_label[FC_REPLAY_KIND_N] = { "read", "write", "flush" };
+
+/**
+ * replays an I/O trace written by fsremap --trace or fsmove --trace against an image file or device.
+ *
+ * fsremap traces: DEVICE is the beginning of the image, STORAGE follows it.
+ * fsmove traces: each traced file is placed in the image in order of first access,
+ * with source and target files in separate regions even if they have the same inode number.
+ */
+class ft_replay
+{
+private:
+    typedef std::pair<ft_u32, ft_u64> file_key; // (type, inode)
+
+    ft_trace this_trace;
+    /* fsmove traces: offset of each file inside the image */
+    std::map<file_key, ft_u64> this_files;
+    /* fsremap traces: copies queued since previous FLUSH, performed only when it is reached */
+    std::vector<ft_trace_op> this_queue;
+    std::vector<double> this_latency[FC_REPLAY_KIND_N];
+    ft_u64 this_bytes[FC_REPLAY_KIND_N];
+    ft_u64 this_image_length, this_op_count;
+    double this_trace_start, this_trace_end;
+    char * this_buf_mem, * this_buf, * this_zero;
+    int this_fd;
+    ft_replay_backend this_backend;
+    bool this_original_timing;
+
+    /** cannot call copy constructor */
+    ft_replay(const ft_replay &);
+
+    /** cannot call assignment operator */
+    const ft_replay & operator=(const ft_replay &);
+
+    /** return image offset of the data accessed by 'op': its source if 'from' is true, else its destination */
+    ft_u64 image_offset(const ft_trace_op & op, bool from) const;
+
+    /** first pass over the trace: compute image layout and length */
+    int layout();
+
+    /** open image, enlarging it if it is a regular file shorter than needed */
+    int open_image(const char * path);
+
+    /** read or write 'length' bytes at image 'offset', accounting latency */
+    int io(ft_replay_kind kind, ft_u64 offset, ft_u64 length, char * buf);
+
+    /** flush image, accounting latency */
+    int flush();
+
+    /** replay a single trace record */
+    int replay(const ft_trace_op & op);
+
+    /** replay a COPY trace record */
+    int copy(const ft_trace_op & op);
+
+    /** replay the copies in this_queue, then empty it */
+    int replay_queue();
+
+    /** log throughput and latency percentiles */
+    void show(double elapsed) const;
+
+public:
+    /** constructor */
+    ft_replay(ft_replay_backend backend, bool original_timing);
+
+    /** destructor */
+    ~ft_replay();
+
+    /** replay 'trace_path' against 'image_path' */
+    int run(const char * trace_path, const char * image_path);
+};
+
+
+/** constructor */
+ft_replay::ft_replay(ft_replay_backend backend, bool original_timing)
+    : this_trace(), this_files(), this_image_length(0), this_op_count(0), this_trace_start(0.0), this_trace_end(0.0),
+      this_buf_mem(NULL), this_buf(NULL), this_zero(NULL), this_fd(-1),
+      this_backend(backend), this_original_timing(original_timing)
+{
+    for (ft_size i = 0; i < FC_REPLAY_KIND_N; i++)
+        this_bytes[i] = 0;
+}
+
+/** destructor */
+ft_replay::~ft_replay()
+{
+    if (this_fd >= 0)
+        (void) ::close(this_fd);
+    free(this_buf_mem);
+}
+
+/** return image offset of the data accessed by 'op': its source if 'from' is true, else its destination */
+ft_u64 ft_replay::image_offset(const ft_trace_op & op, bool from) const
+{
+    if (op.type == FC_TRACE_READ || op.type == FC_TRACE_WRITE) {
+        std::map<file_key, ft_u64>::const_iterator iter = this_files.find(file_key(op.type, op.from));
+        return (iter != this_files.end() ? iter->second : 0) + op.to;
+    }
+    const ft_u32 storage_flag = from ? FC_TRACE_FROM_STORAGE : FC_TRACE_TO_STORAGE;
+    return (from ? op.from : op.to) + ((op.flags & storage_flag) ? this_trace.dev_length() : 0);
+}
+
+/** first pass over the trace: compute image layout and length */
+int ft_replay::layout()
+{
+    std::vector<ft_trace_op> ops(FC_REPLAY_OPS_N);
+    std::vector<file_key> order;
+    std::map<file_key, ft_u64> file_len;
+    ft_u64 image_len = this_trace.dev_length();
+    ft_size i, n;
+    bool first = true;
+
+    while ((n = this_trace.read(& ops[0], ops.size())) != 0) {
+        for (i = 0; i < n; i++) {
+            const ft_trace_op & op = ops[i];
+            if (first) {
+                this_trace_start = op.start;
+                first = false;
+            }
+            this_trace_end = ff_max2(this_trace_end, op.end);
+            this_op_count++;
+
+            if (op.type == FC_TRACE_READ || op.type == FC_TRACE_WRITE) {
+                file_key key(op.type, op.from);
+                std::map<file_key, ft_u64>::iterator iter = file_len.find(key);
+                if (iter == file_len.end()) {
+                    iter = file_len.insert(std::make_pair(key, (ft_u64) 0)).first;
+                    order.push_back(key);
+                }
+                iter->second = ff_max2<ft_u64>(iter->second, op.to + op.length);
+            } else if (op.type == FC_TRACE_COPY || op.type == FC_TRACE_ZERO) {
+                image_len = ff_max2<ft_u64>(image_len, image_offset(op, false) + op.length);
+                if (op.type == FC_TRACE_COPY)
+                    image_len = ff_max2<ft_u64>(image_len, image_offset(op, true) + op.length);
+            }
+        }
+    }
+    /* place fsmove files one after the other, in order of first access */
+    for (i = 0, n = order.size(); i < n; i++) {
+        this_files[order[i]] = image_len;
+        image_len += (file_len[order[i]] + FC_REPLAY_FILE_ALIGN - 1) & ~(ft_u64) (FC_REPLAY_FILE_ALIGN - 1);
+    }
+    this_image_length = image_len;
+    return this_trace.rewind();
+}
+
+/** open image, enlarging it if it is a regular file shorter than needed */
+int ft_replay::open_image(const char * path)
+{
+    int flags = O_RDWR | O_CREAT;
+    if (this_backend == FC_REPLAY_DIRECT) {
+#ifdef O_DIRECT
+        flags |= O_DIRECT;
+#else
+        return ff_log(FC_ERROR, ENOSYS, "backend 'direct' is not supported on this platform: O_DIRECT is not available");
+#endif
+    } else if (this_backend == FC_REPLAY_DSYNC) {
+#ifdef O_DSYNC
+        flags |= O_DSYNC;
+#else
+        return ff_log(FC_ERROR, ENOSYS, "backend 'dsync' is not supported on this platform: O_DSYNC is not available");
+#endif
+    }
+    if ((this_fd = ::open(path, flags, 0600)) < 0)
+        return ff_log(FC_ERROR, errno, "failed to open image '%s'", path);
+
+    ft_stat st;
+    if (::fstat(this_fd, & st) != 0)
+        return ff_log(FC_ERROR, errno, "failed to stat image '%s'", path);
+
+    ft_uoff length = (ft_uoff) st.st_size;
+    int err = 0;
+    if (S_ISBLK(st.st_mode)) {
+        if ((err = FT_IO_NS ff_posix_blkdev_size(this_fd, & length)) != 0)
+            return ff_log(FC_ERROR, err, "failed to get size of device '%s'", path);
+    } else if (S_ISREG(st.st_mode) && length < this_image_length) {
+        /* enlarge as sparse file */
+        if (ftruncate(this_fd, (ft_off) this_image_length) != 0)
+            return ff_log(FC_ERROR, errno, "failed to enlarge image '%s' to %" FT_ULL " bytes", path, (ft_ull) this_image_length);
+        length = this_image_length;
+    }
+    if (length < this_image_length)
+        return ff_log(FC_ERROR, ENOSPC, "image '%s' is too small: trace needs %" FT_ULL " bytes, image has %" FT_ULL,
+                      path, (ft_ull) this_image_length, (ft_ull) length);
+
+    /* one buffer for data, one filled with zeroes. both aligned for O_DIRECT */
+    if ((this_buf_mem = (char *) malloc(2 * FC_REPLAY_BUFSIZE + FC_REPLAY_ALIGN)) == NULL)
+        return ff_log(FC_ERROR, ENOMEM, "failed to allocate %" FT_ULL " bytes", (ft_ull) (2 * FC_REPLAY_BUFSIZE + FC_REPLAY_ALIGN));
+    this_buf = this_buf_mem + (FC_REPLAY_ALIGN - ((ft_size) this_buf_mem & (FC_REPLAY_ALIGN - 1)));
+    this_zero = this_buf + FC_REPLAY_BUFSIZE;
+    memset(this_buf, '\0', 2 * FC_REPLAY_BUFSIZE);
+    return 0;
+}
+
+/** read or write 'length' bytes at image 'offset', accounting latency */
+int ft_replay::io(ft_replay_kind kind, ft_u64 offset, ft_u64 length, char * buf)
+{
+    if (this_backend == FC_REPLAY_DIRECT) {
+        /* O_DIRECT needs aligned offsets and lengths: fsmove traces may contain unaligned ones */
+        ft_u64 end = (offset + length + FC_REPLAY_ALIGN - 1) & ~(ft_u64) (FC_REPLAY_ALIGN - 1);
+        offset &= ~(ft_u64) (FC_REPLAY_ALIGN - 1);
+        length = end - offset;
+    }
+    double start = 0.0, end = 0.0;
+    (void) ff_now(start);
+    int err = FT_IO_NS ff_posix_lseek(this_fd, offset);
+    if (err == 0)
+        err = kind == FC_REPLAY_READ ? FT_IO_NS ff_posix_read(this_fd, buf, length) : FT_IO_NS ff_posix_write(this_fd, buf, length);
+    (void) ff_now(end);
+    if (err != 0)
+        return ff_log(FC_ERROR, err, "I/O error in %s(offset = %" FT_ULL ", length = %" FT_ULL ")",
+                      fc_replay_kind_label[kind], (ft_ull) offset, (ft_ull) length);
+    this_latency[kind].push_back(end - start);
+    this_bytes[kind] += length;
+    return 0;
+}
+
+/** flush image, accounting latency */
+int ft_replay::flush()
+{
+    double start = 0.0, end = 0.0;
+    (void) ff_now(start);
+#if defined(FT_HAVE_FDATASYNC)
+    int err = fdatasync(this_fd) != 0 ? errno : 0;
+#else
+    int err = fsync(this_fd) != 0 ? errno : 0;
+#endif
+    (void) ff_now(end);
+    if (err != 0)
+        return ff_log(FC_ERROR, err, "I/O error in fdatasync()");
+    this_latency[FC_REPLAY_FLUSH].push_back(end - start);
+    return 0;
+}
+
+/** replay a COPY trace record */
+int ft_replay::copy(const ft_trace_op & op)
+{
+    ft_u64 from = image_offset(op, true), to = image_offset(op, false), length = op.length, chunk;
+    int err = 0;
+
+    for (; err == 0 && length != 0; length -= chunk, from += chunk, to += chunk) {
+        chunk = ff_min2<ft_u64>(length, FC_REPLAY_CHUNK);
+        if ((err = io(FC_REPLAY_READ, from, chunk, this_buf)) == 0)
+            err = io(FC_REPLAY_WRITE, to, chunk, this_buf);
+    }
+    return err;
+}
+
+/** replay the copies in this_queue, then empty it */
+int ft_replay::replay_queue()
+{
+    int err = 0;
+    for (ft_size i = 0; err == 0 && i < this_queue.size(); i++)
+        err = copy(this_queue[i]);
+    this_queue.clear();
+    return err;
+}
+
+/** replay a single trace record */
+int ft_replay::replay(const ft_trace_op & op)
+{
+    ft_u64 to = image_offset(op, false), length = op.length, chunk;
+    int err = 0;
+
+    switch (op.type) {
+    case FC_TRACE_COPY:
+        /* fsremap queues copies and performs them at next FLUSH: do the same */
+        this_queue.push_back(op);
+        break;
+    case FC_TRACE_ZERO:
+        for (; err == 0 && length != 0; length -= chunk, to += chunk) {
+            chunk = ff_min2<ft_u64>(length, FC_REPLAY_CHUNK);
+            err = io(FC_REPLAY_WRITE, to, chunk, this_zero);
+        }
+        break;
+    case FC_TRACE_FLUSH:
+        if ((err = replay_queue()) == 0 && !(op.flags & FC_TRACE_NO_SYNC))
+            err = flush();
+        break;
+    case FC_TRACE_READ:
+    case FC_TRACE_WRITE:
+        for (; err == 0 && length != 0; length -= chunk, to += chunk) {
+            chunk = ff_min2<ft_u64>(length, FC_REPLAY_CHUNK);
+            err = io(op.type == FC_TRACE_READ ? FC_REPLAY_READ : FC_REPLAY_WRITE, to, chunk, this_buf);
+        }
+        break;
+    default:
+        break;
+    }
+    return err;
+}
+
+/** return the 'p' percentile of sorted 'v' */
+static double ff_replay_percentile(const std::vector<double> & v, double p)
+{
+    ft_size n = v.size(), i = (ft_size) (p * (double) n);
+    return n == 0 ? 0.0 : v[i < n ? i : n - 1];
+}
+
+/** log throughput and latency percentiles */
+void ft_replay::show(double elapsed) const
+{
+    double pretty_len = 0.0, pretty_time = 0.0;
+    const char * pretty_label = ff_pretty_time(elapsed, & pretty_time);
+    double pretty_trace_time = 0.0;
+    const char * pretty_trace_label = ff_pretty_time(this_trace_end - this_trace_start, & pretty_trace_time);
+
+    ff_log(FC_NOTICE, 0, "replayed %" FT_ULL " %s operations in %.1f %s%s with backend '%s' (traced run took %.1f %s%s)",
+           (ft_ull) this_op_count, this_trace.program() == FC_TRACE_FSREMAP ? "fsremap" : "fsmove",
+           pretty_time, pretty_label, pretty_time != 1.0 ? "s" : "", fc_replay_backend_label[this_backend],
+           pretty_trace_time, pretty_trace_label, pretty_trace_time != 1.0 ? "s" : "");
+
+    for (ft_size kind = 0; kind < FC_REPLAY_KIND_N; kind++) {
+        std::vector<double> v = this_latency[kind];
+        if (v.empty())
+            continue;
+        std::sort(v.begin(), v.end());
+        if (kind == FC_REPLAY_FLUSH)
+            ff_log(FC_NOTICE, 0, "%-5s %8" FT_ULL " calls, latency ms: p50 %.3f, p90 %.3f, p99 %.3f, max %.3f",
+                   fc_replay_kind_label[kind], (ft_ull) v.size(), ff_replay_percentile(v, 0.5) * 1e3,
+                   ff_replay_percentile(v, 0.9) * 1e3, ff_replay_percentile(v, 0.99) * 1e3, v.back() * 1e3);
+        else {
+            pretty_label = ff_pretty_size((ft_uoff) this_bytes[kind], & pretty_len);
+            double rate = elapsed > 0.0 ? (double) this_bytes[kind] / elapsed / 1048576.0 : 0.0;
+            ff_log(FC_NOTICE, 0, "%-5s %8" FT_ULL " calls, %.2f %sbytes, %.2f MB/s, latency ms: p50 %.3f, p90 %.3f, p99 %.3f, max %.3f",
+                   fc_replay_kind_label[kind], (ft_ull) v.size(), pretty_len, pretty_label, rate,
+                   ff_replay_percentile(v, 0.5) * 1e3, ff_replay_percentile(v, 0.9) * 1e3,
+                   ff_replay_percentile(v, 0.99) * 1e3, v.back() * 1e3);
+        }
+    }
+}
+
+/** replay 'trace_path' against 'image_path' */
+int ft_replay::run(const char * trace_path, const char * image_path)
+{
+    int err;
+    if ((err = this_trace.open(trace_path)) != 0
+        || (err = layout()) != 0
+        || (err = open_image(image_path)) != 0)
+        return err;
+
+    double pretty_len = 0.0;
+    const char * pretty_label = ff_pretty_size((ft_uoff) this_image_length, & pretty_len);
+    ff_log(FC_INFO, 0, "replaying %" FT_ULL " operations from '%s' on image '%s' (%.2f %sbytes used)",
+           (ft_ull) this_op_count, trace_path, image_path, pretty_len, pretty_label);
+
+    std::vector<ft_trace_op> ops(FC_REPLAY_OPS_N);
+    double start = 0.0, now = 0.0;
+    (void) ff_now(start);
+    ft_size i, n;
+
+    while (err == 0 && (n = this_trace.read(& ops[0], ops.size())) != 0) {
+        for (i = 0; err == 0 && i < n; i++) {
+            /* queued copies are replayed at next FLUSH, i.e. when fsremap performed them */
+            if (this_original_timing && ops[i].type != FC_TRACE_COPY && ff_now(now) == 0) {
+                /* reproduce the original delay between operations, but do not try to catch up if late */
+                double wait = (ops[i].start - this_trace_start) - (now - start);
+                if (wait > 0.0)
+                    (void) ff_sleep(wait);
+            }
+            err = replay(ops[i]);
+        }
+    }
+    /* data is not replayed until it reaches the image */
+    if (err == 0 && (err = replay_queue()) == 0)
+        err = flush();
+    (void) ff_now(now);
+    if (err == 0)
+        show(now - start);
+    return err;
+}
+
+
+static int replay_help(const char * program_name) {
+    ff_log(FC_NOTICE, 0, "Usage: %s [OPTION]... TRACE-FILE IMAGE", program_name);
+    ff_log(FC_NOTICE, 0, "Replay an I/O trace written by 'fsremap --trace' or 'fsmove --trace'");
+    ff_log(FC_NOTICE, 0, "against IMAGE, a sparse file or a device whose contents will be OVERWRITTEN.");
+    ff_log(FC_NOTICE, 0, "Report throughput and latency percentiles of reads, writes and flushes.\n");
+
+    return ff_log(FC_NOTICE, 0,
+     "Options:\n"
+     "  --                 end of options. treat subsequent parameters as arguments\n"
+     "                       even if they start with '-'\n"
+     "  --backend=buffered use read() and write() through page cache (default)\n"
+     "  --backend=direct   use O_DIRECT, bypassing page cache\n"
+     "  --backend=dsync    use O_DSYNC, waiting for each write to reach the device\n"
+     "  --timing=fast      replay operations as fast as possible (default)\n"
+     "  --timing=original  reproduce the delays between traced operations\n"
+     "  --help             display this help and exit\n"
+     "  --version          output version information and exit");
+}
+
+static int replay_version() {
+    return ff_log(FC_NOTICE, 0,
+        "fsreplay (fstransform utilities) " FT_VERSION "\n"
+        "Copyright (C) 2011-2026 Massimiliano Ghilardi\n"
+        "\n"
+        "License GPLv2: GNU GPL version 2\n"
+        "<http://www.gnu.org/licenses/old-licenses/gpl-2.0.html>.\n"
+        "This is free software: you are free to change and redistribute it.\n"
+        "There is NO WARRANTY, to the extent permitted by law.");
+}
+
+static int replay_usage(const char * program_name) {
+    ff_log(FC_NOTICE, 0, "Try `%s --help' for more information.", program_name);
+    return 1;
+}
+
+int replay_main(int argc, char ** argv) {
+    const char * program_name = argv[0], * paths[2] = { NULL, NULL };
+    ft_replay_backend backend = FC_REPLAY_BUFFERED;
+    ft_size paths_n = 0;
+    bool allow_opts = true, original_timing = false;
+
+    while (--argc) {
+        char * arg = * ++argv;
+        if (allow_opts && arg[0] == '-') {
+            if (!strcmp(arg, "--"))
+                allow_opts = false;
+            else if (!strcmp(arg, "--help"))
+                return replay_help(program_name);
+            else if (!strcmp(arg, "--version"))
+                return replay_version();
+            else if (!strcmp(arg, "--backend=buffered"))
+                backend = FC_REPLAY_BUFFERED;
+            else if (!strcmp(arg, "--backend=direct"))
+                backend = FC_REPLAY_DIRECT;
+            else if (!strcmp(arg, "--backend=dsync"))
+                backend = FC_REPLAY_DSYNC;
+            else if (!strcmp(arg, "--timing=fast"))
+                original_timing = false;
+            else if (!strcmp(arg, "--timing=original"))
+                original_timing = true;
+            else {
+                ff_log(FC_ERROR, 0, "%s: invalid option '%s'", program_name, arg);
+                return replay_usage(program_name);
+            }
+        } else if (paths_n < 2)
+            paths[paths_n++] = arg;
+        else {
+            ff_log(FC_ERROR, 0, "%s: too many arguments", program_name);
+            return replay_usage(program_name);
+        }
+    }
+    if (paths_n < 2) {
+        ff_log(FC_ERROR, 0, "%s: missing argument%s", program_name, paths_n == 0 ? "s TRACE-FILE IMAGE" : " IMAGE");
+        return replay_usage(program_name);
+    }
+    ft_replay replay(backend, original_timing);
+    return replay.run(paths[0], paths[1]) != 0 ? 1 : 0;
+}
+
+FT_NAMESPACE_END
@@ -0,0 +1,36 @@
+/*
+ * fsreplay - replay fsremap and fsmove I/O traces
+ *
+ * Copyright (C) 2011-2012 Massimiliano Ghilardi
+ *
+ *     This program is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * replay.hh
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: max
+ */
+
+#ifndef FSREPLAY_REPLAY_HH
+#define FSREPLAY_REPLAY_HH
+
+#include "types.hh"
+
+FT_NAMESPACE_BEGIN
+
+int replay_main(int argc, char **argv);
+
+FT_NAMESPACE_END
+
+#endif /* FSREPLAY_REPLAY_HH */
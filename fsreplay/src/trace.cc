@@ -0,0 +1 @@
+../../fsremap/src/trace.cc
\ No newline at end of file
@@ -0,0 +1 @@
+../../fsremap/src/traits.hh
\ No newline at end of file
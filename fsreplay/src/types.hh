@@ -0,0 +1 @@
+../../fsremap/src/types.hh
\ No newline at end of file
@@ -43,4 +43,69 @@ m4_define([FT_CXX_FEATURES],
    AC_DEFINE([HAVE_EXTERN_TEMPLATE], [1],
      [define if C++ compiler supports forcing and inhibiting template instantiation])
  fi
+
+ AC_CACHE_CHECK([whether $CXX supports __atomic builtins],
+   [ac_cv_cxx_have_atomic_builtins],
+   [AC_LINK_IFELSE([AC_LANG_PROGRAM([[
+     unsigned long ft_my_counter;
+   ]], [[
+     unsigned long n = __atomic_load_n(& ft_my_counter, __ATOMIC_ACQUIRE);
+     __atomic_store_n(& ft_my_counter, n + 1, __ATOMIC_RELEASE);
+     return (int) __atomic_fetch_add(& ft_my_counter, 1, __ATOMIC_RELAXED);
+   ]])],
+   [ac_cv_cxx_have_atomic_builtins=yes],
+   [ac_cv_cxx_have_atomic_builtins=no]
+  )
+ ])
+
+ if test "$ac_cv_cxx_have_atomic_builtins" = yes; then
+   AC_DEFINE([HAVE_ATOMIC_BUILTINS], [1],
+     [define if C++ compiler supports __atomic_load_n(), __atomic_store_n() and __atomic_fetch_add()])
+ fi
+
+ AC_CACHE_CHECK([whether $CXX supports AVX2 functions selected at runtime],
+   [ac_cv_cxx_have_avx2_dispatch],
+   [AC_LINK_IFELSE([AC_LANG_PROGRAM([[
+     #include <immintrin.h>
+     __attribute__((target("avx2"))) int ft_my_testz(const char * mem) {
+       __m256i v = _mm256_loadu_si256((const __m256i *) mem);
+       return _mm256_testz_si256(v, v);
+     }
+     char ft_my_buf[32];
+   ]], [[
+     __builtin_cpu_init();
+     return __builtin_cpu_supports("avx2") ? ft_my_testz(ft_my_buf) : 0;
+   ]])],
+   [ac_cv_cxx_have_avx2_dispatch=yes],
+   [ac_cv_cxx_have_avx2_dispatch=no]
+  )
+ ])
+
+ if test "$ac_cv_cxx_have_avx2_dispatch" = yes; then
+   AC_DEFINE([HAVE_AVX2_DISPATCH], [1],
+     [define if C++ compiler supports __attribute__((target("avx2"))), <immintrin.h> and __builtin_cpu_supports()])
+ fi
+
+ AC_CACHE_CHECK([whether <linux/io_uring.h> supports openat, read, write and close],
+   [ac_cv_cxx_have_io_uring],
+   [AC_COMPILE_IFELSE([AC_LANG_PROGRAM([[
+     #include <linux/io_uring.h>
+     #include <sys/syscall.h>
+     struct io_uring_params ft_my_params;
+     struct io_uring_sqe ft_my_sqe;
+   ]], [[
+     long n = __NR_io_uring_setup + __NR_io_uring_enter + __NR_io_uring_register;
+     ft_my_sqe.opcode = IORING_OP_OPENAT + IORING_OP_READ + IORING_OP_WRITE + IORING_OP_CLOSE;
+     ft_my_sqe.open_flags = IORING_REGISTER_PROBE + IO_URING_OP_SUPPORTED;
+     return (int) n + (int) (ft_my_params.features & IORING_FEAT_SINGLE_MMAP) + (int) IORING_OFF_SQES;
+   ]])],
+   [ac_cv_cxx_have_io_uring=yes],
+   [ac_cv_cxx_have_io_uring=no]
+  )
+ ])
+
+ if test "$ac_cv_cxx_have_io_uring" = yes; then
+   AC_DEFINE([HAVE_IO_URING], [1],
+     [define if <linux/io_uring.h> and <sys/syscall.h> support io_uring with openat, read, write and close])
+ fi
 ])